@@ -466,6 +466,114 @@ OGGZ * oggz_open (const char * filename, int flags);
  */
 OGGZ * oggz_open_stdio (FILE * file, int flags);
 
+/**
+ * The parsed headers of an Ogg file, shared between OGGZ handles.
+ *
+ * Opening a file for reading from an OggzFileInfo creates a cursor: an
+ * OGGZ handle with its own read and seek state, whose streams already
+ * know their content type, granulerate, granuleshift, number of headers,
+ * preroll, comments and Skeleton keypoints, and which starts reading at
+ * the data start. An OggzFileInfo is not modified after it is created,
+ * so cursors on different threads may be opened from and use the same
+ * OggzFileInfo concurrently; each cursor must itself only be used by one
+ * thread at a time.
+ */
+typedef void OggzFileInfo;
+
+/**
+ * Create an OggzFileInfo from the streams of an OGGZ opened for reading.
+ * This is typically done once all header packets have been read, after
+ * marking the data start with oggz_set_data_start(). The OGGZ may then
+ * be closed; the returned OggzFileInfo does not refer to it.
+ * Metrics set by the application with oggz_set_metric() are not kept, and
+ * must be set on each cursor.
+ * \param oggz An OGGZ handle previously opened for reading
+ * \returns A new OggzFileInfo, with a reference count of 1
+ * \retval NULL \a oggz is NULL or was opened for writing, or out of memory
+ */
+OggzFileInfo * oggz_file_info_new (OGGZ * oggz);
+
+/**
+ * Take a reference to an OggzFileInfo
+ * \param info An OggzFileInfo
+ * \returns \a info
+ */
+OggzFileInfo * oggz_file_info_ref (OggzFileInfo * info);
+
+/**
+ * Release a reference to an OggzFileInfo, freeing it when none remain.
+ * Each cursor opened from \a info holds a reference until it is closed.
+ * \param info An OggzFileInfo
+ * \retval 0 Success
+ * \retval OGGZ_ERR_BAD_OGGZ \a info is NULL
+ */
+int oggz_file_info_unref (OggzFileInfo * info);
+
+/**
+ * Open a cursor on an Ogg file whose headers have been parsed into an
+ * OggzFileInfo. The cursor takes a reference to \a info, which it
+ * releases when it is closed.
+ * \param info The OggzFileInfo of the file
+ * \param filename The file to open
+ * \param flags OGGZ_READ, optionally with other read flags
+ * \return A new OGGZ handle, positioned at the data start
+ * \retval NULL \a info is NULL, \a flags includes OGGZ_WRITE, or system
+ * error; check errno for details
+ */
+OGGZ * oggz_open_file_info (OggzFileInfo * info, const char * filename,
+                            int flags);
+
+/**
+ * Create a cursor associated with a stdio stream, on an Ogg file whose
+ * headers have been parsed into an OggzFileInfo. The cursor takes a
+ * reference to \a info, which it releases when it is closed.
+ * \param info The OggzFileInfo of the file
+ * \param file An open FILE handle
+ * \param flags OGGZ_READ, optionally with other read flags
+ * \return A new OGGZ handle, positioned at the data start
+ * \retval NULL \a info is NULL, \a flags includes OGGZ_WRITE, or system
+ * error; check errno for details
+ */
+OGGZ * oggz_open_stdio_file_info (OggzFileInfo * info, FILE * file,
+                                  int flags);
+
+/**
+ * Set the number of files whose parsed headers are kept in the
+ * process-wide probe cache used by oggz_open_cached(). When the cache is
+ * full, the least recently opened file is dropped from it. The cache is
+ * disabled, with a size of 0, by default; setting the size to 0 empties it.
+ * \param max_entries The number of files to keep
+ * \retval 0 Success
+ * \retval OGGZ_ERR_INVALID \a max_entries is negative
+ */
+int oggz_file_info_cache_set_size (int max_entries);
+
+/**
+ * Open an Ogg file for reading, positioned at the data start with its
+ * headers already parsed. The first time a file is opened, its headers
+ * are read with oggz_read_headers() and the end of the file is found; the
+ * streams, comments, data start and end are then kept in the probe cache
+ * as an OggzFileInfo. Later opens of the same file go straight to the data
+ * start without reading its headers, as oggz_open_file_info().
+ *
+ * Files are told apart by \a key if given, or else by their device,
+ * inode, size and modification time; a modified file is therefore read
+ * again, but a file rewritten to the same size within the same second is
+ * not noticed. Files
+ * without an inode number are only cached by \a key.
+ *
+ * As the headers are read before any read callbacks can be set, header
+ * packets are not delivered to callbacks; use eg. oggz_comment_first()
+ * and oggz_stream_get_content() to inspect them.
+ * \param filename The file to open
+ * \param key A key identifying the contents of the file, or NULL
+ * \param flags OGGZ_READ, optionally with other read flags
+ * \return A new OGGZ handle, positioned at the data start
+ * \retval NULL \a flags includes OGGZ_WRITE, or system error; check errno
+ * for details
+ */
+OGGZ * oggz_open_cached (const char * filename, const char * key, int flags);
+
 /**
  * Ensure any associated io streams are flushed.
  * \param oggz An OGGZ handle
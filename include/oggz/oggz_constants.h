@@ -40,7 +40,7 @@
 /**
  * Flags to oggz_new(), oggz_open(), and oggz_openfd().
  * Can be or'ed together in the following combinations:
- * - OGGZ_READ | OGGZ_AUTO
+ * - OGGZ_READ | OGGZ_AUTO | OGGZ_INDEX | OGGZ_MMAP
  * - OGGZ_WRITE | OGGZ_NONSTRICT | OGGZ_PREFIX | OGGZ_SUFFIX
  */
 enum OggzFlags {
@@ -74,7 +74,32 @@ enum OggzFlags {
    * Ogg stream, ie. disable checking for conformance with
    * beginning-of-stream constraints.
    */
-  OGGZ_SUFFIX       = 0x80
+  OGGZ_SUFFIX       = 0x80,
+
+  /**
+   * Keep an in-memory index of the pages passed over while reading.
+   * oggz_seek_units() can then seek within regions of the file which
+   * have already been read without bisecting over them again.
+   */
+  OGGZ_INDEX        = 0x100,
+
+  /**
+   * Map the file into memory and parse pages in place, rather than
+   * copying it through read buffers. Only applies to files opened for
+   * reading with oggz_open() or oggz_open_stdio(); if the file cannot be
+   * mapped, eg. because it is a pipe, ordinary reads are used instead.
+   * The file must not be modified while it is open.
+   */
+  OGGZ_MMAP         = 0x200,
+
+  /**
+   * Read the file ahead of the parser in a background thread, so that
+   * parsing overlaps with I/O. Seeking cancels outstanding reads. Only
+   * applies to regular files opened for reading with oggz_open() or
+   * oggz_open_stdio(), and is ignored if OGGZ_MMAP is in effect; if
+   * threads are not available, ordinary reads are used instead.
+   */
+  OGGZ_READAHEAD    = 0x400
 
 };
 
@@ -100,6 +125,20 @@ enum OggzFlushOpts {
   OGGZ_FLUSH_AFTER  = 0x02
 };
 
+/**
+ * Page header fields to replace in oggz_write_page(); can be or'ed together
+ */
+enum OggzPagePatchFields {
+  /** Replace the serialno */
+  OGGZ_PATCH_SERIALNO   = 0x01,
+
+  /** Replace the granulepos */
+  OGGZ_PATCH_GRANULEPOS = 0x02,
+
+  /** Replace the page sequence number */
+  OGGZ_PATCH_PAGENO     = 0x04
+};
+
 /**
  * Definition of stream content types
  */
@@ -178,6 +217,9 @@ enum OggzError {
   /** Out of memory */
   OGGZ_ERR_OUT_OF_MEMORY                = -18,
 
+  /** Seek index is corrupt, or does not match the file being read */
+  OGGZ_ERR_BAD_INDEX                    = -19,
+
   /** The requested serialno does not exist in this OGGZ */
   OGGZ_ERR_BAD_SERIALNO                 = -20,
 
@@ -108,6 +108,57 @@ typedef int (*OggzReadPacket) (OGGZ * oggz, oggz_packet * packet, long serialno,
 int oggz_set_read_callback (OGGZ * oggz, long serialno,
 			    OggzReadPacket read_packet, void * user_data);
 
+/**
+ * This is the signature of a callback which you may provide for Oggz
+ * to call with several packets at once, instead of calling an
+ * OggzReadPacket for each one.
+ *
+ * \param oggz The OGGZ handle
+ * \param packets An array of \a nr_packets consecutive packets, including
+ *                their positions in the stream
+ * \param nr_packets The number of packets in \a packets
+ * \param serialno Identify the logical bistream in \a oggz that contains
+ *                 all of \a packets
+ * \param user_data A generic pointer you have provided earlier
+ * \returns 0 to continue, non-zero to instruct Oggz to stop.
+ *
+ * \note The packet data is only valid until the callback returns.
+ * \note Within this callback, oggz_tell() and related functions refer
+ * to the position after the last packet in \a packets.
+ */
+typedef int (*OggzReadPackets) (OGGZ * oggz, oggz_packet * packets,
+                                int nr_packets, long serialno,
+                                void * user_data);
+
+/**
+ * Set a callback for Oggz to call with batches of Ogg packets found in
+ * the stream. A batch holds consecutive packets of one logical bitstream
+ * which were completed by the same page, so packets are delivered at most
+ * one page late.
+ *
+ * \param oggz An OGGZ handle previously opened for reading
+ * \param serialno Identify the logical bitstream in \a oggz to attach
+ * this callback to, or -1 to attach this callback to all unattached
+ * logical bitstreams in \a oggz.
+ * \param read_packets Your callback function, or NULL to remove it
+ * \param max_packets The maximum number of packets to deliver per call,
+ * or 0 to deliver all the packets completed by each page together
+ * \param user_data Arbitrary data you wish to pass to your callback
+ * \retval 0 Success
+ * \retval OGGZ_ERR_BAD_OGGZ \a oggz does not refer to an existing OGGZ
+ * \retval OGGZ_ERR_INVALID Operation not suitable for this OGGZ, or
+ * \a max_packets is negative
+ * \retval OGGZ_ERR_OUT_OF_MEMORY Out of memory
+ *
+ * \note A batch callback takes precedence over an OggzReadPacket callback
+ * set with oggz_set_read_callback() for the same \a serialno, and a
+ * callback attached to a specific \a serialno takes precedence over one
+ * attached to all logical bitstreams.
+ */
+int oggz_set_read_packets_batch (OGGZ * oggz, long serialno,
+                                 OggzReadPackets read_packets,
+                                 int max_packets, void * user_data);
+
 /**
  * This is the signature of a callback which you must provide for Oggz
  * to call whenever it finds a new page in the Ogg stream associated
@@ -182,6 +233,38 @@ long oggz_read (OGGZ * oggz, long n);
  */
 long oggz_read_input (OGGZ * oggz, unsigned char * buf, long n);
 
+/**
+ * Read only the headers of \a oggz, calling any read callbacks on the fly.
+ * This reads the bos pages of all streams, and then the header packets of
+ * each stream, until the number of headers given by
+ * oggz_stream_get_numheaders() have been read for every stream. It then
+ * returns before the first content page, having read the input one page
+ * at a time rather than in large blocks, so that no more than the header
+ * pages and the first content page header are read in.
+ *
+ * The number of headers is only known for the codecs recognised by liboggz
+ * if \a oggz was opened with OGGZ_AUTO; otherwise every stream is assumed
+ * to have 3 headers. A Skeleton track's headers end with its eos page.
+ *
+ * Reading may be continued with oggz_read() afterwards, starting with the
+ * first content page.
+ *
+ * \param oggz An OGGZ handle previously opened for reading with
+ * oggz_open() or oggz_openfd(), or with an IO read callback
+ * \retval 0 The headers have been read, or the end of the file was reached
+ * first
+ * \retval OGGZ_ERR_BAD_OGGZ \a oggz does not refer to an existing OGGZ
+ * \retval OGGZ_ERR_INVALID Operation not suitable for this OGGZ
+ * \retval OGGZ_ERR_SYSTEM System error; check errno for details
+ * \retval OGGZ_ERR_STOP_OK Reading was stopped by a user callback
+ * returning OGGZ_STOP_OK
+ * \retval OGGZ_ERR_STOP_ERR Reading was stopped by a user callback
+ * returning OGGZ_STOP_ERR
+ * \retval OGGZ_ERR_HOLE_IN_DATA Hole (sequence number gap) detected in input data
+ * \retval OGGZ_ERR_OUT_OF_MEMORY Out of memory
+ */
+int oggz_read_headers (OGGZ * oggz);
+
 /** \}
  */
 
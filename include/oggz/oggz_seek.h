@@ -76,6 +76,27 @@
  * see the section on \link metric Using OggzMetrics \endlink for details
  * of setting up and seeking with metrics.
  *
+ * \section seek_index Seeking with a page index
+ *
+ * If the OGGZ handle is opened with the OGGZ_INDEX flag, Oggz remembers
+ * the position and granulepos of each page it reads. oggz_seek_units()
+ * can then seek to any point within the data already read without
+ * bisecting the file again, and only bisects over regions not yet seen.
+ * The index can be saved alongside the file with oggz_index_save(), and
+ * loaded with oggz_index_load() when the file is next opened.
+ *
+ * \section seek_skeleton Seeking with a Skeleton index
+ *
+ * If the OGGZ handle is opened with the OGGZ_AUTO flag and the file
+ * carries an Ogg Skeleton 4.0 keyframe index for every stream,
+ * oggz_seek_units() jumps directly to the latest keypoint at or before
+ * the target once the Skeleton headers have been read, and returns the
+ * time of that keypoint. Targets before the first keypoint of any stream
+ * are found by bisection as usual. The index is ignored if the segment
+ * length in the Skeleton header does not match the file, as happens when
+ * the headers have been rewritten, or if the page at a keypoint is not
+ * the one indexed.
+ *
  * \section seek_bytes Byte seeking
  *
  * oggz_seek() provides low-level seeking to byte positions.
@@ -108,6 +129,18 @@ ogg_int64_t oggz_tell_units (OGGZ * oggz);
  */
 ogg_int64_t oggz_seek_units (OGGZ * oggz, ogg_int64_t units, int whence);
 
+/**
+ * Query the number of pages probed by the most recent call to
+ * oggz_seek_units(), when searching the file for the target.
+ * Seeks served from a page index or cached file bounds probe fewer
+ * pages, or none at all.
+ * \param oggz An OGGZ handle
+ * \returns the number of pages probed
+ * \retval OGGZ_ERR_BAD_OGGZ \a oggz does not refer to an existing OGGZ
+ * \retval OGGZ_ERR_INVALID Operation not suitable for this OGGZ
+ */
+int oggz_seek_get_probes (OGGZ * oggz);
+
 /**
  * Provide the exact stored granulepos (from the page header) if relevant to
  * the current packet, or a constructed granulepos if the stored granulepos
@@ -142,6 +175,39 @@ oggz_off_t oggz_tell (OGGZ * oggz);
  */
 oggz_off_t oggz_seek (OGGZ * oggz, oggz_off_t offset, int whence);
 
+/**
+ * Save the page index of an OGGZ handle opened with OGGZ_INDEX, so that
+ * it can be reloaded with oggz_index_load() next time the same file is
+ * opened. The size and modification time of the file being read are
+ * recorded in the index file.
+ * \param oggz An OGGZ handle
+ * \param filename The name of the index file to write
+ * \retval 0 Success
+ * \retval OGGZ_ERR_BAD_OGGZ \a oggz does not refer to an existing OGGZ
+ * \retval OGGZ_ERR_INVALID \a oggz is not open for reading with OGGZ_INDEX
+ * \retval OGGZ_ERR_NOSEEK The size of the file being read is not known
+ * \retval OGGZ_ERR_OUT_OF_MEMORY Out of memory
+ * \retval OGGZ_ERR_SYSTEM System error; check errno for details
+ */
+int oggz_index_save (OGGZ * oggz, const char * filename);
+
+/**
+ * Load a page index saved by oggz_index_save(), merging it with any pages
+ * already indexed. Indexing is enabled if \a oggz was not opened with
+ * OGGZ_INDEX.
+ * \param oggz An OGGZ handle
+ * \param filename The name of the index file to read
+ * \retval 0 Success
+ * \retval OGGZ_ERR_BAD_OGGZ \a oggz does not refer to an existing OGGZ
+ * \retval OGGZ_ERR_INVALID \a oggz is not open for reading
+ * \retval OGGZ_ERR_NOSEEK The size of the file being read is not known
+ * \retval OGGZ_ERR_BAD_INDEX The index file is corrupt, or its recorded
+ * size and modification time do not match the file being read
+ * \retval OGGZ_ERR_OUT_OF_MEMORY Out of memory
+ * \retval OGGZ_ERR_SYSTEM System error; check errno for details
+ */
+int oggz_index_load (OGGZ * oggz, const char * filename);
+
 #ifdef _UNIMPLEMENTED
 long oggz_seek_packets (OGGZ * oggz, long serialno, long packets, int whence);
 #endif
@@ -206,6 +206,61 @@ int oggz_write_feed (OGGZ * oggz, ogg_packet * op, long serialno, int flush,
  */
 long oggz_write_output (OGGZ * oggz, unsigned char * buf, long n);
 
+/**
+ * A read-only region of output data, as returned by
+ * oggz_write_output_iov(). This can be copied into a struct iovec for
+ * writev() or sendmsg().
+ */
+typedef struct {
+  /** The start of the region */
+  const unsigned char * base;
+  /** The length of the region, in bytes */
+  long length;
+} oggz_iovec;
+
+/**
+ * Retrieve the data of the page waiting to be output, without copying it.
+ * The regions returned point into Oggz's own buffers and cover the part
+ * of the current page not yet consumed: at most two regions, its header
+ * and its body. Call oggz_write_output_consume() once some or all of it
+ * has been sent, and call this again for the rest or for the next page.
+ *
+ * The regions remain valid until the next call to oggz_write_output_iov(),
+ * oggz_write_output(), oggz_write(), oggz_write_feed() or oggz_close().
+ * This may be mixed with calls to oggz_write_output().
+ *
+ * \param oggz An OGGZ handle previously opened for writing
+ * \param iov An array of regions to fill in
+ * \param iovcnt The number of entries in \a iov; 2 suffices to return a
+ * whole page
+ * \retval "> 0" The number of regions filled in
+ * \retval 0 End of stream
+ * \retval OGGZ_ERR_RECURSIVE_WRITE Attempt to initiate writing from
+ * within an OggzHungry callback
+ * \retval OGGZ_ERR_BAD_OGGZ \a oggz does not refer to an existing OGGZ
+ * \retval OGGZ_ERR_INVALID Operation not suitable for this OGGZ
+ * \retval OGGZ_ERR_STOP_OK Writing was stopped by an OggzHungry callback
+ * returning OGGZ_STOP_OK
+ * \retval OGGZ_ERR_STOP_ERR Reading was stopped by an OggzHungry callback
+ * returning OGGZ_STOP_ERR
+ */
+int oggz_write_output_iov (OGGZ * oggz, oggz_iovec * iov, int iovcnt);
+
+/**
+ * Mark bytes returned by oggz_write_output_iov() as output.
+ *
+ * \param oggz An OGGZ handle previously opened for writing
+ * \param n A count of bytes output, from the start of the first region
+ * \retval ">= 0" The number of bytes consumed; this is less than \a n
+ * if \a n exceeds the rest of the current page
+ * \retval OGGZ_ERR_RECURSIVE_WRITE Attempt to consume from within an
+ * OggzHungry callback
+ * \retval OGGZ_ERR_BAD_OGGZ \a oggz does not refer to an existing OGGZ
+ * \retval OGGZ_ERR_INVALID Operation not suitable for this OGGZ, or
+ * \a n is negative
+ */
+long oggz_write_output_consume (OGGZ * oggz, long n);
+
 /**
  * Write n bytes from an OGGZ handle. Oggz will call your write callback
  * as needed.
@@ -235,6 +290,117 @@ long oggz_write (OGGZ * oggz, long n);
  */
 long oggz_write_get_next_page_size (OGGZ * oggz);
 
+/**
+ * Memory usage of the queue of packets waiting to be written.
+ * Queue entries are allocated from slabs, and copies of packet data
+ * from a ring of bytes which is reused as packets are written out.
+ */
+typedef struct {
+  /** Queue entries and packet data copies handed out */
+  long allocations;
+  /** Calls to the system allocator, to grow the slabs or ring, or for
+   * packet data which did not fit in the ring */
+  long system_allocations;
+  /** Bytes of packet data currently copied into the queue */
+  long bytes_queued;
+  /** The largest value of \a bytes_queued so far */
+  long bytes_queued_peak;
+  /** Bytes currently held from the system allocator */
+  long pool_bytes;
+  /** The largest value of \a pool_bytes so far */
+  long pool_bytes_peak;
+} oggz_write_pool_stats;
+
+/**
+ * Retrieve memory usage counters for the packet queue.
+ *
+ * \param oggz An OGGZ handle previously opened for writing
+ * \param stats Counters to fill in
+ * \retval 0 Success
+ * \retval OGGZ_ERR_BAD_OGGZ \a oggz does not refer to an existing OGGZ
+ * \retval OGGZ_ERR_INVALID Operation not suitable for this OGGZ
+ */
+int oggz_write_get_pool_stats (OGGZ * oggz, oggz_write_pool_stats * stats);
+
+/**
+ * Gather completed pages and write them out together, rather than
+ * writing each page's header and body separately. oggz_write() then calls
+ * your write callback, or writes to the file, once per batch.
+ *
+ * A batch is written out when it holds \a max_bytes, or before a page
+ * would make it span more than \a max_units of time according to the
+ * streams' metrics, whichever comes first. Batches are always written out before oggz_write()
+ * returns, so batching never delays data beyond the call that produced
+ * it; the time budget bounds the delay within a call, eg. while an
+ * OggzWriteHungry callback waits for a live source.
+ *
+ * Batching does not apply to oggz_write_output(), which already copies
+ * pages into the caller's buffer. Any pages still batched by
+ * oggz_write_page() are written out before the batch size changes.
+ *
+ * \param oggz An OGGZ handle previously opened for writing
+ * \param max_bytes The size of a batch, in bytes, or 0 to disable
+ * batching (the default)
+ * \param max_units The longest time a batch may span, in units, or 0 for
+ * no limit
+ * \retval 0 Success
+ * \retval OGGZ_ERR_BAD_OGGZ \a oggz does not refer to an existing OGGZ
+ * \retval OGGZ_ERR_INVALID Operation not suitable for this OGGZ, or
+ * \a max_bytes is negative
+ * \retval OGGZ_ERR_RECURSIVE_WRITE Called from within an OggzWriteHungry
+ * callback
+ * \retval OGGZ_ERR_OUT_OF_MEMORY Unable to allocate the batch
+ * \retval OGGZ_ERR_SYSTEM Writing out the batched pages failed
+ */
+int oggz_write_set_batch (OGGZ * oggz, long max_bytes,
+                          ogg_int64_t max_units);
+
+/**
+ * Replacement page header fields for oggz_write_page().
+ */
+typedef struct {
+  /** The fields to replace, a combination of OggzPagePatchFields */
+  int fields;
+  /** The new serialno, for OGGZ_PATCH_SERIALNO */
+  long serialno;
+  /** The new granulepos, for OGGZ_PATCH_GRANULEPOS */
+  ogg_int64_t granulepos;
+  /** The new page sequence number, for OGGZ_PATCH_PAGENO */
+  long pageno;
+} oggz_page_patch;
+
+/**
+ * Write out a page as it is, eg. one passed to an OggzReadPage callback,
+ * without going through the packet queue. Its packets are neither
+ * reassembled nor paged again. Some page header fields can be replaced on
+ * the way out; the page checksum is then updated from the changed bytes
+ * only, rather than over the whole page. The page passed in is not
+ * modified.
+ *
+ * If batching is set with oggz_write_set_batch(), the page is added to the
+ * batch. A batch of pages written this way is written out when it is
+ * full, and by oggz_write(), oggz_flush() and oggz_close().
+ *
+ * Pages written this way are output immediately, ahead of any packets
+ * still queued with oggz_write_feed(). Use either this or
+ * oggz_write_feed() for a given logical bitstream.
+ *
+ * \param oggz An OGGZ handle previously opened for writing
+ * \param og The page to write. It must have a valid checksum if any
+ * field is to be replaced.
+ * \param patch The header fields to replace, or NULL to write the page
+ * unchanged
+ * \retval 0 Success
+ * \retval OGGZ_ERR_BAD_OGGZ \a oggz does not refer to an existing OGGZ
+ * \retval OGGZ_ERR_INVALID Operation not suitable for this OGGZ, \a og is
+ * not a valid page, or oggz_write() is part way through writing a page
+ * \retval OGGZ_ERR_RECURSIVE_WRITE Called from within an OggzWriteHungry
+ * callback
+ * \retval OGGZ_ERR_SYSTEM The page could not be written out
+ */
+int oggz_write_page (OGGZ * oggz, const ogg_page * og,
+                     const oggz_page_patch * patch);
+
 /** \}
  */
 
@@ -87,6 +87,8 @@ oggz_new (int flags)
   oggz->flags = flags;
   oggz->file = NULL;
   oggz->io = NULL;
+  oggz->map = NULL;
+  oggz->readahead = NULL;
 
   oggz->offset = 0;
   oggz->offset_data_begin = 0;
@@ -94,10 +96,17 @@ oggz_new (int flags)
   oggz->run_blocksize = 1024;
   oggz->cb_next = 0;
 
+  oggz->file_info = NULL;
+
   oggz->streams = oggz_vector_new ();
   if (oggz->streams == NULL) {
     goto err_oggz_new;
   }
+
+  oggz->stream_table = oggz_table_new ();
+  if (oggz->stream_table == NULL) {
+    goto err_streams_new;
+  }
   
   oggz->all_at_eos = 0;
 
@@ -110,20 +119,25 @@ oggz_new (int flags)
 
   oggz->packet_buffer = oggz_dlist_new ();
   if (oggz->packet_buffer == NULL) {
-    goto err_streams_new;
+    goto err_stream_table_new;
   }
 
   if (OGGZ_CONFIG_WRITE && (oggz->flags & OGGZ_WRITE)) {
     if (oggz_write_init (oggz) == NULL)
       goto err_packet_buffer_new;
   } else if (OGGZ_CONFIG_READ) {
-    oggz_read_init (oggz);
+    if (oggz_read_init (oggz) == NULL)
+      goto err_read_init;
   }
 
   return oggz;
 
+err_read_init:
+  oggz_read_close (oggz);
 err_packet_buffer_new:
   oggz_free (oggz->packet_buffer);
+err_stream_table_new:
+  oggz_table_delete (oggz->stream_table);
 err_streams_new:
   oggz_free (oggz->streams);
 err_oggz_new:
@@ -153,6 +167,16 @@ oggz_open (char * filename, int flags)
 
   oggz->file = file;
 
+  if ((flags & OGGZ_MMAP) && !(flags & OGGZ_WRITE)) {
+    /* Fall back to ordinary reads if the file cannot be mapped */
+    oggz->map = oggz_mmap_new (file);
+  }
+
+  if ((flags & OGGZ_READAHEAD) && !(flags & OGGZ_WRITE) && oggz->map == NULL) {
+    /* Fall back to ordinary reads if no worker thread can be started */
+    oggz->readahead = oggz_readahead_new (file);
+  }
+
   return oggz;
 }
 
@@ -168,6 +192,16 @@ oggz_open_stdio (FILE * file, int flags)
 
   oggz->file = file;
 
+  if ((flags & OGGZ_MMAP) && !(flags & OGGZ_WRITE)) {
+    /* Fall back to ordinary reads if the file cannot be mapped */
+    oggz->map = oggz_mmap_new (file);
+  }
+
+  if ((flags & OGGZ_READAHEAD) && !(flags & OGGZ_WRITE) && oggz->map == NULL) {
+    /* Fall back to ordinary reads if no worker thread can be started */
+    oggz->readahead = oggz_readahead_new (file);
+  }
+
   return oggz;
 }
 
@@ -178,6 +212,7 @@ oggz_flush (OGGZ * oggz)
 
   if (OGGZ_CONFIG_WRITE && (oggz->flags & OGGZ_WRITE)) {
     oggz_write_flush (oggz);
+    if (oggz_write_batch_flush (oggz) != 0) return OGGZ_ERR_SYSTEM;
   }
 
   return oggz_io_flush (oggz);
@@ -198,6 +233,9 @@ oggz_stream_clear (void * data)
 
   if (stream->calculate_data != NULL)
     oggz_free (stream->calculate_data);
+
+  if (stream->keypoints != NULL && !stream->shared)
+    oggz_free (stream->keypoints);
   
   oggz_free (stream);
 
@@ -217,6 +255,10 @@ oggz_close (OGGZ * oggz)
 
   oggz_vector_foreach (oggz->streams, oggz_stream_clear);
   oggz_vector_delete (oggz->streams);
+  oggz_table_delete (oggz->stream_table);
+
+  /* Release the file info that the streams borrowed from */
+  oggz_file_info_close (oggz);
 
   oggz_dlist_deliter(oggz->packet_buffer, oggz_read_free_pbuffers);
   oggz_dlist_delete(oggz->packet_buffer);
@@ -224,6 +266,9 @@ oggz_close (OGGZ * oggz)
   if (oggz->metric_internal)
     oggz_free (oggz->metric_user_data);
 
+  oggz_mmap_delete (oggz->map);
+  oggz_readahead_delete (oggz->readahead);
+
   if (oggz->file != NULL) {
     if (fclose (oggz->file) == EOF) {
       return OGGZ_ERR_SYSTEM;
@@ -314,20 +359,12 @@ oggz_run_set_blocksize (OGGZ * oggz, long blocksize)
 
 /******** oggz_stream management ********/
 
-static int
-oggz_find_stream (void * data, long serialno)
-{
-  oggz_stream_t * stream = (oggz_stream_t *) data;
-
-  return (stream->ogg_stream.serialno == serialno);
-}
-
 oggz_stream_t *
 oggz_get_stream (OGGZ * oggz, long serialno)
 {
   if (serialno == -1) return NULL;
 
-  return oggz_vector_find_with (oggz->streams, oggz_find_stream, serialno);
+  return oggz_table_lookup (oggz->stream_table, serialno);
 }
 
 oggz_stream_t *
@@ -354,6 +391,12 @@ oggz_add_stream (OGGZ * oggz, long serialno)
   stream->basegranule = 0;
   stream->granuleshift = 0;
 
+  stream->keypoints = NULL;
+  stream->nr_keypoints = 0;
+  stream->keypoints_end = -1;
+  stream->segment_length = -1;
+  stream->shared = 0;
+
   stream->delivered_non_b_o_s = 0;
   stream->b_o_s = 1;
   stream->e_o_s = 0;
@@ -367,10 +410,24 @@ oggz_add_stream (OGGZ * oggz, long serialno)
   stream->order_user_data = NULL;
   stream->read_packet = NULL;
   stream->read_user_data = NULL;
+  stream->read_packets = NULL;
+  stream->read_packets_user_data = NULL;
+  stream->read_packets_max = 0;
   stream->read_page = NULL;
   stream->read_page_user_data = NULL;
 
   stream->calculate_data = NULL;
+  stream->calculate_size = 0;
+
+  /* oggz_get_stream() never looks up -1, so it need not be indexed */
+  if (stream->ogg_stream.serialno != -1 &&
+      oggz_table_insert (oggz->stream_table, stream->ogg_stream.serialno,
+                         stream) == NULL) {
+    oggz_comments_free (stream);
+    ogg_stream_clear (&stream->ogg_stream);
+    oggz_free (stream);
+    return NULL;
+  }
   
   oggz_vector_insert_p (oggz->streams, stream);
 
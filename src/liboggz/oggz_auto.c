@@ -494,11 +494,121 @@ auto_fisbone (OGGZ * oggz, long serialno, unsigned char * data, long length, voi
   return 1;
 }
 
+/*
+ * Read a Skeleton 4.0 variable length integer: 7 bits per byte, least
+ * significant first, with the high bit set on the final byte.
+ */
+static unsigned char *
+skeleton_varint_at (unsigned char * p, unsigned char * end, ogg_int64_t * n)
+{
+  int shift;
+
+  *n = 0;
+
+  for (shift = 0; p < end && shift < 63; shift += 7) {
+    *n |= (ogg_int64_t)(*p & 0x7f) << shift;
+    if (*p++ & 0x80) return p;
+  }
+
+  return NULL;
+}
+
+static int
+auto_skeleton_index (OGGZ * oggz, long serialno, unsigned char * data, long length, void * user_data)
+{
+  unsigned char * header = data, * p, * end = data + length;
+  oggz_stream_t * stream;
+  oggz_keypoint_t * keypoints;
+  long index_serialno; /* The serialno referred to in this index */
+  ogg_int64_t nr_keypoints, denominator, end_time, i;
+  ogg_int64_t offset = 0, time = 0, offset_delta, time_delta;
+  int numheaders;
+
+  if (length < 42) return 0;
+
+  index_serialno = (long) int32_le_at(&header[6]);
+  nr_keypoints = int64_le_at(&header[10]);
+  denominator = int64_le_at(&header[18]);
+  end_time = int64_le_at(&header[34]);
+
+  /* Each keypoint takes at least two bytes */
+  if (nr_keypoints < 0 || nr_keypoints > (length - 42) / 2) return 0;
+  if (denominator <= 0) return 0;
+
+  stream = oggz_get_stream (oggz, index_serialno);
+  if (stream == NULL) return 0;
+
+  keypoints = oggz_malloc ((size_t)(nr_keypoints + 1) * sizeof (oggz_keypoint_t));
+  if (keypoints == NULL) return 0;
+
+  p = &header[42];
+  for (i = 0; i < nr_keypoints; i++) {
+    if ((p = skeleton_varint_at (p, end, &offset_delta)) == NULL ||
+        (p = skeleton_varint_at (p, end, &time_delta)) == NULL) {
+      oggz_free (keypoints);
+      return 0;
+    }
+
+    offset += offset_delta;
+    time += time_delta;
+    if (offset < 0 || time < 0) {
+      oggz_free (keypoints);
+      return 0;
+    }
+
+    keypoints[i].offset = (oggz_off_t)offset;
+    keypoints[i].unit = (time / denominator) * OGGZ_AUTO_MULT +
+      (time % denominator) * OGGZ_AUTO_MULT / denominator;
+  }
+
+#ifdef DEBUG
+  printf ("Got index of %lld keypoints for serialno %010lu\n",
+          nr_keypoints, index_serialno);
+#endif
+
+  if (stream->keypoints != NULL)
+    oggz_free (stream->keypoints);
+  stream->keypoints = keypoints;
+  stream->nr_keypoints = (long)nr_keypoints;
+
+  /* The end time of the last sample bounds seeks past the last keypoint */
+  if (end_time > 0) {
+    stream->keypoints_end = (end_time / denominator) * OGGZ_AUTO_MULT +
+      (end_time % denominator) * OGGZ_AUTO_MULT / denominator;
+  } else {
+    stream->keypoints_end = -1;
+  }
+
+  /* Increment the number of headers for this stream */
+  numheaders = oggz_stream_get_numheaders (oggz, serialno);
+  oggz_stream_set_numheaders (oggz, serialno, numheaders+1);
+
+  return 1;
+}
+
+static int
+auto_skeleton_secondary (OGGZ * oggz, long serialno, unsigned char * data, long length, void * user_data)
+{
+  if (length >= 6 && memcmp (data, "index\0", 6) == 0)
+    return auto_skeleton_index (oggz, serialno, data, length, user_data);
+
+  return auto_fisbone (oggz, serialno, data, length, user_data);
+}
+
 static int
 auto_fishead (OGGZ * oggz, long serialno, unsigned char * data, long length, void * user_data)
 {
+  oggz_stream_t * stream;
+
   oggz_set_granulerate (oggz, serialno, 0, 1);
 
+  /* Skeleton 4.0 gives the length of the segment, which is checked before
+   * trusting the byte offsets in its index */
+  if (length >= 72 && int16_le_at(&data[8]) >= 4 &&
+      (stream = oggz_get_stream (oggz, serialno)) != NULL) {
+    stream->segment_length = int64_le_at(&data[64]);
+  }
+
   /* For skeleton, numheaders will get incremented as each header is seen */
   oggz_stream_set_numheaders (oggz, serialno, 1);
 
@@ -528,6 +638,7 @@ auto_calc_speex(ogg_int64_t now, oggz_stream_t *stream, ogg_packet *op) {
 
   if (stream->calculate_data == NULL) {
     stream->calculate_data = oggz_malloc(sizeof(auto_calc_speex_info_t));
+    stream->calculate_size = sizeof(auto_calc_speex_info_t);
     if (stream->calculate_data == NULL) return -1;
     info = stream->calculate_data;
     info->encountered_first_data_packet = 0;
@@ -582,6 +693,7 @@ auto_calc_celt (ogg_int64_t now, oggz_stream_t *stream, ogg_packet *op) {
 
   if (stream->calculate_data == NULL) {
     stream->calculate_data = oggz_malloc(sizeof(auto_calc_celt_info_t));
+    stream->calculate_size = sizeof(auto_calc_celt_info_t);
     if (stream->calculate_data == NULL) return -1;
 
     info = stream->calculate_data;
@@ -676,6 +788,7 @@ auto_calc_opus(ogg_int64_t now, oggz_stream_t *stream, ogg_packet *op) {
 
   if (stream->calculate_data == NULL) {
     stream->calculate_data = oggz_malloc(sizeof(auto_calc_opus_info_t));
+    stream->calculate_size = sizeof(auto_calc_opus_info_t);
     if (stream->calculate_data == NULL) return -1;
     info = stream->calculate_data;
     info->encountered_first_data_packet = 0;
@@ -746,6 +859,7 @@ auto_calc_vp8(ogg_int64_t now, oggz_stream_t *stream, ogg_packet *op) {
 
   if (stream->calculate_data == NULL) {
     stream->calculate_data = oggz_malloc(sizeof(auto_calc_vp8_info_t));
+    stream->calculate_size = sizeof(auto_calc_vp8_info_t);
     if (stream->calculate_data == NULL) return -1;
     info = stream->calculate_data;
     info->encountered_first_data_packet = 0;
@@ -839,6 +953,7 @@ auto_calc_theora(ogg_int64_t now, oggz_stream_t *stream, ogg_packet *op) {
   {
     if (info == NULL) {
       stream->calculate_data = oggz_malloc(sizeof(auto_calc_theora_info_t));
+      stream->calculate_size = sizeof(auto_calc_theora_info_t);
       if (stream->calculate_data == NULL) return -1;
       info = stream->calculate_data;
     }
@@ -964,6 +1079,8 @@ auto_calc_vorbis(ogg_int64_t now, oggz_stream_t *stream, ogg_packet *op) {
     short_size = 1 << (op->packet[28] & 0xF);
 
     stream->calculate_data = oggz_malloc(sizeof(auto_calc_vorbis_info_t));
+
+    stream->calculate_size = sizeof(auto_calc_vorbis_info_t);
     if (stream->calculate_data == NULL) return -1;
 
     info = (auto_calc_vorbis_info_t *)stream->calculate_data;
@@ -1128,6 +1245,7 @@ auto_calc_vorbis(ogg_int64_t now, oggz_stream_t *stream, ogg_packet *op) {
       if (info == NULL) return -1;
 
       stream->calculate_data = info;
+      stream->calculate_size = size_realloc_bytes;
 
       i = -1;
       while ((1 << (++i)) < size);
@@ -1253,6 +1371,7 @@ auto_calc_flac (ogg_int64_t now, oggz_stream_t *stream, ogg_packet *op)
 
   if (stream->calculate_data == NULL) {
     stream->calculate_data = oggz_malloc(sizeof(auto_calc_flac_info_t));
+    stream->calculate_size = sizeof(auto_calc_flac_info_t);
     if (stream->calculate_data == NULL) return -1;
 
     info = (auto_calc_flac_info_t *)stream->calculate_data;
@@ -1407,7 +1526,7 @@ oggz_auto_read_bos_page (OGGZ * oggz, ogg_page * og, long serialno,
   if (content < 0 || content >= OGGZ_CONTENT_UNKNOWN) {
     return 0;
   } else if (content == OGGZ_CONTENT_SKELETON && !ogg_page_bos(og)) {
-    return auto_fisbone(oggz, serialno, og->body, og->body_len, user_data);
+    return auto_skeleton_secondary(oggz, serialno, og->body, og->body_len, user_data);
   } else {
     return oggz_auto_codec_ident[content].reader(oggz, serialno, og->body, og->body_len, user_data);
   }
@@ -1423,7 +1542,7 @@ oggz_auto_read_bos_packet (OGGZ * oggz, ogg_packet * op, long serialno,
   if (content < 0 || content >= OGGZ_CONTENT_UNKNOWN) {
     return 0;
   } else if (content == OGGZ_CONTENT_SKELETON && !op->b_o_s) {
-    return auto_fisbone(oggz, serialno, op->packet, op->bytes, user_data);
+    return auto_skeleton_secondary(oggz, serialno, op->packet, op->bytes, user_data);
   } else {
     return oggz_auto_codec_ident[content].reader(oggz, serialno, op->packet, op->bytes, user_data);
   }
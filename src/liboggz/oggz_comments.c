@@ -51,6 +51,7 @@
 
 #ifdef WIN32                                                                   
 #define strcasecmp _stricmp
+#define strncasecmp _strnicmp
 #endif
 
 /* Ensure comment vector length can be expressed in 32 bits
@@ -98,6 +99,32 @@ oggz_strdup_len (const char * s, size_t len)
   return ret;
 }
 
+/* Copy a span of a comment packet, which may be empty */
+static char *
+oggz_strdup_span (const char * s, size_t len)
+{
+  char * ret;
+
+  ret = oggz_malloc (len + 1);
+  if (ret == NULL) return NULL;
+
+  memcpy (ret, s, len);
+  ret[len] = '\0';
+
+  return ret;
+}
+
+/* The length of a span up to any NUL within it */
+static size_t
+oggz_span_len (const char * s, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len && s[i]; i++);
+
+  return i;
+}
+
 static char *
 oggz_index_len (const char * s, char c, int len)
 {
@@ -147,16 +174,14 @@ The comment header is decoded as follows:
                                      buf[base+2]=(char)((val)&0xff);
 
 static int
-oggz_comment_validate_byname (const char * name)
+oggz_comment_validate_byname_len (const char * name, size_t len)
 {
-  const char * c;
-
-  if (!name) return 0;
+  size_t i;
 
-  for (c = name; *c; c++) {
-    if (*c < 0x20 || *c > 0x7D || *c == 0x3D) {
+  for (i = 0; i < len; i++) {
+    if (name[i] < 0x20 || name[i] > 0x7D || name[i] == 0x3D) {
 #ifdef DEBUG
-      printf ("XXX char %c in %s invalid\n", *c, name);
+      printf ("XXX char %c in %.*s invalid\n", name[i], (int)len, name);
 #endif
       return 0;
     }
@@ -167,6 +192,14 @@ oggz_comment_validate_byname (const char * name)
   return 1;
 }
 
+static int
+oggz_comment_validate_byname (const char * name)
+{
+  if (!name) return 0;
+
+  return oggz_comment_validate_byname_len (name, strlen (name));
+}
+
 static OggzComment *
 oggz_comment_new (const char * name, const char * value)
 {
@@ -198,6 +231,35 @@ oggz_comment_new (const char * name, const char * value)
   return comment;
 }
 
+static OggzComment *
+oggz_comment_new_len (const char * name, size_t name_len,
+                      const char * value, size_t value_len)
+{
+  OggzComment * comment;
+
+  comment = oggz_malloc (sizeof (OggzComment));
+  if (comment == NULL) return NULL;
+
+  comment->name = oggz_strdup_span (name, name_len);
+  if (comment->name == NULL) {
+    oggz_free (comment);
+    return NULL;
+  }
+
+  if (value) {
+    comment->value = oggz_strdup_span (value, value_len);
+    if (comment->value == NULL) {
+      oggz_free (comment->name);
+      oggz_free (comment);
+      return NULL;
+    }
+  } else {
+    comment->value = NULL;
+  }
+
+  return comment;
+}
+
 static void
 oggz_comment_free (OggzComment * comment)
 {
@@ -219,6 +281,44 @@ oggz_comment_cmp (const OggzComment * comment1, const OggzComment * comment2)
   return 1;
 }
 
+static int
+oggz_comment_span_match (const oggz_comment_span_t * span, const char * name)
+{
+  return (strlen (name) == span->name_len &&
+          !strncasecmp (name, span->name, span->name_len));
+}
+
+/* Get the nth comment of a decoded comment packet, copying it out of the
+ * packet the first time it is asked for */
+static OggzComment *
+oggz_comment_span_nth (oggz_stream_t * stream, int i)
+{
+  oggz_comment_span_t * span;
+
+  if (i < 0 || i >= stream->nr_comment_spans) return NULL;
+
+  span = &stream->comment_spans[i];
+  if (span->comment == NULL) {
+    span->comment = oggz_comment_new_len (span->name, span->name_len,
+                                          span->value, span->value_len);
+  }
+
+  return span->comment;
+}
+
+static int
+oggz_comment_span_find_index (oggz_stream_t * stream,
+                              const OggzComment * comment)
+{
+  int i;
+
+  for (i = 0; i < stream->nr_comment_spans; i++) {
+    if (stream->comment_spans[i].comment == comment) return i;
+  }
+
+  return -1;
+}
+
 static int
 _oggz_comment_set_vendor (OGGZ * oggz, long serialno,
 			  const char * vendor_string)
@@ -250,7 +350,7 @@ oggz_comment_get_vendor (OGGZ * oggz, long serialno)
   stream = oggz_get_stream (oggz, serialno);
   if (stream == NULL) return NULL;
 
-  return stream->vendor;
+  return oggz_comments_vendor (stream);
 }
 
 int
@@ -289,6 +389,9 @@ oggz_comment_first (OGGZ * oggz, long serialno)
   stream = oggz_get_stream (oggz, serialno);
   if (stream == NULL) return NULL;
 
+  if (stream->comment_packet)
+    return oggz_comment_span_nth (stream, 0);
+
   return oggz_vector_nth_p (stream->comments, 0);
 }
 
@@ -304,11 +407,19 @@ oggz_comment_first_byname (OGGZ * oggz, long serialno, char * name)
   stream = oggz_get_stream (oggz, serialno);
   if (stream == NULL) return NULL;
 
-  if (name == NULL) return oggz_vector_nth_p (stream->comments, 0);
+  if (name == NULL) return oggz_comment_first (oggz, serialno);
 
   if (!oggz_comment_validate_byname (name))
     return NULL;
 
+  if (stream->comment_packet) {
+    for (i = 0; i < stream->nr_comment_spans; i++) {
+      if (oggz_comment_span_match (&stream->comment_spans[i], name))
+        return oggz_comment_span_nth (stream, i);
+    }
+    return NULL;
+  }
+
   for (i = 0; i < oggz_vector_size (stream->comments); i++) {
     comment = (OggzComment *) oggz_vector_nth_p (stream->comments, i);
     if (comment->name && !strcasecmp (name, comment->name))
@@ -329,6 +440,12 @@ oggz_comment_next (OGGZ * oggz, long serialno, const OggzComment * comment)
   stream = oggz_get_stream (oggz, serialno);
   if (stream == NULL) return NULL;
 
+  if (stream->comment_packet) {
+    i = oggz_comment_span_find_index (stream, comment);
+    if (i == -1) return NULL;
+    return oggz_comment_span_nth (stream, i+1);
+  }
+
   i = oggz_vector_find_index_p (stream->comments, comment);
 
   return oggz_vector_nth_p (stream->comments, i+1);
@@ -347,6 +464,16 @@ oggz_comment_next_byname (OGGZ * oggz, long serialno,
   stream = oggz_get_stream (oggz, serialno);
   if (stream == NULL) return NULL;
 
+  if (stream->comment_packet) {
+    i = oggz_comment_span_find_index (stream, comment);
+    if (i == -1) return NULL;
+    for (i++; i < stream->nr_comment_spans; i++) {
+      if (oggz_comment_span_match (&stream->comment_spans[i], comment->name))
+        return oggz_comment_span_nth (stream, i);
+    }
+    return NULL;
+  }
+
   i = oggz_vector_find_index_p (stream->comments, comment);
 
   for (i++; i < oggz_vector_size (stream->comments); i++) {
@@ -542,6 +669,9 @@ int
 oggz_comments_init (oggz_stream_t * stream)
 {
   stream->vendor = NULL;
+  stream->comment_packet = NULL;
+  stream->comment_spans = NULL;
+  stream->nr_comment_spans = 0;
   stream->comments = oggz_vector_new ();
   if (stream->comments == NULL) return -1;
 
@@ -550,67 +680,177 @@ oggz_comments_init (oggz_stream_t * stream)
   return 0;
 }
 
+static void
+oggz_comments_free_packet (oggz_stream_t * stream)
+{
+  int i;
+
+  for (i = 0; i < stream->nr_comment_spans; i++)
+    oggz_comment_free (stream->comment_spans[i].comment);
+
+  if (stream->comment_spans) oggz_free (stream->comment_spans);
+  stream->comment_spans = NULL;
+  stream->nr_comment_spans = 0;
+
+  if (stream->comment_packet) oggz_free (stream->comment_packet);
+  stream->comment_packet = NULL;
+}
+
 int
 oggz_comments_free (oggz_stream_t * stream)
 {
-  oggz_vector_foreach (stream->comments, (OggzFunc)oggz_comment_free);
-  oggz_vector_delete (stream->comments);
+  if (stream->shared) {
+    /* Owned by the OggzFileInfo */
+    stream->comments = NULL;
+    stream->vendor = NULL;
+    return 0;
+  }
+
+  oggz_comments_delete (stream->comments);
   stream->comments = NULL;
 
+  oggz_comments_free_packet (stream);
+
   if (stream->vendor) oggz_free (stream->vendor);
   stream->vendor = NULL;
 
   return 0;
 }
 
+const char *
+oggz_comments_vendor (oggz_stream_t * stream)
+{
+  size_t len;
+
+  if (stream->vendor == NULL && stream->comment_packet != NULL) {
+    len = readint (stream->comment_packet, 0);
+    stream->vendor = oggz_strdup_len (stream->comment_packet + 4, len);
+  }
+
+  return stream->vendor;
+}
+
+OggzVector *
+oggz_comments_dup (oggz_stream_t * stream)
+{
+  OggzVector * comments;
+  OggzComment * comment, * new_comment;
+  oggz_comment_span_t * span;
+  int i;
+
+  comments = oggz_vector_new ();
+  if (comments == NULL) return NULL;
+
+  oggz_vector_set_cmp (comments, (OggzCmpFunc) oggz_comment_cmp, NULL);
+
+  for (i = 0; i < stream->nr_comment_spans; i++) {
+    span = &stream->comment_spans[i];
+    if ((new_comment = oggz_comment_new_len (span->name, span->name_len,
+                                             span->value,
+                                             span->value_len)) == NULL ||
+        oggz_vector_insert_p (comments, new_comment) == NULL) {
+      oggz_comment_free (new_comment);
+      oggz_comments_delete (comments);
+      return NULL;
+    }
+  }
+
+  for (i = 0; i < oggz_vector_size (stream->comments); i++) {
+    comment = (OggzComment *) oggz_vector_nth_p (stream->comments, i);
+    if ((new_comment = oggz_comment_new (comment->name, comment->value)) == NULL ||
+        oggz_vector_insert_p (comments, new_comment) == NULL) {
+      oggz_comment_free (new_comment);
+      oggz_comments_delete (comments);
+      return NULL;
+    }
+  }
+
+  return comments;
+}
+
+void
+oggz_comments_delete (OggzVector * comments)
+{
+  oggz_vector_foreach (comments, (OggzFunc)oggz_comment_free);
+  oggz_vector_delete (comments);
+}
+
+static int
+oggz_comment_span_cmp (const oggz_comment_span_t * span1,
+                       const oggz_comment_span_t * span2)
+{
+  if (span1->name_len != span2->name_len) return 0;
+  if (strncasecmp (span1->name, span2->name, span1->name_len)) return 0;
+
+  if (span1->value == NULL || span2->value == NULL)
+    return (span1->value == span2->value);
+
+  if (span1->value_len != span2->value_len) return 0;
+  if (memcmp (span1->value, span2->value, span1->value_len)) return 0;
+
+  return 1;
+}
+
+/*
+ * The comment packet is kept as read, and only the spans of its comments
+ * are recorded here; comments are copied out when they are asked for, so
+ * large values such as embedded pictures are not copied unless used.
+ */
 int
 oggz_comments_decode (OGGZ * oggz, long serialno,
                       unsigned char * comments, long length)
 {
    oggz_stream_t * stream;
-   char *c= (char *)comments;
-   int i, nb_fields, n;
+   oggz_comment_span_t * span;
+   char *c, *end;
+   int i, j, nb_fields, max_fields;
    size_t len;
-   char *end;
-   char * name, * value, * nvalue = NULL;
-   OggzComment * comment;
+   char * value;
 
    if (length<8)
       return -1;
 
-   end = c+length;
-   len=readint(c, 0);
-
-   c+=4;
-   if (len>(size_t)(end-c)) return -1;
+   len=readint(comments, 0);
+   if (len>(size_t)(length-8)) return -1;
 
    stream = oggz_get_stream (oggz, serialno);
    if (stream == NULL) return OGGZ_ERR_BAD_SERIALNO;
 
-   /* Vendor */
-   if (len > 0) {
-     if ((nvalue = oggz_strdup_len (c, len)) == NULL)
-       return OGGZ_ERR_OUT_OF_MEMORY;
+   /* Comments shared from an OggzFileInfo are already known */
+   if (stream->shared) return 0;
+
+   /* The comment packet has already been read */
+   if (stream->comment_packet) return 0;
+
+   /* This value gets checked effectively by the 'for' condition
+      and the checks within the loop for c running off the end.  */
+   nb_fields=readint(comments, 4+len);
+
+   /* Each comment takes at least 4 bytes of the packet */
+   max_fields = (length - 8 - len) / 4;
+   if (nb_fields < 0) nb_fields = 0;
+
+   if ((stream->comment_packet = oggz_malloc (length)) == NULL)
+     return OGGZ_ERR_OUT_OF_MEMORY;
+   memcpy (stream->comment_packet, comments, length);
 
-     if (_oggz_comment_set_vendor (oggz, serialno, nvalue) == OGGZ_ERR_OUT_OF_MEMORY) {
-       oggz_free (nvalue);
+   if (nb_fields > 0 && max_fields > 0) {
+     stream->comment_spans =
+       oggz_malloc (MIN (nb_fields, max_fields) * sizeof (oggz_comment_span_t));
+     if (stream->comment_spans == NULL) {
+       oggz_comments_free_packet (stream);
        return OGGZ_ERR_OUT_OF_MEMORY;
      }
-
-     oggz_free (nvalue);
    }
 
+   c = stream->comment_packet;
+   end = c+length;
+
 #ifdef DEBUG
-   fwrite(c, 1, len, stderr); fputc ('\n', stderr);
+   fwrite(c+4, 1, len, stderr); fputc ('\n', stderr);
 #endif
-   c+=len;
-
-   if (c+4>end) return -1;
+   c+=8+len;
 
-   /* This value gets checked effectively by the 'for' condition
-      and the checks within the loop for c running off the end.  */
-   nb_fields=readint(c, 0);
-   c+=4;
    for (i=0;i<nb_fields;i++) {
       if (c+4>end) return -1;
 
@@ -618,55 +858,44 @@ oggz_comments_decode (OGGZ * oggz, long serialno,
 
       c+=4;
       if (len>(size_t)(end-c)) return -1;
+      if (len == 0) return OGGZ_ERR_COMMENT_INVALID;
+
+      span = &stream->comment_spans[stream->nr_comment_spans];
+      span->name = c;
+      span->comment = NULL;
 
-      n = 0;
-      name = c;
+      /* Names and values end at any NUL within the comment. A comment
+       * of the form "name=" is kept as a name without a value. */
       value = oggz_index_len (c, '=', len);
       if (value) {
-         *value = '\0';
+         span->name_len = value - c;
          value++;
-         n = c+len - value;
+      } else {
+         span->name_len = oggz_span_len (c, len);
       }
 
-      if (n != 0) {
-         if ((nvalue = oggz_strdup_len (value, n)) == NULL)
-           return OGGZ_ERR_OUT_OF_MEMORY;
-
-#ifdef DEBUG
-         printf ("oggz_comments_decode: [%d] %s -> %s (length %d)\n",
-         i, name, nvalue, n);
-#endif
-         if (_oggz_comment_add_byname (stream, name, nvalue) == NULL) {
-           oggz_free (nvalue);
-           return OGGZ_ERR_OUT_OF_MEMORY;
-	 }
-
-         oggz_free (nvalue);
+      if (value && value < c+len) {
+         span->value = value;
+         span->value_len = oggz_span_len (value, c+len - value);
       } else {
-        /* For the case of a comment which is not in key=value form,
-         * duplicate exactly the length of the comment, as it is
-         * not NUL-terminated. In the case of the last comment of the
-         * packet, it will be followed immediately by a framing bit.
-         */
-         if ((nvalue = oggz_strdup_len (name, len)) == NULL)
-           return OGGZ_ERR_OUT_OF_MEMORY;
+         span->value = NULL;
+         span->value_len = 0;
+      }
+
+      if (!oggz_comment_validate_byname_len (span->name, span->name_len))
+        return OGGZ_ERR_COMMENT_INVALID;
 
 #ifdef DEBUG
-         printf ("oggz_comments_decode: [%d] %s (no value) (length %d)\n",
-         i, nvalue, len);
+      printf ("oggz_comments_decode: [%d] %.*s (length %d)\n",
+              i, (int)span->name_len, span->name, (int)len);
 #endif
 
-         if (_oggz_comment_add_byname (stream, nvalue, NULL) == NULL) {
-           oggz_free (nvalue);
-           return OGGZ_ERR_OUT_OF_MEMORY;
-	 }
-
-         oggz_free (nvalue);
+      /* Skip the same name=value pair if it is already present */
+      for (j = 0; j < stream->nr_comment_spans; j++) {
+        if (oggz_comment_span_cmp (&stream->comment_spans[j], span)) break;
       }
-
-      /* If we nulled out an equal sign, put it back. */
-      if (value)
-         value[-1] = '=';
+      if (j == stream->nr_comment_spans)
+        stream->nr_comment_spans++;
 
       c+=len;
    }
@@ -705,6 +934,7 @@ oggz_comments_encode (OGGZ * oggz, long serialno,
   oggz_stream_t * stream;
   char * c = (char *)buf;
   const OggzComment * comment;
+  const char * vendor;
   int nb_fields = 0, vendor_length = 0;
   unsigned long actual_length = 0, remaining = length, field_length;
 
@@ -715,12 +945,13 @@ oggz_comments_encode (OGGZ * oggz, long serialno,
   if (stream == NULL) return OGGZ_ERR_BAD_SERIALNO;
 
   /* Vendor string */
-  if (stream->vendor)
-    vendor_length = oggz_comment_len (stream->vendor);
+  vendor = oggz_comments_vendor (stream);
+  if (vendor)
+    vendor_length = oggz_comment_len (vendor);
   if (accum_length (&actual_length, 4 + vendor_length) == 0)
     return 0;
 #ifdef DEBUG
-  printf ("oggz_comments_encode: vendor = %s\n", stream->vendor);
+  printf ("oggz_comments_encode: vendor = %s\n", vendor);
 #endif
 
   /* user comment list length */
@@ -760,9 +991,9 @@ oggz_comments_encode (OGGZ * oggz, long serialno,
   writeint (c, 0, vendor_length);
   c += 4;
 
-  if (stream->vendor) {
-    field_length = oggz_comment_len (stream->vendor);
-    memcpy (c, stream->vendor, MIN (field_length, remaining));
+  if (vendor) {
+    field_length = oggz_comment_len (vendor);
+    memcpy (c, vendor, MIN (field_length, remaining));
     c += field_length; remaining -= field_length;
     if (remaining <= 0) return actual_length;
   }
@@ -0,0 +1,740 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "oggz_compat.h"
+#include "oggz_private.h"
+
+#include "oggz/oggz_read.h"
+#include "oggz/oggz_seek.h"
+
+/*#define DEBUG*/
+
+typedef struct _OggzFileInfo OggzFileInfo;
+
+/* The facts about one logical bitstream, as found by parsing its headers */
+typedef struct {
+  long serialno;
+
+  int content;
+  int numheaders;
+  int preroll;
+  ogg_int64_t granulerate_n;
+  ogg_int64_t granulerate_d;
+  ogg_int64_t first_granule;
+  ogg_int64_t basegranule;
+  int granuleshift;
+  int metric_internal; /* whether the stream had a metric from its headers */
+  ogg_int64_t packetno;
+
+  char * vendor;
+  OggzVector * comments;
+
+  oggz_keypoint_t * keypoints;
+  long nr_keypoints;
+  ogg_int64_t keypoints_end;
+  ogg_int64_t segment_length;
+
+  /* Codec state for granulepos calculation, copied into each cursor */
+  void * calculate_data;
+  size_t calculate_size;
+} oggz_file_info_stream_t;
+
+/*
+ * Nothing but the reference count changes after oggz_file_info_new(), so
+ * cursors on several threads may read the streams without locking.
+ */
+struct _OggzFileInfo {
+  int refcount;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t mutex;
+#endif
+
+  oggz_off_t offset_data_begin;
+
+  /* File bounds already found by seeking */
+  oggz_off_t bounds_end;
+  long bounds_end_serialno;
+  ogg_int64_t bounds_end_granulepos;
+  oggz_off_t bounds_end_page;
+  oggz_off_t bounds_begin;
+  long bounds_begin_serialno;
+  ogg_int64_t bounds_begin_granulepos;
+
+  int nr_streams;
+  oggz_file_info_stream_t * streams;
+};
+
+/*
+ * An entry in the probe cache, keyed by a user key or by the identity of
+ * the file. Entries are kept in order of use, most recent first.
+ */
+typedef struct _OggzProbeEntry OggzProbeEntry;
+
+struct _OggzProbeEntry {
+  OggzProbeEntry * prev;
+  OggzProbeEntry * next;
+
+  char * key; /* the user key, or NULL to use the file identity */
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t mtime;
+  int auto_flag; /* whether the headers were read with OGGZ_AUTO */
+
+  OggzFileInfo * info; /* the cache holds a reference */
+};
+
+static struct {
+  int max_entries;
+  int nr_entries;
+  OggzProbeEntry * head; /* most recently used */
+  OggzProbeEntry * tail; /* least recently used */
+} probe_cache = {0, 0, NULL, NULL};
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t probe_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#if OGGZ_CONFIG_READ
+
+static void
+oggz_file_info_free (OggzFileInfo * info)
+{
+  oggz_file_info_stream_t * fs;
+  int i;
+
+  for (i = 0; i < info->nr_streams; i++) {
+    fs = &info->streams[i];
+    if (fs->vendor) oggz_free (fs->vendor);
+    if (fs->comments) oggz_comments_delete (fs->comments);
+    if (fs->keypoints) oggz_free (fs->keypoints);
+    if (fs->calculate_data) oggz_free (fs->calculate_data);
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy (&info->mutex);
+#endif
+
+  oggz_free (info->streams);
+  oggz_free (info);
+}
+
+static void *
+oggz_file_info_memdup (const void * data, size_t size)
+{
+  void * copy;
+
+  if (data == NULL || size == 0) return NULL;
+
+  if ((copy = oggz_malloc (size)) == NULL) return NULL;
+  memcpy (copy, data, size);
+
+  return copy;
+}
+
+static int
+oggz_file_info_add_stream (oggz_file_info_stream_t * fs,
+                           oggz_stream_t * stream)
+{
+  const char * vendor;
+
+  fs->serialno = stream->ogg_stream.serialno;
+  fs->content = stream->content;
+  fs->numheaders = stream->numheaders;
+  fs->preroll = stream->preroll;
+  fs->granulerate_n = stream->granulerate_n;
+  fs->granulerate_d = stream->granulerate_d;
+  fs->first_granule = stream->first_granule;
+  fs->basegranule = stream->basegranule;
+  fs->granuleshift = stream->granuleshift;
+  fs->metric_internal = stream->metric_internal;
+  fs->packetno = stream->packetno;
+
+  if ((vendor = oggz_comments_vendor (stream)) != NULL) {
+    fs->vendor = oggz_file_info_memdup (vendor, strlen (vendor) + 1);
+    if (fs->vendor == NULL) return -1;
+  }
+
+  if ((fs->comments = oggz_comments_dup (stream)) == NULL) return -1;
+
+  if (stream->nr_keypoints > 0) {
+    fs->keypoints =
+      oggz_file_info_memdup (stream->keypoints,
+                             stream->nr_keypoints * sizeof (oggz_keypoint_t));
+    if (fs->keypoints == NULL) return -1;
+    fs->nr_keypoints = stream->nr_keypoints;
+  }
+  fs->keypoints_end = stream->keypoints_end;
+  fs->segment_length = stream->segment_length;
+
+  if (stream->calculate_data != NULL) {
+    fs->calculate_data = oggz_file_info_memdup (stream->calculate_data,
+                                                stream->calculate_size);
+    if (fs->calculate_data == NULL) return -1;
+    fs->calculate_size = stream->calculate_size;
+  }
+
+  return 0;
+}
+
+OggzFileInfo *
+oggz_file_info_new (OGGZ * oggz)
+{
+  OggzFileInfo * info;
+  OggzReader * reader;
+  oggz_stream_t * stream;
+  int i, nr_streams;
+
+  if (oggz == NULL) return NULL;
+
+  if (oggz->flags & OGGZ_WRITE) return NULL;
+
+  reader = &oggz->x.reader;
+
+  info = oggz_malloc (sizeof (OggzFileInfo));
+  if (info == NULL) return NULL;
+
+  nr_streams = oggz_vector_size (oggz->streams);
+
+  info->refcount = 1;
+  info->offset_data_begin = oggz->offset_data_begin;
+  info->bounds_end = reader->bounds_end;
+  info->bounds_end_serialno = reader->bounds_end_serialno;
+  info->bounds_end_granulepos = reader->bounds_end_granulepos;
+  info->bounds_end_page = reader->bounds_end_page;
+  info->bounds_begin = reader->bounds_begin;
+  info->bounds_begin_serialno = reader->bounds_begin_serialno;
+  info->bounds_begin_granulepos = reader->bounds_begin_granulepos;
+  info->nr_streams = 0;
+
+  info->streams = oggz_malloc ((nr_streams + 1) * sizeof (oggz_file_info_stream_t));
+  if (info->streams == NULL) {
+    oggz_free (info);
+    return NULL;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  if (pthread_mutex_init (&info->mutex, NULL) != 0) {
+    oggz_free (info->streams);
+    oggz_free (info);
+    return NULL;
+  }
+#endif
+
+  for (i = 0; i < nr_streams; i++) {
+    stream = (oggz_stream_t *) oggz_vector_nth_p (oggz->streams, i);
+    if (stream->ogg_stream.serialno == -1) continue;
+
+    memset (&info->streams[info->nr_streams], 0,
+            sizeof (oggz_file_info_stream_t));
+    info->nr_streams++;
+
+    if (oggz_file_info_add_stream (&info->streams[info->nr_streams-1],
+                                   stream) == -1) {
+      oggz_file_info_free (info);
+      return NULL;
+    }
+  }
+
+#ifdef DEBUG
+  printf ("oggz_file_info_new: %d streams, data begins at %" PRI_OGGZ_OFF_T "d\n",
+          info->nr_streams, info->offset_data_begin);
+#endif
+
+  return info;
+}
+
+OggzFileInfo *
+oggz_file_info_ref (OggzFileInfo * info)
+{
+  if (info == NULL) return NULL;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock (&info->mutex);
+  info->refcount++;
+  pthread_mutex_unlock (&info->mutex);
+#else
+  info->refcount++;
+#endif
+
+  return info;
+}
+
+int
+oggz_file_info_unref (OggzFileInfo * info)
+{
+  int refcount;
+
+  if (info == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock (&info->mutex);
+  refcount = --info->refcount;
+  pthread_mutex_unlock (&info->mutex);
+#else
+  refcount = --info->refcount;
+#endif
+
+  if (refcount == 0)
+    oggz_file_info_free (info);
+
+  return 0;
+}
+
+/*
+ * Set up the streams of a newly opened OGGZ from info, borrowing the
+ * comments and keypoints, and position it at the start of data. The
+ * OGGZ holds a reference to info until it is closed.
+ */
+static int
+oggz_file_info_apply (OggzFileInfo * info, OGGZ * oggz)
+{
+  OggzReader * reader = &oggz->x.reader;
+  oggz_file_info_stream_t * fs;
+  oggz_stream_t * stream;
+  int i;
+
+  oggz->file_info = oggz_file_info_ref (info);
+
+  for (i = 0; i < info->nr_streams; i++) {
+    fs = &info->streams[i];
+
+    if ((stream = oggz_add_stream (oggz, fs->serialno)) == NULL)
+      return OGGZ_ERR_OUT_OF_MEMORY;
+
+    stream->content = fs->content;
+    stream->numheaders = fs->numheaders;
+    stream->preroll = fs->preroll;
+    stream->granulerate_n = fs->granulerate_n;
+    stream->granulerate_d = fs->granulerate_d;
+    stream->basegranule = fs->basegranule;
+    stream->granuleshift = fs->granuleshift;
+    stream->packetno = fs->packetno;
+    stream->delivered_non_b_o_s = 1;
+
+    oggz_comments_free (stream);
+    stream->vendor = fs->vendor;
+    stream->comments = fs->comments;
+    stream->keypoints = fs->keypoints;
+    stream->nr_keypoints = fs->nr_keypoints;
+    stream->keypoints_end = fs->keypoints_end;
+    stream->segment_length = fs->segment_length;
+    stream->shared = 1;
+
+    if (fs->calculate_data != NULL) {
+      stream->calculate_data = oggz_file_info_memdup (fs->calculate_data,
+                                                      fs->calculate_size);
+      if (stream->calculate_data == NULL)
+        return OGGZ_ERR_OUT_OF_MEMORY;
+      stream->calculate_size = fs->calculate_size;
+    }
+
+    /* Choose the metric as the headers did */
+    if (fs->metric_internal &&
+        oggz_set_first_granule (oggz, fs->serialno, fs->first_granule) != 0)
+      return OGGZ_ERR_OUT_OF_MEMORY;
+    stream->first_granule = fs->first_granule;
+  }
+
+  reader->bounds_end = info->bounds_end;
+  reader->bounds_end_serialno = info->bounds_end_serialno;
+  reader->bounds_end_granulepos = info->bounds_end_granulepos;
+  reader->bounds_end_page = info->bounds_end_page;
+  reader->bounds_begin = info->bounds_begin;
+  reader->bounds_begin_serialno = info->bounds_begin_serialno;
+  reader->bounds_begin_granulepos = info->bounds_begin_granulepos;
+
+  oggz_set_data_start (oggz, info->offset_data_begin);
+
+  if (info->offset_data_begin > 0 &&
+      oggz_seek (oggz, info->offset_data_begin, SEEK_SET) == -1)
+    return OGGZ_ERR_SYSTEM;
+
+  return 0;
+}
+
+OGGZ *
+oggz_open_file_info (OggzFileInfo * info, const char * filename, int flags)
+{
+  OGGZ * oggz;
+
+  if (info == NULL || (flags & OGGZ_WRITE)) return NULL;
+
+  if ((oggz = oggz_open ((char *)filename, flags)) == NULL)
+    return NULL;
+
+  if (oggz_file_info_apply (info, oggz) != 0) {
+    oggz_close (oggz);
+    return NULL;
+  }
+
+  return oggz;
+}
+
+OGGZ *
+oggz_open_stdio_file_info (OggzFileInfo * info, FILE * file, int flags)
+{
+  OGGZ * oggz;
+
+  if (info == NULL || (flags & OGGZ_WRITE)) return NULL;
+
+  if ((oggz = oggz_open_stdio (file, flags)) == NULL)
+    return NULL;
+
+  if (oggz_file_info_apply (info, oggz) != 0) {
+    /* Leave the caller's file open */
+    oggz->file = NULL;
+    oggz_close (oggz);
+    return NULL;
+  }
+
+  return oggz;
+}
+
+void
+oggz_file_info_close (OGGZ * oggz)
+{
+  if (oggz->file_info != NULL) {
+    oggz_file_info_unref (oggz->file_info);
+    oggz->file_info = NULL;
+  }
+}
+
+/********** Probe cache **********/
+
+static void
+oggz_probe_cache_lock (void)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock (&probe_cache_mutex);
+#endif
+}
+
+static void
+oggz_probe_cache_unlock (void)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock (&probe_cache_mutex);
+#endif
+}
+
+static int
+oggz_probe_entry_match (OggzProbeEntry * entry, OggzProbeEntry * id)
+{
+  if (entry->auto_flag != id->auto_flag) return 0;
+
+  if (id->key != NULL)
+    return (entry->key != NULL && strcmp (entry->key, id->key) == 0);
+
+  return (entry->key == NULL && entry->dev == id->dev &&
+          entry->ino == id->ino && entry->size == id->size &&
+          entry->mtime == id->mtime);
+}
+
+static void
+oggz_probe_cache_unlink (OggzProbeEntry * entry)
+{
+  if (entry->prev) entry->prev->next = entry->next;
+  else probe_cache.head = entry->next;
+
+  if (entry->next) entry->next->prev = entry->prev;
+  else probe_cache.tail = entry->prev;
+
+  probe_cache.nr_entries--;
+}
+
+static void
+oggz_probe_cache_push (OggzProbeEntry * entry)
+{
+  entry->prev = NULL;
+  entry->next = probe_cache.head;
+
+  if (probe_cache.head) probe_cache.head->prev = entry;
+  else probe_cache.tail = entry;
+
+  probe_cache.head = entry;
+  probe_cache.nr_entries++;
+}
+
+/* Drop the least recently used entries beyond max_entries */
+static void
+oggz_probe_cache_trim (void)
+{
+  OggzProbeEntry * entry;
+
+  while (probe_cache.nr_entries > probe_cache.max_entries) {
+    entry = probe_cache.tail;
+    oggz_probe_cache_unlink (entry);
+
+    oggz_file_info_unref (entry->info);
+    if (entry->key) oggz_free (entry->key);
+    oggz_free (entry);
+  }
+}
+
+/*
+ * Find the file info cached for id, and take a reference to it for the
+ * caller.
+ */
+static OggzFileInfo *
+oggz_probe_cache_lookup (OggzProbeEntry * id)
+{
+  OggzProbeEntry * entry;
+  OggzFileInfo * info = NULL;
+
+  oggz_probe_cache_lock ();
+
+  for (entry = probe_cache.head; entry != NULL; entry = entry->next) {
+    if (oggz_probe_entry_match (entry, id)) {
+      /* Move it to the front */
+      oggz_probe_cache_unlink (entry);
+      oggz_probe_cache_push (entry);
+      info = oggz_file_info_ref (entry->info);
+      break;
+    }
+  }
+
+  oggz_probe_cache_unlock ();
+
+  return info;
+}
+
+static int
+oggz_probe_cache_enabled (void)
+{
+  int enabled;
+
+  oggz_probe_cache_lock ();
+  enabled = (probe_cache.max_entries > 0);
+  oggz_probe_cache_unlock ();
+
+  return enabled;
+}
+
+/*
+ * Add info to the cache under id, passing the caller's reference to the
+ * cache. If another thread has meanwhile added the same file, its entry
+ * is kept.
+ */
+static void
+oggz_probe_cache_insert (OggzProbeEntry * id, OggzFileInfo * info)
+{
+  OggzProbeEntry * entry;
+
+  oggz_probe_cache_lock ();
+
+  for (entry = probe_cache.head; entry != NULL; entry = entry->next) {
+    if (oggz_probe_entry_match (entry, id)) break;
+  }
+
+  if (entry != NULL || probe_cache.max_entries == 0 ||
+      (entry = oggz_malloc (sizeof (OggzProbeEntry))) == NULL) {
+    oggz_probe_cache_unlock ();
+    oggz_file_info_unref (info);
+    return;
+  }
+
+  *entry = *id;
+  entry->info = info;
+
+  if (id->key != NULL &&
+      (entry->key = oggz_file_info_memdup (id->key, strlen (id->key) + 1)) == NULL) {
+    oggz_free (entry);
+    oggz_probe_cache_unlock ();
+    oggz_file_info_unref (info);
+    return;
+  }
+
+  oggz_probe_cache_push (entry);
+  oggz_probe_cache_trim ();
+
+  oggz_probe_cache_unlock ();
+}
+
+int
+oggz_file_info_cache_set_size (int max_entries)
+{
+  if (max_entries < 0) return OGGZ_ERR_INVALID;
+
+  oggz_probe_cache_lock ();
+  probe_cache.max_entries = max_entries;
+  oggz_probe_cache_trim ();
+  oggz_probe_cache_unlock ();
+
+  return 0;
+}
+
+/*
+ * Open file by reading its headers, and add its file info to the cache
+ * under id, unless id is NULL.
+ */
+static OGGZ *
+oggz_probe_open (FILE * file, OggzProbeEntry * id, int flags)
+{
+  OGGZ * oggz;
+  OggzFileInfo * info;
+  oggz_off_t data_start;
+
+  if ((oggz = oggz_open_stdio (file, flags)) == NULL) {
+    fclose (file);
+    return NULL;
+  }
+
+  if (oggz_read_headers (oggz) != 0) {
+    oggz_close (oggz);
+    return NULL;
+  }
+
+  /* Data starts after the last header page read */
+  data_start = oggz->offset + oggz->x.reader.current_page_bytes;
+  oggz_set_data_start (oggz, data_start);
+
+  if (id != NULL && oggz_probe_cache_enabled ()) {
+    /* Find the end too, so that later opens need not */
+    oggz_seek_find_end (oggz);
+
+    if ((info = oggz_file_info_new (oggz)) != NULL)
+      oggz_probe_cache_insert (id, info);
+  }
+
+  if (oggz_seek (oggz, data_start, SEEK_SET) == -1) {
+    oggz_close (oggz);
+    return NULL;
+  }
+
+  return oggz;
+}
+
+OGGZ *
+oggz_open_cached (const char * filename, const char * key, int flags)
+{
+  OggzProbeEntry id;
+  OggzFileInfo * info;
+  OGGZ * oggz;
+  FILE * file;
+  struct stat statbuf;
+  int cacheable = 1;
+
+  if (filename == NULL || (flags & OGGZ_WRITE)) return NULL;
+
+  if ((file = fopen (filename, "rb")) == NULL) return NULL;
+
+  memset (&id, 0, sizeof (id));
+  id.key = (char *)key;
+  id.auto_flag = (flags & OGGZ_AUTO) ? 1 : 0;
+
+  if (key == NULL) {
+    /* Without inode numbers, files cannot be told apart */
+    if (fstat (fileno (file), &statbuf) == 0 && statbuf.st_ino != 0) {
+      id.dev = statbuf.st_dev;
+      id.ino = statbuf.st_ino;
+      id.size = statbuf.st_size;
+      id.mtime = statbuf.st_mtime;
+    } else {
+      cacheable = 0;
+    }
+  }
+
+  if (cacheable && (info = oggz_probe_cache_lookup (&id)) != NULL) {
+    oggz = oggz_open_stdio_file_info (info, file, flags);
+    oggz_file_info_unref (info);
+
+    if (oggz == NULL) fclose (file);
+
+    return oggz;
+  }
+
+  return oggz_probe_open (file, cacheable ? &id : NULL, flags);
+}
+
+#else /* OGGZ_CONFIG_READ */
+
+OggzFileInfo *
+oggz_file_info_new (OGGZ * oggz)
+{
+  return NULL;
+}
+
+OggzFileInfo *
+oggz_file_info_ref (OggzFileInfo * info)
+{
+  return NULL;
+}
+
+int
+oggz_file_info_unref (OggzFileInfo * info)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
+OGGZ *
+oggz_open_file_info (OggzFileInfo * info, const char * filename, int flags)
+{
+  return NULL;
+}
+
+OGGZ *
+oggz_open_stdio_file_info (OggzFileInfo * info, FILE * file, int flags)
+{
+  return NULL;
+}
+
+void
+oggz_file_info_close (OGGZ * oggz)
+{
+}
+
+int
+oggz_file_info_cache_set_size (int max_entries)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
+OGGZ *
+oggz_open_cached (const char * filename, const char * key, int flags)
+{
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,213 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <ogg/ogg.h>
+
+#include "oggz_macros.h"
+#include "oggz_heap.h"
+
+typedef struct {
+  void * p;
+  ogg_int64_t seq; /* insertion order, to break ties */
+} oggz_heap_elem;
+
+struct _OggzHeap {
+  int max_elements;
+  int nr_elements;
+  oggz_heap_elem * data;
+  ogg_int64_t next_seq;
+  OggzCmpFunc compare;
+  void * compare_user_data;
+};
+
+OggzHeap *
+oggz_heap_new (void)
+{
+  OggzHeap * heap;
+
+  heap = oggz_malloc (sizeof (OggzHeap));
+  if (heap == NULL) return NULL;
+
+  heap->max_elements = 0;
+  heap->nr_elements = 0;
+  heap->data = NULL;
+  heap->next_seq = 0;
+  heap->compare = NULL;
+  heap->compare_user_data = NULL;
+
+  return heap;
+}
+
+void
+oggz_heap_delete (OggzHeap * heap)
+{
+  if (heap == NULL) return;
+
+  if (heap->data) oggz_free (heap->data);
+  oggz_free (heap);
+}
+
+int
+oggz_heap_size (OggzHeap * heap)
+{
+  if (heap == NULL) return 0;
+
+  return heap->nr_elements;
+}
+
+/* Whether element i should be popped before element j */
+static int
+oggz_heap_before (OggzHeap * heap, int i, int j)
+{
+  oggz_heap_elem * a = &heap->data[i], * b = &heap->data[j];
+  int c;
+
+  if (heap->compare) {
+    c = heap->compare (a->p, b->p, heap->compare_user_data);
+    if (c != 0) return (c < 0);
+  }
+
+  return (a->seq < b->seq);
+}
+
+static void
+oggz_heap_swap (OggzHeap * heap, int i, int j)
+{
+  oggz_heap_elem t;
+
+  t = heap->data[i];
+  heap->data[i] = heap->data[j];
+  heap->data[j] = t;
+}
+
+static void
+oggz_heap_sift_up (OggzHeap * heap, int i)
+{
+  int parent;
+
+  while (i > 0) {
+    parent = (i - 1) / 2;
+    if (!oggz_heap_before (heap, i, parent)) break;
+    oggz_heap_swap (heap, i, parent);
+    i = parent;
+  }
+}
+
+static void
+oggz_heap_sift_down (OggzHeap * heap, int i)
+{
+  int child, n = heap->nr_elements;
+
+  while ((child = 2 * i + 1) < n) {
+    if (child + 1 < n && oggz_heap_before (heap, child + 1, child))
+      child++;
+    if (!oggz_heap_before (heap, child, i)) break;
+    oggz_heap_swap (heap, i, child);
+    i = child;
+  }
+}
+
+void *
+oggz_heap_insert (OggzHeap * heap, void * data)
+{
+  oggz_heap_elem * new_elements;
+  int new_max_elements;
+
+  if (heap->nr_elements == heap->max_elements) {
+    new_max_elements = (heap->max_elements == 0) ? 16 : heap->max_elements * 2;
+
+    new_elements =
+      oggz_realloc (heap->data, (size_t)new_max_elements * sizeof (oggz_heap_elem));
+    if (new_elements == NULL) return NULL;
+
+    heap->max_elements = new_max_elements;
+    heap->data = new_elements;
+  }
+
+  heap->data[heap->nr_elements].p = data;
+  heap->data[heap->nr_elements].seq = heap->next_seq++;
+  heap->nr_elements++;
+
+  oggz_heap_sift_up (heap, heap->nr_elements - 1);
+
+  return data;
+}
+
+void *
+oggz_heap_pop (OggzHeap * heap)
+{
+  void * data;
+
+  if (heap == NULL || heap->nr_elements == 0) return NULL;
+
+  data = heap->data[0].p;
+
+  heap->nr_elements--;
+  if (heap->nr_elements > 0) {
+    heap->data[0] = heap->data[heap->nr_elements];
+    oggz_heap_sift_down (heap, 0);
+  } else {
+    heap->next_seq = 0;
+  }
+
+  return data;
+}
+
+int
+oggz_heap_foreach1 (OggzHeap * heap, OggzFunc1 func, void * arg)
+{
+  int i;
+
+  for (i = 0; i < heap->nr_elements; i++) {
+    func (heap->data[i].p, arg);
+  }
+
+  return 0;
+}
+
+int
+oggz_heap_set_cmp (OggzHeap * heap, OggzCmpFunc compare, void * user_data)
+{
+  int i;
+
+  heap->compare = compare;
+  heap->compare_user_data = user_data;
+
+  for (i = heap->nr_elements / 2 - 1; i >= 0; i--) {
+    oggz_heap_sift_down (heap, i);
+  }
+
+  return 0;
+}
@@ -0,0 +1,84 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef __OGGZ_HEAP_H__
+#define __OGGZ_HEAP_H__
+
+#include "oggz_vector.h"
+
+/*
+ * A priority queue of void * elements, used to implement the writer's
+ * packet queue. Elements are popped in the order given by the comparison
+ * function, and in insertion order where it finds them equal; with no
+ * comparison function the heap behaves as a FIFO queue.
+ */
+
+struct _OggzHeap;
+typedef struct _OggzHeap OggzHeap;
+
+OggzHeap *
+oggz_heap_new (void);
+
+void
+oggz_heap_delete (OggzHeap * heap);
+
+int
+oggz_heap_size (OggzHeap * heap);
+
+/**
+ * Add an element to the heap.
+ * \retval data on success
+ * \retval NULL out of memory
+ */
+void *
+oggz_heap_insert (OggzHeap * heap, void * data);
+
+/**
+ * Remove and return the first element of the heap.
+ * \retval NULL the heap is empty
+ */
+void *
+oggz_heap_pop (OggzHeap * heap);
+
+/**
+ * Call a function on each element, in no particular order.
+ */
+int
+oggz_heap_foreach1 (OggzHeap * heap, OggzFunc1 func, void * arg);
+
+/**
+ * Set the comparison function used to order elements, or NULL to order
+ * them only by insertion.
+ */
+int
+oggz_heap_set_cmp (OggzHeap * heap, OggzCmpFunc compare, void * user_data);
+
+#endif /* __OGGZ_HEAP_H__ */
@@ -0,0 +1,564 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "oggz_compat.h"
+#include "oggz_private.h"
+
+struct _OggzIndex {
+  int max_entries;
+  int nr_entries;
+  oggz_index_entry_t * entries;
+
+  /* offset of the last entry inserted since the last break, or -1 */
+  oggz_off_t run_offset;
+};
+
+OggzIndex *
+oggz_index_new (void)
+{
+  OggzIndex * index;
+
+  index = oggz_malloc (sizeof (OggzIndex));
+  if (index == NULL) return NULL;
+
+  index->max_entries = 0;
+  index->nr_entries = 0;
+  index->entries = NULL;
+  index->run_offset = -1;
+
+  return index;
+}
+
+void
+oggz_index_delete (OggzIndex * index)
+{
+  if (index == NULL) return;
+
+  if (index->entries) oggz_free (index->entries);
+  oggz_free (index);
+}
+
+/*
+ * Find the position of the first entry with offset >= the given offset
+ */
+static int
+oggz_index_search (OggzIndex * index, oggz_off_t offset)
+{
+  int lo = 0, hi = index->nr_entries, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (index->entries[mid].offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+oggz_index_entry_t *
+oggz_index_insert (OggzIndex * index, oggz_off_t offset, long bytes,
+                   long serialno, ogg_int64_t granulepos, ogg_int64_t unit)
+{
+  oggz_index_entry_t * entry, * new_entries;
+  int i, new_max;
+
+  if (index == NULL) return NULL;
+
+  /* Pages are usually seen in file order, so check the tail first */
+  if (index->nr_entries == 0 ||
+      index->entries[index->nr_entries-1].offset < offset) {
+    i = index->nr_entries;
+  } else {
+    i = oggz_index_search (index, offset);
+  }
+
+  if (i < index->nr_entries && index->entries[i].offset == offset) {
+    /* Already indexed; keep any unit calculated earlier */
+    entry = &index->entries[i];
+    if (unit == -1) unit = entry->unit;
+  } else {
+    if (index->nr_entries == index->max_entries) {
+      new_max = index->max_entries == 0 ? 64 : index->max_entries * 2;
+      new_entries = oggz_realloc (index->entries,
+                                  (size_t)new_max * sizeof (oggz_index_entry_t));
+      if (new_entries == NULL) return NULL;
+
+      index->entries = new_entries;
+      index->max_entries = new_max;
+    }
+
+    entry = &index->entries[i];
+    if (i < index->nr_entries) {
+      memmove (entry + 1, entry,
+               (size_t)(index->nr_entries - i) * sizeof (oggz_index_entry_t));
+    }
+    index->nr_entries++;
+
+    entry->linked = 0;
+  }
+
+  entry->offset = offset;
+  entry->bytes = bytes;
+  entry->serialno = serialno;
+  entry->granulepos = granulepos;
+  entry->unit = unit;
+
+  if (index->run_offset != -1 && i > 0 &&
+      index->entries[i-1].offset == index->run_offset) {
+    index->entries[i-1].linked = 1;
+  }
+
+  index->run_offset = offset;
+
+  return entry;
+}
+
+void
+oggz_index_break (OggzIndex * index)
+{
+  if (index == NULL) return;
+
+  index->run_offset = -1;
+}
+
+int
+oggz_index_size (OggzIndex * index)
+{
+  if (index == NULL) return 0;
+
+  return index->nr_entries;
+}
+
+oggz_index_entry_t *
+oggz_index_nth (OggzIndex * index, int n)
+{
+  if (index == NULL) return NULL;
+
+  if (n < 0 || n >= index->nr_entries) return NULL;
+
+  return &index->entries[n];
+}
+
+#if OGGZ_CONFIG_READ
+
+/*
+ * Index files
+ *
+ * All fixed size integers are little-endian:
+ *
+ *   7 bytes    "OggzIdx"
+ *   1 byte     version (OGGZ_INDEX_VERSION)
+ *   8 bytes    size of the indexed file
+ *   8 bytes    modification time of the indexed file, or 0 if unknown
+ *   4 bytes    number of streams, followed by the serialno of each (4 bytes)
+ *   4 bytes    number of entries, followed by the entries
+ *
+ * Each entry is a sequence of unsigned LEB128 varints:
+ *
+ *   offset - offset of previous entry
+ *   page length
+ *   stream number << 1 | linked
+ *   zigzag (granulepos - granulepos of previous entry in the same stream)
+ */
+
+#define OGGZ_INDEX_MAGIC "OggzIdx"
+#define OGGZ_INDEX_VERSION 1
+
+#define OGGZ_INDEX_HEADER_LEN 28
+
+/* Longest encoding of one entry: four 64 bit varints */
+#define OGGZ_INDEX_ENTRY_MAX 40
+
+static int
+oggz_index_stat (OGGZ * oggz, ogg_int64_t * size, ogg_int64_t * mtime)
+{
+  struct stat statbuf;
+  oggz_off_t offset_end;
+
+  if (oggz->file != NULL) {
+    if (fstat (fileno (oggz->file), &statbuf) == -1)
+      return OGGZ_ERR_SYSTEM;
+
+    if (!oggz_stat_regular (statbuf.st_mode))
+      return OGGZ_ERR_NOSEEK;
+
+    *size = statbuf.st_size;
+    *mtime = statbuf.st_mtime;
+  } else {
+    /* No file to stat; use the size reported by the io seek method */
+    if ((offset_end = oggz_offset_end (oggz)) == -1)
+      return OGGZ_ERR_NOSEEK;
+
+    *size = offset_end;
+    *mtime = 0;
+  }
+
+  return 0;
+}
+
+static unsigned char *
+writeint (unsigned char * buf, ogg_uint64_t val, int len)
+{
+  int i;
+
+  for (i = 0; i < len; i++) {
+    buf[i] = (unsigned char)(val & 0xff);
+    val >>= 8;
+  }
+
+  return buf + len;
+}
+
+static ogg_uint64_t
+readint (const unsigned char * buf, int len)
+{
+  ogg_uint64_t val = 0;
+  int i;
+
+  for (i = len-1; i >= 0; i--)
+    val = (val << 8) | buf[i];
+
+  return val;
+}
+
+static unsigned char *
+writevarint (unsigned char * buf, ogg_uint64_t val)
+{
+  while (val >= 0x80) {
+    *buf++ = (unsigned char)(val | 0x80);
+    val >>= 7;
+  }
+  *buf++ = (unsigned char)val;
+
+  return buf;
+}
+
+static const unsigned char *
+readvarint (const unsigned char * buf, const unsigned char * end,
+            ogg_uint64_t * val)
+{
+  int shift = 0;
+
+  *val = 0;
+
+  while (buf < end && shift < 64) {
+    *val |= (ogg_uint64_t)(*buf & 0x7f) << shift;
+    if ((*buf++ & 0x80) == 0) return buf;
+    shift += 7;
+  }
+
+  return NULL;
+}
+
+#define ZIGZAG(v) (((ogg_uint64_t)(v) << 1) ^ (ogg_uint64_t)((v) >> 63))
+#define UNZIGZAG(u) ((ogg_int64_t)((u) >> 1) ^ -(ogg_int64_t)((u) & 1))
+
+int
+oggz_index_save (OGGZ * oggz, const char * filename)
+{
+  OggzIndex * index;
+  oggz_index_entry_t * entry;
+  ogg_int64_t size, mtime;
+  ogg_int64_t * last_granulepos = NULL;
+  long * serialnos = NULL;
+  int nr_streams = 0, i, j;
+  oggz_off_t last_offset = 0;
+  unsigned char * buf, * p;
+  size_t len;
+  FILE * f;
+  int ret = 0;
+
+  if (oggz == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+  if (oggz->flags & OGGZ_WRITE) return OGGZ_ERR_INVALID;
+
+  index = oggz->x.reader.index;
+  if (index == NULL) return OGGZ_ERR_INVALID;
+
+  if ((ret = oggz_index_stat (oggz, &size, &mtime)) != 0) return ret;
+
+  len = OGGZ_INDEX_HEADER_LEN + (size_t)index->nr_entries *
+    (OGGZ_INDEX_ENTRY_MAX + 4);
+
+  buf = oggz_malloc (len);
+  serialnos = oggz_malloc (((size_t)index->nr_entries + 1) * sizeof (long));
+  last_granulepos =
+    oggz_malloc (((size_t)index->nr_entries + 1) * sizeof (ogg_int64_t));
+  if (buf == NULL || serialnos == NULL || last_granulepos == NULL) {
+    ret = OGGZ_ERR_OUT_OF_MEMORY;
+    goto out;
+  }
+
+  /* Collect the streams */
+  for (i = 0; i < index->nr_entries; i++) {
+    for (j = 0; j < nr_streams; j++)
+      if (serialnos[j] == index->entries[i].serialno) break;
+    if (j == nr_streams) {
+      serialnos[nr_streams] = index->entries[i].serialno;
+      last_granulepos[nr_streams] = 0;
+      nr_streams++;
+    }
+  }
+
+  memcpy (buf, OGGZ_INDEX_MAGIC, 7);
+  buf[7] = OGGZ_INDEX_VERSION;
+  p = writeint (&buf[8], size, 8);
+  p = writeint (p, mtime, 8);
+  p = writeint (p, nr_streams, 4);
+  for (j = 0; j < nr_streams; j++)
+    p = writeint (p, (ogg_uint32_t)serialnos[j], 4);
+  p = writeint (p, index->nr_entries, 4);
+
+  for (i = 0; i < index->nr_entries; i++) {
+    entry = &index->entries[i];
+
+    for (j = 0; serialnos[j] != entry->serialno; j++);
+
+    p = writevarint (p, entry->offset - last_offset);
+    p = writevarint (p, entry->bytes);
+    p = writevarint (p, ((ogg_uint64_t)j << 1) | (entry->linked ? 1 : 0));
+    p = writevarint (p, ZIGZAG (entry->granulepos - last_granulepos[j]));
+
+    last_offset = entry->offset;
+    last_granulepos[j] = entry->granulepos;
+  }
+
+  if ((f = fopen (filename, "wb")) == NULL) {
+    ret = OGGZ_ERR_SYSTEM;
+    goto out;
+  }
+
+  if (fwrite (buf, 1, p - buf, f) != (size_t)(p - buf))
+    ret = OGGZ_ERR_SYSTEM;
+
+  if (fclose (f) == EOF)
+    ret = OGGZ_ERR_SYSTEM;
+
+out:
+  if (buf) oggz_free (buf);
+  if (serialnos) oggz_free (serialnos);
+  if (last_granulepos) oggz_free (last_granulepos);
+
+  return ret;
+}
+
+static int
+oggz_index_decode (OggzIndex * index, const unsigned char * buf, size_t len,
+                   ogg_int64_t size)
+{
+  const unsigned char * p, * end = buf + len;
+  ogg_int64_t * last_granulepos = NULL;
+  long * serialnos = NULL;
+  oggz_index_entry_t * entry;
+  ogg_uint64_t offset_delta, bytes, stream, granule_delta;
+  oggz_off_t offset = 0;
+  long nr_streams, nr_entries, i;
+  int ret = OGGZ_ERR_BAD_INDEX;
+
+  p = buf + OGGZ_INDEX_HEADER_LEN - 4;
+  nr_streams = (long)readint (p, 4);
+  p += 4;
+
+  if (nr_streams < 0 || (size_t)(end - p) / 4 < (size_t)nr_streams + 1)
+    return OGGZ_ERR_BAD_INDEX;
+
+  serialnos = oggz_malloc (((size_t)nr_streams + 1) * sizeof (long));
+  last_granulepos =
+    oggz_malloc (((size_t)nr_streams + 1) * sizeof (ogg_int64_t));
+  if (serialnos == NULL || last_granulepos == NULL) {
+    ret = OGGZ_ERR_OUT_OF_MEMORY;
+    goto out;
+  }
+
+  for (i = 0; i < nr_streams; i++) {
+    serialnos[i] = (long)(ogg_int32_t)readint (p, 4);
+    last_granulepos[i] = 0;
+    p += 4;
+  }
+
+  nr_entries = (long)readint (p, 4);
+  p += 4;
+
+  for (i = 0; i < nr_entries; i++) {
+    if ((p = readvarint (p, end, &offset_delta)) == NULL ||
+        (p = readvarint (p, end, &bytes)) == NULL ||
+        (p = readvarint (p, end, &stream)) == NULL ||
+        (p = readvarint (p, end, &granule_delta)) == NULL)
+      goto out;
+
+    if ((i > 0 && offset_delta == 0) || (long)(stream >> 1) >= nr_streams)
+      goto out;
+
+    offset += offset_delta;
+    if (offset < 0 || offset + (ogg_int64_t)bytes > size)
+      goto out;
+
+    last_granulepos[stream >> 1] += UNZIGZAG (granule_delta);
+
+    entry = oggz_index_insert (index, offset, (long)bytes,
+                               serialnos[stream >> 1],
+                               last_granulepos[stream >> 1], -1);
+    if (entry == NULL) {
+      ret = OGGZ_ERR_OUT_OF_MEMORY;
+      goto out;
+    }
+    entry->linked = stream & 1;
+    oggz_index_break (index);
+  }
+
+  ret = (p == end) ? 0 : OGGZ_ERR_BAD_INDEX;
+
+out:
+  if (serialnos) oggz_free (serialnos);
+  if (last_granulepos) oggz_free (last_granulepos);
+
+  return ret;
+}
+
+int
+oggz_index_load (OGGZ * oggz, const char * filename)
+{
+  OggzReader * reader;
+  OggzIndex * loaded;
+  oggz_index_entry_t * entry, * merged;
+  ogg_int64_t size, mtime;
+  oggz_off_t run_offset;
+  unsigned char * buf = NULL;
+  long len;
+  FILE * f;
+  int i, ret;
+
+  if (oggz == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+  if (oggz->flags & OGGZ_WRITE) return OGGZ_ERR_INVALID;
+
+  reader = &oggz->x.reader;
+
+  if ((ret = oggz_index_stat (oggz, &size, &mtime)) != 0) return ret;
+
+  if ((f = fopen (filename, "rb")) == NULL) return OGGZ_ERR_SYSTEM;
+
+  if (fseek (f, 0, SEEK_END) == -1 || (len = ftell (f)) == -1 ||
+      fseek (f, 0, SEEK_SET) == -1) {
+    fclose (f);
+    return OGGZ_ERR_SYSTEM;
+  }
+
+  if (len < OGGZ_INDEX_HEADER_LEN) {
+    fclose (f);
+    return OGGZ_ERR_BAD_INDEX;
+  }
+
+  if ((buf = oggz_malloc (len)) == NULL) {
+    fclose (f);
+    return OGGZ_ERR_OUT_OF_MEMORY;
+  }
+
+  if (fread (buf, 1, len, f) != (size_t)len) {
+    fclose (f);
+    oggz_free (buf);
+    return OGGZ_ERR_SYSTEM;
+  }
+  fclose (f);
+
+  /* Ignore indexes of other versions, or of a different file */
+  if (memcmp (buf, OGGZ_INDEX_MAGIC, 7) || buf[7] != OGGZ_INDEX_VERSION ||
+      (ogg_int64_t)readint (&buf[8], 8) != size ||
+      (ogg_int64_t)readint (&buf[16], 8) != mtime) {
+    oggz_free (buf);
+    return OGGZ_ERR_BAD_INDEX;
+  }
+
+  if ((loaded = oggz_index_new ()) == NULL) {
+    oggz_free (buf);
+    return OGGZ_ERR_OUT_OF_MEMORY;
+  }
+
+  ret = oggz_index_decode (loaded, buf, (size_t)len, size);
+  oggz_free (buf);
+
+  if (ret != 0) {
+    oggz_index_delete (loaded);
+    return ret;
+  }
+
+  if (oggz_index_size (reader->index) == 0) {
+    oggz_index_delete (reader->index);
+    reader->index = loaded;
+    return 0;
+  }
+
+  /* Merge with the pages already indexed, keeping the current run */
+  run_offset = reader->index->run_offset;
+  for (i = 0; i < loaded->nr_entries; i++) {
+    entry = &loaded->entries[i];
+    oggz_index_break (reader->index);
+    merged = oggz_index_insert (reader->index, entry->offset, entry->bytes,
+                                entry->serialno, entry->granulepos, -1);
+    if (merged == NULL) {
+      ret = OGGZ_ERR_OUT_OF_MEMORY;
+      break;
+    }
+    if (entry->linked) merged->linked = 1;
+  }
+  reader->index->run_offset = run_offset;
+
+  oggz_index_delete (loaded);
+
+  return ret;
+}
+
+#else /* OGGZ_CONFIG_READ */
+
+int
+oggz_index_save (OGGZ * oggz, const char * filename)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
+int
+oggz_index_load (OGGZ * oggz, const char * filename)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
+#endif
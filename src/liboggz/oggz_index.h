@@ -0,0 +1,98 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __OGGZ_INDEX_H__
+#define __OGGZ_INDEX_H__
+
+#include <ogg/ogg.h>
+#include <oggz/oggz_off_t.h>
+
+/*
+ * An in-memory index of the pages which carry a granulepos, kept sorted
+ * by byte offset. Entries are filled in by the reader as it passes over
+ * pages, and used by the seek code to avoid bisecting over regions of the
+ * file which have already been seen.
+ */
+
+typedef struct _OggzIndex OggzIndex;
+
+typedef struct {
+  oggz_off_t offset; /* offset of page start */
+  long bytes; /* length of page */
+  long serialno;
+  ogg_int64_t granulepos;
+  ogg_int64_t unit; /* -1 if no unit was known when indexed */
+
+  /* The next entry was reached by reading forward from this one, ie.
+   * no page carrying a granulepos lies between them */
+  int linked;
+} oggz_index_entry_t;
+
+/**
+ * Create a new index object.
+ * \retval a pointer to the new index.
+ * \retval NULL on failure.
+ */
+OggzIndex *
+oggz_index_new (void);
+
+/**
+ * Destroy an index object.
+ */
+void
+oggz_index_delete (OggzIndex * index);
+
+/**
+ * Record a page in the index. If the previously recorded page was
+ * reached without an intervening oggz_index_break(), it is linked to
+ * this one.
+ * \retval the entry for this page
+ * \retval NULL on failure (out of memory)
+ */
+oggz_index_entry_t *
+oggz_index_insert (OggzIndex * index, oggz_off_t offset, long bytes,
+                   long serialno, ogg_int64_t granulepos, ogg_int64_t unit);
+
+/**
+ * Mark a discontinuity in reading, eg. after seeking. The next page
+ * inserted will not be linked to the last.
+ */
+void
+oggz_index_break (OggzIndex * index);
+
+int
+oggz_index_size (OggzIndex * index);
+
+oggz_index_entry_t *
+oggz_index_nth (OggzIndex * index, int n);
+
+#endif /* __OGGZ_INDEX_H__ */
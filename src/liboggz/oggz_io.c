@@ -58,9 +58,24 @@ size_t
 oggz_io_read (OGGZ * oggz, void * buf, size_t n)
 {
   OggzIO * io;
+  OggzMmap * map;
   size_t bytes;
+  long ret;
 
-  if (oggz->file != NULL) {
+  if ((map = oggz->map) != NULL) {
+    bytes = (size_t) MIN ((oggz_off_t)n, map->size - map->avail);
+    memcpy (buf, map->data + map->avail, bytes);
+    map->avail += bytes;
+    map->pos = map->avail;
+  }
+
+  else if (oggz->readahead != NULL) {
+    if ((ret = oggz_readahead_read (oggz->readahead, buf, n)) == -1)
+      return (size_t) OGGZ_ERR_SYSTEM;
+    bytes = (size_t) ret;
+  }
+
+  else if (oggz->file != NULL) {
     if ((bytes = read (fileno(oggz->file), buf, n)) == 0) {
       if (ferror (oggz->file)) {
         return (size_t) OGGZ_ERR_SYSTEM;
@@ -104,9 +119,31 @@ int
 oggz_io_seek (OGGZ * oggz, long offset, int whence)
 {
   OggzIO * io;
+  OggzMmap * map;
+
+  if ((map = oggz->map) != NULL) {
+    switch (whence) {
+    case SEEK_SET: break;
+    case SEEK_CUR: offset += (long)map->avail; break;
+    case SEEK_END: offset += (long)map->size; break;
+    default: return OGGZ_ERR_INVALID;
+    }
+    if (offset < 0) return OGGZ_ERR_SYSTEM;
+    map->avail = map->pos = MIN ((oggz_off_t)offset, map->size);
+  }
 
-  if (oggz->file != NULL) {
-    if (fseek (oggz->file, offset, whence) == -1) {
+  else if (oggz->readahead != NULL) {
+    if (oggz_readahead_seek (oggz->readahead, offset, whence) == -1)
+      return OGGZ_ERR_SYSTEM;
+  }
+
+  else if (oggz->file != NULL) {
+    /* Reads bypass stdio buffering (see oggz_io_read() above), so move
+     * the descriptor itself; stdio's idea of the offset may be stale */
+    if (!(oggz->flags & OGGZ_WRITE)) {
+      if (lseek (fileno (oggz->file), offset, whence) == -1)
+        return OGGZ_ERR_SYSTEM;
+    } else if (fseek (oggz->file, offset, whence) == -1) {
       if (errno == ESPIPE) {
 	/*oggz_set_error (oggz, OGGZ_ERR_NOSEEK);*/
       } else {
@@ -133,8 +170,21 @@ oggz_io_tell (OGGZ * oggz)
   OggzIO * io;
   long offset;
 
-  if (oggz->file != NULL) {
-    if ((offset = ftell (oggz->file)) == -1) {
+  if (oggz->map != NULL) {
+    offset = (long)oggz->map->avail;
+  }
+
+  else if (oggz->readahead != NULL) {
+    offset = (long)oggz_readahead_tell (oggz->readahead);
+  }
+
+  else if (oggz->file != NULL) {
+    if (!(oggz->flags & OGGZ_WRITE)) {
+      offset = (long) lseek (fileno (oggz->file), 0, SEEK_CUR);
+    } else {
+      offset = ftell (oggz->file);
+    }
+    if (offset == -1) {
       if (errno == ESPIPE) {
 	/*oggz_set_error (oggz, OGGZ_ERR_NOSEEK);*/
       } else {
@@ -0,0 +1,185 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include "oggz_compat.h"
+#include "oggz_private.h"
+
+/*#define DEBUG*/
+
+/* The longest possible page header: 27 bytes and 255 lacing values */
+#define MAX_HEADER_LEN 282
+
+/*
+ * Check the CRC of a page without modifying it. libogg computes the CRC
+ * by zeroing its field in the header, so work on a copy of the header.
+ */
+static int
+page_crc_ok (unsigned char * page, long header_len, long body_len)
+{
+  unsigned char header[MAX_HEADER_LEN];
+  ogg_page og;
+
+  memcpy (header, page, header_len);
+
+  og.header = header;
+  og.header_len = header_len;
+  og.body = page + header_len;
+  og.body_len = body_len;
+
+  ogg_page_checksum_set (&og);
+
+  return (memcmp (header + 22, page + 22, 4) == 0);
+}
+
+#ifdef HAVE_SYS_MMAN_H
+
+OggzMmap *
+oggz_mmap_new (FILE * file)
+{
+  OggzMmap * map;
+  struct stat statbuf;
+  long offset;
+  void * data;
+  int fd;
+
+  if ((fd = fileno (file)) == -1) return NULL;
+  if (fstat (fd, &statbuf) == -1) return NULL;
+  if (!oggz_stat_regular (statbuf.st_mode) || statbuf.st_size <= 0)
+    return NULL;
+  if ((oggz_off_t)(size_t)statbuf.st_size != statbuf.st_size)
+    return NULL;
+
+  if ((offset = ftell (file)) == -1) return NULL;
+
+  /* Private and writable so that callers which patch a page in place,
+   * eg. to set its EOS flag, never modify the file */
+  data = mmap (NULL, (size_t)statbuf.st_size, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) return NULL;
+
+  map = oggz_malloc (sizeof (OggzMmap));
+  if (map == NULL) {
+    munmap (data, (size_t)statbuf.st_size);
+    return NULL;
+  }
+
+#ifdef MADV_SEQUENTIAL
+  madvise (data, (size_t)statbuf.st_size, MADV_SEQUENTIAL);
+#endif
+
+  map->data = data;
+  map->size = statbuf.st_size;
+  map->pos = map->avail = MIN (offset, map->size);
+
+#ifdef DEBUG
+  printf ("oggz_mmap_new: mapped %" PRI_OGGZ_OFF_T "d bytes\n", map->size);
+#endif
+
+  return map;
+}
+
+void
+oggz_mmap_delete (OggzMmap * map)
+{
+  if (map == NULL) return;
+
+  munmap (map->data, (size_t)map->size);
+  oggz_free (map);
+}
+
+#else /* HAVE_SYS_MMAN_H */
+
+OggzMmap *
+oggz_mmap_new (FILE * file)
+{
+  return NULL;
+}
+
+void
+oggz_mmap_delete (OggzMmap * map)
+{
+}
+
+#endif /* HAVE_SYS_MMAN_H */
+
+long
+oggz_mmap_pageseek (OggzMmap * map, ogg_page * og)
+{
+  unsigned char * page = map->data + map->pos, * next;
+  oggz_off_t bytes = map->avail - map->pos;
+  long header_len, body_len = 0;
+  int i;
+
+  if (bytes < 27) return 0;
+
+  if (memcmp (page, "OggS", 4) != 0) goto sync_fail;
+
+  header_len = page[26] + 27;
+  if (bytes < header_len) return 0;
+
+  for (i = 0; i < page[26]; i++)
+    body_len += page[27 + i];
+
+  if (bytes < header_len + body_len) return 0;
+
+  if (!page_crc_ok (page, header_len, body_len)) goto sync_fail;
+
+  og->header = page;
+  og->header_len = header_len;
+  og->body = page + header_len;
+  og->body_len = body_len;
+
+  map->pos += header_len + body_len;
+
+  return header_len + body_len;
+
+ sync_fail:
+  /* Skip to the next possible capture pattern */
+  next = memchr (page + 1, 'O', (size_t)(bytes - 1));
+  if (next == NULL) next = map->data + map->avail;
+
+  map->pos = next - map->data;
+
+  return -(long)(next - page);
+}
@@ -0,0 +1,81 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __OGGZ_MMAP_H__
+#define __OGGZ_MMAP_H__
+
+#include <stdio.h>
+#include <ogg/ogg.h>
+#include <oggz/oggz_off_t.h>
+
+/*
+ * A read-only file mapping for OGGZ_MMAP. Pages are parsed in place, so
+ * the ogg_page header and body returned point into the mapping.
+ */
+
+typedef struct {
+  unsigned char * data;
+  oggz_off_t size;
+
+  /* Next byte to be parsed */
+  oggz_off_t pos;
+
+  /* End of the bytes made available to the parser by oggz_read(); this
+   * is also the position that oggz_io_read(), _seek() and _tell() use */
+  oggz_off_t avail;
+} OggzMmap;
+
+/**
+ * Map a file for reading, starting at its current position.
+ * \retval a pointer to the new mapping.
+ * \retval NULL if the file cannot be mapped, eg. if it is not a regular
+ * file, or mmap() is not supported.
+ */
+OggzMmap *
+oggz_mmap_new (FILE * file);
+
+/**
+ * Unmap a file.
+ */
+void
+oggz_mmap_delete (OggzMmap * map);
+
+/**
+ * Find the next page in the available bytes, as ogg_sync_pageseek().
+ * \retval n > 0 the page was found, and is n bytes long
+ * \retval 0 more bytes must be made available
+ * \retval n < 0 n bytes were skipped to resynchronize
+ */
+long
+oggz_mmap_pageseek (OggzMmap * map, ogg_page * og);
+
+#endif /* __OGGZ_MMAP_H__ */
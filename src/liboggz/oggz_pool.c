@@ -0,0 +1,301 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ogg/ogg.h>
+
+#include "oggz_macros.h"
+#include "oggz_pool.h"
+
+/*#define DEBUG*/
+
+#define OGGZ_POOL_SLAB_ENTRIES 64
+
+#define OGGZ_POOL_RING_SIZE (64*1024)
+#define OGGZ_POOL_RING_MAX (4*1024*1024)
+
+typedef union {
+  void * p;
+  long l;
+  ogg_int64_t i;
+  double d;
+} oggz_pool_align;
+
+#define ALIGN_UP(n) \
+  (((n) + sizeof (oggz_pool_align) - 1) / sizeof (oggz_pool_align) * \
+   sizeof (oggz_pool_align))
+
+/* Header preceding each payload; live is 1 for a ring block in use,
+ * 0 for a ring block awaiting reclamation and -1 for a payload from
+ * oggz_malloc() */
+typedef struct {
+  long size; /* including this header */
+  long bytes; /* as requested */
+  long live;
+} oggz_pool_block;
+
+#define BLOCK_HEADER ALIGN_UP (sizeof (oggz_pool_block))
+
+static void
+oggz_pool_grew (OggzPool * pool, long n)
+{
+  pool->system_allocations++;
+  pool->pool_bytes += n;
+  if (pool->pool_bytes > pool->pool_bytes_peak)
+    pool->pool_bytes_peak = pool->pool_bytes;
+}
+
+void
+oggz_pool_init (OggzPool * pool, size_t entry_size)
+{
+  /* Free entries are linked through their first word */
+  if (entry_size < sizeof (void *)) entry_size = sizeof (void *);
+  pool->entry_size = ALIGN_UP (entry_size);
+  pool->free_entries = NULL;
+  pool->slabs = NULL;
+
+  pool->ring = NULL;
+  pool->ring_size = 0;
+  pool->ring_head = 0;
+  pool->ring_tail = 0;
+  pool->ring_end = 0;
+  pool->ring_blocks = 0;
+  pool->ring_overflow = 0;
+
+  pool->allocations = 0;
+  pool->system_allocations = 0;
+  pool->bytes_queued = 0;
+  pool->bytes_queued_peak = 0;
+  pool->pool_bytes = 0;
+  pool->pool_bytes_peak = 0;
+}
+
+void
+oggz_pool_clear (OggzPool * pool)
+{
+  void * slab;
+
+  while ((slab = pool->slabs) != NULL) {
+    pool->slabs = *(void **)slab;
+    oggz_free (slab);
+  }
+  pool->free_entries = NULL;
+
+  if (pool->ring != NULL) oggz_free (pool->ring);
+  pool->ring = NULL;
+  pool->ring_size = 0;
+  pool->ring_blocks = 0;
+
+  pool->pool_bytes = 0;
+}
+
+void *
+oggz_pool_entry_new (OggzPool * pool)
+{
+  unsigned char * slab;
+  void * entry;
+  long n;
+  int i;
+
+  if (pool->free_entries == NULL) {
+    n = ALIGN_UP (sizeof (void *)) + OGGZ_POOL_SLAB_ENTRIES * pool->entry_size;
+    if ((slab = oggz_malloc (n)) == NULL) return NULL;
+    oggz_pool_grew (pool, n);
+
+    *(void **)slab = pool->slabs;
+    pool->slabs = slab;
+
+    slab += ALIGN_UP (sizeof (void *));
+    for (i = 0; i < OGGZ_POOL_SLAB_ENTRIES; i++) {
+      entry = slab + i * pool->entry_size;
+      *(void **)entry = pool->free_entries;
+      pool->free_entries = entry;
+    }
+  }
+
+  entry = pool->free_entries;
+  pool->free_entries = *(void **)entry;
+  pool->allocations++;
+
+  return entry;
+}
+
+void
+oggz_pool_entry_free (OggzPool * pool, void * entry)
+{
+  if (entry == NULL) return;
+
+  *(void **)entry = pool->free_entries;
+  pool->free_entries = entry;
+}
+
+/*
+ * Reallocate an empty ring, growing it if payloads have overflowed it
+ * or if the first payload is larger than it.
+ */
+static void
+oggz_pool_ring_resize (OggzPool * pool, long need)
+{
+  long size = pool->ring_size;
+
+  if (size == 0) size = OGGZ_POOL_RING_SIZE;
+  else if (pool->ring_overflow) size *= 2;
+
+  while (size < need) size *= 2;
+  if (size > OGGZ_POOL_RING_MAX) size = OGGZ_POOL_RING_MAX;
+
+  pool->ring_overflow = 0;
+
+  if (size == pool->ring_size) return;
+
+  if (pool->ring != NULL) {
+    oggz_free (pool->ring);
+    pool->pool_bytes -= pool->ring_size;
+    pool->ring = NULL;
+    pool->ring_size = 0;
+  }
+
+  if ((pool->ring = oggz_malloc (size)) == NULL) return;
+  oggz_pool_grew (pool, size);
+
+  pool->ring_size = size;
+
+#ifdef DEBUG
+  printf ("oggz_pool_ring_resize: %ld bytes\n", size);
+#endif
+}
+
+static oggz_pool_block *
+oggz_pool_ring_alloc (OggzPool * pool, long need)
+{
+  long pos;
+
+  if (pool->ring_blocks == 0) {
+    if (pool->ring == NULL || pool->ring_overflow || need > pool->ring_size)
+      oggz_pool_ring_resize (pool, need);
+    pool->ring_head = pool->ring_tail = 0;
+    pool->ring_end = pool->ring_size;
+  }
+
+  if (pool->ring == NULL) return NULL;
+
+  /* Keep head from catching up with tail, so that head == tail
+   * only ever means the ring is empty */
+  if (pool->ring_head >= pool->ring_tail) {
+    if (pool->ring_size - pool->ring_head >= need) {
+      pos = pool->ring_head;
+    } else if (pool->ring_tail > need) {
+      pool->ring_end = pool->ring_head;
+      pos = 0;
+    } else {
+      return NULL;
+    }
+  } else if (pool->ring_tail - pool->ring_head > need) {
+    pos = pool->ring_head;
+  } else {
+    return NULL;
+  }
+
+  pool->ring_head = pos + need;
+  pool->ring_blocks++;
+
+  return (oggz_pool_block *)(pool->ring + pos);
+}
+
+static void
+oggz_pool_ring_reclaim (OggzPool * pool)
+{
+  oggz_pool_block * block;
+
+  while (pool->ring_blocks > 0) {
+    block = (oggz_pool_block *)(pool->ring + pool->ring_tail);
+    if (block->live) break;
+
+    pool->ring_tail += block->size;
+    pool->ring_blocks--;
+
+    if (pool->ring_tail == pool->ring_end && pool->ring_blocks > 0) {
+      pool->ring_tail = 0;
+      pool->ring_end = pool->ring_size;
+    }
+  }
+}
+
+void *
+oggz_pool_bytes_new (OggzPool * pool, long n)
+{
+  oggz_pool_block * block;
+  long need;
+
+  need = BLOCK_HEADER + ALIGN_UP (n);
+
+  if ((block = oggz_pool_ring_alloc (pool, need)) != NULL) {
+    block->live = 1;
+  } else {
+    pool->ring_overflow = 1;
+    if ((block = oggz_malloc (need)) == NULL) return NULL;
+    oggz_pool_grew (pool, need);
+    block->live = -1;
+  }
+
+  block->size = need;
+  block->bytes = n;
+
+  pool->allocations++;
+  pool->bytes_queued += n;
+  if (pool->bytes_queued > pool->bytes_queued_peak)
+    pool->bytes_queued_peak = pool->bytes_queued;
+
+  return (unsigned char *)block + BLOCK_HEADER;
+}
+
+void
+oggz_pool_bytes_free (OggzPool * pool, void * data)
+{
+  oggz_pool_block * block;
+
+  if (data == NULL) return;
+
+  block = (oggz_pool_block *)((unsigned char *)data - BLOCK_HEADER);
+  pool->bytes_queued -= block->bytes;
+
+  if (block->live == -1) {
+    pool->pool_bytes -= block->size;
+    oggz_free (block);
+  } else {
+    block->live = 0;
+    oggz_pool_ring_reclaim (pool);
+  }
+}
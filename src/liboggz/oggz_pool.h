@@ -0,0 +1,97 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef __OGGZ_POOL_H__
+#define __OGGZ_POOL_H__
+
+#include <stddef.h>
+
+/*
+ * Memory for the writer queue: a slab allocator of fixed size queue
+ * entries, and a ring of bytes for packet payloads. Payloads are mostly
+ * released in the order they were allocated, so the ring is reclaimed
+ * from its tail; payloads which do not fit fall back to oggz_malloc().
+ */
+
+typedef struct {
+  /* Queue entries */
+  size_t entry_size;
+  void * free_entries; /* linked through the first word of each entry */
+  void * slabs; /* linked through the first word of each slab */
+
+  /* Payload ring */
+  unsigned char * ring;
+  long ring_size;
+  long ring_head; /* next allocation */
+  long ring_tail; /* oldest allocated block */
+  long ring_end; /* end of data before wrapping to the start */
+  long ring_blocks; /* blocks between tail and head */
+  int ring_overflow; /* payloads fell back to oggz_malloc() */
+
+  /* Counters */
+  long allocations;
+  long system_allocations;
+  long bytes_queued;
+  long bytes_queued_peak;
+  long pool_bytes;
+  long pool_bytes_peak;
+} OggzPool;
+
+void
+oggz_pool_init (OggzPool * pool, size_t entry_size);
+
+/**
+ * Release all memory held by a pool.
+ */
+void
+oggz_pool_clear (OggzPool * pool);
+
+/**
+ * Allocate a queue entry of the pool's entry_size.
+ * \retval NULL Out of memory
+ */
+void *
+oggz_pool_entry_new (OggzPool * pool);
+
+void
+oggz_pool_entry_free (OggzPool * pool, void * entry);
+
+/**
+ * Allocate n bytes for a packet payload.
+ * \retval NULL Out of memory
+ */
+void *
+oggz_pool_bytes_new (OggzPool * pool, long n);
+
+void
+oggz_pool_bytes_free (OggzPool * pool, void * data);
+
+#endif /* __OGGZ_POOL_H__ */
@@ -41,10 +41,16 @@
 #include <oggz/oggz_off_t.h>
 
 #include "oggz/oggz_packet.h"
+#include "oggz/oggz_table.h"
 
 #include "oggz_macros.h"
 #include "oggz_vector.h"
 #include "oggz_dlist.h"
+#include "oggz_heap.h"
+#include "oggz_index.h"
+#include "oggz_mmap.h"
+#include "oggz_readahead.h"
+#include "oggz_pool.h"
 
 #define OGGZ_AUTO_MULT 1000Ull
 
@@ -57,6 +63,9 @@ typedef struct _OggzWriter OggzWriter;
 
 typedef int (*OggzReadPacket) (OGGZ * oggz, oggz_packet * op, long serialno,
 			       void * user_data);
+typedef int (*OggzReadPackets) (OGGZ * oggz, oggz_packet * packets,
+                                int nr_packets, long serialno,
+                                void * user_data);
 typedef int (*OggzReadPage) (OGGZ * oggz, const ogg_page * og, long serialno,
 			     void * user_data);
 
@@ -79,6 +88,31 @@ typedef int (*OggzIOSeek) (void * user_handle, long offset, int whence);
 typedef long (*OggzIOTell) (void * user_handle);
 typedef int (*OggzIOFlush) (void * user_handle);
 
+/* A page probed while seeking */
+typedef struct {
+  oggz_off_t offset;
+  long serialno;
+  ogg_int64_t granulepos;
+} oggz_seek_sample_t;
+
+#define OGGZ_SEEK_SAMPLES 32
+
+/* A comment within a decoded comment packet, which is only copied into an
+ * OggzComment when it is first asked for */
+typedef struct {
+  const char * name;
+  size_t name_len;
+  const char * value; /* NULL if the comment has no value */
+  size_t value_len;
+  OggzComment * comment;
+} oggz_comment_span_t;
+
+/* A keypoint from an Ogg Skeleton 4.0 index */
+typedef struct {
+  oggz_off_t offset;
+  ogg_int64_t unit;
+} oggz_keypoint_t;
+
 struct _oggz_stream_t {
   ogg_stream_state ogg_stream;
 
@@ -96,6 +130,26 @@ struct _oggz_stream_t {
   char * vendor;
   OggzVector * comments;
 
+  /* The comment packet as read, and the comments within it; the comments
+   * vector above is unused while comment_packet is set */
+  char * comment_packet;
+  oggz_comment_span_t * comment_spans;
+  int nr_comment_spans;
+
+  /* Keypoints from a Skeleton index, in increasing order, and the end
+   * time of the indexed stream, or -1 if the index does not give it */
+  oggz_keypoint_t * keypoints;
+  long nr_keypoints;
+  ogg_int64_t keypoints_end;
+
+  /* For a Skeleton 4.0 stream, the length in bytes of the segment its
+   * index was made for, or -1 if not known */
+  ogg_int64_t segment_length;
+
+  /* The vendor, comments and keypoints are borrowed from an OggzFileInfo,
+   * which is shared with other OGGZ handles, and must not be modified */
+  int shared;
+
   /** CURRENT STATE **/
   /* non b_o_s packet has been written (not just queued) */
   int delivered_non_b_o_s;
@@ -116,6 +170,10 @@ struct _oggz_stream_t {
   OggzReadPacket read_packet;
   void * read_user_data;
 
+  OggzReadPackets read_packets;
+  void * read_packets_user_data;
+  int read_packets_max;
+
   OggzReadPage read_page;
   void * read_page_user_data;
 
@@ -123,6 +181,7 @@ struct _oggz_stream_t {
   ogg_int64_t last_granulepos;
   ogg_int64_t page_granulepos;
   void * calculate_data;
+  size_t calculate_size;
   ogg_packet * last_packet;
 };
 
@@ -136,9 +195,20 @@ struct _OggzReader {
   OggzReadPacket read_packet;
   void * read_user_data;
 
+  OggzReadPackets read_packets;
+  void * read_packets_user_data;
+  int read_packets_max;
+
   OggzReadPage read_page;
   void * read_page_user_data;
 
+  /* Packets awaiting delivery to an OggzReadPackets callback, all
+   * belonging to batch_stream */
+  oggz_packet * batch;
+  int nr_batch;
+  oggz_stream_t * batch_stream;
+  long batch_serialno;
+
   ogg_int64_t current_unit;
   ogg_int64_t current_granulepos;
 
@@ -150,6 +220,38 @@ struct _OggzReader {
   int current_packet_pages;
   int current_packet_begin_segment_index;
 
+  /* Index of pages seen, if opened with OGGZ_INDEX */
+  OggzIndex * index;
+
+  /* File bounds found by seeking, kept until the file is seen to grow.
+   * bounds_end is -1 if the end offset is not known, and the serialnos
+   * are -1 if the first or last page is not known. */
+  oggz_off_t bounds_end;
+  long bounds_end_serialno;
+  ogg_int64_t bounds_end_granulepos;
+  oggz_off_t bounds_end_page;
+  oggz_off_t bounds_begin;
+  long bounds_begin_serialno;
+  ogg_int64_t bounds_begin_granulepos;
+
+  int seek_probes; /* Pages probed by the last oggz_seek_units() */
+
+  /* Pages probed by recent seeks, used to narrow later seeks */
+  oggz_seek_sample_t seek_samples[OGGZ_SEEK_SAMPLES];
+  int nr_seek_samples;
+  int seek_sample_next;
+
+  /* Page whose packets are being delivered in place, without copying
+   * through libogg; slice_stream is NULL when no page is being sliced */
+  ogg_page slice_page;
+  oggz_stream_t * slice_stream;
+  long slice_body; /* n bytes of page body already delivered */
+  int slice_segment; /* lacing index of the next packet */
+  int slice_packets; /* n packets already delivered */
+
+  /* Set while oggz_read_headers() is reading, to stop before content */
+  int headers_only;
+
 #if 0
   oggz_off_t offset_page_end; /* offset of end of current page */
 #endif
@@ -173,7 +275,7 @@ enum oggz_writer_state {
 
 struct _OggzWriter {
   oggz_writer_packet_t * next_zpacket; /* stashed in case of FLUSH_BEFORE */
-  OggzVector * packet_queue;
+  OggzHeap * packet_queue;
 
   OggzWriteHungry hungry;
   void * hungry_user_data;
@@ -200,6 +302,15 @@ struct _OggzWriter {
   int no_more_packets; /* used only in the local oggz_write loop to indicate
                           end of stream */
 
+  OggzPool pool; /* queue entries and copied packet data */
+
+  /* Completed pages gathered for a single write, for oggz_write_set_batch() */
+  unsigned char * batch;
+  long batch_bytes; /* size of batch, or 0 to write pages through */
+  long batch_fill;
+  ogg_int64_t batch_max_units;
+  ogg_int64_t batch_unit_begin; /* unit of the first timed page in batch */
+
 };
 
 struct _OggzIO {
@@ -231,6 +342,8 @@ struct _OGGZ {
   int flags;
   FILE * file;
   OggzIO * io;
+  OggzMmap * map; /* the mapped file, for OGGZ_MMAP */
+  OggzReadahead * readahead; /* the worker thread, for OGGZ_READAHEAD */
 
   ogg_packet current_packet;
   ogg_page current_page;
@@ -242,6 +355,7 @@ struct _OGGZ {
   int cb_next;
 
   OggzVector * streams;
+  OggzTable * stream_table; /* streams by serialno, for oggz_get_stream() */
   int all_at_eos; /* all streams are at eos */
 
   OggzMetric metric;
@@ -257,13 +371,23 @@ struct _OGGZ {
   } x;
 
   OggzDList * packet_buffer;
+
+  /* The OggzFileInfo that a cursor's streams borrow from, which it holds
+   * a reference to */
+  void * file_info;
 };
 
+/* oggz, declared for internal callers as oggz.h cannot be included */
+OGGZ * oggz_open (char * filename, int flags);
+OGGZ * oggz_open_stdio (FILE * file, int flags);
+int oggz_close (OGGZ * oggz);
+
 OGGZ * oggz_read_init (OGGZ * oggz);
 OGGZ * oggz_read_close (OGGZ * oggz);
 
 OGGZ * oggz_write_init (OGGZ * oggz);
 int oggz_write_flush (OGGZ * oggz);
+int oggz_write_batch_flush (OGGZ * oggz);
 OGGZ * oggz_write_close (OGGZ * oggz);
 
 int oggz_map_return_value_to_error (int cb_ret);
@@ -277,6 +401,11 @@ int oggz_has_metrics (OGGZ * oggz);
 
 int oggz_purge (OGGZ * oggz);
 
+int oggz_seek_find_end (OGGZ * oggz);
+
+/* oggz_file_info */
+void oggz_file_info_close (OGGZ * oggz);
+
 /* metric_internal */
 
 int
@@ -320,6 +449,9 @@ int oggz_comments_decode (OGGZ * oggz, long serialno,
                           unsigned char * comments, long length);
 long oggz_comments_encode (OGGZ * oggz, long serialno,
                            unsigned char * buf, long length);
+const char * oggz_comments_vendor (oggz_stream_t * stream);
+OggzVector * oggz_comments_dup (oggz_stream_t * stream);
+void oggz_comments_delete (OggzVector * comments);
 
 /* oggz_io */
 size_t oggz_io_read (OGGZ * oggz, void * buf, size_t n);
@@ -328,6 +460,9 @@ int oggz_io_seek (OGGZ * oggz, long offset, int whence);
 long oggz_io_tell (OGGZ * oggz);
 int oggz_io_flush (OGGZ * oggz);
 
+/* oggz_seek */
+oggz_off_t oggz_offset_end (OGGZ * oggz);
+
 /* oggz_read */
 OggzDListIterResponse oggz_read_free_pbuffers(void *elem);
 
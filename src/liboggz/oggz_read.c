@@ -72,6 +72,10 @@
 #define CHUNKSIZE 65536
 
 #define OGGZ_READ_EMPTY (-404)
+#define OGGZ_READ_HEADERS_DONE (-405)
+
+/* A page can complete at most 255 packets */
+#define OGGZ_READ_BATCH_MAX 255
 
 OGGZ *
 oggz_read_init (OGGZ * oggz)
@@ -85,6 +89,15 @@ oggz_read_init (OGGZ * oggz)
   reader->read_packet = NULL;
   reader->read_user_data = NULL;
 
+  reader->read_packets = NULL;
+  reader->read_packets_user_data = NULL;
+  reader->read_packets_max = 0;
+
+  reader->batch = NULL;
+  reader->nr_batch = 0;
+  reader->batch_stream = NULL;
+  reader->batch_serialno = -1;
+
   reader->read_page = NULL;
   reader->read_page_user_data = NULL;
 
@@ -95,6 +108,25 @@ oggz_read_init (OGGZ * oggz)
   reader->current_packet_begin_page_offset = 0;
   reader->current_packet_pages = 0;
 
+  reader->slice_stream = NULL;
+
+  reader->headers_only = 0;
+
+  reader->bounds_end = -1;
+  reader->bounds_end_serialno = -1;
+  reader->bounds_begin = -1;
+  reader->bounds_begin_serialno = -1;
+
+  reader->seek_probes = 0;
+  reader->nr_seek_samples = 0;
+  reader->seek_sample_next = 0;
+
+  reader->index = NULL;
+  if (oggz->flags & OGGZ_INDEX) {
+    if ((reader->index = oggz_index_new ()) == NULL)
+      return NULL;
+  }
+
   return oggz;
 }
 
@@ -106,6 +138,10 @@ oggz_read_close (OGGZ * oggz)
   ogg_stream_clear (&reader->ogg_stream);
   ogg_sync_clear (&reader->ogg_sync);
 
+  oggz_index_delete (reader->index);
+
+  if (reader->batch != NULL) oggz_free (reader->batch);
+
   return oggz;
 }
 
@@ -141,6 +177,52 @@ oggz_set_read_callback (OGGZ * oggz, long serialno,
   return 0;
 }
 
+int
+oggz_set_read_packets_batch (OGGZ * oggz, long serialno,
+                             OggzReadPackets read_packets, int max_packets,
+                             void * user_data)
+{
+  OggzReader * reader;
+  oggz_stream_t * stream;
+
+  if (oggz == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+  reader =  &oggz->x.reader;
+
+  if (oggz->flags & OGGZ_WRITE) {
+    return OGGZ_ERR_INVALID;
+  }
+
+  if (max_packets < 0) return OGGZ_ERR_INVALID;
+
+  if (max_packets == 0 || max_packets > OGGZ_READ_BATCH_MAX)
+    max_packets = OGGZ_READ_BATCH_MAX;
+
+  if (read_packets != NULL && reader->batch == NULL) {
+    reader->batch = oggz_malloc (OGGZ_READ_BATCH_MAX * sizeof (oggz_packet));
+    if (reader->batch == NULL)
+      return OGGZ_ERR_OUT_OF_MEMORY;
+  }
+
+  if (serialno == -1) {
+    reader->read_packets = read_packets;
+    reader->read_packets_user_data = user_data;
+    reader->read_packets_max = max_packets;
+  } else {
+    stream = oggz_get_stream (oggz, serialno);
+    if (stream == NULL)
+      stream = oggz_add_stream (oggz, serialno);
+    if (stream == NULL)
+      return OGGZ_ERR_OUT_OF_MEMORY;
+
+    stream->read_packets = read_packets;
+    stream->read_packets_user_data = user_data;
+    stream->read_packets_max = max_packets;
+  }
+
+  return 0;
+}
+
 int
 oggz_set_read_page (OGGZ * oggz, long serialno, OggzReadPage read_page,
                     void * user_data)
@@ -197,9 +279,15 @@ oggz_read_get_next_page (OGGZ * oggz, ogg_page * og)
           oggz->offset, reader->current_page_bytes);
 #endif
   oggz->offset += reader->current_page_bytes;
+  reader->current_page_bytes = 0;
 
   do {
-    more = ogg_sync_pageseek (&reader->ogg_sync, og);
+    if (oggz->map != NULL) {
+      /* Parse in place from the mapped file */
+      more = oggz_mmap_pageseek (oggz->map, og);
+    } else {
+      more = ogg_sync_pageseek (&reader->ogg_sync, og);
+    }
 
     if (more == 0) {
       /* No page available */
@@ -222,6 +310,86 @@ oggz_read_get_next_page (OGGZ * oggz, ogg_page * og)
   return oggz->offset;
 }
 
+/*
+ * Packets for streams with an OggzReadPackets callback are collected
+ * in reader->batch and delivered together. Their data points into the
+ * page or ogg_stream_state buffers, so a batch must be flushed before
+ * the next page is read in.
+ */
+static OggzReadPackets
+oggz_read_batch_callback (OggzReader * reader, oggz_stream_t * stream,
+                          void ** user_data, int * max_packets)
+{
+  if (stream->read_packets) {
+    *user_data = stream->read_packets_user_data;
+    *max_packets = stream->read_packets_max;
+    return stream->read_packets;
+  } else if (stream->read_packet == NULL && reader->read_packets) {
+    *user_data = reader->read_packets_user_data;
+    *max_packets = reader->read_packets_max;
+    return reader->read_packets;
+  }
+
+  return NULL;
+}
+
+static int
+oggz_read_batch_flush (OGGZ * oggz)
+{
+  OggzReader * reader = &oggz->x.reader;
+  OggzReadPackets read_packets;
+  void * user_data;
+  int max_packets, nr_batch, i, cb_ret = 0;
+
+  if ((nr_batch = reader->nr_batch) == 0) return 0;
+
+  reader->nr_batch = 0;
+
+  read_packets = oggz_read_batch_callback (reader, reader->batch_stream,
+                                           &user_data, &max_packets);
+  if (read_packets) {
+    return read_packets (oggz, reader->batch, nr_batch,
+                         reader->batch_serialno, user_data);
+  }
+
+  /* The batch callback was removed while packets were pending */
+  for (i = 0; i < nr_batch && cb_ret == 0; i++) {
+    if (reader->batch_stream->read_packet) {
+      cb_ret = reader->batch_stream->read_packet (oggz, &reader->batch[i],
+                                                  reader->batch_serialno,
+                                                  reader->batch_stream->read_user_data);
+    } else if (reader->read_packet) {
+      cb_ret = reader->read_packet (oggz, &reader->batch[i],
+                                    reader->batch_serialno,
+                                    reader->read_user_data);
+    }
+  }
+
+  return cb_ret;
+}
+
+static int
+oggz_read_batch_append (OGGZ * oggz, oggz_stream_t * stream, long serialno,
+                        oggz_packet * packet, int max_packets)
+{
+  OggzReader * reader = &oggz->x.reader;
+  int cb_ret;
+
+  if (reader->nr_batch > 0 && reader->batch_stream != stream) {
+    if ((cb_ret = oggz_read_batch_flush (oggz)) != 0)
+      return cb_ret;
+  }
+
+  reader->batch_stream = stream;
+  reader->batch_serialno = serialno;
+  memcpy (&reader->batch[reader->nr_batch++], packet, sizeof (oggz_packet));
+
+  if (reader->nr_batch >= max_packets)
+    return oggz_read_batch_flush (oggz);
+
+  return 0;
+}
+
 typedef struct {
   oggz_packet     zp;
   oggz_stream_t * stream;
@@ -304,6 +472,9 @@ oggz_read_deliver_packet(void *elem) {
   OggzBufferedPacket *p = (OggzBufferedPacket *)elem;
   ogg_int64_t gp_stored;
   ogg_int64_t unit_stored;
+  OggzReadPackets read_packets;
+  void * user_data;
+  int max_packets;
   int cb_ret;
 
   if (p->zp.pos.calc_granulepos == -1) {
@@ -318,7 +489,17 @@ oggz_read_deliver_packet(void *elem) {
   p->reader->current_unit =
     oggz_get_unit (p->oggz, p->serialno, p->zp.pos.calc_granulepos);
 
-  if (p->stream->read_packet) {
+  read_packets = oggz_read_batch_callback (p->reader, p->stream,
+                                           &user_data, &max_packets);
+  if (read_packets) {
+    /* Buffered packets are freed once delivered, so go one at a time */
+    if ((cb_ret = read_packets (p->oggz, &(p->zp), 1, p->serialno,
+                                user_data)) < 0) {
+      p->oggz->cb_next = cb_ret;
+      if (cb_ret == -1)
+        return DLIST_ITER_ERROR;
+    }
+  } else if (p->stream->read_packet) {
     if ((cb_ret = p->stream->read_packet(p->oggz, &(p->zp), p->serialno, 
 			       p->stream->read_user_data)) < 0) {
       p->oggz->cb_next = cb_ret;
@@ -342,8 +523,174 @@ oggz_read_deliver_packet(void *elem) {
   return DLIST_ITER_CONTINUE;
 }
 
+/*
+ * Packets which begin and end within a single page are handed out
+ * directly from the page buffer rather than being copied into the
+ * ogg_stream_state by ogg_stream_pagein(). The stream state is kept
+ * in step by hand so that later pages can still go through libogg.
+ */
 static int
-oggz_read_sync (OGGZ * oggz)
+oggz_read_slice_page (OggzReader * reader, oggz_stream_t * stream,
+                      ogg_page * og)
+{
+  ogg_stream_state * os = &stream->ogg_stream;
+  int segments = og->header[26];
+  long pageno = ogg_page_pageno (og);
+
+  /* Leave continued, unterminated and malformed pages to libogg */
+  if (ogg_page_version (og) != 0 || ogg_page_continued (og)) return 0;
+  if (segments == 0 || og->header[27 + segments - 1] == 255) return 0;
+
+  /* Anything still buffered in libogg, or a gap in the page sequence,
+   * must be handled by libogg too */
+  if (os->lacing_returned < os->lacing_fill) return 0;
+  if (pageno != os->pageno && os->pageno != -1) return 0;
+
+  os->pageno = pageno + 1;
+  if (ogg_page_eos (og)) os->e_o_s = 1;
+
+  reader->slice_page = *og;
+  reader->slice_stream = stream;
+  reader->slice_body = 0;
+  reader->slice_segment = 0;
+  reader->slice_packets = 0;
+
+  return 1;
+}
+
+static int
+oggz_read_slice_packet (OggzReader * reader, ogg_packet * op)
+{
+  ogg_page * og = &reader->slice_page;
+  ogg_stream_state * os = &reader->slice_stream->ogg_stream;
+  unsigned char * lacing = og->header + 27;
+  int segments = og->header[26];
+  int s = reader->slice_segment;
+  long bytes = 0;
+
+  if (s >= segments) {
+    reader->slice_stream = NULL;
+    return 0;
+  }
+
+  /* The last lacing value is < 255, so this terminates within the page */
+  do {
+    bytes += lacing[s];
+  } while (lacing[s++] == 255);
+
+  /* Flag values as set by libogg's ogg_stream_packetout() */
+  op->packet = og->body + reader->slice_body;
+  op->bytes = bytes;
+  op->b_o_s = (reader->slice_segment == 0 && ogg_page_bos (og)) ? 0x100 : 0;
+  op->e_o_s = (s == segments && ogg_page_eos (og)) ? 0x200 : 0;
+  op->granulepos = (s == segments) ? ogg_page_granulepos (og) : -1;
+  op->packetno = os->packetno++;
+
+  reader->slice_body += bytes;
+  reader->slice_segment = s;
+  reader->slice_packets++;
+
+  return 1;
+}
+
+/*
+ * Hand any packets not yet delivered from the sliced page over to libogg,
+ * as the sync buffer holding the page may be moved by the next read.
+ */
+static void
+oggz_read_slice_spill (OggzReader * reader)
+{
+  oggz_stream_t * stream = reader->slice_stream;
+  ogg_stream_state * os;
+  int i;
+
+  if (stream == NULL) return;
+
+  reader->slice_stream = NULL;
+
+  if (reader->slice_segment >= reader->slice_page.header[26]) return;
+
+  os = &stream->ogg_stream;
+  os->pageno = ogg_page_pageno (&reader->slice_page);
+  os->packetno -= reader->slice_packets;
+
+  ogg_stream_pagein (os, &reader->slice_page);
+  for (i = 0; i < reader->slice_packets; i++) {
+    ogg_stream_packetout (os, NULL);
+  }
+}
+
+/*
+ * Look at the bytes in hand for the next page, without consuming them.
+ * *need is set to the number of bytes still required to complete it, at
+ * least 1.
+ * returns 1 if it is a bos page, 0 if not
+ * returns -1 if its header is not yet in hand
+ */
+static int
+oggz_read_peek_page (OGGZ * oggz, long * need)
+{
+  OggzReader * reader = &oggz->x.reader;
+  unsigned char * data;
+  long avail, len;
+  int i, nsegs;
+
+  if (oggz->map != NULL) {
+    data = oggz->map->data + oggz->map->pos;
+    avail = (long)(oggz->map->avail - oggz->map->pos);
+  } else {
+    data = reader->ogg_sync.data + reader->ogg_sync.returned;
+    avail = reader->ogg_sync.fill - reader->ogg_sync.returned;
+  }
+
+  if (avail < 27) {
+    *need = 27 - avail;
+    return -1;
+  }
+
+  /* Not at a capture pattern; the page parser resynchronizes byte by byte */
+  if (memcmp (data, "OggS", 4) != 0) {
+    *need = 1;
+    return -1;
+  }
+
+  nsegs = data[26];
+  len = 27 + nsegs;
+  if (avail >= len) {
+    for (i = 0; i < nsegs; i++)
+      len += data[27+i];
+  }
+  *need = (len > avail) ? len - avail : 1;
+
+  return (data[5] & 0x02) ? 1 : 0;
+}
+
+/*
+ * Determine whether all header packets of the streams seen so far have
+ * been read. Skeleton declares no count of headers; its headers end with
+ * its eos page.
+ */
+static int
+oggz_read_headers_complete (OGGZ * oggz)
+{
+  oggz_stream_t * stream;
+  int i, size;
+
+  size = oggz_vector_size (oggz->streams);
+  if (size == 0) return 0;
+
+  for (i = 0; i < size; i++) {
+    stream = (oggz_stream_t *)oggz_vector_nth_p (oggz->streams, i);
+    if (stream->ogg_stream.e_o_s) continue;
+    if (stream->content == OGGZ_CONTENT_SKELETON) return 0;
+    if (stream->packetno + 1 < stream->numheaders) return 0;
+  }
+
+  return 1;
+}
+
+static int
+oggz_read_sync_packets (OGGZ * oggz)
 {
   OggzReader * reader = &oggz->x.reader;
 
@@ -356,6 +703,10 @@ oggz_read_sync (OGGZ * oggz)
   oggz_packet packet;
   ogg_page og;
 
+  OggzReadPackets read_packets;
+  void * user_data;
+  int max_packets;
+
   int cb_ret = 0;
 
   /*os = &reader->ogg_stream;*/
@@ -386,7 +737,11 @@ oggz_read_sync (OGGZ * oggz)
         }
         os = &stream->ogg_stream;
 
-        result = ogg_stream_packetout(os, op);
+        if (reader->slice_stream == stream) {
+          result = oggz_read_slice_packet (reader, op);
+        } else {
+          result = ogg_stream_packetout(os, op);
+        }
 
         /* libogg flags "holes in the data" (which are really inconsistencies
          * in the page sequence number) by returning -1. */
@@ -429,7 +784,8 @@ oggz_read_sync (OGGZ * oggz)
             reader->current_granulepos = granulepos;
 	  } else {
             /* if we have no metrics for this stream yet, then generate them */      
-            if ((!stream->metric || content == OGGZ_CONTENT_SKELETON) && 
+            if ((!stream->metric ||
+                 (content == OGGZ_CONTENT_SKELETON && !stream->shared)) && 
                 (oggz->flags & OGGZ_AUTO)) {
               oggz_auto_read_bos_packet (oggz, op, serialno, NULL);
             }
@@ -473,6 +829,9 @@ oggz_read_sync (OGGZ * oggz)
             if (reader->current_granulepos == -1) {
               OggzBufferedPacket *p;
 
+              /* Deliver any batch ahead of the buffered packets */
+              cb_ret = oggz_read_batch_flush (oggz);
+
               p = oggz_read_new_pbuffer_entry (oggz, &packet,
                                                serialno, stream, reader);
               oggz_dlist_append(oggz->packet_buffer, p);
@@ -518,7 +877,12 @@ oggz_read_sync (OGGZ * oggz)
           printf ("%s: set begin_page to %llx, calling read_packet\n", __func__, pos->begin_page_offset);
 #endif
 
-          if (stream->read_packet) {
+          if ((read_packets = oggz_read_batch_callback (reader, stream,
+                                                        &user_data,
+                                                        &max_packets))) {
+            cb_ret = oggz_read_batch_append (oggz, stream, serialno,
+                                             &packet, max_packets);
+          } else if (stream->read_packet) {
             cb_ret =
               stream->read_packet (oggz, &packet, serialno, stream->read_user_data);
           } else if (reader->read_packet) {
@@ -550,8 +914,11 @@ prepare_position:
            */
           if (!op->b_o_s) stream->delivered_non_b_o_s = 1;
         }
-        else
+        else {
+          /* The page is used up; deliver its batch before the next */
+          cb_ret = oggz_read_batch_flush (oggz);
           break;
+        }
       }
     }
 
@@ -561,6 +928,16 @@ prepare_position:
 	cb_ret == OGGZ_ERR_HOLE_IN_DATA) 
       return cb_ret;
 
+    /* Reading headers only: stop before the first page that is not a bos
+     * page once every stream has had its headers */
+    if (reader->headers_only) {
+      long need;
+
+      if (oggz_read_peek_page (oggz, &need) == 0 &&
+          oggz_read_headers_complete (oggz))
+        return OGGZ_READ_HEADERS_DONE;
+    }
+
     if(oggz_read_get_next_page (oggz, &og) < 0)
       return OGGZ_READ_EMPTY; /* eof. leave uninitialized */
 
@@ -601,6 +978,20 @@ prepare_position:
       } else if (granulepos == 0) {
        reader->current_unit = 0;
       }
+
+      /* A page beyond the known end means the file has grown */
+      if (reader->bounds_end != -1 &&
+          oggz->offset + reader->current_page_bytes > reader->bounds_end) {
+        reader->bounds_end = -1;
+      }
+
+      if (reader->index != NULL && granulepos != -1) {
+        if (oggz_index_insert (reader->index, oggz->offset,
+                               reader->current_page_bytes, serialno, granulepos,
+                               (oggz->metric || stream->metric) ?
+                               reader->current_unit : -1) == NULL)
+          return OGGZ_ERR_OUT_OF_MEMORY;
+      }
     }
 
     if (stream->read_page) {
@@ -611,7 +1002,9 @@ prepare_position:
         reader->read_page (oggz, &og, serialno, reader->read_page_user_data);
     }
 
-    ogg_stream_pagein(os, &og);
+    if (!oggz_read_slice_page (reader, stream, &og)) {
+      ogg_stream_pagein(os, &og);
+    }
     if (ogg_page_continued(&og)) {
       if (reader->current_packet_pages != -1)
         reader->current_packet_pages++;
@@ -629,6 +1022,23 @@ prepare_position:
   return cb_ret;
 }
 
+static int
+oggz_read_sync (OGGZ * oggz)
+{
+  int cb_ret, batch_ret;
+
+  cb_ret = oggz_read_sync_packets (oggz);
+
+  /* Errors may leave a partial batch; deliver it while its data is valid */
+  batch_ret = oggz_read_batch_flush (oggz);
+  if (batch_ret != 0 && (cb_ret == 0 || cb_ret == OGGZ_READ_EMPTY))
+    cb_ret = batch_ret;
+
+  oggz_read_slice_spill (&oggz->x.reader);
+
+  return cb_ret;
+}
+
 long
 oggz_read (OGGZ * oggz, long n)
 {
@@ -656,16 +1066,24 @@ oggz_read (OGGZ * oggz, long n)
 
   while (cb_ret != OGGZ_STOP_ERR && cb_ret != OGGZ_STOP_OK &&
          bytes_read > 0 && remaining > 0) {
-    bytes = MIN (remaining, CHUNKSIZE);
-    buffer = ogg_sync_buffer (&reader->ogg_sync, bytes);
-    bytes_read = (long) oggz_io_read (oggz, buffer, bytes);
-    if (bytes_read == OGGZ_ERR_SYSTEM) {
-      return OGGZ_ERR_SYSTEM;
+    if (oggz->map != NULL) {
+      /* Make more of the mapped file available to the page parser */
+      bytes_read = (long) MIN ((oggz_off_t)remaining,
+                               oggz->map->size - oggz->map->avail);
+      oggz->map->avail += bytes_read;
+    } else {
+      bytes = MIN (remaining, CHUNKSIZE);
+      buffer = ogg_sync_buffer (&reader->ogg_sync, bytes);
+      bytes_read = (long) oggz_io_read (oggz, buffer, bytes);
+      if (bytes_read == OGGZ_ERR_SYSTEM) {
+        return OGGZ_ERR_SYSTEM;
+      }
+
+      if (bytes_read > 0)
+        ogg_sync_wrote (&reader->ogg_sync, bytes_read);
     }
 
     if (bytes_read > 0) {
-      ogg_sync_wrote (&reader->ogg_sync, bytes_read);
-      
       remaining -= bytes_read;
       nread += bytes_read;
       
@@ -760,6 +1178,61 @@ oggz_read_input (OGGZ * oggz, unsigned char * buf, long n)
   return nread;
 }
 
+int
+oggz_read_headers (OGGZ * oggz)
+{
+  OggzReader * reader;
+  char * buffer;
+  long need, bytes_read;
+  int cb_ret = 0;
+
+  if (oggz == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+  if (oggz->flags & OGGZ_WRITE) {
+    return OGGZ_ERR_INVALID;
+  }
+
+  if ((cb_ret = oggz->cb_next) != OGGZ_CONTINUE) {
+    oggz->cb_next = 0;
+    return oggz_map_return_value_to_error (cb_ret);
+  }
+
+  reader = &oggz->x.reader;
+  reader->headers_only = 1;
+
+  /* Make available only as many bytes as complete the next page, so that
+   * nothing beyond the headers is read in */
+  while ((cb_ret = oggz_read_sync (oggz)) == OGGZ_READ_EMPTY) {
+    oggz_read_peek_page (oggz, &need);
+
+    if (oggz->map != NULL) {
+      bytes_read = (long) MIN ((oggz_off_t)need,
+                               oggz->map->size - oggz->map->avail);
+      oggz->map->avail += bytes_read;
+    } else {
+      buffer = ogg_sync_buffer (&reader->ogg_sync, need);
+      bytes_read = (long) oggz_io_read (oggz, buffer, need);
+      if (bytes_read > 0)
+        ogg_sync_wrote (&reader->ogg_sync, bytes_read);
+    }
+
+    if (bytes_read <= 0) {
+      /* End of file, or an error reading */
+      if (bytes_read < 0) cb_ret = (int)bytes_read;
+      break;
+    }
+  }
+
+  reader->headers_only = 0;
+
+  if (cb_ret == OGGZ_READ_HEADERS_DONE || cb_ret == OGGZ_READ_EMPTY)
+    return 0;
+
+  if (cb_ret == OGGZ_STOP_ERR) oggz_purge (oggz);
+
+  return oggz_map_return_value_to_error (cb_ret);
+}
+
 
 #else /* OGGZ_CONFIG_READ */
 
@@ -785,6 +1258,14 @@ oggz_set_read_callback (OGGZ * oggz, long serialno,
   return OGGZ_ERR_DISABLED;
 }
 
+int
+oggz_set_read_packets_batch (OGGZ * oggz, long serialno,
+                             OggzReadPackets read_packets, int max_packets,
+                             void * user_data)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
 long
 oggz_read (OGGZ * oggz, long n)
 {
@@ -797,4 +1278,10 @@ oggz_read_input (OGGZ * oggz, unsigned char * buf, long n)
   return OGGZ_ERR_DISABLED;
 }
 
+int
+oggz_read_headers (OGGZ * oggz)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
 #endif
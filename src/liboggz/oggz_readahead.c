@@ -0,0 +1,374 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if defined (HAVE_PTHREAD_H) && defined (HAVE_PREAD)
+#include <pthread.h>
+#define OGGZ_HAVE_READAHEAD 1
+#endif
+
+#include "oggz_compat.h"
+#include "oggz_private.h"
+
+/*#define DEBUG*/
+
+#ifdef OGGZ_HAVE_READAHEAD
+
+#define NR_CHUNKS 4
+#define CHUNK_SIZE 65536
+
+struct _OggzReadahead {
+  int fd;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t fill_cond; /* the worker may read another chunk */
+  pthread_cond_t data_cond; /* a chunk was filled, or the worker stopped */
+
+  unsigned char * data; /* NR_CHUNKS chunks of CHUNK_SIZE bytes */
+  size_t bytes[NR_CHUNKS];
+
+  int head; /* the chunk being consumed */
+  int count; /* number of filled chunks, from head */
+  size_t pos; /* bytes already consumed from the head chunk */
+
+  /* Number of chunks to keep filled. This restarts at one after each
+   * seek, so that seeking does not read far past each probe, and doubles
+   * as chunks are consumed */
+  int window;
+
+  oggz_off_t offset; /* read position */
+  oggz_off_t fill_offset; /* file offset of the next chunk to fill */
+
+  /* Incremented when outstanding reads are cancelled */
+  unsigned int generation;
+
+  int eof;
+  int error;
+  int quit;
+};
+
+static void *
+oggz_readahead_worker (void * data)
+{
+  OggzReadahead * ra = (OggzReadahead *) data;
+  unsigned char * chunk;
+  oggz_off_t offset;
+  unsigned int generation;
+  ssize_t n;
+  int i;
+
+  pthread_mutex_lock (&ra->mutex);
+
+  for (;;) {
+    while (!ra->quit && (ra->count >= ra->window || ra->eof || ra->error))
+      pthread_cond_wait (&ra->fill_cond, &ra->mutex);
+
+    if (ra->quit) break;
+
+    /* The chunk after the filled ones is not touched by the reader, so it
+     * can be filled without holding the lock */
+    i = (ra->head + ra->count) % NR_CHUNKS;
+    chunk = ra->data + i * CHUNK_SIZE;
+    offset = ra->fill_offset;
+    generation = ra->generation;
+
+    pthread_mutex_unlock (&ra->mutex);
+    n = pread (ra->fd, chunk, CHUNK_SIZE, offset);
+    pthread_mutex_lock (&ra->mutex);
+
+    /* Discard reads that were cancelled by a seek meanwhile */
+    if (ra->generation != generation) continue;
+
+    if (n > 0) {
+      ra->bytes[i] = (size_t)n;
+      ra->count++;
+      ra->fill_offset += n;
+    } else if (n == 0) {
+      ra->eof = 1;
+    } else if (errno != EINTR) {
+      ra->error = errno;
+    }
+
+    pthread_cond_signal (&ra->data_cond);
+  }
+
+  pthread_mutex_unlock (&ra->mutex);
+
+  return NULL;
+}
+
+OggzReadahead *
+oggz_readahead_new (FILE * file)
+{
+  OggzReadahead * ra;
+  struct stat statbuf;
+  oggz_off_t offset;
+  int fd;
+
+  if ((fd = fileno (file)) == -1) return NULL;
+  if (fstat (fd, &statbuf) == -1) return NULL;
+  if (!oggz_stat_regular (statbuf.st_mode)) return NULL;
+
+  /* Reads bypass stdio buffering, so the descriptor has the position */
+  if ((offset = lseek (fd, 0, SEEK_CUR)) == -1) return NULL;
+
+  ra = oggz_malloc (sizeof (OggzReadahead));
+  if (ra == NULL) return NULL;
+
+  ra->data = oggz_malloc (NR_CHUNKS * CHUNK_SIZE);
+  if (ra->data == NULL) {
+    oggz_free (ra);
+    return NULL;
+  }
+
+  ra->fd = fd;
+  ra->head = ra->count = 0;
+  ra->pos = 0;
+  ra->window = 1;
+  ra->offset = ra->fill_offset = offset;
+  ra->generation = 0;
+  ra->eof = ra->error = ra->quit = 0;
+
+  pthread_mutex_init (&ra->mutex, NULL);
+  pthread_cond_init (&ra->fill_cond, NULL);
+  pthread_cond_init (&ra->data_cond, NULL);
+
+  if (pthread_create (&ra->thread, NULL, oggz_readahead_worker, ra) != 0) {
+    pthread_cond_destroy (&ra->data_cond);
+    pthread_cond_destroy (&ra->fill_cond);
+    pthread_mutex_destroy (&ra->mutex);
+    oggz_free (ra->data);
+    oggz_free (ra);
+    return NULL;
+  }
+
+  return ra;
+}
+
+void
+oggz_readahead_delete (OggzReadahead * ra)
+{
+  if (ra == NULL) return;
+
+  pthread_mutex_lock (&ra->mutex);
+  ra->quit = 1;
+  pthread_cond_signal (&ra->fill_cond);
+  pthread_mutex_unlock (&ra->mutex);
+
+  pthread_join (ra->thread, NULL);
+
+  pthread_cond_destroy (&ra->data_cond);
+  pthread_cond_destroy (&ra->fill_cond);
+  pthread_mutex_destroy (&ra->mutex);
+
+  oggz_free (ra->data);
+  oggz_free (ra);
+}
+
+/*
+ * Consume bytes from the head chunk, releasing it to the worker once it
+ * has been consumed entirely. Call with the lock held.
+ */
+static void
+oggz_readahead_consume (OggzReadahead * ra, size_t bytes)
+{
+  ra->pos += bytes;
+  ra->offset += bytes;
+
+  if (ra->pos == ra->bytes[ra->head]) {
+    ra->head = (ra->head + 1) % NR_CHUNKS;
+    ra->count--;
+    ra->pos = 0;
+
+    if (ra->window < NR_CHUNKS) ra->window *= 2;
+
+    pthread_cond_signal (&ra->fill_cond);
+  }
+}
+
+long
+oggz_readahead_read (OggzReadahead * ra, void * buf, size_t n)
+{
+  unsigned char * chunk;
+  size_t bytes, copied = 0;
+
+  pthread_mutex_lock (&ra->mutex);
+
+  while (ra->count == 0 && !ra->eof && !ra->error)
+    pthread_cond_wait (&ra->data_cond, &ra->mutex);
+
+  if (ra->count == 0) {
+    if (ra->error) {
+      errno = ra->error;
+      ra->error = 0;
+      copied = (size_t)-1;
+    }
+
+    /* Let the worker try again, eg. in case the file is growing */
+    ra->eof = 0;
+    pthread_cond_signal (&ra->fill_cond);
+  }
+
+  while (ra->count > 0 && copied < n) {
+    chunk = ra->data + ra->head * CHUNK_SIZE;
+    bytes = MIN (ra->bytes[ra->head] - ra->pos, n - copied);
+    memcpy ((unsigned char *)buf + copied, chunk + ra->pos, bytes);
+    copied += bytes;
+
+    oggz_readahead_consume (ra, bytes);
+  }
+
+  pthread_mutex_unlock (&ra->mutex);
+
+#ifdef DEBUG
+  printf ("oggz_readahead_read: %ld bytes\n", (long)copied);
+#endif
+
+  return (long)copied;
+}
+
+int
+oggz_readahead_seek (OggzReadahead * ra, oggz_off_t offset, int whence)
+{
+  struct stat statbuf;
+  size_t bytes;
+
+  pthread_mutex_lock (&ra->mutex);
+
+  switch (whence) {
+  case SEEK_SET:
+    break;
+  case SEEK_CUR:
+    offset += ra->offset;
+    break;
+  case SEEK_END:
+    if (fstat (ra->fd, &statbuf) == -1) {
+      pthread_mutex_unlock (&ra->mutex);
+      return -1;
+    }
+    offset += statbuf.st_size;
+    break;
+  default:
+    offset = -1;
+    break;
+  }
+
+  if (offset < 0) {
+    pthread_mutex_unlock (&ra->mutex);
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (offset > ra->offset && offset < ra->fill_offset) {
+    /* Skip forward within the chunks already read */
+    while (ra->offset < offset) {
+      bytes = (size_t) MIN ((oggz_off_t)(ra->bytes[ra->head] - ra->pos),
+                            offset - ra->offset);
+      oggz_readahead_consume (ra, bytes);
+    }
+  } else if (offset != ra->offset) {
+    /* Cancel outstanding reads and restart at the new position */
+#ifdef DEBUG
+    printf ("oggz_readahead_seek: cancel at %" PRI_OGGZ_OFF_T "d\n", offset);
+#endif
+    ra->generation++;
+    ra->head = ra->count = 0;
+    ra->pos = 0;
+    ra->window = 1;
+    ra->offset = ra->fill_offset = offset;
+  }
+
+  ra->eof = ra->error = 0;
+  pthread_cond_signal (&ra->fill_cond);
+
+  pthread_mutex_unlock (&ra->mutex);
+
+  return 0;
+}
+
+oggz_off_t
+oggz_readahead_tell (OggzReadahead * ra)
+{
+  oggz_off_t offset;
+
+  pthread_mutex_lock (&ra->mutex);
+  offset = ra->offset;
+  pthread_mutex_unlock (&ra->mutex);
+
+  return offset;
+}
+
+#else /* OGGZ_HAVE_READAHEAD */
+
+OggzReadahead *
+oggz_readahead_new (FILE * file)
+{
+  return NULL;
+}
+
+void
+oggz_readahead_delete (OggzReadahead * ra)
+{
+}
+
+long
+oggz_readahead_read (OggzReadahead * ra, void * buf, size_t n)
+{
+  return -1;
+}
+
+int
+oggz_readahead_seek (OggzReadahead * ra, oggz_off_t offset, int whence)
+{
+  return -1;
+}
+
+oggz_off_t
+oggz_readahead_tell (OggzReadahead * ra)
+{
+  return -1;
+}
+
+#endif /* OGGZ_HAVE_READAHEAD */
@@ -0,0 +1,89 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __OGGZ_READAHEAD_H__
+#define __OGGZ_READAHEAD_H__
+
+#include <stdio.h>
+#include <oggz/oggz_off_t.h>
+
+/*
+ * A background reader for OGGZ_READAHEAD. A worker thread fills a ring
+ * of chunks from the file ahead of the parser, so that parsing and I/O
+ * overlap. The structure is private to oggz_readahead.c.
+ */
+
+typedef struct _OggzReadahead OggzReadahead;
+
+/**
+ * Start reading ahead in a file, from its current position.
+ * \retval a pointer to the new readahead engine.
+ * \retval NULL if the file cannot be read ahead, eg. if it is not a
+ * regular file, or threads are not supported.
+ */
+OggzReadahead *
+oggz_readahead_new (FILE * file);
+
+/**
+ * Stop the worker thread and free its buffers.
+ */
+void
+oggz_readahead_delete (OggzReadahead * ra);
+
+/**
+ * Read bytes that have been read ahead, waiting for the worker if none
+ * are available yet.
+ * \retval n > 0 the number of bytes copied into buf
+ * \retval 0 at the end of the file
+ * \retval -1 on error, with errno set
+ */
+long
+oggz_readahead_read (OggzReadahead * ra, void * buf, size_t n);
+
+/**
+ * Move the read position, as lseek(). Bytes already read ahead are kept
+ * if the new position lies within them; otherwise outstanding reads are
+ * cancelled and the worker restarts at the new position.
+ * \retval 0 success
+ * \retval -1 on error, with errno set
+ */
+int
+oggz_readahead_seek (OggzReadahead * ra, oggz_off_t offset, int whence);
+
+/**
+ * Get the read position, ie. the offset of the next byte that
+ * oggz_readahead_read() will return.
+ */
+oggz_off_t
+oggz_readahead_tell (OggzReadahead * ra);
+
+#endif /* __OGGZ_READAHEAD_H__ */
@@ -68,6 +68,12 @@
 
 #define CHUNKSIZE 4096
 
+/* Largest backward scanning window */
+#define WINDOW_MAX (1<<20)
+
+/* Largest possible Ogg page: 27 byte header and 255 lacing values */
+#define PAGESIZE_MAX (27 + 255 + 255*255)
+
 /*
  * The typical usage is:
  *
@@ -118,9 +124,13 @@ oggz_seek_raw (OGGZ * oggz, oggz_off_t offset, int whence)
   offset_at = oggz_io_tell (oggz);
 
   oggz->offset = offset_at;
+  reader->current_page_bytes = 0;
+  reader->slice_stream = NULL;
 
   ogg_sync_reset (&reader->ogg_sync);
 
+  oggz_index_break (reader->index);
+
   oggz_vector_foreach(oggz->streams, oggz_seek_reset_stream);
   
   return offset_at;
@@ -204,15 +214,13 @@ oggz_get_next_page (OGGZ * oggz, ogg_page * og)
   OggzReader * reader = &oggz->x.reader;
   char * buffer;
   long bytes = 0, more;
-  oggz_off_t page_offset = 0, ret;
+  oggz_off_t ret;
   int found = 0;
 
   do {
     more = ogg_sync_pageseek (&reader->ogg_sync, og);
 
     if (more == 0) {
-      page_offset = 0;
-
       buffer = ogg_sync_buffer (&reader->ogg_sync, CHUNKSIZE);
       if ((bytes = (long) oggz_io_read (oggz, buffer, CHUNKSIZE)) == 0) {
 	if (oggz->file && feof (oggz->file)) {
@@ -241,7 +249,7 @@ oggz_get_next_page (OGGZ * oggz, ogg_page * og)
 #ifdef DEBUG_VERBOSE
       printf ("get_next_page: skipped %ld bytes\n", -more);
 #endif
-      page_offset -= more;
+      oggz->offset -= more;
     } else {
 #ifdef DEBUG_VERBOSE
       printf ("get_next_page: page has %ld bytes\n", more);
@@ -251,15 +259,10 @@ oggz_get_next_page (OGGZ * oggz, ogg_page * og)
 
   } while (!found);
 
-  /* Calculate the byte offset of the page which was found */
-  if (bytes > 0) {
-    oggz->offset = oggz_tell_raw (oggz) - bytes + page_offset;
-  } else {
-    /* didn't need to do any reading -- accumulate the page_offset */
-    oggz->offset += page_offset;
-  }
-  
-  ret = oggz->offset + more;
+  /* oggz->offset tracks the data consumed from the sync buffer, which
+   * is now the start of the page found; move it past the page */
+  ret = oggz->offset;
+  oggz->offset += more;
 
   return ret;
 }
@@ -290,14 +293,26 @@ oggz_get_next_start_page (OGGZ * oggz, ogg_page * og)
   return page_offset;
 }
 
+/*
+ * oggz_get_prev_start_page (oggz, og, granule, serialno)
+ *
+ * Find the last page before the current offset which starts a packet.
+ * The file is scanned backwards in windows that double in size, so that
+ * a run of large pages is crossed in O(log size) reads. Bytes read for
+ * one window are kept and fed to the sync buffer again when scanning the
+ * next, to complete pages which straddle the window boundary.
+ */
 static oggz_off_t
 oggz_get_prev_start_page (OGGZ * oggz, ogg_page * og,
 			 ogg_int64_t * granule, long * serialno)
 {
-  oggz_off_t offset_at, offset_start;
+  OggzReader * reader = &oggz->x.reader;
+  oggz_off_t offset_at, offset_start, offset_limit, offset_read;
   oggz_off_t page_offset, found_offset = 0;
   ogg_int64_t unit_at;
-  ogg_int64_t granule_at = -1;
+  unsigned char * buf = NULL, * new_buf;
+  long buf_len = 0, fed, window = CHUNKSIZE, n, bytes, more;
+  char * buffer;
 
 #if 0
   offset_at = oggz_tell_raw (oggz);
@@ -310,65 +325,109 @@ oggz_get_prev_start_page (OGGZ * oggz, ogg_page * og,
 
   do {
 
-    offset_start = offset_start - CHUNKSIZE;
+    /* Pages starting after offset_limit were scanned in earlier windows */
+    offset_limit = offset_start;
+    offset_start = offset_limit - window;
     if (offset_start < 0) offset_start = 0;
+    n = (long)(offset_limit - offset_start);
 
-    offset_start = oggz_seek_raw (oggz, offset_start, SEEK_SET);
-    if (offset_start == -1) return -1;
+    /* Only the bytes needed to complete pages starting before
+     * offset_limit are kept from the previous window */
+    if (buf_len > PAGESIZE_MAX) buf_len = PAGESIZE_MAX;
 
-#ifdef DEBUG
+    if ((new_buf = oggz_malloc (n + buf_len)) == NULL) {
+      oggz_free (buf);
+      return -1;
+    }
 
+    if (oggz_seek_raw (oggz, offset_start, SEEK_SET) == -1) {
+      oggz_free (new_buf);
+      oggz_free (buf);
+      return -1;
+    }
+
+#ifdef DEBUG
     printf ("get_prev_start_page: [A] offset_at: @%" PRI_OGGZ_OFF_T "d\toffset_start: @%" PRI_OGGZ_OFF_T "d\n",
 	    offset_at, offset_start);
-
-    printf ("get_prev_start_page: seeked to %" PRI_OGGZ_OFF_T "d\n", offset_start);
 #endif
 
-    page_offset = 0;
-
-    do {
-      page_offset = oggz_get_next_start_page (oggz, og);
-      if (page_offset == -1) {
-#ifdef DEBUG
-	printf ("get_prev_start_page: page_offset = -1\n");
-#endif
-	return -1;
-      }
-      if (page_offset == -2) {
-#ifdef DEBUG
-	printf ("*** get_prev_start_page: page_offset = -2\n");
-#endif
-	break;
-      }
+    for (bytes = 0; bytes < n; bytes += more) {
+      more = (long) oggz_io_read (oggz, new_buf + bytes, n - bytes);
+      if (more <= 0) break;
+    }
 
-      granule_at = ogg_page_granulepos (og);
+    if (bytes < n) {
+      oggz_free (new_buf);
+      oggz_free (buf);
+      return -1;
+    }
 
+    if (buf_len > 0) memcpy (new_buf + n, buf, buf_len);
+    oggz_free (buf);
+    buf = new_buf;
+    buf_len += n;
+    offset_read = offset_limit;
+
+    ogg_sync_reset (&reader->ogg_sync);
+    fed = 0;
+
+    page_offset = offset_start;
+
+    while (page_offset < offset_limit) {
+      more = ogg_sync_pageseek (&reader->ogg_sync, og);
+
+      if (more == 0) {
+        if (fed == buf_len) {
+          /* Read on to complete a page straddling the end of the buffer */
+          if (offset_read != offset_start + buf_len) {
+            offset_read = offset_start + buf_len;
+            if (oggz_io_seek (oggz, offset_read, SEEK_SET) < 0) break;
+          }
+
+          if ((new_buf = oggz_realloc (buf, buf_len + CHUNKSIZE)) == NULL)
+            break;
+          buf = new_buf;
+
+          bytes = (long) oggz_io_read (oggz, buf + buf_len, CHUNKSIZE);
+          if (bytes <= 0) break;
+
+          buf_len += bytes;
+          offset_read += bytes;
+        }
+
+        buffer = ogg_sync_buffer (&reader->ogg_sync, buf_len - fed);
+        memcpy (buffer, buf + fed, buf_len - fed);
+        ogg_sync_wrote (&reader->ogg_sync, buf_len - fed);
+        fed = buf_len;
+      } else if (more < 0) {
+        page_offset -= more;
+      } else {
+        /* As for oggz_get_next_start_page() */
+        if (page_offset == 0 || ogg_page_granulepos (og) > -1) {
 #ifdef DEBUG_VERBOSE
-      printf ("get_prev_start_page: GOT page (%lld) @%" PRI_OGGZ_OFF_T "d\tat @%" PRI_OGGZ_OFF_T  "d\n",
-	      granule_at, page_offset, offset_at);
+          printf ("get_prev_start_page: GOT page (%lld) @%" PRI_OGGZ_OFF_T "d\tat @%" PRI_OGGZ_OFF_T  "d\n",
+                  ogg_page_granulepos (og), page_offset, offset_at);
 #endif
-
-      /* Need to stash the granule and serialno of this page because og
-       * will be overwritten by the time we realise this was the desired
-       * prev page */
-      if (page_offset >= 0 && page_offset < offset_at) {
-	found_offset = page_offset;
-	*granule = granule_at;
-	*serialno = ogg_page_serialno (og);
+          found_offset = page_offset;
+          *granule = ogg_page_granulepos (og);
+          *serialno = ogg_page_serialno (og);
+        }
+        page_offset += more;
       }
-
-    } while (page_offset >= 0 && page_offset < offset_at);
+    }
 
 #ifdef DEBUG
     printf ("get_prev_start_page: [B] offset_at: @%" PRI_OGGZ_OFF_T "d\toffset_start: @%" PRI_OGGZ_OFF_T "d\n"
 	    "found_offset: @%" PRI_OGGZ_OFF_T "d\tpage_offset: @%" PRI_OGGZ_OFF_T "d\n",
 	    offset_at, offset_start, found_offset, page_offset);
 #endif
-    /* reset the file offset */
-    /*offset_at = offset_start;*/
+
+    if (window < WINDOW_MAX) window *= 2;
 
   } while (found_offset == 0 && offset_start > 0);
 
+  oggz_free (buf);
+
   unit_at = oggz_get_unit (oggz, *serialno, *granule);
   offset_at = oggz_reset (oggz, found_offset, unit_at, SEEK_SET);
 
@@ -501,69 +560,312 @@ oggz_scan_for_page (OGGZ * oggz, ogg_page * og, ogg_int64_t unit_target,
 
 #define GUESS_MULTIPLIER (1<<16)
 
-static oggz_off_t
-guess (ogg_int64_t unit_at, ogg_int64_t unit_target,
-       ogg_int64_t unit_begin, ogg_int64_t unit_end,
-       oggz_off_t offset_begin, oggz_off_t offset_end)
-{
-  ogg_int64_t guess_ratio;
-  oggz_off_t offset_guess;
+/*
+ * State of the search for a seek target. The target is interpolated
+ * between the pages either side of it (regula falsi). When the same side
+ * moves twice running, the weight of the other side is halved (the
+ * Illinois method) so that uneven bitrate can't hold one side in place.
+ * If interpolation still fails to halve the search range in
+ * GUESS_STALLED probes, the next probe bisects.
+ */
+#define GUESS_STALLED 3
 
-  if (unit_at == unit_begin) return offset_begin;
+typedef struct {
+  ogg_int64_t weight_begin;
+  ogg_int64_t weight_end;
+  int side; /* The side last moved: -1 begin, 1 end, 0 none */
+  oggz_off_t range; /* Search range when last halved */
+  int stalled; /* Probes since the search range was last halved */
+} oggz_seek_search;
+
+static void
+oggz_seek_search_init (oggz_seek_search * search, ogg_int64_t unit_target,
+                       ogg_int64_t unit_begin, ogg_int64_t unit_end,
+                       oggz_off_t offset_begin, oggz_off_t offset_end)
+{
+  search->weight_begin = unit_target - unit_begin;
+  search->weight_end = unit_end - unit_target;
+  search->side = 0;
+  search->range = offset_end - offset_begin;
+  search->stalled = 0;
+}
 
-  if (unit_end != -1) {
-    guess_ratio =
-      GUESS_MULTIPLIER * (unit_target - unit_begin) /
-      (unit_end - unit_begin);
+static void
+oggz_seek_search_update (oggz_seek_search * search, int side,
+                         ogg_int64_t unit_target,
+                         ogg_int64_t unit_begin, ogg_int64_t unit_end,
+                         oggz_off_t offset_begin, oggz_off_t offset_end)
+{
+  if (side < 0) {
+    search->weight_begin = unit_target - unit_begin;
+    if (search->side < 0 && search->weight_end > 1) search->weight_end /= 2;
   } else {
-    guess_ratio =
-      GUESS_MULTIPLIER * (unit_target - unit_begin) /
-      (unit_at - unit_begin);
+    search->weight_end = unit_end - unit_target;
+    if (search->side > 0 && search->weight_begin > 1) search->weight_begin /= 2;
   }
 
-#ifdef DEBUG
-  printf ("oggz_seek::guess: guess_ratio %lld = (%lld - %lld) / (%lld - %lld)\n",
-	  guess_ratio, unit_target, unit_begin, unit_at, unit_begin);
-#endif
-  
-  offset_guess = offset_begin +
-    (oggz_off_t)(((offset_end - offset_begin) * guess_ratio) /
-		 GUESS_MULTIPLIER);
-  
-  return offset_guess;
+  search->side = side;
+
+  if (offset_end - offset_begin <= search->range / 2) {
+    search->range = offset_end - offset_begin;
+    search->stalled = 0;
+  } else {
+    search->stalled++;
+  }
 }
 
 static oggz_off_t
-oggz_seek_guess (ogg_int64_t unit_at, ogg_int64_t unit_target,
-		 ogg_int64_t unit_begin, ogg_int64_t unit_end,
-		 oggz_off_t offset_at,
-		 oggz_off_t offset_begin, oggz_off_t offset_end)
+oggz_seek_guess (oggz_seek_search * search,
+                 ogg_int64_t unit_begin, ogg_int64_t unit_end,
+                 oggz_off_t offset_begin, oggz_off_t offset_end)
 {
+  ogg_int64_t guess_ratio;
   oggz_off_t offset_guess;
 
-  if (unit_at == unit_begin) {
-    offset_guess = offset_begin + (offset_end - offset_begin)/2;
-  } else if (unit_end == -1) {
-    offset_guess = guess (unit_at, unit_target, unit_begin, unit_end,
-			  offset_begin, offset_at);
-  } else if (unit_end <= unit_begin) {
+  if (unit_end <= unit_begin) {
 #ifdef DEBUG
     printf ("oggz_seek_guess: unit_end <= unit_begin (ERROR)\n");
 #endif
-    offset_guess = -1;
-  } else {
-    offset_guess = guess (unit_at, unit_target, unit_begin, unit_end,
-			  offset_begin, offset_end);
+    return -1;
   }
 
+  if (search->stalled >= GUESS_STALLED ||
+      search->weight_begin + search->weight_end <= 0) {
+    offset_guess = offset_begin + (offset_end - offset_begin)/2;
 #ifdef DEBUG
-    printf ("oggz_seek_guess: guessed %" PRI_OGGZ_OFF_T "d\n", offset_guess);
+    printf ("oggz_seek_guess: bisected %" PRI_OGGZ_OFF_T "d\n", offset_guess);
+#endif
+    return offset_guess;
+  }
+
+  guess_ratio =
+    GUESS_MULTIPLIER * search->weight_begin /
+    (search->weight_begin + search->weight_end);
+
+  offset_guess = offset_begin +
+    (oggz_off_t)(((offset_end - offset_begin) * guess_ratio) /
+		 GUESS_MULTIPLIER);
+
+#ifdef DEBUG
+  printf ("oggz_seek_guess: guess_ratio %lld, guessed %" PRI_OGGZ_OFF_T "d\n",
+          guess_ratio, offset_guess);
 #endif
 
   return offset_guess;
 }
 
+static void
+oggz_seek_sample_add (OggzReader * reader, oggz_off_t offset,
+                      long serialno, ogg_int64_t granulepos)
+{
+  oggz_seek_sample_t * sample;
+
+  sample = &reader->seek_samples[reader->seek_sample_next];
+  sample->offset = offset;
+  sample->serialno = serialno;
+  sample->granulepos = granulepos;
+
+  reader->seek_sample_next = (reader->seek_sample_next + 1) % OGGZ_SEEK_SAMPLES;
+  if (reader->nr_seek_samples < OGGZ_SEEK_SAMPLES) reader->nr_seek_samples++;
+}
+
+static ogg_int64_t
+oggz_index_entry_unit (OGGZ * oggz, oggz_index_entry_t * entry)
+{
+  /* Metrics may not have been known when the page was indexed */
+  if (entry->unit == -1)
+    entry->unit = oggz_get_unit (oggz, entry->serialno, entry->granulepos);
+
+  return entry->unit;
+}
+
+/*
+ * oggz_index_known (oggz, n, end)
+ *
+ * Find the first indexed page at or after n, and before end, whose unit
+ * is known. Pages of streams with no metric have no unit and are not
+ * ordered against the others. Returns end if there is no such page.
+ */
+static int
+oggz_index_known (OGGZ * oggz, int n, int end)
+{
+  OggzIndex * index = oggz->x.reader.index;
+
+  while (n < end &&
+         oggz_index_entry_unit (oggz, oggz_index_nth (index, n)) == -1)
+    n++;
+
+  return n;
+}
+
+/*
+ * oggz_index_lookup (oggz, unit_target, &prev, &next, &linked)
+ *
+ * Find the indexed pages either side of unit_target: prev is the last
+ * page with unit <= unit_target, and next is the first page with a known
+ * unit after it. Either may be NULL if no such page has been indexed.
+ * linked is set if every page from prev to next was read consecutively.
+ */
+static void
+oggz_index_lookup (OGGZ * oggz, ogg_int64_t unit_target,
+                   oggz_index_entry_t ** prev, oggz_index_entry_t ** next,
+                   int * linked)
+{
+  OggzIndex * index = oggz->x.reader.index;
+  int size = oggz_index_size (index);
+  int lo = 0, hi = size, mid, known, i;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    known = oggz_index_known (oggz, mid, hi);
+    if (known < hi &&
+        oggz_index_entry_unit (oggz, oggz_index_nth (index, known)) <= unit_target)
+      lo = known + 1;
+    else
+      hi = mid;
+  }
+
+  for (i = lo - 1; i >= 0; i--) {
+    if (oggz_index_entry_unit (oggz, oggz_index_nth (index, i)) != -1)
+      break;
+  }
+  known = oggz_index_known (oggz, lo, size);
+
+  *prev = oggz_index_nth (index, i);
+  *next = oggz_index_nth (index, known);
+
+  *linked = (*prev != NULL && *next != NULL);
+  for (; *linked && i < known; i++) {
+    if (!oggz_index_nth (index, i)->linked) *linked = 0;
+  }
+}
+
+/*
+ * oggz_keypoints_drop (oggz)
+ *
+ * Forget the keypoints of all streams.
+ */
+static void
+oggz_keypoints_drop (OGGZ * oggz)
+{
+  oggz_stream_t * stream;
+  int i, size;
+
+  size = oggz_vector_size (oggz->streams);
+  for (i = 0; i < size; i++) {
+    stream = (oggz_stream_t *)oggz_vector_nth_p (oggz->streams, i);
+    if (stream->keypoints != NULL && !stream->shared)
+      oggz_free (stream->keypoints);
+    stream->keypoints = NULL;
+    stream->nr_keypoints = 0;
+    stream->keypoints_end = -1;
+  }
+}
+
+/*
+ * oggz_keypoint_lookup (oggz, unit_target, offset_file_end, &unit, &serialno)
+ *
+ * Find the offset from which every stream can be decoded at unit_target,
+ * using the keypoints of a Skeleton index. Returns -1 unless all streams
+ * with a metric are indexed and have a keypoint at or before unit_target,
+ * and unit_target is before the next keypoint or the end of the indexed
+ * stream. Keypoint units come from the built-in metrics, so streams with
+ * a metric set by oggz_set_metric() cannot use them. serialno is set to
+ * the stream whose keypoint gave the offset.
+ *
+ * The keypoints are dropped if the Skeleton segment length is not
+ * offset_file_end, as the file has changed since the index was made.
+ */
 static oggz_off_t
+oggz_keypoint_lookup (OGGZ * oggz, ogg_int64_t unit_target,
+                      oggz_off_t offset_file_end, ogg_int64_t * unit,
+                      long * serialno)
+{
+  oggz_stream_t * stream;
+  oggz_keypoint_t * keypoint;
+  oggz_off_t offset = -1;
+  int i, size;
+  long lo, hi, mid;
+
+  size = oggz_vector_size (oggz->streams);
+  for (i = 0; i < size; i++) {
+    stream = (oggz_stream_t *)oggz_vector_nth_p (oggz->streams, i);
+    if (stream->content == OGGZ_CONTENT_SKELETON &&
+        stream->segment_length == offset_file_end)
+      break;
+  }
+  if (i == size) {
+    oggz_keypoints_drop (oggz);
+    return -1;
+  }
+
+  for (i = 0; i < size; i++) {
+    stream = (oggz_stream_t *)oggz_vector_nth_p (oggz->streams, i);
+    if (stream->content == OGGZ_CONTENT_SKELETON || stream->metric == NULL)
+      continue;
+
+    if (!stream->metric_internal) return -1;
+
+    lo = 0;
+    hi = stream->nr_keypoints;
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (stream->keypoints[mid].unit <= unit_target)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo == 0) return -1;
+
+    /* Past the last keypoint, the target may be past the end of the data */
+    if (lo == stream->nr_keypoints &&
+        (stream->keypoints_end == -1 || unit_target > stream->keypoints_end))
+      return -1;
+
+    keypoint = &stream->keypoints[lo-1];
+    if (offset == -1) {
+      offset = keypoint->offset;
+      *unit = keypoint->unit;
+      *serialno = stream->ogg_stream.serialno;
+    } else {
+      if (keypoint->offset < offset) {
+        offset = keypoint->offset;
+        *serialno = stream->ogg_stream.serialno;
+      }
+      *unit = MIN (*unit, keypoint->unit);
+    }
+  }
+
+  return offset;
+}
+
+/*
+ * oggz_keypoint_check (oggz, offset, serialno, unit_target)
+ *
+ * Check that a page of stream serialno starts at the keypoint offset, and
+ * that it ends at or before unit_target. A page on which no packet ends
+ * has no granulepos to check. Returns 1 if the keypoint can be used.
+ */
+static int
+oggz_keypoint_check (OGGZ * oggz, oggz_off_t offset, long serialno,
+                     ogg_int64_t unit_target)
+{
+  ogg_page * og = &oggz->current_page;
+  ogg_int64_t granulepos;
+
+  if (oggz_seek_raw (oggz, offset, SEEK_SET) != offset) return 0;
+
+  if (oggz_get_next_page (oggz, og) != offset) return 0;
+
+  if (ogg_page_serialno (og) != serialno) return 0;
+
+  granulepos = ogg_page_granulepos (og);
+  if (granulepos == -1) return 1;
+
+  return (oggz_get_unit (oggz, serialno, granulepos) <= unit_target);
+}
+
+oggz_off_t
 oggz_offset_end (OGGZ * oggz)
 {
   int fd;
@@ -614,6 +916,26 @@ oggz_offset_end (OGGZ * oggz)
   return offset_end;
 }
 
+/*
+ * The end offset of the file, remembered across seeks. Forgetting it
+ * also forgets the unit of the last page.
+ */
+static oggz_off_t
+oggz_seek_offset_end (OGGZ * oggz)
+{
+  OggzReader * reader = &oggz->x.reader;
+  oggz_off_t offset_end;
+
+  if (reader->bounds_end != -1) return reader->bounds_end;
+
+  if ((offset_end = oggz_offset_end (oggz)) == -1) return -1;
+
+  reader->bounds_end = offset_end;
+  reader->bounds_end_serialno = -1;
+
+  return offset_end;
+}
+
 ogg_int64_t
 oggz_bounded_seek_set (OGGZ * oggz,
                        ogg_int64_t unit_target,
@@ -622,12 +944,17 @@ oggz_bounded_seek_set (OGGZ * oggz,
 {
   OggzReader * reader;
   oggz_off_t offset_orig, offset_at, offset_guess;
-  oggz_off_t offset_next;
+  oggz_off_t offset_next, offset_page_end, offset_end_page = -1;
+  oggz_index_entry_t * index_prev = NULL, * index_next = NULL;
+  int index_linked = 0;
   ogg_int64_t granule_at;
   ogg_int64_t unit_at, unit_begin = -1, unit_end = -1, unit_last_iter = -1;
   long serialno;
   ogg_page * og;
+  oggz_seek_search search;
+  oggz_seek_sample_t * sample;
   int hit_eof = 0;
+  int cached, i;
 
   if (oggz == NULL) {
     return -1;
@@ -640,15 +967,16 @@ oggz_bounded_seek_set (OGGZ * oggz,
     return -1;
   }
   
-  if (offset_end == -1 && (offset_end = oggz_offset_end (oggz)) == -1) {
+  reader = &oggz->x.reader;
+
+  cached = (offset_end == -1);
+  if (cached && (offset_end = oggz_seek_offset_end (oggz)) == -1) {
 #ifdef DEBUG
     printf ("oggz_bounded_seek_set: oggz_offset_end == -1, FAIL\n");
 #endif
     return -1;
   }
 
-  reader = &oggz->x.reader;
-
   if (unit_target == reader->current_unit) {
 #ifdef DEBUG
     printf ("oggz_bounded_seek_set: unit_target == reader->current_unit, SKIP\n");
@@ -662,35 +990,155 @@ oggz_bounded_seek_set (OGGZ * oggz,
     return 0;
   }
 
+  /* Checking a keypoint moves the read position, so save it first */
+  offset_orig = oggz->offset;
+
+  if (cached && reader->bounds_end_serialno != -1) {
+    unit_end = oggz_get_unit (oggz, reader->bounds_end_serialno,
+                              reader->bounds_end_granulepos);
+  }
+
+  /* With a Skeleton index, jump straight to the keypoint, unless the
+   * target is already known to be past the end. The page there is checked
+   * first, and bisection is used if the index does not match the file. */
+  if ((oggz->flags & OGGZ_AUTO) && (unit_end == -1 || unit_target <= unit_end)) {
+    offset_at = oggz_keypoint_lookup (oggz, unit_target,
+                                      oggz_seek_offset_end (oggz),
+                                      &unit_at, &serialno);
+    if (offset_at >= offset_begin && offset_at < offset_end &&
+        oggz_keypoint_check (oggz, offset_at, serialno, unit_target)) {
+#ifdef DEBUG
+      printf ("oggz_bounded_seek_set: KEYPOINT (%lld) @%" PRI_OGGZ_OFF_T "d\n",
+              unit_at, offset_at);
+#endif
+      offset_at = oggz_reset (oggz, offset_at, unit_at, SEEK_SET);
+      if (offset_at == -1) return -1;
+
+      return (long)reader->current_unit;
+    }
+  }
+
+  if (reader->index != NULL) {
+    oggz_index_lookup (oggz, unit_target, &index_prev, &index_next,
+                       &index_linked);
+
+    /* If the pages either side of the target were read consecutively, the
+     * earlier one is the page to seek to; no bisection is needed. */
+    if (index_linked &&
+        index_prev->offset >= offset_begin &&
+        index_next->offset + index_next->bytes <= offset_end &&
+        oggz_index_entry_unit (oggz, index_next) > unit_target) {
+#ifdef DEBUG
+      printf ("oggz_bounded_seek_set: INDEXED (%lld) @%" PRI_OGGZ_OFF_T "d\n",
+              index_prev->unit, index_prev->offset);
+#endif
+      offset_at = oggz_reset (oggz, index_prev->offset, index_prev->unit,
+                              SEEK_SET);
+      if (offset_at == -1) return -1;
+
+      return (long)reader->current_unit;
+    }
+  }
+
   offset_at = oggz_tell_raw (oggz);
   if (offset_at == -1) return -1;
 
-  offset_orig = oggz->offset;
-
   unit_at = reader->current_unit;
 
   og = &oggz->current_page;
 
-  if (unit_end == -1 && oggz_seek_raw (oggz, offset_end, SEEK_SET) >= 0) {
+  /* Units are recalculated from the cached pages, as metrics may change */
+  if (cached && reader->bounds_end_serialno != -1) {
+    unit_end = oggz_get_unit (oggz, reader->bounds_end_serialno,
+                              reader->bounds_end_granulepos);
+    offset_end_page = reader->bounds_end_page;
+
+    /* Past the end; look again in case the file has grown */
+    if (unit_target > unit_end && oggz_offset_end (oggz) > offset_end) {
+      reader->bounds_end = -1;
+      return oggz_bounded_seek_set (oggz, unit_target, offset_begin, -1);
+    }
+  } else if (oggz_seek_raw (oggz, offset_end, SEEK_SET) >= 0) {
     ogg_int64_t granulepos;
 
-    if (oggz_get_prev_start_page (oggz, og, &granulepos, &serialno) >= 0) {
+    offset_end_page = oggz_get_prev_start_page (oggz, og, &granulepos,
+                                                &serialno);
+    if (offset_end_page >= 0) {
       unit_end = oggz_get_unit (oggz, serialno, granulepos);
+      if (cached) {
+        reader->bounds_end_serialno = serialno;
+        reader->bounds_end_granulepos = granulepos;
+        reader->bounds_end_page = offset_end_page;
+      }
     }
   }
 
-  if (unit_begin == -1 && oggz_seek_raw (oggz, offset_begin, SEEK_SET) >= 0) {
+  if (offset_begin == reader->bounds_begin &&
+      reader->bounds_begin_serialno != -1) {
+    unit_begin = oggz_get_unit (oggz, reader->bounds_begin_serialno,
+                                reader->bounds_begin_granulepos);
+  } else if (oggz_seek_raw (oggz, offset_begin, SEEK_SET) >= 0) {
     ogg_int64_t granulepos;
     if (oggz_get_next_start_page (oggz, og) >= 0) {
       serialno = ogg_page_serialno (og);
       granulepos = ogg_page_granulepos (og);
       unit_begin = oggz_get_unit (oggz, serialno, granulepos);
+      reader->bounds_begin = offset_begin;
+      reader->bounds_begin_serialno = serialno;
+      reader->bounds_begin_granulepos = granulepos;
     }
   }
 
   /* Fail if target isn't in specified range. */
-  if (unit_target < unit_begin || unit_target > unit_end)
+  if (unit_target < unit_begin || unit_target > unit_end) {
+    oggz_reset (oggz, offset_orig, -1, SEEK_SET);
     return -1;
+  }
+
+  /* The target is the end of the last page, which is already known */
+  if (unit_target == unit_end && offset_end_page >= 0) {
+#ifdef DEBUG
+    printf ("oggz_bounded_seek_set: LAST PAGE (%lld) @%" PRI_OGGZ_OFF_T "d\n",
+            unit_end, offset_end_page);
+#endif
+    offset_at = oggz_reset (oggz, offset_end_page, unit_end, SEEK_SET);
+    if (offset_at == -1) return -1;
+
+    return (long)reader->current_unit;
+  }
+
+  /* Reduce the search range if possible using indexed pages. */
+  if (index_prev != NULL && index_prev->unit > unit_begin &&
+      index_prev->offset > offset_begin) {
+    unit_begin = index_prev->unit;
+    offset_begin = index_prev->offset;
+  }
+  if (index_next != NULL && index_next->unit < unit_end &&
+      index_next->offset < offset_end) {
+    unit_end = index_next->unit;
+    offset_end = index_next->offset;
+  }
+
+  /* Reduce the search range if possible using pages probed by earlier
+   * seeks. Units are recalculated as metrics may have changed. */
+  for (i = 0; i < reader->nr_seek_samples; i++) {
+    sample = &reader->seek_samples[i];
+    if (sample->offset <= offset_begin || sample->offset > offset_end)
+      continue;
+
+    unit_at = oggz_get_unit (oggz, sample->serialno, sample->granulepos);
+    if (unit_at == -1) continue;
+
+    if (unit_at < unit_target && unit_at > unit_begin) {
+      unit_begin = unit_at;
+      offset_begin = sample->offset;
+    } else if (unit_at > unit_target && unit_at < unit_end) {
+      unit_end = unit_at;
+      offset_end = sample->offset - 1;
+    }
+  }
+
+  unit_at = reader->current_unit;
 
   /* Reduce the search range if possible using read cursor position. */
   if (unit_at > unit_begin && unit_at < unit_end) {
@@ -703,8 +1151,18 @@ oggz_bounded_seek_set (OGGZ * oggz,
     }
   }
 
+  /* The last page starts before the end of the file; unless it is the
+   * target, don't bother probing beyond its start. */
+  if (unit_target < unit_end && offset_end_page > offset_begin &&
+      offset_end_page <= offset_end) {
+    offset_end = offset_end_page - 1;
+  }
+
   og = &oggz->current_page;
 
+  oggz_seek_search_init (&search, unit_target, unit_begin, unit_end,
+                         offset_begin, offset_end);
+
   for ( ; ; ) {
 
     unit_last_iter = unit_at;
@@ -715,9 +1173,7 @@ oggz_bounded_seek_set (OGGZ * oggz,
 	    unit_target, unit_begin, unit_end, offset_begin, offset_end);
 #endif
 
-    offset_guess = oggz_seek_guess (unit_at, unit_target,
-				    unit_begin, unit_end,
-				    offset_at,
+    offset_guess = oggz_seek_guess (&search, unit_begin, unit_end,
 				    offset_begin, offset_end);
     if (offset_guess == -1) break;
 
@@ -726,19 +1182,37 @@ oggz_bounded_seek_set (OGGZ * oggz,
       break;
     }
 
+    reader->seek_probes++;
+
     if (offset_guess > offset_end) {
       offset_guess = offset_end;
       offset_at = oggz_seek_raw (oggz, offset_guess, SEEK_SET);
       offset_next = oggz_get_prev_start_page (oggz, og, &granule_at, &serialno);
+      offset_page_end = offset_next + 1;
     } else {
       offset_at = oggz_seek_raw (oggz, offset_guess, SEEK_SET);
       offset_next = oggz_get_next_start_page (oggz, og);
       serialno = ogg_page_serialno (og);
       granule_at = ogg_page_granulepos (og);
+      offset_page_end = offset_next + og->header_len + og->body_len;
+    }
+
+    if (offset_next == -1) break;
+
+    if (offset_next < 0) {
+      /* No page starts between the guess and the end of the file */
+      offset_end = offset_at - 1;
+      if (offset_end <= offset_begin) break;
+      oggz_seek_search_update (&search, 1, unit_target, unit_begin, unit_end,
+                               offset_begin, offset_end);
+      continue;
     }
 
     unit_at = oggz_get_unit (oggz, serialno, granule_at);
 
+    if (granule_at != -1)
+      oggz_seek_sample_add (reader, offset_next, serialno, granule_at);
+
 #ifdef DEBUG
     printf ("oggz_bounded_seek_set: offset_next %" PRI_OGGZ_OFF_T "d\n", offset_next);
 #endif
@@ -750,13 +1224,19 @@ oggz_bounded_seek_set (OGGZ * oggz,
 #endif
 
     if (unit_at < unit_target) {
-      offset_begin = offset_at;
+      /* No later page can start within the page found */
+      offset_begin = offset_page_end;
       unit_begin = unit_at;
+      if (offset_begin > offset_end) break;
       if (unit_end == unit_begin) break;
+      oggz_seek_search_update (&search, -1, unit_target, unit_begin, unit_end,
+                               offset_begin, offset_end);
     } else if (unit_at > unit_target) {
       offset_end = offset_at-1;
       unit_end = unit_at;
       if (unit_end == unit_begin) break;
+      oggz_seek_search_update (&search, 1, unit_target, unit_begin, unit_end,
+                               offset_begin, offset_end);
     } else {
       break;
     }
@@ -782,34 +1262,58 @@ oggz_bounded_seek_set (OGGZ * oggz,
   return (long)reader->current_unit;
 }
 
-static ogg_int64_t
-oggz_seek_end (OGGZ * oggz, ogg_int64_t unit_offset)
+/*
+ * Find the last page of the file, unless it is already known, and keep it
+ * in the read bounds. This leaves the read position at the end of the file.
+ */
+int
+oggz_seek_find_end (OGGZ * oggz)
 {
-  oggz_off_t offset_orig, offset_at, offset_end;
+  OggzReader * reader = &oggz->x.reader;
+  oggz_off_t offset_at, offset_end;
   ogg_int64_t granulepos;
-  ogg_int64_t unit_end;
   long serialno;
-  ogg_page * og;
-
-  og = &oggz->current_page;
-
-  offset_orig = oggz->offset;
 
   offset_at = oggz_seek_raw (oggz, 0, SEEK_END);
   if (offset_at == -1) return -1;
 
-  offset_end = oggz_get_prev_start_page (oggz, og, &granulepos, &serialno);
+  if (offset_at == reader->bounds_end && reader->bounds_end_serialno != -1)
+    return 0;
+
+  offset_end = oggz_get_prev_start_page (oggz, &oggz->current_page,
+                                         &granulepos, &serialno);
+  if (offset_end < 0) return -1;
+
+  reader->bounds_end = offset_at;
+  reader->bounds_end_serialno = serialno;
+  reader->bounds_end_granulepos = granulepos;
+  reader->bounds_end_page = offset_end;
+
+  return 0;
+}
+
+static ogg_int64_t
+oggz_seek_end (OGGZ * oggz, ogg_int64_t unit_offset)
+{
+  OggzReader * reader;
+  oggz_off_t offset_orig;
+  ogg_int64_t unit_end;
+
+  reader = &oggz->x.reader;
+
+  offset_orig = oggz->offset;
 
-  if (offset_end < 0) {
+  if (oggz_seek_find_end (oggz) == -1) {
     oggz_reset (oggz, offset_orig, -1, SEEK_SET);
     return -1;
   }
 
-  unit_end = oggz_get_unit (oggz, serialno, granulepos);
+  unit_end = oggz_get_unit (oggz, reader->bounds_end_serialno,
+                            reader->bounds_end_granulepos);
 
 #ifdef DEBUG
   printf ("*** oggz_seek_end: found packet (%lld) at @%" PRI_OGGZ_OFF_T "d [%lld]\n",
-	  unit_end, offset_end, granulepos);
+	  unit_end, reader->bounds_end_page, reader->bounds_end_granulepos);
 #endif
 
   return oggz_bounded_seek_set (oggz, unit_end + unit_offset, 0, -1);
@@ -868,6 +1372,7 @@ oggz_seek_units (OGGZ * oggz, ogg_int64_t units, int whence)
   }
 
   reader = &oggz->x.reader;
+  reader->seek_probes = 0;
 
   switch (whence) {
   case SEEK_SET:
@@ -890,6 +1395,16 @@ oggz_seek_units (OGGZ * oggz, ogg_int64_t units, int whence)
   return r;
 }
 
+int
+oggz_seek_get_probes (OGGZ * oggz)
+{
+  if (oggz == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+  if (oggz->flags & OGGZ_WRITE) return OGGZ_ERR_INVALID;
+
+  return oggz->x.reader.seek_probes;
+}
+
 long
 oggz_seek_byorder (OGGZ * oggz, void * target)
 {
@@ -919,6 +1434,12 @@ oggz_seek_units (OGGZ * oggz, ogg_int64_t units, int whence)
   return OGGZ_ERR_DISABLED;
 }
 
+int
+oggz_seek_get_probes (OGGZ * oggz)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
 long
 oggz_seek_byorder (OGGZ * oggz, void * target)
 {
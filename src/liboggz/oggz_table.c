@@ -33,16 +33,109 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include "oggz_macros.h"
 #include "oggz_vector.h"
 
+#define OGGZ_TABLE_MIN_INDEX 16
+
 typedef struct _OggzTable OggzTable;
 
+/*
+ * Keys and data are kept in insertion order in a pair of vectors, so that
+ * oggz_table_nth() is unchanged. Lookups go through an open addressed
+ * hash of vector positions, sized to at least twice the number of keys,
+ * after first checking the position of the previous hit.
+ */
 struct _OggzTable {
   OggzVector * keys;
   OggzVector * data;
+
+  int * index; /* vector position + 1 of each key, or 0 if empty */
+  int index_size; /* power of two, or 0 if there is no index */
+  int last; /* vector position of last lookup hit, or -1 */
 };
 
+static unsigned long
+oggz_table_hash (long key)
+{
+  unsigned long h = (unsigned long)key * 2654435761UL;
+
+  return h ^ (h >> 16);
+}
+
+static void
+oggz_table_index_add (OggzTable * table, int n)
+{
+  unsigned long mask = (unsigned long)table->index_size - 1;
+  unsigned long i;
+
+  i = oggz_table_hash (oggz_vector_nth_l (table->keys, n)) & mask;
+  while (table->index[i] != 0) i = (i + 1) & mask;
+
+  table->index[i] = n + 1;
+}
+
+/*
+ * Rebuild the index with room for min_size keys. If that fails the
+ * index is dropped, and lookups fall back to scanning the keys.
+ */
+static void
+oggz_table_index_build (OggzTable * table, int min_size)
+{
+  int size, i, n;
+
+  if (table->index != NULL) oggz_free (table->index);
+  table->index = NULL;
+  table->index_size = 0;
+  table->last = -1;
+
+  for (size = OGGZ_TABLE_MIN_INDEX; size < 2 * min_size; size *= 2);
+
+  if ((table->index = oggz_malloc (size * sizeof (int))) == NULL)
+    return;
+
+  memset (table->index, 0, size * sizeof (int));
+  table->index_size = size;
+
+  n = oggz_vector_size (table->keys);
+  for (i = 0; i < n; i++) {
+    oggz_table_index_add (table, i);
+  }
+}
+
+static int
+oggz_table_find (OggzTable * table, long key)
+{
+  unsigned long mask, i;
+  int n, size;
+
+  n = table->last;
+  if (n != -1 && oggz_vector_nth_l (table->keys, n) == key)
+    return n;
+
+  if (table->index == NULL) {
+    size = oggz_vector_size (table->keys);
+    for (n = 0; n < size; n++) {
+      if (oggz_vector_nth_l (table->keys, n) == key) {
+        return (table->last = n);
+      }
+    }
+    return -1;
+  }
+
+  mask = (unsigned long)table->index_size - 1;
+  for (i = oggz_table_hash (key) & mask; table->index[i] != 0;
+       i = (i + 1) & mask) {
+    n = table->index[i] - 1;
+    if (oggz_vector_nth_l (table->keys, n) == key) {
+      return (table->last = n);
+    }
+  }
+
+  return -1;
+}
+
 OggzTable *
 oggz_table_new (void)
 {
@@ -54,6 +147,10 @@ oggz_table_new (void)
   table->keys = oggz_vector_new ();
   table->data = oggz_vector_new ();
 
+  table->index = NULL;
+  table->index_size = 0;
+  table->last = -1;
+
   return table;
 }
 
@@ -64,43 +161,58 @@ oggz_table_delete (OggzTable * table)
 
   oggz_vector_delete (table->keys);
   oggz_vector_delete (table->data);
+  if (table->index != NULL) oggz_free (table->index);
   oggz_free (table);
 }
 
 void *
 oggz_table_lookup (OggzTable * table, long key)
 {
-  int i, size;
+  int n;
 
   if (table == NULL) return NULL;
 
-  size = oggz_vector_size (table->keys);
-  for (i = 0; i < size; i++) {
-    if (oggz_vector_nth_l (table->keys, i) == key) {
-      return oggz_vector_nth_p (table->data, i);
-    }
-  }
+  if ((n = oggz_table_find (table, key)) == -1)
+    return NULL;
 
-  return NULL;
+  return oggz_vector_nth_p (table->data, n);
 }
 
-void *
-oggz_table_insert (OggzTable * table, long key, void * data)
+int
+oggz_table_remove (OggzTable * table, long key)
 {
   void * old_data;
 
   if ((old_data = oggz_table_lookup (table, key)) != NULL) {
     if (oggz_vector_remove_l (table->keys, key) == NULL)
-      return NULL;
+      return -1;
 
     if (oggz_vector_remove_p (table->data, old_data) == NULL) {
       /* XXX: This error condition can only happen if the previous
        * removal succeeded, and this removal failed, ie. there was
        * an error reallocing table->data->data downwards. */
-      return NULL;
+      return -1;
     }
+
+    /* Later keys have moved down a position */
+    oggz_table_index_build (table, oggz_vector_size (table->keys));
+  }
+  
+  return 0;
+}
+
+void *
+oggz_table_insert (OggzTable * table, long key, void * data)
+{
+  int size;
+
+  if (oggz_table_lookup (table, key) != NULL) {
+    if (oggz_table_remove (table, key) == -1)
+      return NULL;
   }
 
+  size = oggz_vector_size (table->keys);
+
   if (oggz_vector_insert_l (table->keys, key) == -1)
     return NULL;
   
@@ -109,27 +221,13 @@ oggz_table_insert (OggzTable * table, long key, void * data)
     return NULL;
   }
 
-  return data;
-}
-
-int
-oggz_table_remove (OggzTable * table, long key)
-{
-  void * old_data;
-
-  if ((old_data = oggz_table_lookup (table, key)) != NULL) {
-    if (oggz_vector_remove_l (table->keys, key) == NULL)
-      return -1;
-
-    if (oggz_vector_remove_p (table->data, old_data) == NULL) {
-      /* XXX: This error condition can only happen if the previous
-       * removal succeeded, and this removal failed, ie. there was
-       * an error reallocing table->data->data downwards. */
-      return -1;
-    }
+  if (2 * (size + 1) > table->index_size) {
+    oggz_table_index_build (table, size + 1);
+  } else {
+    oggz_table_index_add (table, size);
   }
-  
-  return 0;
+
+  return data;
 }
 
 int
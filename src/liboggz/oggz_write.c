@@ -57,6 +57,8 @@
 #include "oggz_private.h"
 #include "oggz_vector.h"
 
+#include "oggz/oggz_write.h"
+
 /* #define DEBUG */
 
 /* Define to 0 or 1 */
@@ -93,13 +95,13 @@ oggz_write_init (OGGZ * oggz)
 
   writer->next_zpacket = NULL;
 
-  writer->packet_queue = oggz_vector_new ();
+  writer->packet_queue = oggz_heap_new ();
   if (writer->packet_queue == NULL) return NULL;
 
 #ifdef ZPACKET_CMP
   /* XXX: comparison function should only kick in when a metric is set */
-  oggz_vector_set_cmp (writer->packet_queue,
-		       (OggzCmpFunc)oggz_zpacket_cmp, oggz);
+  oggz_heap_set_cmp (writer->packet_queue,
+		     (OggzCmpFunc)oggz_zpacket_cmp, oggz);
 #endif
 
   writer->hungry = NULL;
@@ -124,12 +126,22 @@ oggz_write_init (OGGZ * oggz)
 
   writer->current_stream = NULL;
 
+  oggz_pool_init (&writer->pool, sizeof (oggz_writer_packet_t));
+
+  writer->batch = NULL;
+  writer->batch_bytes = 0;
+  writer->batch_fill = 0;
+  writer->batch_max_units = 0;
+  writer->batch_unit_begin = -1;
+
   return oggz;
 }
 
 static int
-oggz_writer_packet_free (oggz_writer_packet_t * zpacket)
+oggz_writer_packet_free (oggz_writer_packet_t * zpacket, void * data)
 {
+  OggzWriter * writer = (OggzWriter *)data;
+
   if (!zpacket) return 0;
 
   if (zpacket->guard) {
@@ -137,9 +149,9 @@ oggz_writer_packet_free (oggz_writer_packet_t * zpacket)
     *zpacket->guard = 1;
   } else {
     /* managed by oggz; free copied data */
-    oggz_free (zpacket->op.packet);
+    oggz_pool_bytes_free (&writer->pool, zpacket->op.packet);
   }
-  oggz_free (zpacket);
+  oggz_pool_entry_free (&writer->pool, zpacket);
 
   return 0;
 }
@@ -167,13 +179,18 @@ oggz_write_close (OGGZ * oggz)
   OggzWriter * writer = &oggz->x.writer;
 
   oggz_write_flush (oggz);
+  oggz_write_batch_flush (oggz);
 
-  oggz_writer_packet_free (writer->current_zpacket);
-  oggz_writer_packet_free (writer->next_zpacket);
+  oggz_writer_packet_free (writer->current_zpacket, writer);
+  oggz_writer_packet_free (writer->next_zpacket, writer);
 
-  oggz_vector_foreach (writer->packet_queue,
-		       (OggzFunc)oggz_writer_packet_free);
-  oggz_vector_delete (writer->packet_queue);
+  oggz_heap_foreach1 (writer->packet_queue,
+                      (OggzFunc1)oggz_writer_packet_free, writer);
+  oggz_heap_delete (writer->packet_queue);
+
+  oggz_pool_clear (&writer->pool);
+
+  if (writer->batch != NULL) oggz_free (writer->batch);
 
   return oggz;
 }
@@ -311,7 +328,7 @@ oggz_write_feed (OGGZ * oggz, ogg_packet * op, long serialno, int flush,
 
   /* Now set up the packet and add it to the queue */
   if (guard == NULL) {
-    new_buf = oggz_malloc ((size_t)op->bytes);
+    new_buf = oggz_pool_bytes_new (&writer->pool, op->bytes);
     if (new_buf == NULL) return OGGZ_ERR_OUT_OF_MEMORY;
 
     memcpy (new_buf, op->packet, (size_t)op->bytes);
@@ -319,9 +336,9 @@ oggz_write_feed (OGGZ * oggz, ogg_packet * op, long serialno, int flush,
     new_buf = op->packet;
   }
 
-  packet = oggz_malloc (sizeof (oggz_writer_packet_t));
+  packet = oggz_pool_entry_new (&writer->pool);
   if (packet == NULL) {
-    if (guard == NULL && new_buf != NULL) oggz_free (new_buf);
+    if (guard == NULL) oggz_pool_bytes_free (&writer->pool, new_buf);
     return OGGZ_ERR_OUT_OF_MEMORY;
   }
 
@@ -342,9 +359,9 @@ oggz_write_feed (OGGZ * oggz, ogg_packet * op, long serialno, int flush,
 	  new_op->b_o_s, new_op->e_o_s, new_op->bytes, packet->flush);
 #endif
 
-  if (oggz_vector_insert_p (writer->packet_queue, packet) == NULL) {
-    oggz_free (packet);
-    if (!guard) oggz_free (new_buf);
+  if (oggz_heap_insert (writer->packet_queue, packet) == NULL) {
+    oggz_pool_entry_free (&writer->pool, packet);
+    if (!guard) oggz_pool_bytes_free (&writer->pool, new_buf);
     return -1;
   }
 
@@ -352,7 +369,7 @@ oggz_write_feed (OGGZ * oggz, ogg_packet * op, long serialno, int flush,
 
 #ifdef DEBUG
   printf ("oggz_write_feed: enqueued packet, queue size %d\n",
-	  oggz_vector_size (writer->packet_queue));
+	  oggz_heap_size (writer->packet_queue));
 #endif
 
   return 0;
@@ -572,6 +589,66 @@ oggz_page_writeout (OGGZ * oggz, long n)
   return h + b;
 }
 
+/*
+ * Write out the pages gathered in the batch with a single write.
+ */
+int
+oggz_write_batch_flush (OGGZ * oggz)
+{
+  OggzWriter * writer = &oggz->x.writer;
+  long nwritten, fill = writer->batch_fill;
+
+  if (fill == 0) return 0;
+
+  nwritten = (long)oggz_io_write (oggz, writer->batch, fill);
+
+#ifdef DEBUG
+  if (nwritten < fill) {
+    printf ("oggz_write_batch_flush: %ld < %ld\n", nwritten, fill);
+  }
+#endif
+
+  writer->batch_fill = 0;
+  writer->batch_unit_begin = -1;
+
+  return (nwritten == fill) ? 0 : OGGZ_ERR_SYSTEM;
+}
+
+/*
+ * Copy up to n bytes of the current page into the batch, flushing the
+ * batch when it is full, or before the page would take it past its time
+ * budget.
+ */
+static long
+oggz_page_batchout (OGGZ * oggz, long n)
+{
+  OggzWriter * writer = &oggz->x.writer;
+  ogg_page * og = &oggz->current_page;
+  ogg_int64_t granulepos, unit;
+  long bytes;
+
+  if (writer->batch_max_units > 0 && writer->page_offset == 0 &&
+      (granulepos = ogg_page_granulepos (og)) != -1 &&
+      (unit = oggz_get_unit (oggz, ogg_page_serialno (og), granulepos)) != -1) {
+    /* A new page; check the time the batch would span with it */
+    if (writer->batch_unit_begin != -1 &&
+        unit - writer->batch_unit_begin > writer->batch_max_units) {
+      oggz_write_batch_flush (oggz);
+    }
+    if (writer->batch_unit_begin == -1)
+      writer->batch_unit_begin = unit;
+  }
+
+  n = MIN (n, writer->batch_bytes - writer->batch_fill);
+  bytes = oggz_page_copyout (oggz, writer->batch + writer->batch_fill, n);
+  writer->batch_fill += bytes;
+
+  if (writer->batch_fill == writer->batch_bytes)
+    oggz_write_batch_flush (oggz);
+
+  return bytes;
+}
+
 static int
 oggz_dequeue_packet (OGGZ * oggz, oggz_writer_packet_t ** next_zpacket)
 {
@@ -585,27 +662,27 @@ oggz_dequeue_packet (OGGZ * oggz, oggz_writer_packet_t ** next_zpacket)
     *next_zpacket = writer->next_zpacket;
     writer->next_zpacket = NULL;
   } else {
-    *next_zpacket = oggz_vector_pop (writer->packet_queue);
+    *next_zpacket = oggz_heap_pop (writer->packet_queue);
 
     if (*next_zpacket == NULL) {
       if (writer->hungry) {
         ret = writer->hungry (oggz, 1, writer->hungry_user_data);
-        *next_zpacket = oggz_vector_pop (writer->packet_queue);
+        *next_zpacket = oggz_heap_pop (writer->packet_queue);
 #ifdef DEBUG
         printf ("oggz_dequeue_packet: called hungry and popped, new queue size %d\n",
-  	        oggz_vector_size (writer->packet_queue));
+  	        oggz_heap_size (writer->packet_queue));
 #endif
 
 #ifdef DEBUG
       } else {
         printf ("oggz_dequeue_packet: no packet, no hungry, queue size %d\n",
-                oggz_vector_size (writer->packet_queue));
+                oggz_heap_size (writer->packet_queue));
 #endif
       }
 #ifdef DEBUG
     } else {
     printf ("oggz_dequeue_packet: dequeued packet, queue size %d\n",
-            oggz_vector_size (writer->packet_queue));
+            oggz_heap_size (writer->packet_queue));
 #endif
     }
 
@@ -630,14 +707,14 @@ oggz_writer_make_packet (OGGZ * oggz)
 
   /* finished with current packet; unguard */
   zpacket = writer->current_zpacket;
-  oggz_writer_packet_free (zpacket);
+  oggz_writer_packet_free (zpacket, writer);
   writer->current_zpacket = NULL;
 
   /* if the user wants the hungry callback after every packet, give
    * it to them, marking emptiness appropriately
    */
   if (writer->hungry && !writer->hungry_only_when_empty) {
-    int empty = (oggz_vector_size (writer->packet_queue) == 0);
+    int empty = (oggz_heap_size (writer->packet_queue) == 0);
     cb_ret = writer->hungry (oggz, empty, writer->hungry_user_data);
   }
 
@@ -784,6 +861,122 @@ oggz_write_output (OGGZ * oggz, unsigned char * buf, long n)
   return nwritten;
 }
 
+int
+oggz_write_output_iov (OGGZ * oggz, oggz_iovec * iov, int iovcnt)
+{
+  OggzWriter * writer;
+  ogg_page * og;
+  long offset;
+  int active = 1, cb_ret = 0, n = 0;
+
+  if (oggz == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+  writer = &oggz->x.writer;
+
+  if (!(oggz->flags & OGGZ_WRITE) || iov == NULL || iovcnt < 1) {
+    return OGGZ_ERR_INVALID;
+  }
+
+  if (writer->writing) return OGGZ_ERR_RECURSIVE_WRITE;
+  writer->writing = 1;
+
+  if ((cb_ret = oggz->cb_next) != OGGZ_CONTINUE) {
+    oggz->cb_next = 0;
+    writer->writing = 0;
+    writer->no_more_packets = 0;
+    if (cb_ret == OGGZ_WRITE_EMPTY) cb_ret = 0;
+    return oggz_map_return_value_to_error (cb_ret);
+  }
+
+  while (active) {
+    while (writer->state == OGGZ_MAKING_PACKETS) {
+      if ((cb_ret = oggz_writer_make_packet (oggz)) != OGGZ_CONTINUE) {
+        if (cb_ret == OGGZ_WRITE_EMPTY) {
+          writer->flushing = 1;
+          writer->no_more_packets = 1;
+        }
+        /* As in oggz_write_output(), stop here unconditionally */
+        active = 0;
+        break;
+      }
+      if (oggz_page_init (oggz)) {
+        writer->state = OGGZ_WRITING_PAGES;
+      } else if (writer->no_more_packets) {
+        active = 0;
+        break;
+      }
+    }
+
+    if (writer->state == OGGZ_WRITING_PAGES) {
+      og = &oggz->current_page;
+      offset = writer->page_offset;
+
+      if (offset < og->header_len + og->body_len) {
+        /* Point at the rest of the current page, in libogg's buffers */
+        if (offset < og->header_len) {
+          iov[n].base = og->header + offset;
+          iov[n].length = og->header_len - offset;
+          offset = og->header_len;
+          n++;
+        }
+        if (n < iovcnt && offset < og->header_len + og->body_len) {
+          iov[n].base = og->body + (offset - og->header_len);
+          iov[n].length = og->header_len + og->body_len - offset;
+          n++;
+        }
+        break;
+      } else if (writer->no_more_packets) {
+        break;
+      } else if (!oggz_page_init (oggz)) {
+        writer->state = OGGZ_MAKING_PACKETS;
+      }
+    }
+  }
+
+#ifdef DEBUG
+  printf ("oggz_write_output_iov: OUT %d\n", n);
+#endif
+
+  writer->writing = 0;
+
+  if (n == 0) {
+    if (cb_ret == OGGZ_WRITE_EMPTY) cb_ret = 0;
+    return oggz_map_return_value_to_error (cb_ret);
+  } else {
+    oggz->cb_next = cb_ret;
+  }
+
+  return n;
+}
+
+long
+oggz_write_output_consume (OGGZ * oggz, long n)
+{
+  OggzWriter * writer;
+  ogg_page * og;
+  long remaining;
+
+  if (oggz == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+  writer = &oggz->x.writer;
+
+  if (!(oggz->flags & OGGZ_WRITE) || n < 0) {
+    return OGGZ_ERR_INVALID;
+  }
+
+  if (writer->writing) return OGGZ_ERR_RECURSIVE_WRITE;
+
+  if (writer->state != OGGZ_WRITING_PAGES) return 0;
+
+  og = &oggz->current_page;
+  remaining = og->header_len + og->body_len - (long)writer->page_offset;
+
+  n = MIN (n, remaining);
+  writer->page_offset += n;
+
+  return n;
+}
+
 long
 oggz_write (OGGZ * oggz, long n)
 {
@@ -867,7 +1060,11 @@ oggz_write (OGGZ * oggz, long n)
     }
 
     if (writer->state == OGGZ_WRITING_PAGES) {
-      bytes_written = oggz_page_writeout (oggz, bytes);
+      if (writer->batch_bytes > 0) {
+        bytes_written = oggz_page_batchout (oggz, remaining);
+      } else {
+        bytes_written = oggz_page_writeout (oggz, bytes);
+      }
 #ifdef DEBUG
       printf ("oggz_write: MAKING PAGES; wrote %ld bytes\n", bytes_written);
 #endif
@@ -898,6 +1095,9 @@ oggz_write (OGGZ * oggz, long n)
     }
   }
 
+  /* Nothing stays batched between calls */
+  oggz_write_batch_flush (oggz);
+
 #ifdef DEBUG
   printf ("oggz_write: OUT %ld\n", nwritten);
 #endif
@@ -933,11 +1133,220 @@ oggz_write_get_next_page_size (OGGZ * oggz)
   return (og->header_len + og->body_len - (long)writer->page_offset);
 }
 
+int
+oggz_write_get_pool_stats (OGGZ * oggz, oggz_write_pool_stats * stats)
+{
+  OggzPool * pool;
+
+  if (oggz == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+  if (!(oggz->flags & OGGZ_WRITE) || stats == NULL) {
+    return OGGZ_ERR_INVALID;
+  }
+
+  pool = &oggz->x.writer.pool;
+
+  stats->allocations = pool->allocations;
+  stats->system_allocations = pool->system_allocations;
+  stats->bytes_queued = pool->bytes_queued;
+  stats->bytes_queued_peak = pool->bytes_queued_peak;
+  stats->pool_bytes = pool->pool_bytes;
+  stats->pool_bytes_peak = pool->pool_bytes_peak;
+
+  return 0;
+}
+
+int
+oggz_write_set_batch (OGGZ * oggz, long max_bytes, ogg_int64_t max_units)
+{
+  OggzWriter * writer;
+  unsigned char * batch;
+  int ret;
+
+  if (oggz == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+  writer = &oggz->x.writer;
+
+  if (!(oggz->flags & OGGZ_WRITE) || max_bytes < 0) {
+    return OGGZ_ERR_INVALID;
+  }
+
+  if (writer->writing) return OGGZ_ERR_RECURSIVE_WRITE;
+
+  /* Pages passed through oggz_write_page() may still be waiting */
+  if ((ret = oggz_write_batch_flush (oggz)) != 0) return ret;
+
+  if (max_bytes == 0) {
+    if (writer->batch != NULL) oggz_free (writer->batch);
+    batch = NULL;
+  } else if ((batch = oggz_realloc (writer->batch, max_bytes)) == NULL) {
+    return OGGZ_ERR_OUT_OF_MEMORY;
+  }
+
+  writer->batch = batch;
+  writer->batch_bytes = max_bytes;
+  writer->batch_max_units = max_units;
+
+  return 0;
+}
+
+/******** Page passthrough ********/
+
+#define OGGZ_CRC_POLY 0x04c11db7
+
+/* Fold bytes into a CRC, MSB first as in libogg's page checksum */
+static ogg_uint32_t
+oggz_crc_update (ogg_uint32_t crc, const unsigned char * buf, long n)
+{
+  int i;
+
+  while (n-- > 0) {
+    crc ^= (ogg_uint32_t)(*buf++) << 24;
+    for (i = 0; i < 8; i++)
+      crc = (crc & 0x80000000) ? (crc << 1) ^ OGGZ_CRC_POLY : crc << 1;
+  }
+
+  return crc;
+}
+
+/* Multiply a and b modulo the CRC polynomial */
+static ogg_uint32_t
+oggz_crc_multmodp (ogg_uint32_t a, ogg_uint32_t b)
+{
+  ogg_uint32_t prod = 0;
+  int i;
+
+  for (i = 31; i >= 0; i--) {
+    prod = (prod & 0x80000000) ? (prod << 1) ^ OGGZ_CRC_POLY : prod << 1;
+    if (a & ((ogg_uint32_t)1 << i)) prod ^= b;
+  }
+
+  return prod;
+}
+
+/*
+ * Replace fields in a copy of a page header. The CRC is linear, so the
+ * checksum changes by the CRC of the changed bytes alone, carried through
+ * the rest of the page: that is, multiplied by x^(8n) for the n bytes that
+ * follow them.
+ */
+static void
+oggz_page_patch_header (unsigned char * header, long page_bytes,
+                        const oggz_page_patch * patch)
+{
+  unsigned char diff[16]; /* header bytes 6..21 */
+  ogg_uint32_t crc, shift, x8n;
+  ogg_int64_t granulepos;
+  long n;
+  int i;
+
+  memcpy (diff, header + 6, 16);
+
+  if (patch->fields & OGGZ_PATCH_GRANULEPOS) {
+    granulepos = patch->granulepos;
+    for (i = 0; i < 8; i++) {
+      header[6+i] = (unsigned char)(granulepos & 0xff);
+      granulepos >>= 8;
+    }
+  }
+
+  if (patch->fields & OGGZ_PATCH_SERIALNO) {
+    for (i = 0; i < 4; i++)
+      header[14+i] = (unsigned char)((patch->serialno >> (8*i)) & 0xff);
+  }
+
+  if (patch->fields & OGGZ_PATCH_PAGENO) {
+    for (i = 0; i < 4; i++)
+      header[18+i] = (unsigned char)((patch->pageno >> (8*i)) & 0xff);
+  }
+
+  for (i = 0; i < 16; i++)
+    diff[i] ^= header[6+i];
+
+  /* x^(8n) modulo the CRC polynomial, by repeated squaring of x^8 */
+  x8n = 1;
+  shift = 0x100;
+  for (n = page_bytes - 22; n > 0; n >>= 1) {
+    if (n & 1) x8n = oggz_crc_multmodp (x8n, shift);
+    shift = oggz_crc_multmodp (shift, shift);
+  }
+
+  crc = header[22] | (header[23] << 8) | (header[24] << 16) |
+    ((ogg_uint32_t)header[25] << 24);
+  crc ^= oggz_crc_multmodp (oggz_crc_update (0, diff, 16), x8n);
+
+  for (i = 0; i < 4; i++)
+    header[22+i] = (unsigned char)((crc >> (8*i)) & 0xff);
+}
+
+int
+oggz_write_page (OGGZ * oggz, const ogg_page * og,
+                 const oggz_page_patch * patch)
+{
+  OggzWriter * writer;
+  ogg_page * current;
+  unsigned char header[27 + 255];
+  long header_len, body_len, page_bytes;
+
+  if (oggz == NULL) return OGGZ_ERR_BAD_OGGZ;
+
+  writer = &oggz->x.writer;
+
+  if (!(oggz->flags & OGGZ_WRITE) || og == NULL) {
+    return OGGZ_ERR_INVALID;
+  }
+
+  header_len = og->header_len;
+  body_len = og->body_len;
+  if (header_len < 27 || header_len > (long)sizeof (header) || body_len < 0)
+    return OGGZ_ERR_INVALID;
+
+  if (writer->writing) return OGGZ_ERR_RECURSIVE_WRITE;
+
+  /* Don't cut into a page that oggz_write() has started writing */
+  current = &oggz->current_page;
+  if (writer->state == OGGZ_WRITING_PAGES && writer->page_offset > 0 &&
+      writer->page_offset < current->header_len + current->body_len)
+    return OGGZ_ERR_INVALID;
+
+  page_bytes = header_len + body_len;
+
+  memcpy (header, og->header, header_len);
+  if (patch != NULL && patch->fields != 0)
+    oggz_page_patch_header (header, page_bytes, patch);
+
+  if (writer->batch_bytes > 0) {
+    if (writer->batch_fill + page_bytes > writer->batch_bytes &&
+        oggz_write_batch_flush (oggz) != 0)
+      return OGGZ_ERR_SYSTEM;
+
+    if (page_bytes <= writer->batch_bytes) {
+      memcpy (writer->batch + writer->batch_fill, header, header_len);
+      memcpy (writer->batch + writer->batch_fill + header_len, og->body,
+              body_len);
+      writer->batch_fill += page_bytes;
+      return 0;
+    }
+  }
+
+  /* Too large to batch, or not batching */
+  if ((long)oggz_io_write (oggz, header, header_len) != header_len)
+    return OGGZ_ERR_SYSTEM;
+
+  if (body_len > 0 &&
+      (long)oggz_io_write (oggz, og->body, body_len) != body_len)
+    return OGGZ_ERR_SYSTEM;
+
+  return 0;
+}
+
 #else /* OGGZ_CONFIG_WRITE */
 
 #include <ogg/ogg.h>
 #include "oggz_private.h"
 
+#include "oggz/oggz_write.h"
+
 OGGZ *
 oggz_write_init (OGGZ * oggz)
 {
@@ -976,6 +1385,18 @@ oggz_write_output (OGGZ * oggz, unsigned char * buf, long n)
   return OGGZ_ERR_DISABLED;
 }
 
+int
+oggz_write_output_iov (OGGZ * oggz, oggz_iovec * iov, int iovcnt)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
+long
+oggz_write_output_consume (OGGZ * oggz, long n)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
 long
 oggz_write (OGGZ * oggz, long n)
 {
@@ -988,4 +1409,29 @@ oggz_write_get_next_page_size (OGGZ * oggz)
   return OGGZ_ERR_DISABLED;
 }
 
+int
+oggz_write_get_pool_stats (OGGZ * oggz, oggz_write_pool_stats * stats)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
+int
+oggz_write_set_batch (OGGZ * oggz, long max_bytes, ogg_int64_t max_units)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
+int
+oggz_write_batch_flush (OGGZ * oggz)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
+int
+oggz_write_page (OGGZ * oggz, const ogg_page * og,
+                 const oggz_page_patch * patch)
+{
+  return OGGZ_ERR_DISABLED;
+}
+
 #endif
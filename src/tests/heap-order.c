@@ -0,0 +1,163 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include "oggz_heap.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define NR_ELEMENTS 200
+
+#define NR_KEYS 7
+
+typedef struct {
+  int key;
+  int seq; /* the order in which the element was fed */
+} elem;
+
+static elem elems[NR_ELEMENTS];
+
+static int
+cmp_key (const void * data1, const void * data2, void * user_data)
+{
+  const elem * e1 = (const elem *)data1, * e2 = (const elem *)data2;
+
+  return (e1->key > e2->key) - (e1->key < e2->key);
+}
+
+static void
+insert_elements (OggzHeap * heap, int first, int last)
+{
+  int i;
+
+  for (i = first; i < last; i++) {
+    elems[i].key = (i * 5) % NR_KEYS;
+    elems[i].seq = i;
+    if (oggz_heap_insert (heap, &elems[i]) == NULL)
+      FAIL("Could not insert element");
+  }
+}
+
+/*
+ * Pop n elements, checking that they come out in key order, and in the
+ * order they were fed where keys are equal.
+ */
+static void
+check_pop_ordered (OggzHeap * heap, int n)
+{
+  elem * e, * prev = NULL;
+
+  for ( ; n > 0; n--) {
+    if ((e = oggz_heap_pop (heap)) == NULL)
+      FAIL("Heap emptied early");
+
+#ifdef DEBUG
+    printf ("key %d seq %d\n", e->key, e->seq);
+#endif
+
+    if (prev != NULL) {
+      if (e->key < prev->key)
+        FAIL("Elements out of key order");
+      if (e->key == prev->key && e->seq < prev->seq)
+        FAIL("Equal elements out of feed order");
+    }
+    prev = e;
+  }
+}
+
+int
+main (int argc, char * argv[])
+{
+  OggzHeap * heap;
+  elem * e;
+  int i;
+
+  INFO ("Testing heap without a comparator");
+
+  if ((heap = oggz_heap_new ()) == NULL)
+    FAIL("newly created heap == NULL");
+
+  insert_elements (heap, 0, NR_ELEMENTS);
+
+  for (i = 0; i < NR_ELEMENTS; i++) {
+    if ((e = oggz_heap_pop (heap)) == NULL || e->seq != i)
+      FAIL("Elements out of feed order");
+  }
+
+  if (oggz_heap_pop (heap) != NULL)
+    FAIL("Heap not empty");
+
+  INFO ("Testing heap ordering with equal keys");
+
+  oggz_heap_set_cmp (heap, cmp_key, NULL);
+
+  insert_elements (heap, 0, NR_ELEMENTS);
+  if (oggz_heap_size (heap) != NR_ELEMENTS)
+    FAIL("Wrong heap size");
+
+  check_pop_ordered (heap, NR_ELEMENTS);
+
+  if (oggz_heap_size (heap) != 0)
+    FAIL("Heap not empty");
+
+  oggz_heap_delete (heap);
+
+  INFO ("Testing comparator set on a full heap");
+
+  if ((heap = oggz_heap_new ()) == NULL)
+    FAIL("newly created heap == NULL");
+
+  insert_elements (heap, 0, NR_ELEMENTS);
+  oggz_heap_set_cmp (heap, cmp_key, NULL);
+
+  check_pop_ordered (heap, NR_ELEMENTS);
+
+  INFO ("Testing interleaved inserts and pops");
+
+  /* Elements fed later than those still queued must follow them */
+  insert_elements (heap, 0, NR_ELEMENTS / 2);
+  check_pop_ordered (heap, NR_ELEMENTS / 4);
+  insert_elements (heap, NR_ELEMENTS / 2, NR_ELEMENTS);
+  check_pop_ordered (heap, NR_ELEMENTS - NR_ELEMENTS / 4);
+
+  if (oggz_heap_pop (heap) != NULL)
+    FAIL("Heap not empty");
+
+  oggz_heap_delete (heap);
+
+  exit (0);
+}
@@ -0,0 +1,222 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define MAX_PACKET 400
+#define READ_SIZE 4096
+
+#define BATCH_A 4
+
+static long serialno_a, serialno_b;
+
+typedef struct {
+  long serialno;
+  int max_packets;
+  int iter;
+  int batches;
+  int largest;
+} batch_log;
+
+static long
+packet_bytes (int iter)
+{
+  /* Mostly small packets sharing pages, with some spanning several pages */
+  return (iter % 50 == 25) ? 9000 : 20 + iter % 60;
+}
+
+static void
+feed_packet (OGGZ * oggz, long serialno, int iter)
+{
+  unsigned char buf[9000];
+  ogg_packet op;
+
+  memset (buf, 'a' + iter % 26, sizeof (buf));
+
+  op.packet = buf;
+  op.bytes = packet_bytes (iter);
+  op.b_o_s = (iter == 0);
+  op.e_o_s = (iter == MAX_PACKET - 1);
+  op.granulepos = iter;
+  op.packetno = iter;
+
+  if (oggz_write_feed (oggz, &op, serialno, 0, NULL) != 0)
+    FAIL ("Oggz write failed");
+}
+
+static int
+hungry (OGGZ * oggz, int empty, void * user_data)
+{
+  static int iter = 0;
+
+  if (iter >= MAX_PACKET) return 1;
+
+  feed_packet (oggz, serialno_a, iter);
+  feed_packet (oggz, serialno_b, iter);
+
+  iter++;
+
+  return 0;
+}
+
+static int
+read_packets (OGGZ * oggz, oggz_packet * packets, int nr_packets,
+              long serialno, void * user_data)
+{
+  batch_log * log = (batch_log *)user_data;
+  int i;
+  long j;
+
+#ifdef DEBUG
+  printf ("%08" PRI_OGGZ_OFF_T "x: serialno %010lu, %d packets\n",
+          oggz_tell (oggz), serialno, nr_packets);
+#endif
+
+  if (serialno != log->serialno)
+    FAIL ("Batch delivered for the wrong serialno");
+
+  if (nr_packets < 1 || nr_packets > log->max_packets)
+    FAIL ("Batch has incorrect number of packets");
+
+  for (i = 0; i < nr_packets; i++) {
+    ogg_packet * op = &packets[i].op;
+
+    if (op->bytes != packet_bytes (log->iter))
+      FAIL ("Packet has incorrect size");
+
+    for (j = 0; j < op->bytes; j++) {
+      if (op->packet[j] != 'a' + log->iter % 26)
+        FAIL ("Packet contains incorrect data");
+    }
+
+    if (op->packetno != log->iter)
+      FAIL ("Packet has incorrect packetno");
+
+    if (op->granulepos != -1 && op->granulepos != log->iter)
+      FAIL ("Packet has incorrect granulepos");
+
+    log->iter++;
+  }
+
+  log->batches++;
+  if (nr_packets > log->largest) log->largest = nr_packets;
+
+  /* Pause now and then; no packets of the batch may be repeated */
+  if (log->batches % 5 == 0) return OGGZ_STOP_OK;
+
+  return OGGZ_CONTINUE;
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * reader, * writer;
+  unsigned char buf[READ_SIZE];
+  batch_log log_a, log_b;
+  long n, remaining, offset;
+
+  INFO ("Testing batched delivery of packets");
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  serialno_a = oggz_serialno_new (writer);
+  serialno_b = oggz_serialno_new (writer);
+
+  if (oggz_write_set_hungry_callback (writer, hungry, 1, NULL) == -1)
+    FAIL("Could not set hungry callback");
+
+  reader = oggz_new (OGGZ_READ);
+  if (reader == NULL)
+    FAIL("newly created OGGZ reader == NULL");
+
+  memset (&log_a, 0, sizeof (log_a));
+  log_a.serialno = serialno_a;
+  log_a.max_packets = BATCH_A;
+
+  memset (&log_b, 0, sizeof (log_b));
+  log_b.serialno = serialno_b;
+  log_b.max_packets = 255;
+
+  if (oggz_set_read_packets_batch (reader, serialno_a, read_packets,
+                                   BATCH_A, &log_a) != 0)
+    FAIL("Could not set batch callback for stream");
+
+  if (oggz_set_read_packets_batch (reader, -1, read_packets, 0, &log_b) != 0)
+    FAIL("Could not set batch callback");
+
+  if (oggz_set_read_packets_batch (reader, -1, read_packets, -1, &log_b) !=
+      OGGZ_ERR_INVALID)
+    FAIL("Negative batch size accepted");
+
+  while ((remaining = oggz_write_output (writer, buf, READ_SIZE)) > 0) {
+    offset = 0;
+    while (remaining > 0) {
+      n = oggz_read_input (reader, buf + offset, remaining);
+      if (n == OGGZ_ERR_READ_STOP_OK) continue;
+      if (n < 0)
+        FAIL ("Read failed");
+      offset += n;
+      remaining -= n;
+    }
+  }
+
+  /* Deliver anything left after the last pause */
+  for (n = 0; n < MAX_PACKET && log_b.iter < MAX_PACKET; n++)
+    oggz_read_input (reader, buf, 0);
+
+  if (log_a.iter != MAX_PACKET || log_b.iter != MAX_PACKET)
+    FAIL ("Not all packets read");
+
+  if (log_a.largest != BATCH_A)
+    FAIL ("Expected some full batches");
+
+  if (log_b.largest <= BATCH_A)
+    FAIL ("Expected larger batches for a whole page");
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  exit (0);
+}
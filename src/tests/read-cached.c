@@ -0,0 +1,260 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <utime.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define MAX_PACKET 200
+
+#define READ_BLOCKSIZE 1000
+
+#define FRAME_SIZE 160
+
+#define FILENAME_A "read-cached-a.ogg"
+#define FILENAME_B "read-cached-b.ogg"
+
+#define SERIALNO_A 1001
+#define SERIALNO_B 2002
+
+static void
+put_le32 (unsigned char * p, long v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static void
+write_file (const char * filename, long serialno, const char * title)
+{
+  FILE * f;
+  OGGZ * writer;
+  unsigned char buf[1000];
+  ogg_packet op;
+  long n;
+  int iter;
+
+  if ((f = fopen (filename, "wb")) == NULL)
+    FAIL("Could not create test file");
+
+  writer = oggz_open_stdio (f, OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  /* A Speex header, for 8000Hz audio in packets of one frame */
+  memset (buf, 0, 80);
+  memcpy (buf, "Speex   ", 8);
+  put_le32 (&buf[36], 8000);
+  put_le32 (&buf[56], FRAME_SIZE);
+  put_le32 (&buf[64], 1);
+  put_le32 (&buf[68], 0);
+
+  op.packet = buf;
+  op.bytes = 80;
+  op.b_o_s = 1;
+  op.e_o_s = 0;
+  op.granulepos = 0;
+  op.packetno = 0;
+  if (oggz_write_feed (writer, &op, serialno, OGGZ_FLUSH_AFTER, NULL) != 0)
+    FAIL("Oggz write failed");
+
+  /* The comment header */
+  n = 0;
+  put_le32 (&buf[n], 9); n += 4;
+  memcpy (&buf[n], "oggz-test", 9); n += 9;
+  put_le32 (&buf[n], 1); n += 4;
+  put_le32 (&buf[n], (long)strlen (title) + 6); n += 4;
+  memcpy (&buf[n], "TITLE=", 6); n += 6;
+  memcpy (&buf[n], title, strlen (title)); n += (long)strlen (title);
+
+  op.bytes = n;
+  op.b_o_s = 0;
+  op.packetno = 1;
+  if (oggz_write_feed (writer, &op, serialno, OGGZ_FLUSH_AFTER, NULL) != 0)
+    FAIL("Oggz write failed");
+
+  for (iter = 0; iter < MAX_PACKET; iter++) {
+    memset (buf, 'a' + iter % 26, sizeof (buf));
+
+    op.bytes = 20 + (iter * 7) % 300;
+    op.e_o_s = (iter == MAX_PACKET - 1);
+    op.granulepos = (iter + 1) * FRAME_SIZE;
+    op.packetno = iter + 2;
+
+    if (oggz_write_feed (writer, &op, serialno, 0, NULL) != 0)
+      FAIL("Oggz write failed");
+  }
+
+  while (oggz_write (writer, 4096) > 0);
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+}
+
+static int
+read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
+{
+  int * nr_packets = (int *)user_data;
+
+  (*nr_packets)++;
+
+  return 0;
+}
+
+/*
+ * Open a file through the cache and check that it has the expected stream
+ * and title. If these are the file's own, read its content packets too.
+ */
+static void
+check_open (const char * filename, const char * key, long serialno,
+            const char * title, int stale)
+{
+  OGGZ * reader;
+  const OggzComment * comment;
+  int nr_packets = 0;
+  long n;
+
+  reader = oggz_open_cached (filename, key, OGGZ_READ | OGGZ_AUTO);
+  if (reader == NULL)
+    FAIL("Could not open test file");
+
+  if (oggz_stream_get_content (reader, serialno) != OGGZ_CONTENT_SPEEX)
+    FAIL("Stream not identified as Speex");
+
+  comment = oggz_comment_first_byname (reader, serialno, "TITLE");
+  if (comment == NULL || strcmp (comment->value, title) != 0)
+    FAIL("Wrong title");
+
+  if (!stale) {
+    oggz_set_read_callback (reader, -1, read_packet, &nr_packets);
+    while ((n = oggz_read (reader, READ_BLOCKSIZE)) > 0);
+
+    if (n < 0)
+      FAIL("Read failed");
+
+    /* Only content packets, as the cursor starts at the data start */
+    if (nr_packets != MAX_PACKET)
+      FAIL("Wrong number of packets read");
+  }
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * reader;
+  const OggzComment * comment;
+  struct utimbuf times;
+  int nr_packets = 0;
+  long n;
+
+  write_file (FILENAME_A, SERIALNO_A, "A");
+  write_file (FILENAME_B, SERIALNO_B, "B");
+
+  INFO ("Testing opening files without a probe cache");
+  check_open (FILENAME_A, "a", SERIALNO_A, "A", 0);
+  check_open (FILENAME_B, "a", SERIALNO_B, "B", 0);
+
+  INFO ("Testing probe cache hits by key");
+  oggz_file_info_cache_set_size (1);
+  check_open (FILENAME_A, "a", SERIALNO_A, "A", 0);
+
+  /* Whatever is under the same key is taken to be the same file */
+  check_open (FILENAME_B, "a", SERIALNO_A, "A", 1);
+
+  INFO ("Testing probe cache eviction");
+  check_open (FILENAME_B, "b", SERIALNO_B, "B", 0);
+  check_open (FILENAME_B, "a", SERIALNO_B, "B", 0);
+
+  INFO ("Testing probe cache hits by file identity");
+  oggz_file_info_cache_set_size (4);
+  check_open (FILENAME_A, NULL, SERIALNO_A, "A", 0);
+
+  /* Rewrite the file with a new modification time */
+  write_file (FILENAME_A, SERIALNO_B, "B");
+  times.actime = times.modtime = 1000000000;
+  utime (FILENAME_A, &times);
+  check_open (FILENAME_A, NULL, SERIALNO_B, "B", 0);
+
+  /* A rewrite keeping the same size and modification time is not noticed */
+  write_file (FILENAME_A, SERIALNO_A, "A");
+  utime (FILENAME_A, &times);
+  check_open (FILENAME_A, NULL, SERIALNO_B, "B", 1);
+
+  /* A modified file is read again */
+  times.actime = times.modtime = 1000000001;
+  utime (FILENAME_A, &times);
+  check_open (FILENAME_A, NULL, SERIALNO_A, "A", 0);
+
+  INFO ("Testing seeking to the end of a cached file");
+  reader = oggz_open_cached (FILENAME_A, NULL, OGGZ_READ | OGGZ_AUTO);
+  if (reader == NULL)
+    FAIL("Could not open test file");
+  if (oggz_seek_units (reader, 0, SEEK_END) != MAX_PACKET * FRAME_SIZE / 8)
+    FAIL("Wrong end unit");
+  oggz_close (reader);
+
+  INFO ("Testing a cursor outliving its cache entry");
+  reader = oggz_open_cached (FILENAME_A, NULL, OGGZ_READ | OGGZ_AUTO);
+  if (reader == NULL)
+    FAIL("Could not open test file");
+  oggz_file_info_cache_set_size (0);
+
+  comment = oggz_comment_first_byname (reader, SERIALNO_A, "TITLE");
+  if (comment == NULL || strcmp (comment->value, "A") != 0)
+    FAIL("Wrong title");
+
+  oggz_set_read_callback (reader, -1, read_packet, &nr_packets);
+  while ((n = oggz_read (reader, READ_BLOCKSIZE)) > 0);
+  if (n < 0 || nr_packets != MAX_PACKET)
+    FAIL("Wrong number of packets read");
+  oggz_close (reader);
+
+  remove (FILENAME_A);
+  remove (FILENAME_B);
+
+  exit (0);
+}
@@ -0,0 +1,220 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define FILENAME "read-comments.ogg"
+
+#define SERIALNO 1003
+
+#define VENDOR "oggz-test"
+
+/* A value too large to fit in one page */
+#define PICTURE_LENGTH 20000
+
+static unsigned char buf[PICTURE_LENGTH + 1000];
+static char picture[PICTURE_LENGTH];
+
+static void
+put_le32 (unsigned char * p, long v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static long
+put_comment (unsigned char * p, const char * name, const char * value,
+             long value_len)
+{
+  long n = 0, name_len = (long)strlen (name);
+
+  put_le32 (p, name_len + (value ? 1 + value_len : 0)); n += 4;
+  memcpy (p + n, name, name_len); n += name_len;
+  if (value) {
+    p[n++] = '=';
+    memcpy (p + n, value, value_len); n += value_len;
+  }
+
+  return n;
+}
+
+static void
+write_file (void)
+{
+  FILE * f;
+  OGGZ * writer;
+  ogg_packet op;
+  long n;
+
+  if ((f = fopen (FILENAME, "wb")) == NULL)
+    FAIL("Could not create test file");
+
+  writer = oggz_open_stdio (f, OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  /* A Speex header, for 8000Hz audio in packets of 160 samples */
+  memset (buf, 0, 80);
+  memcpy (buf, "Speex   ", 8);
+  put_le32 (&buf[36], 8000);
+  put_le32 (&buf[56], 160);
+  put_le32 (&buf[64], 1);
+  put_le32 (&buf[68], 0);
+
+  op.packet = buf;
+  op.bytes = 80;
+  op.b_o_s = 1;
+  op.e_o_s = 0;
+  op.granulepos = 0;
+  op.packetno = 0;
+  if (oggz_write_feed (writer, &op, SERIALNO, OGGZ_FLUSH_AFTER, NULL) != 0)
+    FAIL("Oggz write failed");
+
+  /* The comment header, with a repeated comment, comments without a
+   * value and a large value */
+  n = 0;
+  put_le32 (&buf[n], strlen (VENDOR)); n += 4;
+  memcpy (&buf[n], VENDOR, strlen (VENDOR)); n += (long)strlen (VENDOR);
+  put_le32 (&buf[n], 7); n += 4;
+  n += put_comment (&buf[n], "ARTIST", "Trout Junkies", 13);
+  n += put_comment (&buf[n], "TITLE", "Spawn", 5);
+  n += put_comment (&buf[n], "artist", "DJ Fugu", 7);
+  n += put_comment (&buf[n], "Artist", "Trout Junkies", 13);
+  n += put_comment (&buf[n], "ARTIST", "", 0);
+  n += put_comment (&buf[n], "LIVE", NULL, 0);
+  memset (picture, 'A', PICTURE_LENGTH);
+  n += put_comment (&buf[n], "METADATA_BLOCK_PICTURE", picture,
+                    PICTURE_LENGTH);
+
+  op.bytes = n;
+  op.b_o_s = 0;
+  op.e_o_s = 1;
+  op.packetno = 1;
+  if (oggz_write_feed (writer, &op, SERIALNO, OGGZ_FLUSH_AFTER, NULL) != 0)
+    FAIL("Oggz write failed");
+
+  while (oggz_write (writer, 4096) > 0);
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * reader;
+  const OggzComment * comment;
+  const char * vendor;
+  int nr_comments = 0;
+
+  INFO ("Testing decoding of comments");
+  write_file ();
+
+  reader = oggz_open (FILENAME, OGGZ_READ | OGGZ_AUTO);
+  if (reader == NULL)
+    FAIL("Could not open test file");
+
+  if (oggz_read_headers (reader) != 0)
+    FAIL("Could not read headers");
+
+  vendor = oggz_comment_get_vendor (reader, SERIALNO);
+  if (vendor == NULL || strcmp (vendor, VENDOR))
+    FAIL("Wrong vendor");
+
+  INFO ("+ Looking up comments by name");
+  comment = oggz_comment_first_byname (reader, SERIALNO, "Artist");
+  if (comment == NULL || strcmp (comment->name, "ARTIST") ||
+      strcmp (comment->value, "Trout Junkies"))
+    FAIL("Wrong first artist");
+
+  comment = oggz_comment_next_byname (reader, SERIALNO, comment);
+  if (comment == NULL || strcmp (comment->name, "artist") ||
+      strcmp (comment->value, "DJ Fugu"))
+    FAIL("Wrong second artist");
+
+  /* An empty value, as in "ARTIST=", is taken as no value */
+  comment = oggz_comment_next_byname (reader, SERIALNO, comment);
+  if (comment == NULL || strcmp (comment->name, "ARTIST") ||
+      comment->value != NULL)
+    FAIL("Wrong artist without value");
+
+  /* The repeated name=value pair is only kept once */
+  if (oggz_comment_next_byname (reader, SERIALNO, comment) != NULL)
+    FAIL("Repeated artist not skipped");
+
+  comment = oggz_comment_first_byname (reader, SERIALNO, "LIVE");
+  if (comment == NULL || comment->value != NULL)
+    FAIL("Wrong comment without value");
+
+  if (oggz_comment_first_byname (reader, SERIALNO, "ALBUM") != NULL)
+    FAIL("Found missing comment");
+
+  INFO ("+ Iterating over comments");
+  for (comment = oggz_comment_first (reader, SERIALNO); comment;
+       comment = oggz_comment_next (reader, SERIALNO, comment)) {
+#ifdef DEBUG
+    printf ("%s: %.20s\n", comment->name, comment->value);
+#endif
+    nr_comments++;
+  }
+  if (nr_comments != 6)
+    FAIL("Wrong number of comments");
+
+  comment = oggz_comment_first_byname (reader, SERIALNO,
+                                       "METADATA_BLOCK_PICTURE");
+  if (comment == NULL || strlen (comment->value) != PICTURE_LENGTH)
+    FAIL("Wrong large value");
+
+  /* Comments are the same each time they are asked for */
+  if (oggz_comment_first_byname (reader, SERIALNO, "TITLE") !=
+      oggz_comment_next (reader, SERIALNO,
+                         oggz_comment_first (reader, SERIALNO)))
+    FAIL("Comment not kept");
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  remove (FILENAME);
+
+  exit (0);
+}
@@ -0,0 +1,279 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define MAX_PACKET 200
+
+#define READ_BLOCKSIZE 1000
+
+#define FRAME_SIZE 160
+
+#define TEST_FILENAME "read-headers.ogg"
+
+#define NR_HEADERS 5 /* Header packets of both streams */
+
+static long serialno1, serialno2;
+
+/* Offset of the first content page */
+static oggz_off_t content_offset;
+
+typedef struct {
+  int nr_packets;
+  int nr_content_packets;
+  int nr_content_pages;
+} read_log;
+
+static void
+put_le32 (unsigned char * p, long v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static void
+feed (OGGZ * writer, unsigned char * buf, long bytes, long serialno,
+      int b_o_s, int e_o_s, ogg_int64_t granulepos, ogg_int64_t packetno,
+      int flush)
+{
+  ogg_packet op;
+
+  op.packet = buf;
+  op.bytes = bytes;
+  op.b_o_s = b_o_s;
+  op.e_o_s = e_o_s;
+  op.granulepos = granulepos;
+  op.packetno = packetno;
+
+  if (oggz_write_feed (writer, &op, serialno, flush, NULL) != 0)
+    FAIL("Oggz write failed");
+}
+
+static void
+write_file (void)
+{
+  FILE * f;
+  OGGZ * writer;
+  unsigned char buf[1000];
+  long n;
+  int iter;
+
+  if ((f = fopen (TEST_FILENAME, "wb")) == NULL)
+    FAIL("Could not create test file");
+
+  writer = oggz_open_stdio (f, OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  serialno1 = oggz_serialno_new (writer);
+  serialno2 = oggz_serialno_new (writer);
+
+  /* Speex headers, the first announcing one extra header */
+  memset (buf, 0, 80);
+  memcpy (buf, "Speex   ", 8);
+  put_le32 (&buf[36], 8000);
+  put_le32 (&buf[56], FRAME_SIZE);
+  put_le32 (&buf[64], 1);
+  put_le32 (&buf[68], 1);
+  feed (writer, buf, 80, serialno1, 1, 0, 0, 0, OGGZ_FLUSH_AFTER);
+
+  put_le32 (&buf[68], 0);
+  feed (writer, buf, 80, serialno2, 1, 0, 0, 0, OGGZ_FLUSH_AFTER);
+
+  /* Comment headers */
+  n = 0;
+  put_le32 (&buf[n], 9); n += 4;
+  memcpy (&buf[n], "oggz-test", 9); n += 9;
+  put_le32 (&buf[n], 0); n += 4;
+
+  feed (writer, buf, n, serialno1, 0, 0, 0, 1, 0);
+  memset (buf, 'x', 500);
+  feed (writer, buf, 500, serialno1, 0, 0, 0, 2, OGGZ_FLUSH_AFTER);
+
+  put_le32 (&buf[0], 9);
+  memcpy (&buf[4], "oggz-test", 9);
+  put_le32 (&buf[13], 0);
+  feed (writer, buf, n, serialno2, 0, 0, 0, 1, OGGZ_FLUSH_AFTER);
+
+  for (iter = 0; iter < MAX_PACKET; iter++) {
+    memset (buf, 'a' + iter % 26, sizeof (buf));
+    feed (writer, buf, 20 + (iter * 7) % 300,
+          (iter % 2) ? serialno2 : serialno1, 0, (iter >= MAX_PACKET - 2),
+          (iter / 2 + 1) * FRAME_SIZE, iter / 2 + (iter % 2 ? 2 : 3), 0);
+  }
+
+  while (oggz_write (writer, 4096) > 0);
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+}
+
+static int
+read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
+{
+  read_log * log = (read_log *)user_data;
+
+  if (ogg_page_granulepos ((ogg_page *)og) > 0) {
+    if (log->nr_content_pages == 0)
+      content_offset = oggz_tell (oggz);
+    log->nr_content_pages++;
+  }
+
+  return 0;
+}
+
+static int
+read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
+{
+  read_log * log = (read_log *)user_data;
+
+  if (zp->op.packetno >= oggz_stream_get_numheaders (oggz, serialno))
+    log->nr_content_packets++;
+  log->nr_packets++;
+
+  return 0;
+}
+
+static OGGZ *
+open_file (int flags, FILE ** f, read_log * log)
+{
+  OGGZ * reader;
+
+  if ((*f = fopen (TEST_FILENAME, "rb")) == NULL)
+    FAIL("Could not open test file");
+
+  reader = oggz_open_stdio (*f, OGGZ_READ | OGGZ_AUTO | flags);
+  if (reader == NULL)
+    FAIL("Could not open test file");
+
+  memset (log, 0, sizeof (*log));
+  oggz_set_read_page (reader, -1, read_page, log);
+  oggz_set_read_callback (reader, -1, read_packet, log);
+
+  return reader;
+}
+
+static void
+read_rest (OGGZ * reader, read_log * log)
+{
+  long n;
+
+  while ((n = oggz_read (reader, READ_BLOCKSIZE)) > 0);
+
+  if (n < 0)
+    FAIL("Read failed");
+
+  if (log->nr_packets != NR_HEADERS + MAX_PACKET)
+    FAIL("Not all packets read after the headers");
+}
+
+static void
+test_read_headers (int flags)
+{
+  OGGZ * reader;
+  FILE * f;
+  read_log log;
+
+  reader = open_file (flags, &f, &log);
+
+  if (oggz_read_headers (reader) != 0)
+    FAIL("Reading headers failed");
+
+  if (log.nr_packets != NR_HEADERS)
+    FAIL("Wrong number of header packets read");
+
+  if (log.nr_content_pages != 0 || log.nr_content_packets != 0)
+    FAIL("Content read with the headers");
+
+  if (oggz_stream_get_numheaders (reader, serialno1) != 3 ||
+      oggz_stream_get_numheaders (reader, serialno2) != 2)
+    FAIL("Wrong numheaders");
+
+  /* Only the header of the first content page is peeked at */
+  if (!(flags & OGGZ_MMAP) && ftell (f) != content_offset + 27)
+    FAIL("Read beyond the headers");
+
+  read_rest (reader, &log);
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+}
+
+static int
+stop_headers (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
+{
+  return (zp->op.packetno == 1) ? OGGZ_STOP_OK : OGGZ_CONTINUE;
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * reader;
+  FILE * f;
+  read_log log;
+
+  write_file ();
+
+  /* Find the first content page */
+  reader = open_file (0, &f, &log);
+  read_rest (reader, &log);
+  oggz_close (reader);
+
+  INFO ("Testing reading only headers");
+  test_read_headers (0);
+
+  INFO ("Testing reading only headers of a mapped file");
+  test_read_headers (OGGZ_MMAP);
+
+  INFO ("Testing stopping while reading headers");
+  reader = open_file (0, &f, &log);
+  oggz_set_read_callback (reader, -1, stop_headers, NULL);
+  if (oggz_read_headers (reader) != OGGZ_ERR_STOP_OK)
+    FAIL("Stop not returned");
+  oggz_close (reader);
+
+  remove (TEST_FILENAME);
+
+  exit (0);
+}
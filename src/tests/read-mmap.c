@@ -0,0 +1,203 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define MAX_PACKET 300
+
+#define READ_BLOCKSIZE 1000
+
+#define TEST_FILENAME "read-mmap.ogg"
+
+static long serialno;
+
+typedef struct {
+  int nr_packets;
+  long bytes[MAX_PACKET];
+  long sum[MAX_PACKET];
+  ogg_int64_t granulepos[MAX_PACKET];
+  oggz_off_t offset[MAX_PACKET];
+} packet_log;
+
+static void
+write_file (void)
+{
+  FILE * f;
+  OGGZ * writer;
+  unsigned char buf[10000];
+  ogg_packet op;
+  int iter;
+
+  if ((f = fopen (TEST_FILENAME, "wb")) == NULL)
+    FAIL("Could not create test file");
+
+  /* Some junk to resynchronize past */
+  fputs ("OggS is not a page", f);
+
+  writer = oggz_open_stdio (f, OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  serialno = oggz_serialno_new (writer);
+
+  for (iter = 0; iter < MAX_PACKET; iter++) {
+    memset (buf, 'a' + iter % 26, sizeof (buf));
+
+    op.packet = buf;
+    /* Make some packets span several pages */
+    op.bytes = (iter % 50 == 25) ? 10000 : 100 + iter;
+    op.b_o_s = (iter == 0);
+    op.e_o_s = (iter == MAX_PACKET - 1);
+    op.granulepos = iter;
+    op.packetno = iter;
+
+    if (oggz_write_feed (writer, &op, serialno, 0, NULL) != 0)
+      FAIL ("Oggz write failed");
+  }
+
+  while (oggz_write (writer, 4096) > 0);
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+}
+
+static int
+read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
+{
+  packet_log * log = (packet_log *)user_data;
+  ogg_packet * op = &zp->op;
+  int i = log->nr_packets;
+  long j, sum = 0;
+
+  if (i >= MAX_PACKET)
+    FAIL("Too many packets");
+
+  for (j = 0; j < op->bytes; j++)
+    sum += op->packet[j];
+
+  log->bytes[i] = op->bytes;
+  log->sum[i] = sum;
+  log->granulepos[i] = op->granulepos;
+  log->offset[i] = oggz_tell (oggz);
+  log->nr_packets++;
+
+  return 0;
+}
+
+static void
+read_file (int flags, packet_log * log, ogg_int64_t seek_units)
+{
+  OGGZ * reader;
+  long n;
+
+  reader = oggz_open (TEST_FILENAME, OGGZ_READ | flags);
+  if (reader == NULL)
+    FAIL("Could not open test file");
+
+  memset (log, 0, sizeof (*log));
+  oggz_set_read_callback (reader, -1, read_packet, log);
+
+  if (seek_units > 0) {
+    /* Read the headers, then seek */
+    if (oggz_read (reader, READ_BLOCKSIZE) <= 0)
+      FAIL("Read failed");
+    oggz_set_granulerate (reader, serialno, 1, 1);
+    if (oggz_seek_units (reader, seek_units, SEEK_SET) < 0)
+      FAIL("Seek failed");
+    log->nr_packets = 0;
+  }
+
+  while ((n = oggz_read (reader, READ_BLOCKSIZE)) > 0);
+
+  if (n < 0)
+    FAIL("Read failed");
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+}
+
+static void
+compare_logs (packet_log * a, packet_log * b)
+{
+  int i;
+
+  if (a->nr_packets != b->nr_packets)
+    FAIL("Different numbers of packets read");
+
+  for (i = 0; i < a->nr_packets; i++) {
+    if (a->bytes[i] != b->bytes[i] || a->sum[i] != b->sum[i])
+      FAIL("Different packet data read");
+
+    if (a->granulepos[i] != b->granulepos[i])
+      FAIL("Different packet granulepos read");
+
+    if (a->offset[i] != b->offset[i])
+      FAIL("Packets read at different offsets");
+  }
+}
+
+int
+main (int argc, char * argv[])
+{
+  static packet_log plain, mapped;
+
+  INFO ("Testing reading a mapped file");
+
+  write_file ();
+
+  read_file (0, &plain, 0);
+  if (plain.nr_packets != MAX_PACKET)
+    FAIL("Not all packets read");
+
+  read_file (OGGZ_MMAP, &mapped, 0);
+  compare_logs (&plain, &mapped);
+
+  INFO ("Testing seeking in a mapped file");
+
+  read_file (0, &plain, MAX_PACKET / 2);
+  read_file (OGGZ_MMAP, &mapped, MAX_PACKET / 2);
+  compare_logs (&plain, &mapped);
+
+  remove (TEST_FILENAME);
+
+  exit (0);
+}
@@ -0,0 +1,343 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define MAX_PACKET 300
+
+/* Room for the packets read by several seeks */
+#define MAX_LOG (4 * MAX_PACKET)
+
+#define READ_BLOCKSIZE 1000
+
+#define FRAME_SIZE 160
+
+#define TEST_FILENAME "read-shared.ogg"
+
+static long serialno;
+
+typedef struct {
+  int nr_packets;
+  long bytes[MAX_LOG];
+  long sum[MAX_LOG];
+  ogg_int64_t granulepos[MAX_LOG];
+  ogg_int64_t units[MAX_LOG];
+} packet_log;
+
+/* Seek targets in milliseconds */
+static ogg_int64_t seeks[] = {3000, 400, 5000, 20, -1};
+
+static void
+put_le32 (unsigned char * p, long v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static void
+write_file (void)
+{
+  FILE * f;
+  OGGZ * writer;
+  unsigned char buf[1000];
+  ogg_packet op;
+  long n;
+  int iter;
+
+  if ((f = fopen (TEST_FILENAME, "wb")) == NULL)
+    FAIL("Could not create test file");
+
+  writer = oggz_open_stdio (f, OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  serialno = oggz_serialno_new (writer);
+
+  /* A Speex header, for 8000Hz audio in packets of one frame */
+  memset (buf, 0, 80);
+  memcpy (buf, "Speex   ", 8);
+  put_le32 (&buf[36], 8000);
+  put_le32 (&buf[56], FRAME_SIZE);
+  put_le32 (&buf[64], 1);
+  put_le32 (&buf[68], 0);
+
+  op.packet = buf;
+  op.bytes = 80;
+  op.b_o_s = 1;
+  op.e_o_s = 0;
+  op.granulepos = 0;
+  op.packetno = 0;
+  if (oggz_write_feed (writer, &op, serialno, OGGZ_FLUSH_AFTER, NULL) != 0)
+    FAIL("Oggz write failed");
+
+  /* The comment header */
+  n = 0;
+  put_le32 (&buf[n], 9); n += 4;
+  memcpy (&buf[n], "oggz-test", 9); n += 9;
+  put_le32 (&buf[n], 1); n += 4;
+  put_le32 (&buf[n], 12); n += 4;
+  memcpy (&buf[n], "TITLE=Shared", 12); n += 12;
+
+  op.bytes = n;
+  op.b_o_s = 0;
+  op.packetno = 1;
+  if (oggz_write_feed (writer, &op, serialno, OGGZ_FLUSH_AFTER, NULL) != 0)
+    FAIL("Oggz write failed");
+
+  for (iter = 0; iter < MAX_PACKET; iter++) {
+    memset (buf, 'a' + iter % 26, sizeof (buf));
+
+    op.bytes = 20 + (iter * 7) % 300;
+    op.e_o_s = (iter == MAX_PACKET - 1);
+    op.granulepos = (iter + 1) * FRAME_SIZE;
+    op.packetno = iter + 2;
+
+    if (oggz_write_feed (writer, &op, serialno, 0, NULL) != 0)
+      FAIL("Oggz write failed");
+  }
+
+  while (oggz_write (writer, 4096) > 0);
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+}
+
+static int
+read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
+{
+  packet_log * log = (packet_log *)user_data;
+  ogg_packet * op = &zp->op;
+  int i = log->nr_packets;
+  long j, sum = 0;
+
+  if (i >= MAX_LOG)
+    FAIL("Too many packets");
+
+  for (j = 0; j < op->bytes; j++)
+    sum += op->packet[j];
+
+  log->bytes[i] = op->bytes;
+  log->sum[i] = sum;
+  log->granulepos[i] = zp->pos.calc_granulepos;
+  log->units[i] = oggz_tell_units (oggz);
+  log->nr_packets++;
+
+  return 0;
+}
+
+static int
+read_headers (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
+{
+  int * nr_headers = (int *)user_data;
+
+  if (*nr_headers == 2) {
+    /* The first data packet starts the first data page */
+    oggz_set_data_start (oggz, oggz_tell (oggz));
+    return OGGZ_STOP_OK;
+  }
+
+  (*nr_headers)++;
+
+  return 0;
+}
+
+static void
+read_all (OGGZ * reader, packet_log * log)
+{
+  long n;
+
+  while ((n = oggz_read (reader, READ_BLOCKSIZE)) > 0);
+  if (n < 0)
+    FAIL("Read failed");
+}
+
+static void
+read_seeks (OGGZ * reader, packet_log * log)
+{
+  int i;
+
+  for (i = 0; seeks[i] != -1; i++) {
+    if (oggz_seek_units (reader, seeks[i], SEEK_SET) < 0)
+      FAIL("Seek failed");
+
+    if (oggz_read (reader, READ_BLOCKSIZE) <= 0)
+      FAIL("Read failed");
+  }
+}
+
+static void
+compare_logs (packet_log * a, int skip, packet_log * b)
+{
+  int i;
+
+  if (a->nr_packets - skip != b->nr_packets)
+    FAIL("Different numbers of packets read");
+
+  for (i = 0; i < b->nr_packets; i++) {
+    if (a->bytes[i+skip] != b->bytes[i] || a->sum[i+skip] != b->sum[i])
+      FAIL("Different packet data read");
+
+    if (a->granulepos[i+skip] != b->granulepos[i])
+      FAIL("Different packet granulepos read");
+
+    if (a->units[i+skip] != b->units[i])
+      FAIL("Different packet units read");
+  }
+}
+
+static void
+check_stream (OGGZ * oggz)
+{
+  const OggzComment * comment;
+  ogg_int64_t granulerate_n, granulerate_d;
+
+  if (oggz_get_numtracks (oggz) != 1)
+    FAIL("Wrong number of tracks");
+
+  if (oggz_stream_get_content (oggz, serialno) != OGGZ_CONTENT_SPEEX)
+    FAIL("Stream not identified as Speex");
+
+  if (oggz_stream_get_numheaders (oggz, serialno) != 2)
+    FAIL("Wrong number of headers");
+
+  if (oggz_get_preroll (oggz, serialno) != 3)
+    FAIL("Wrong preroll");
+
+  oggz_get_granulerate (oggz, serialno, &granulerate_n, &granulerate_d);
+  if (granulerate_n != 8000 || granulerate_d != 1)
+    FAIL("Wrong granulerate");
+
+  if (oggz_comment_get_vendor (oggz, serialno) == NULL ||
+      strcmp (oggz_comment_get_vendor (oggz, serialno), "oggz-test"))
+    FAIL("Wrong vendor");
+
+  comment = oggz_comment_first_byname (oggz, serialno, "TITLE");
+  if (comment == NULL || strcmp (comment->value, "Shared"))
+    FAIL("Wrong comment");
+}
+
+int
+main (int argc, char * argv[])
+{
+  static packet_log plain, shared;
+  OggzFileInfo * info;
+  OGGZ * reader, * cursor, * cursor2;
+  int nr_headers = 0;
+  long n;
+
+  INFO ("Testing sharing parsed headers between cursors");
+
+  write_file ();
+
+  reader = oggz_open (TEST_FILENAME, OGGZ_READ | OGGZ_AUTO);
+  if (reader == NULL)
+    FAIL("Could not open test file");
+
+  oggz_set_read_callback (reader, -1, read_headers, &nr_headers);
+  while ((n = oggz_read (reader, READ_BLOCKSIZE)) > 0);
+  if (n != OGGZ_ERR_STOP_OK)
+    FAIL("Headers not read");
+
+  info = oggz_file_info_new (reader);
+  if (info == NULL)
+    FAIL("Could not create file info");
+
+  /* The file info does not depend on the OGGZ it was made from */
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  reader = oggz_open (TEST_FILENAME, OGGZ_READ | OGGZ_AUTO);
+  if (reader == NULL)
+    FAIL("Could not open test file");
+  oggz_set_read_callback (reader, -1, read_packet, &plain);
+  read_all (reader, &plain);
+  if (plain.nr_packets != MAX_PACKET + 2)
+    FAIL("Not all packets read");
+
+  cursor = oggz_open_file_info (info, TEST_FILENAME, OGGZ_READ | OGGZ_AUTO);
+  if (cursor == NULL)
+    FAIL("Could not open cursor");
+  check_stream (cursor);
+
+  /* The cursor starts at the data, without delivering the headers */
+  oggz_set_read_callback (cursor, -1, read_packet, &shared);
+  read_all (cursor, &shared);
+  compare_logs (&plain, 2, &shared);
+
+  INFO ("Testing seeking in several cursors");
+
+  cursor2 = oggz_open_file_info (oggz_file_info_ref (info), TEST_FILENAME,
+                                 OGGZ_READ | OGGZ_AUTO);
+  if (cursor2 == NULL)
+    FAIL("Could not open second cursor");
+  check_stream (cursor2);
+
+  memset (&plain, 0, sizeof (plain));
+  read_seeks (reader, &plain);
+
+  memset (&shared, 0, sizeof (shared));
+  oggz_set_read_callback (cursor2, -1, read_packet, &shared);
+  read_seeks (cursor2, &shared);
+  compare_logs (&plain, 0, &shared);
+
+  INFO ("Testing cursors outliving the caller's references");
+
+  /* Each cursor holds its own reference to the file info */
+  oggz_file_info_unref (info);
+  oggz_file_info_unref (info);
+
+  check_stream (cursor);
+  check_stream (cursor2);
+
+  memset (&shared, 0, sizeof (shared));
+  read_seeks (cursor2, &shared);
+  compare_logs (&plain, 0, &shared);
+
+  if (oggz_close (cursor) != 0 || oggz_close (cursor2) != 0 ||
+      oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ");
+
+  remove (TEST_FILENAME);
+
+  exit (0);
+}
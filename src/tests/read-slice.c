@@ -0,0 +1,183 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define MAX_PACKET 500
+#define READ_SIZE 1000
+
+static long serialno;
+static int read_iter = 0;
+static int granules = 0;
+
+static long
+packet_bytes (int iter)
+{
+  /* Mostly small packets sharing pages, with some spanning several pages */
+  return (iter % 40 == 20) ? 10000 : 1 + iter % 97;
+}
+
+static int
+hungry (OGGZ * oggz, int empty, void * user_data)
+{
+  unsigned char buf[10000];
+  ogg_packet op;
+  static int iter = 0;
+
+  if (iter >= MAX_PACKET) return 1;
+
+  memset (buf, 'a' + iter % 26, sizeof (buf));
+
+  op.packet = buf;
+  op.bytes = packet_bytes (iter);
+  op.b_o_s = (iter == 0);
+  op.e_o_s = (iter == MAX_PACKET - 1);
+  op.granulepos = iter;
+  op.packetno = iter;
+
+  if (oggz_write_feed (oggz, &op, serialno, 0, NULL) != 0)
+    FAIL ("Oggz write failed");
+
+  iter++;
+
+  return 0;
+}
+
+static int
+read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
+{
+  ogg_packet * op = &zp->op;
+  long i;
+
+#ifdef DEBUG
+  printf ("%08" PRI_OGGZ_OFF_T "x: granulepos %" PRId64 ", packetno %" PRId64
+          ", bytes %ld\n", oggz_tell (oggz), op->granulepos, op->packetno,
+          op->bytes);
+#endif
+
+  if (read_iter >= MAX_PACKET)
+    FAIL ("Too many packets read");
+
+  if (op->bytes != packet_bytes (read_iter))
+    FAIL ("Packet has incorrect size");
+
+  for (i = 0; i < op->bytes; i++) {
+    if (op->packet[i] != 'a' + read_iter % 26)
+      FAIL ("Packet contains incorrect data");
+  }
+
+  if ((op->b_o_s == 0) != (read_iter != 0))
+    FAIL ("Packet has incorrect b_o_s");
+
+  if ((op->e_o_s == 0) != (read_iter != MAX_PACKET - 1))
+    FAIL ("Packet has incorrect e_o_s");
+
+  if (op->granulepos != -1) {
+    if (op->granulepos != read_iter)
+      FAIL ("Packet has incorrect granulepos");
+    granules++;
+  }
+
+  if (op->packetno != read_iter)
+    FAIL ("Packet has incorrect packetno");
+
+  read_iter++;
+
+  /* Pause part way through pages, so the rest of the page must survive
+   * the sync buffer being refilled */
+  if (read_iter % 7 == 0) return OGGZ_STOP_OK;
+
+  return OGGZ_CONTINUE;
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * reader, * writer;
+  unsigned char buf[READ_SIZE];
+  long n, remaining, offset;
+
+  INFO ("Testing delivery of packets contained within a page");
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  serialno = oggz_serialno_new (writer);
+
+  if (oggz_write_set_hungry_callback (writer, hungry, 1, NULL) == -1)
+    FAIL("Could not set hungry callback");
+
+  reader = oggz_new (OGGZ_READ);
+  if (reader == NULL)
+    FAIL("newly created OGGZ reader == NULL");
+
+  oggz_set_read_callback (reader, -1, read_packet, NULL);
+
+  while ((remaining = oggz_write_output (writer, buf, READ_SIZE)) > 0) {
+    offset = 0;
+    while (remaining > 0) {
+      n = oggz_read_input (reader, buf + offset, remaining);
+      if (n == OGGZ_ERR_READ_STOP_OK) continue;
+      if (n < 0)
+        FAIL ("Read failed");
+      offset += n;
+      remaining -= n;
+    }
+  }
+
+  /* Deliver anything left after the last pause */
+  for (n = 0; n < MAX_PACKET && read_iter < MAX_PACKET; n++)
+    oggz_read_input (reader, buf, 0);
+
+  if (read_iter != MAX_PACKET)
+    FAIL ("Not all packets read");
+
+  if (granules == 0 || granules == MAX_PACKET)
+    FAIL ("Expected some pages to hold several packets");
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  exit (0);
+}
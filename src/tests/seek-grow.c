@@ -0,0 +1,211 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define DATA_BUF_LEN (4096*64)
+#define MAX_PACKET 200
+
+static long serialno;
+
+/* The readable end of data_buf, moved to simulate a growing file */
+static long offset_end = 0;
+static long my_offset = 0;
+static int seek_end_called = 0;
+
+static int
+hungry (OGGZ * oggz, int empty, void * user_data)
+{
+  unsigned char buf[1000];
+  ogg_packet op;
+  static int iter = 0;
+
+  if (iter >= MAX_PACKET) return 1;
+
+  memset (buf, 'a' + iter % 26, sizeof (buf));
+
+  op.packet = buf;
+  op.bytes = sizeof (buf);
+  op.b_o_s = (iter == 0);
+  op.e_o_s = (iter == MAX_PACKET - 1);
+  op.granulepos = iter;
+  op.packetno = iter;
+
+  if (oggz_write_feed (oggz, &op, serialno, OGGZ_FLUSH_AFTER, NULL) != 0)
+    FAIL ("Oggz write failed");
+
+  iter++;
+
+  return 0;
+}
+
+static int
+read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
+{
+  return OGGZ_CONTINUE;
+}
+
+static size_t
+my_io_read (void * user_handle, void * buf, size_t n)
+{
+  unsigned char * data_buf = (unsigned char *)user_handle;
+  long len;
+
+  len = MIN ((long)n, offset_end - my_offset);
+  if (len <= 0) return 0;
+
+  memcpy (buf, &data_buf[my_offset], len);
+  my_offset += len;
+
+  return len;
+}
+
+static int
+my_io_seek (void * user_handle, long offset, int whence)
+{
+  switch (whence) {
+  case SEEK_SET:
+    my_offset = offset;
+    break;
+  case SEEK_CUR:
+    my_offset += offset;
+    break;
+  case SEEK_END:
+    seek_end_called++;
+    my_offset = offset_end + offset;
+    break;
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+static long
+my_io_tell (void * user_handle)
+{
+  return my_offset;
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * reader, * writer;
+  unsigned char data_buf[DATA_BUF_LEN];
+  ogg_int64_t units_end, units_grown, target, result;
+  long n;
+
+  INFO ("Testing seeking in a file that grows");
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  serialno = oggz_serialno_new (writer);
+
+  if (oggz_write_set_hungry_callback (writer, hungry, 1, NULL) == -1)
+    FAIL("Could not set hungry callback");
+
+  n = oggz_write_output (writer, data_buf, DATA_BUF_LEN);
+  if (n >= DATA_BUF_LEN)
+    FAIL("Too much data generated by writer");
+
+  reader = oggz_new (OGGZ_READ);
+  if (reader == NULL)
+    FAIL("newly created OGGZ reader == NULL");
+
+  oggz_io_set_read (reader, my_io_read, data_buf);
+  oggz_io_set_seek (reader, my_io_seek, data_buf);
+  oggz_io_set_tell (reader, my_io_tell, data_buf);
+
+  oggz_set_read_callback (reader, -1, read_packet, NULL);
+
+  /* Only the first half has been written so far */
+  offset_end = n / 2;
+
+  while (oggz_read (reader, 4096) > 0);
+
+  oggz_set_granulerate (reader, serialno, 1, 1);
+
+  units_end = oggz_seek_units (reader, 0, SEEK_END);
+  if (units_end <= 0)
+    FAIL("Could not seek to end of first half");
+
+  INFO ("+ Seeking within known bounds");
+
+  seek_end_called = 0;
+
+  if (oggz_seek_units (reader, units_end / 2, SEEK_SET) != units_end / 2)
+    FAIL("Could not seek within first half");
+
+  if (oggz_seek_units (reader, units_end / 4, SEEK_SET) != units_end / 4)
+    FAIL("Could not seek within first half");
+
+  if (seek_end_called != 0)
+    FAIL("End of file was looked up again");
+
+  target = units_end + units_end / 2;
+
+  if (oggz_seek_units (reader, target, SEEK_SET) != -1)
+    FAIL("Seek beyond end of file succeeded");
+
+  INFO ("+ Seeking after the file has grown");
+
+  offset_end = n;
+
+  if ((result = oggz_seek_units (reader, target, SEEK_SET)) != target) {
+#ifdef DEBUG
+    printf ("Seek to %" PRId64 " returned %" PRId64 "\n", target, result);
+#endif
+    FAIL("Could not seek into grown part of file");
+  }
+
+  units_grown = oggz_seek_units (reader, 0, SEEK_END);
+  if (units_grown <= units_end)
+    FAIL("End of file did not move after growing");
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  exit (0);
+}
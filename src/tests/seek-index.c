@@ -0,0 +1,326 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define DATA_BUF_LEN (256 * 1024)
+
+#define MAX_PACKET 300
+
+#define INDEX_FILENAME "seek-index.idx"
+
+static long serialno;
+static long serialno_raw = -1;
+static int iter = 0;
+static long offset_end = 0;
+static int read_called = 0;
+
+static unsigned char data_buf[DATA_BUF_LEN];
+
+/* Offsets of the pages carrying each granulepos */
+static oggz_off_t page_offsets[MAX_PACKET];
+
+typedef struct {
+  long offset;
+} my_handle;
+
+static int
+hungry (OGGZ * oggz, int empty, void * user_data)
+{
+  static unsigned char buf[10000];
+  ogg_packet op;
+
+  if (iter >= MAX_PACKET) return 1;
+
+  memset (buf, 'a' + iter % 26, sizeof (buf));
+
+  op.packet = buf;
+  /* Make some packets span several pages without a granulepos */
+  op.bytes = (iter % 50 == 25) ? 10000 : 200;
+  op.b_o_s = (iter == 0);
+  op.e_o_s = (iter == MAX_PACKET - 1);
+  op.granulepos = iter;
+  op.packetno = iter;
+
+  if (oggz_write_feed (oggz, &op, serialno, OGGZ_FLUSH_AFTER, NULL) != 0)
+    FAIL ("Oggz write failed");
+
+  /* Interleave another stream, whose pages will not be given a unit */
+  if (serialno_raw != -1) {
+    op.bytes = 100;
+    op.packetno = iter;
+    if (oggz_write_feed (oggz, &op, serialno_raw, OGGZ_FLUSH_AFTER, NULL) != 0)
+      FAIL ("Oggz write failed");
+  }
+
+  iter++;
+
+  return 0;
+}
+
+static int
+read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
+{
+  ogg_int64_t granulepos = ogg_page_granulepos (og);
+
+  if (granulepos >= 0 && granulepos < MAX_PACKET)
+    page_offsets[granulepos] = oggz_tell (oggz);
+
+  return 0;
+}
+
+/* Give units to the pages of the main stream only */
+static ogg_int64_t
+main_metric (OGGZ * oggz, long serialno, ogg_int64_t granulepos,
+             void * user_data)
+{
+  return (serialno == *(long *)user_data) ? granulepos : -1;
+}
+
+static size_t
+my_io_read (void * user_handle, void * buf, size_t n)
+{
+  my_handle * h = (my_handle *)user_handle;
+  long len;
+
+  read_called++;
+
+  len = MIN ((long)n, offset_end - h->offset);
+  memcpy (buf, &data_buf[h->offset], len);
+
+  h->offset += len;
+
+  return len;
+}
+
+static int
+my_io_seek (void * user_handle, long offset, int whence)
+{
+  my_handle * h = (my_handle *)user_handle;
+
+  switch (whence) {
+  case SEEK_SET:
+    h->offset = offset;
+    break;
+  case SEEK_CUR:
+    h->offset += offset;
+    break;
+  case SEEK_END:
+    h->offset = offset_end + offset;
+    break;
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+static long
+my_io_tell (void * user_handle)
+{
+  my_handle * h = (my_handle *)user_handle;
+
+  return h->offset;
+}
+
+static OGGZ *
+open_reader (my_handle * h, long n)
+{
+  OGGZ * reader;
+
+  reader = oggz_new (OGGZ_READ | OGGZ_INDEX);
+  if (reader == NULL)
+    FAIL("newly created OGGZ reader == NULL");
+
+  h->offset = 0;
+
+  oggz_io_set_read (reader, my_io_read, h);
+  oggz_io_set_seek (reader, my_io_seek, h);
+  oggz_io_set_tell (reader, my_io_tell, h);
+
+  oggz_set_read_page (reader, serialno, read_page, NULL);
+  oggz_set_granulerate (reader, serialno, 1, 1);
+  if (serialno_raw != -1)
+    oggz_set_metric (reader, -1, main_metric, &serialno);
+
+  if (n > 0 && oggz_read (reader, n) <= 0)
+    FAIL("Read failed");
+
+  return reader;
+}
+
+static void
+test_seek (OGGZ * reader, ogg_int64_t units, int indexed)
+{
+  ogg_int64_t r;
+
+#ifdef DEBUG
+  printf ("Seeking to %" PRId64 "\n", units);
+#endif
+
+  read_called = 0;
+  r = oggz_seek_units (reader, units, SEEK_SET);
+
+  if (indexed) {
+    if (read_called != 0)
+      FAIL("Seek within indexed region read data");
+
+    if (r != units)
+      FAIL("Seek within indexed region returned incorrect unit");
+  } else {
+    if (r < 0 || r > units)
+      FAIL("Seek beyond indexed region returned incorrect unit");
+  }
+
+  if (oggz_tell (reader) != page_offsets[r])
+    FAIL("Seek reached incorrect offset");
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * writer, * reader;
+  my_handle h;
+  ogg_int64_t units;
+
+  INFO ("Testing seeking with a page index");
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  serialno = oggz_serialno_new (writer);
+
+  if (oggz_write_set_hungry_callback (writer, hungry, 1, NULL) == -1)
+    FAIL("Could not set hungry callback");
+
+  offset_end = oggz_write_output (writer, data_buf, DATA_BUF_LEN);
+
+  if (offset_end >= DATA_BUF_LEN)
+    FAIL("Too much data generated by writer");
+
+  /* Seek within a fully indexed file */
+  reader = open_reader (&h, offset_end);
+
+  for (units = 3; units < MAX_PACKET - 1; units += 17) {
+    test_seek (reader, units, 1);
+  }
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  INFO ("Testing seeking beyond the indexed region");
+
+  reader = open_reader (&h, offset_end / 3);
+
+  test_seek (reader, 20, 1);
+  test_seek (reader, MAX_PACKET - 20, 0);
+  test_seek (reader, 40, 1);
+
+  if (oggz_index_save (reader, INDEX_FILENAME) != 0)
+    FAIL("Could not save index");
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  INFO ("Testing seeking with a saved index");
+
+  reader = open_reader (&h, 0);
+
+  if (oggz_index_load (reader, INDEX_FILENAME) != 0)
+    FAIL("Could not load index");
+
+  test_seek (reader, 20, 1);
+  test_seek (reader, MAX_PACKET - 20, 0);
+  test_seek (reader, 40, 1);
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  INFO ("Testing rejection of a stale index");
+
+  reader = open_reader (&h, 0);
+
+  offset_end--;
+  if (oggz_index_load (reader, INDEX_FILENAME) != OGGZ_ERR_BAD_INDEX)
+    FAIL("Stale index was loaded");
+  offset_end++;
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  remove (INDEX_FILENAME);
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  INFO ("Testing seeking among pages with no unit");
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  serialno = oggz_serialno_new (writer);
+  serialno_raw = oggz_serialno_new (writer);
+  iter = 0;
+
+  if (oggz_write_set_hungry_callback (writer, hungry, 1, NULL) == -1)
+    FAIL("Could not set hungry callback");
+
+  offset_end = oggz_write_output (writer, data_buf, DATA_BUF_LEN);
+
+  if (offset_end >= DATA_BUF_LEN)
+    FAIL("Too much data generated by writer");
+
+  reader = open_reader (&h, offset_end);
+
+  for (units = 3; units < MAX_PACKET - 1; units += 17) {
+    test_seek (reader, units, 1);
+  }
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  exit (0);
+}
@@ -0,0 +1,209 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define DATA_BUF_LEN (4096*512)
+#define MAX_PACKET 30
+#define PACKET_BYTES 60000
+
+/* Bytes and reads allowed to find the start of one page scanning back */
+#define MAX_SCAN_BYTES (4 * PACKET_BYTES)
+#define MAX_SCAN_READS 16
+
+static unsigned char data_buf[DATA_BUF_LEN];
+static long offset_end = 0;
+static long my_offset = 0;
+
+static long bytes_read = 0;
+static int read_called = 0;
+
+static long serialno;
+
+static int
+hungry (OGGZ * oggz, int empty, void * user_data)
+{
+  static unsigned char buf[PACKET_BYTES];
+  ogg_packet op;
+  static int iter = 0;
+
+  if (iter >= MAX_PACKET) return 1;
+
+  memset (buf, 'a' + iter % 26, sizeof (buf));
+
+  op.packet = buf;
+  op.bytes = PACKET_BYTES;
+  op.b_o_s = (iter == 0);
+  op.e_o_s = (iter == MAX_PACKET - 1);
+  op.granulepos = iter;
+  op.packetno = iter;
+
+  /* One packet per page, making pages of nearly the largest size */
+  if (oggz_write_feed (oggz, &op, serialno, OGGZ_FLUSH_AFTER, NULL) != 0)
+    FAIL ("Oggz write failed");
+
+  iter++;
+
+  return 0;
+}
+
+static int
+read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
+{
+  return OGGZ_CONTINUE;
+}
+
+static size_t
+my_io_read (void * user_handle, void * buf, size_t n)
+{
+  long len;
+
+  read_called++;
+
+  len = MIN ((long)n, offset_end - my_offset);
+  if (len <= 0) return 0;
+
+  memcpy (buf, &data_buf[my_offset], len);
+  my_offset += len;
+  bytes_read += len;
+
+  return len;
+}
+
+static int
+my_io_seek (void * user_handle, long offset, int whence)
+{
+  switch (whence) {
+  case SEEK_SET:
+    my_offset = offset;
+    break;
+  case SEEK_CUR:
+    my_offset += offset;
+    break;
+  case SEEK_END:
+    my_offset = offset_end + offset;
+    break;
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+static long
+my_io_tell (void * user_handle)
+{
+  return my_offset;
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * reader, * writer;
+  ogg_int64_t result;
+  char buf[128];
+  int i;
+
+  INFO ("Testing seeking over large pages");
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  serialno = oggz_serialno_new (writer);
+
+  if (oggz_write_set_hungry_callback (writer, hungry, 1, NULL) == -1)
+    FAIL("Could not set hungry callback");
+
+  offset_end = oggz_write_output (writer, data_buf, DATA_BUF_LEN);
+  if (offset_end >= DATA_BUF_LEN)
+    FAIL("Too much data generated by writer");
+
+  reader = oggz_new (OGGZ_READ);
+  if (reader == NULL)
+    FAIL("newly created OGGZ reader == NULL");
+
+  oggz_io_set_read (reader, my_io_read, NULL);
+  oggz_io_set_seek (reader, my_io_seek, NULL);
+  oggz_io_set_tell (reader, my_io_tell, NULL);
+
+  oggz_set_read_callback (reader, -1, read_packet, NULL);
+
+  while (oggz_read (reader, 4096) > 0);
+
+  oggz_set_granulerate (reader, serialno, 1, 1);
+
+  INFO ("+ Seeking to the last page");
+
+  bytes_read = 0;
+  read_called = 0;
+
+  result = oggz_seek_units (reader, 0, SEEK_END);
+  if (result != MAX_PACKET - 1)
+    FAIL("Seek to end found incorrect page");
+
+#ifdef DEBUG
+  printf ("Read %ld bytes in %d reads\n", bytes_read, read_called);
+#endif
+
+  if (bytes_read > MAX_SCAN_BYTES || read_called > MAX_SCAN_READS) {
+    snprintf (buf, 128, "Finding the last page read %ld bytes in %d reads",
+              bytes_read, read_called);
+    FAIL (buf);
+  }
+
+  INFO ("+ Seeking to each page");
+
+  for (i = MAX_PACKET - 1; i >= 0; i--) {
+    result = oggz_seek_units (reader, i, SEEK_SET);
+    if (result != i) {
+      snprintf (buf, 128, "Seek to %d returned %" PRId64, i, result);
+      FAIL (buf);
+    }
+  }
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  exit (0);
+}
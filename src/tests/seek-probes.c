@@ -0,0 +1,241 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define DATA_BUF_LEN (4096*1024)
+#define MAX_PACKET 2000
+#define KEYFRAME 50
+#define NR_SEEKS 200
+
+/* Mean and worst number of pages probed per seek */
+#define MAX_MEAN_PROBES 4
+#define MAX_PROBES 10
+
+static unsigned char data_buf[DATA_BUF_LEN];
+static long offset_end = 0;
+static long my_offset = 0;
+
+static long serialno;
+
+/* Granulepos of each page read, in order */
+static ogg_int64_t pages[DATA_BUF_LEN/4096];
+static int nr_pages = 0;
+
+static long
+packet_bytes (int iter)
+{
+  /* Large keyframes between small, variable delta frames */
+  return (iter % KEYFRAME == 0) ? 40000 : 200 + (iter * 7919) % 400;
+}
+
+static int
+hungry (OGGZ * oggz, int empty, void * user_data)
+{
+  unsigned char buf[40000];
+  ogg_packet op;
+  static int iter = 0;
+
+  if (iter >= MAX_PACKET) return 1;
+
+  memset (buf, 'a' + iter % 26, sizeof (buf));
+
+  op.packet = buf;
+  op.bytes = packet_bytes (iter);
+  op.b_o_s = (iter == 0);
+  op.e_o_s = (iter == MAX_PACKET - 1);
+  op.granulepos = iter;
+  op.packetno = iter;
+
+  if (oggz_write_feed (oggz, &op, serialno, 0, NULL) != 0)
+    FAIL ("Oggz write failed");
+
+  iter++;
+
+  return 0;
+}
+
+static int
+read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
+{
+  ogg_int64_t granulepos = ogg_page_granulepos ((ogg_page *)og);
+
+  if (granulepos != -1) pages[nr_pages++] = granulepos;
+
+  return OGGZ_CONTINUE;
+}
+
+static size_t
+my_io_read (void * user_handle, void * buf, size_t n)
+{
+  long len;
+
+  len = MIN ((long)n, offset_end - my_offset);
+  if (len <= 0) return 0;
+
+  memcpy (buf, &data_buf[my_offset], len);
+  my_offset += len;
+
+  return len;
+}
+
+static int
+my_io_seek (void * user_handle, long offset, int whence)
+{
+  switch (whence) {
+  case SEEK_SET:
+    my_offset = offset;
+    break;
+  case SEEK_CUR:
+    my_offset += offset;
+    break;
+  case SEEK_END:
+    my_offset = offset_end + offset;
+    break;
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+static long
+my_io_tell (void * user_handle)
+{
+  return my_offset;
+}
+
+/* The last page at or before the target */
+static ogg_int64_t
+expected_unit (ogg_int64_t target)
+{
+  ogg_int64_t unit = 0;
+  int i;
+
+  for (i = 0; i < nr_pages && pages[i] <= target; i++)
+    unit = pages[i];
+
+  return unit;
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * reader, * writer;
+  ogg_int64_t target, result;
+  unsigned long seed = 1;
+  long total_probes = 0;
+  int i, probes;
+  char buf[128];
+
+  INFO ("Testing seek probes in variable bitrate data");
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  serialno = oggz_serialno_new (writer);
+
+  if (oggz_write_set_hungry_callback (writer, hungry, 1, NULL) == -1)
+    FAIL("Could not set hungry callback");
+
+  offset_end = oggz_write_output (writer, data_buf, DATA_BUF_LEN);
+  if (offset_end >= DATA_BUF_LEN)
+    FAIL("Too much data generated by writer");
+
+  if (oggz_seek_get_probes (writer) != OGGZ_ERR_INVALID)
+    FAIL("Probes reported for OGGZ_WRITE");
+
+  reader = oggz_new (OGGZ_READ);
+  if (reader == NULL)
+    FAIL("newly created OGGZ reader == NULL");
+
+  oggz_io_set_read (reader, my_io_read, NULL);
+  oggz_io_set_seek (reader, my_io_seek, NULL);
+  oggz_io_set_tell (reader, my_io_tell, NULL);
+
+  oggz_set_read_page (reader, -1, read_page, NULL);
+
+  while (oggz_read (reader, 4096) > 0);
+
+  oggz_set_read_page (reader, -1, NULL, NULL);
+
+  /* Seek in units of granules */
+  oggz_set_granulerate (reader, serialno, 1, 1);
+
+  for (i = 0; i < NR_SEEKS; i++) {
+    seed = seed * 1103515245 + 12345;
+    target = 1 + (seed >> 8) % (MAX_PACKET - 1);
+
+    result = oggz_seek_units (reader, target, SEEK_SET);
+    probes = oggz_seek_get_probes (reader);
+
+#ifdef DEBUG
+    printf ("Seek to %" PRId64 ": %" PRId64 " in %d probes\n", target, result,
+            probes);
+#endif
+
+    if (result != expected_unit (target)) {
+      snprintf (buf, 128, "Seek to %" PRId64 " returned %" PRId64
+                ", expected %" PRId64,
+                target, result, expected_unit (target));
+      FAIL (buf);
+    }
+
+    if (probes < 0 || probes > MAX_PROBES) {
+      snprintf (buf, 128, "Seek to %" PRId64 " took %d probes", target,
+                probes);
+      FAIL (buf);
+    }
+
+    total_probes += probes;
+  }
+
+  if (total_probes > MAX_MEAN_PROBES * NR_SEEKS)
+    FAIL("Too many probes per seek");
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  exit (0);
+}
@@ -0,0 +1,406 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define DATA_BUF_LEN (256 * 1024)
+
+#define MAX_PACKET 300
+
+/* Data pages with these granulepos are keypoints: 10, 60, 110, ... */
+#define KEYPOINT_FIRST 10
+#define KEYPOINT_INTERVAL 50
+#define NR_KEYPOINTS ((MAX_PACKET - KEYPOINT_FIRST + KEYPOINT_INTERVAL - 1) / KEYPOINT_INTERVAL)
+
+#define FISHEAD_LEN 80
+#define FISBONE_LEN 86
+#define DATA_LEN 200
+
+/* Bytes added to the data stream's header to make an index stale */
+#define STALE_PAD 40
+#define INDEX_LEN (42 + NR_KEYPOINTS * 8)
+
+static long skeleton_serialno, data_serialno;
+static long offset_end = 0;
+static int read_called = 0;
+
+static unsigned char data_buf[DATA_BUF_LEN];
+
+/* Offsets of the data pages carrying each granulepos */
+static oggz_off_t page_offsets[MAX_PACKET];
+
+typedef struct {
+  long offset;
+} my_handle;
+
+static void
+put_le (unsigned char * c, ogg_int64_t n, int len)
+{
+  int i;
+
+  for (i = 0; i < len; i++) {
+    c[i] = (unsigned char)(n & 0xff);
+    n >>= 8;
+  }
+}
+
+/* Write n as a fixed width (4 byte) Skeleton variable length integer, so
+ * that the index does not change size when real offsets are filled in */
+static unsigned char *
+put_varint (unsigned char * c, ogg_int64_t n)
+{
+  c[0] = n & 0x7f;
+  c[1] = (n >> 7) & 0x7f;
+  c[2] = (n >> 14) & 0x7f;
+  c[3] = ((n >> 21) & 0x7f) | 0x80;
+
+  return c + 4;
+}
+
+static void
+feed (OGGZ * writer, unsigned char * buf, long bytes, long serialno,
+      ogg_int64_t granulepos, ogg_int64_t packetno, int b_o_s, int e_o_s)
+{
+  ogg_packet op;
+
+  op.packet = buf;
+  op.bytes = bytes;
+  op.b_o_s = b_o_s;
+  op.e_o_s = e_o_s;
+  op.granulepos = granulepos;
+  op.packetno = packetno;
+
+  if (oggz_write_feed (writer, &op, serialno, OGGZ_FLUSH_AFTER, NULL) != 0)
+    FAIL ("Oggz write failed");
+}
+
+/*
+ * Write a Skeleton 4.0 file with one indexed data stream, taking keypoint
+ * offsets from page_offsets[]. pad bytes are added to the header packet of
+ * the data stream.
+ */
+static long
+write_file (long pad, oggz_off_t segment_length)
+{
+  OGGZ * writer;
+  unsigned char fishead[FISHEAD_LEN], fisbone[FISBONE_LEN], index[INDEX_LEN];
+  unsigned char buf[DATA_LEN + STALE_PAD], * p;
+  oggz_off_t offset = 0;
+  ogg_int64_t granulepos, time = 0;
+  long n;
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  skeleton_serialno = 1000;
+  data_serialno = 2000;
+
+  memset (fishead, 0, sizeof (fishead));
+  memcpy (fishead, "fishead\0", 8);
+  put_le (&fishead[8], 4, 2);
+  put_le (&fishead[20], 1000, 8);
+  put_le (&fishead[36], 1000, 8);
+  put_le (&fishead[64], segment_length, 8);
+  feed (writer, fishead, FISHEAD_LEN, skeleton_serialno, 0, 0, 1, 0);
+
+  memset (buf, 0, sizeof (buf));
+  memcpy (buf, "testdata", 8);
+  feed (writer, buf, DATA_LEN + pad, data_serialno, 0, 0, 1, 0);
+
+  memset (fisbone, 0, sizeof (fisbone));
+  memcpy (fisbone, "fisbone\0", 8);
+  put_le (&fisbone[8], 44, 4);
+  put_le (&fisbone[12], data_serialno, 4);
+  put_le (&fisbone[16], 1, 4);
+  put_le (&fisbone[20], 1, 8);
+  put_le (&fisbone[28], 1, 8);
+  memcpy (&fisbone[52], "Content-Type: application/x-test\r\n", 34);
+  feed (writer, fisbone, FISBONE_LEN, skeleton_serialno, 0, 1, 0, 0);
+
+  memset (index, 0, sizeof (index));
+  memcpy (index, "index\0", 6);
+  put_le (&index[6], data_serialno, 4);
+  put_le (&index[10], NR_KEYPOINTS, 8);
+  put_le (&index[18], 1000, 8);
+  put_le (&index[34], MAX_PACKET * 1000, 8);
+  p = &index[42];
+  for (granulepos = KEYPOINT_FIRST; granulepos < MAX_PACKET;
+       granulepos += KEYPOINT_INTERVAL) {
+    p = put_varint (p, page_offsets[granulepos] - offset);
+    p = put_varint (p, granulepos * 1000 - time);
+    offset = page_offsets[granulepos];
+    time = granulepos * 1000;
+  }
+  feed (writer, index, INDEX_LEN, skeleton_serialno, 0, 2, 0, 0);
+
+  feed (writer, buf, 0, skeleton_serialno, 0, 3, 0, 1);
+
+  for (granulepos = 1; granulepos < MAX_PACKET; granulepos++) {
+    memset (buf, 'a' + granulepos % 26, DATA_LEN);
+    feed (writer, buf, DATA_LEN, data_serialno, granulepos, granulepos,
+          0, granulepos == MAX_PACKET - 1);
+  }
+
+  n = oggz_write_output (writer, data_buf, DATA_BUF_LEN);
+  if (n >= DATA_BUF_LEN)
+    FAIL("Too much data generated by writer");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  return n;
+}
+
+static int
+read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
+{
+  ogg_int64_t granulepos = ogg_page_granulepos (og);
+
+  if (granulepos >= 0 && granulepos < MAX_PACKET)
+    page_offsets[granulepos] = oggz_tell (oggz);
+
+  return 0;
+}
+
+static size_t
+my_io_read (void * user_handle, void * buf, size_t n)
+{
+  my_handle * h = (my_handle *)user_handle;
+  long len;
+
+  read_called++;
+
+  len = MIN ((long)n, offset_end - h->offset);
+  memcpy (buf, &data_buf[h->offset], len);
+
+  h->offset += len;
+
+  return len;
+}
+
+static int
+my_io_seek (void * user_handle, long offset, int whence)
+{
+  my_handle * h = (my_handle *)user_handle;
+
+  switch (whence) {
+  case SEEK_SET:
+    h->offset = offset;
+    break;
+  case SEEK_CUR:
+    h->offset += offset;
+    break;
+  case SEEK_END:
+    h->offset = offset_end + offset;
+    break;
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+static long
+my_io_tell (void * user_handle)
+{
+  my_handle * h = (my_handle *)user_handle;
+
+  return h->offset;
+}
+
+static OGGZ *
+open_reader (my_handle * h, int flags, long n)
+{
+  OGGZ * reader;
+
+  reader = oggz_new (OGGZ_READ | flags);
+  if (reader == NULL)
+    FAIL("newly created OGGZ reader == NULL");
+
+  h->offset = 0;
+
+  oggz_io_set_read (reader, my_io_read, h);
+  oggz_io_set_seek (reader, my_io_seek, h);
+  oggz_io_set_tell (reader, my_io_tell, h);
+
+  oggz_set_read_page (reader, data_serialno, read_page, NULL);
+
+  if (oggz_read (reader, n) <= 0)
+    FAIL("Read failed");
+
+  return reader;
+}
+
+static void
+test_seek (OGGZ * reader, ogg_int64_t units, ogg_int64_t keypoint)
+{
+  ogg_int64_t r;
+
+#ifdef DEBUG
+  printf ("Seeking to %" PRId64 "\n", units);
+#endif
+
+  read_called = 0;
+  r = oggz_seek_units (reader, units, SEEK_SET);
+
+  if (keypoint != -1) {
+    /* Only the page at the keypoint is read, to check it */
+    if (read_called > 1)
+      FAIL("Seek to keypoint searched for the page");
+
+    if (r != keypoint * 1000)
+      FAIL("Seek to keypoint returned incorrect unit");
+
+    if (oggz_tell (reader) != page_offsets[keypoint])
+      FAIL("Seek to keypoint reached incorrect offset");
+  } else {
+    if (r < 0 || r > units || r % 1000 != 0)
+      FAIL("Seek without keypoint returned incorrect unit");
+
+    if (oggz_tell (reader) != page_offsets[r / 1000])
+      FAIL("Seek without keypoint reached incorrect offset");
+  }
+}
+
+static void
+test_stale_seeks (OGGZ * reader)
+{
+  /* Keypoints are not used, but seeks find the right pages */
+  test_seek (reader, 123456, -1);
+  test_seek (reader, 60000, -1);
+  test_seek (reader, (MAX_PACKET - 1) * 1000, -1);
+  test_seek (reader, 10500, -1);
+}
+
+/* Twice the built-in metric, so that keypoint times do not apply */
+static ogg_int64_t
+double_metric (OGGZ * oggz, long serialno, ogg_int64_t granulepos,
+               void * user_data)
+{
+  return granulepos * 2000;
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * reader;
+  my_handle h;
+  oggz_off_t offset;
+  ogg_int64_t r;
+  long n;
+  int i;
+
+  INFO ("Testing seeking with a Skeleton index");
+
+  /* Find the data page offsets, then write them into the index */
+  offset_end = write_file (0, 0);
+  reader = open_reader (&h, 0, offset_end);
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  n = write_file (0, offset_end);
+  if (n != offset_end)
+    FAIL("Index changed size");
+
+  /* Read the headers only */
+  reader = open_reader (&h, OGGZ_AUTO, page_offsets[1]);
+
+  test_seek (reader, 123456, 110);
+  test_seek (reader, 60000, 60);
+  test_seek (reader, (MAX_PACKET - 1) * 1000, 260);
+  test_seek (reader, 5000, -1);
+  test_seek (reader, 10500, 10);
+
+  INFO ("+ Seeking past the end");
+  offset = oggz_tell (reader);
+  if (oggz_seek_units (reader, 30000000, SEEK_SET) != -1)
+    FAIL("Seek past the end succeeded");
+  if (oggz_tell (reader) != offset)
+    FAIL("Seek past the end moved the read position");
+
+  INFO ("+ Seeking with a user metric");
+  oggz_set_metric (reader, data_serialno, double_metric, NULL);
+  read_called = 0;
+  r = oggz_seek_units (reader, 120000, SEEK_SET);
+  if (read_called == 0)
+    FAIL("Seek used keypoints despite a user metric");
+  if (r < 0 || r > 120000 || r != oggz_tell_units (reader))
+    FAIL("Seek with a user metric returned incorrect unit");
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  INFO ("Testing seeking with a stale Skeleton index");
+
+  /* Grow the headers as an editor would, leaving the index as it was */
+  offset_end = write_file (STALE_PAD, offset_end);
+  reader = open_reader (&h, OGGZ_AUTO, offset_end);
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  reader = open_reader (&h, OGGZ_AUTO, page_offsets[1]);
+  test_stale_seeks (reader);
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  INFO ("+ Segment length updated, keypoint offsets not");
+
+  for (i = KEYPOINT_FIRST; i < MAX_PACKET; i += KEYPOINT_INTERVAL)
+    page_offsets[i] -= STALE_PAD;
+
+  n = write_file (STALE_PAD, offset_end);
+  if (n != offset_end)
+    FAIL("Index changed size");
+
+  /* Find the real data page offsets again */
+  reader = open_reader (&h, OGGZ_AUTO, offset_end);
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  reader = open_reader (&h, OGGZ_AUTO, page_offsets[1]);
+  test_stale_seeks (reader);
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  exit (0);
+}
@@ -0,0 +1,109 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+#define NR_KEYS 1000
+
+static long
+key_of (int i)
+{
+  /* Spread like serialnos, including negative values */
+  return (long)(int)((unsigned int)i * 2246822519U);
+}
+
+int
+main (int argc, char * argv[])
+{
+  OggzTable * table;
+  static int values[NR_KEYS];
+  long key;
+  int i;
+
+  INFO ("Testing OggzTable lookups");
+
+  table = oggz_table_new ();
+  if (table == NULL)
+    FAIL("newly created OggzTable == NULL");
+
+  for (i = 0; i < NR_KEYS; i++) {
+    if (oggz_table_insert (table, key_of (i), &values[i]) != &values[i])
+      FAIL("Could not insert into table");
+  }
+
+  if (oggz_table_size (table) != NR_KEYS)
+    FAIL("Table has incorrect size");
+
+  for (i = 0; i < NR_KEYS; i++) {
+    if (oggz_table_lookup (table, key_of (i)) != &values[i])
+      FAIL("Lookup returned incorrect data");
+  }
+
+  if (oggz_table_lookup (table, key_of (NR_KEYS)) != NULL)
+    FAIL("Lookup of missing key returned data");
+
+  INFO ("+ Removing every third key");
+
+  for (i = 0; i < NR_KEYS; i += 3) {
+    if (oggz_table_remove (table, key_of (i)) != 0)
+      FAIL("Could not remove from table");
+  }
+
+  for (i = 0; i < NR_KEYS; i++) {
+    if (oggz_table_lookup (table, key_of (i)) != ((i % 3) ? &values[i] : NULL))
+      FAIL("Lookup after removal returned incorrect data");
+  }
+
+  /* Remaining entries keep their insertion order */
+  if (oggz_table_nth (table, 0, &key) != &values[1] || key != key_of (1))
+    FAIL("Table order changed by removal");
+
+  INFO ("+ Replacing a key");
+
+  if (oggz_table_insert (table, key_of (1), &values[0]) != &values[0])
+    FAIL("Could not replace data in table");
+
+  if (oggz_table_lookup (table, key_of (1)) != &values[0])
+    FAIL("Lookup returned replaced data");
+
+  if (oggz_table_nth (table, oggz_table_size (table) - 1, &key) != &values[0]
+      || key != key_of (1))
+    FAIL("Replaced key not moved to end of table");
+
+  oggz_table_delete (table);
+
+  exit (0);
+}
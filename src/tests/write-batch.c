@@ -0,0 +1,219 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define NR_PACKETS 200
+#define PACKET_BYTES 100
+
+#define OUT_BUF_LEN 65536
+#define MAX_WRITES 1024
+
+#define BATCH_BYTES 4096
+
+/* Each page carries one granule, which is two units */
+#define GRANULERATE_N 1
+#define GRANULERATE_D 2
+#define UNITS(granulepos) ((granulepos) * GRANULERATE_D / GRANULERATE_N)
+
+/* Not a whole number of pages, so that a batch cannot end exactly on it */
+#define BATCH_UNITS 9
+#define BATCH_PAGES (BATCH_UNITS / UNITS(1) + 1)
+
+typedef struct {
+  unsigned char data[OUT_BUF_LEN];
+  long length;
+  int nr_writes;
+  long write_offset[MAX_WRITES];
+  long write_bytes[MAX_WRITES];
+} output;
+
+static size_t
+my_io_write (void * user_handle, void * buf, size_t n)
+{
+  output * out = (output *)user_handle;
+
+  if (out->length + (long)n > OUT_BUF_LEN)
+    FAIL("Too much data written");
+
+  if (out->nr_writes >= MAX_WRITES)
+    FAIL("Too many writes");
+
+  out->write_offset[out->nr_writes] = out->length;
+  out->write_bytes[out->nr_writes] = (long)n;
+  out->nr_writes++;
+
+  memcpy (out->data + out->length, buf, n);
+  out->length += (long)n;
+
+  return n;
+}
+
+static void
+write_stream (output * out, long max_bytes, ogg_int64_t max_units)
+{
+  OGGZ * writer;
+  unsigned char buf[PACKET_BYTES];
+  ogg_packet op;
+  long serialno;
+  int iter;
+
+  memset (out, 0, sizeof (*out));
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  oggz_io_set_write (writer, my_io_write, out);
+
+  if (oggz_write_set_batch (writer, max_bytes, max_units) != 0)
+    FAIL("Could not set batch");
+
+  /* A fixed serialno, so that the outputs can be compared */
+  serialno = 7;
+
+  for (iter = 0; iter < NR_PACKETS; iter++) {
+    memset (buf, 'a' + iter % 26, sizeof (buf));
+
+    op.packet = buf;
+    op.bytes = PACKET_BYTES;
+    op.b_o_s = (iter == 0);
+    op.e_o_s = (iter == NR_PACKETS - 1);
+    op.granulepos = iter;
+    op.packetno = iter;
+
+    /* Small pages, one packet each */
+    if (oggz_write_feed (writer, &op, serialno, OGGZ_FLUSH_AFTER, NULL) != 0)
+      FAIL ("Oggz write failed");
+  }
+
+  if (oggz_set_granulerate (writer, serialno, GRANULERATE_N,
+                            GRANULERATE_D) != 0)
+    FAIL("Could not set granulerate");
+
+  while (oggz_write (writer, OUT_BUF_LEN) > 0);
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+#ifdef DEBUG
+  printf ("%ld bytes in %d writes\n", out->length, out->nr_writes);
+#endif
+}
+
+/*
+ * Check that a write holds whole pages spanning at most BATCH_UNITS, and
+ * return the number of pages.
+ */
+static int
+check_write_span (output * out, int i)
+{
+  ogg_sync_state oy;
+  ogg_page og;
+  ogg_int64_t granulepos, first = -1, last = -1;
+  char * buffer;
+  int nr_pages = 0;
+
+  ogg_sync_init (&oy);
+
+  buffer = ogg_sync_buffer (&oy, out->write_bytes[i]);
+  memcpy (buffer, out->data + out->write_offset[i], out->write_bytes[i]);
+  ogg_sync_wrote (&oy, out->write_bytes[i]);
+
+  while (ogg_sync_pageout (&oy, &og) == 1) {
+    nr_pages++;
+    if ((granulepos = ogg_page_granulepos (&og)) == -1) continue;
+    if (first == -1) first = granulepos;
+    last = granulepos;
+  }
+
+  if (oy.fill != oy.returned)
+    FAIL("Write did not end on a page boundary");
+
+  if (UNITS(last) - UNITS(first) > BATCH_UNITS)
+    FAIL("Write spans too much time");
+
+  ogg_sync_clear (&oy);
+
+  return nr_pages;
+}
+
+int
+main (int argc, char * argv[])
+{
+  static output plain, batched;
+  int i;
+
+  INFO ("Testing batching of pages by size");
+
+  write_stream (&plain, 0, 0);
+  write_stream (&batched, BATCH_BYTES, 0);
+
+  if (plain.length != batched.length ||
+      memcmp (plain.data, batched.data, plain.length) != 0)
+    FAIL("Batched output differs");
+
+  if (batched.nr_writes > plain.length / BATCH_BYTES + 1)
+    FAIL("Too many batched writes");
+
+  for (i = 0; i < batched.nr_writes; i++) {
+    if (batched.write_bytes[i] > BATCH_BYTES)
+      FAIL("Batch too large");
+  }
+
+  INFO ("Testing batching of pages by time");
+
+  write_stream (&batched, OUT_BUF_LEN, BATCH_UNITS);
+
+  if (plain.length != batched.length ||
+      memcmp (plain.data, batched.data, plain.length) != 0)
+    FAIL("Batched output differs");
+
+  for (i = 0; i < batched.nr_writes; i++) {
+    if (check_write_span (&batched, i) < 2 && i < batched.nr_writes - 1)
+      FAIL("Batched write holds a single page");
+  }
+
+  /* Every write but the last is filled up to the time budget */
+  if (batched.nr_writes != (NR_PACKETS + BATCH_PAGES - 1) / BATCH_PAGES)
+    FAIL("Batched writes not filled to the time budget");
+
+  exit (0);
+}
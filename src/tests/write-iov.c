@@ -0,0 +1,160 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define NR_PACKETS 100
+
+#define OUT_BUF_LEN 262144
+
+/* An odd amount to consume at a time, to split headers and bodies */
+#define CONSUME_BYTES 37
+
+static OGGZ *
+new_writer (void)
+{
+  OGGZ * writer;
+  unsigned char buf[5000];
+  ogg_packet op;
+  int iter;
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  for (iter = 0; iter < NR_PACKETS; iter++) {
+    memset (buf, 'a' + iter % 26, sizeof (buf));
+
+    op.packet = buf;
+    op.bytes = (iter % 10 == 5) ? 5000 : 10 + iter;
+    op.b_o_s = (iter == 0);
+    op.e_o_s = (iter == NR_PACKETS - 1);
+    op.granulepos = iter;
+    op.packetno = iter;
+
+    /* A fixed serialno, so that the outputs can be compared */
+    if (oggz_write_feed (writer, &op, 7, (iter % 7 == 0), NULL) != 0)
+      FAIL ("Oggz write failed");
+  }
+
+  return writer;
+}
+
+int
+main (int argc, char * argv[])
+{
+  static unsigned char copied[OUT_BUF_LEN], gathered[OUT_BUF_LEN];
+  OGGZ * writer;
+  oggz_iovec iov[2];
+  long copied_len = 0, gathered_len = 0, n, len;
+  int i, nr_iov, nr_pages = 0;
+
+  INFO ("Testing output of pages by copying");
+
+  writer = new_writer ();
+
+  while ((n = oggz_write_output (writer, copied + copied_len,
+                                 OUT_BUF_LEN - copied_len)) > 0)
+    copied_len += n;
+
+  if (n < 0)
+    FAIL("Output failed");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  INFO ("Testing output of pages in place");
+
+  writer = new_writer ();
+
+  while ((nr_iov = oggz_write_output_iov (writer, iov, 2)) > 0) {
+    /* Consume the regions a few bytes at a time */
+    len = MIN (iov[0].length, CONSUME_BYTES);
+    if (gathered_len + len > OUT_BUF_LEN)
+      FAIL("Too much data output");
+    memcpy (gathered + gathered_len, iov[0].base, len);
+    gathered_len += len;
+
+    if (oggz_write_output_consume (writer, len) != len)
+      FAIL("Could not consume output");
+
+    if (!memcmp (iov[0].base, "OggS", 4)) nr_pages++;
+  }
+
+  if (nr_iov < 0)
+    FAIL("Output failed");
+
+  if (gathered_len != copied_len || memcmp (gathered, copied, copied_len))
+    FAIL("Output in place differs from copied output");
+
+  if (nr_pages < NR_PACKETS / 7)
+    FAIL("Too few pages output");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  INFO ("Testing consuming whole pages");
+
+  writer = new_writer ();
+  gathered_len = 0;
+
+  while ((nr_iov = oggz_write_output_iov (writer, iov, 2)) > 0) {
+    if (nr_iov != 2 || memcmp (iov[0].base, "OggS", 4))
+      FAIL("Expected a whole page");
+
+    for (i = 0, len = 0; i < nr_iov; i++) {
+      memcpy (gathered + gathered_len + len, iov[i].base, iov[i].length);
+      len += iov[i].length;
+    }
+    gathered_len += len;
+
+    /* Consuming too much stops at the end of the page */
+    if (oggz_write_output_consume (writer, len + 100) != len)
+      FAIL("Could not consume page");
+  }
+
+  if (gathered_len != copied_len || memcmp (gathered, copied, copied_len))
+    FAIL("Output in place differs from copied output");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  exit (0);
+}
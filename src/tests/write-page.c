@@ -0,0 +1,276 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define NR_PACKETS 60
+
+#define OUT_BUF_LEN 1048576
+#define MAX_WRITES 1024
+
+#define BATCH_BYTES 8192
+
+typedef struct {
+  unsigned char data[OUT_BUF_LEN];
+  long length;
+  int nr_writes;
+} output;
+
+static size_t
+my_io_write (void * user_handle, void * buf, size_t n)
+{
+  output * out = (output *)user_handle;
+
+  if (out->length + (long)n > OUT_BUF_LEN)
+    FAIL("Too much data written");
+
+  if (out->nr_writes >= MAX_WRITES)
+    FAIL("Too many writes");
+
+  out->nr_writes++;
+
+  memcpy (out->data + out->length, buf, n);
+  out->length += (long)n;
+
+  return n;
+}
+
+/*
+ * Generate a stream with one page per packet.
+ */
+static void
+write_stream (output * out)
+{
+  OGGZ * writer;
+  static unsigned char buf[3 * BATCH_BYTES];
+  ogg_packet op;
+  long serialno = 7;
+  int iter;
+
+  memset (out, 0, sizeof (*out));
+
+  if ((writer = oggz_new (OGGZ_WRITE)) == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  oggz_io_set_write (writer, my_io_write, out);
+
+  for (iter = 0; iter < NR_PACKETS; iter++) {
+    memset (buf, 'a' + iter % 26, sizeof (buf));
+
+    op.packet = buf;
+    /* Every tenth page is too large for a batch */
+    op.bytes = (iter % 10 == 5) ? (long)sizeof (buf) : (iter * 997) % 3000;
+    op.b_o_s = (iter == 0);
+    op.e_o_s = (iter == NR_PACKETS - 1);
+    op.granulepos = iter;
+    op.packetno = iter;
+
+    if (oggz_write_feed (writer, &op, serialno, OGGZ_FLUSH_AFTER, NULL) != 0)
+      FAIL ("Oggz write failed");
+  }
+
+  while (oggz_write (writer, OUT_BUF_LEN) > 0);
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+}
+
+/*
+ * Pass the pages of in through a new writer, replacing header fields of
+ * odd-numbered pages if patch is set. If resize is set, the batch is
+ * disabled, re-enabled and shrunk while pages are waiting in it.
+ */
+static void
+pass_pages (output * in, output * out, long batch_bytes, int patch,
+            int resize)
+{
+  OGGZ * writer;
+  ogg_sync_state oy;
+  ogg_page og;
+  oggz_page_patch pp;
+  unsigned char header[27 + 255];
+  char * buffer;
+  int i = 0;
+
+  memset (out, 0, sizeof (*out));
+
+  if ((writer = oggz_new (OGGZ_WRITE)) == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  oggz_io_set_write (writer, my_io_write, out);
+
+  if (oggz_write_set_batch (writer, batch_bytes, 0) != 0)
+    FAIL("Could not set batch");
+
+  ogg_sync_init (&oy);
+  buffer = ogg_sync_buffer (&oy, in->length);
+  memcpy (buffer, in->data, in->length);
+  ogg_sync_wrote (&oy, in->length);
+
+  while (ogg_sync_pageout (&oy, &og) == 1) {
+    memcpy (header, og.header, og.header_len);
+
+    pp.fields = 0;
+    if (patch && (i % 2) == 1) {
+      pp.fields = OGGZ_PATCH_SERIALNO | OGGZ_PATCH_GRANULEPOS |
+        OGGZ_PATCH_PAGENO;
+      pp.serialno = 0x12345678;
+      pp.granulepos = ((ogg_int64_t)i << 40) | 0x0102;
+      pp.pageno = 1000 + i;
+    }
+
+    if (oggz_write_page (writer, &og, patch ? &pp : NULL) != 0)
+      FAIL("Could not write page");
+
+    if (memcmp (header, og.header, og.header_len) != 0)
+      FAIL("Page passed in was modified");
+
+    i++;
+
+    if (resize && (i == 10 || i == 20 || i == 30)) {
+      batch_bytes = (i == 10) ? 0 : (i == 20) ? BATCH_BYTES : 64;
+      if (oggz_write_set_batch (writer, batch_bytes, 0) != 0)
+        FAIL("Could not resize batch");
+    }
+  }
+
+  ogg_sync_clear (&oy);
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+#ifdef DEBUG
+  printf ("%d pages, %ld bytes in %d writes\n", i, out->length,
+          out->nr_writes);
+#endif
+}
+
+/*
+ * Check that the pages of out carry the values set by pass_pages(), with
+ * the same checksums that libogg computes over the whole page.
+ */
+static void
+check_patched (output * in, output * out)
+{
+  ogg_sync_state oy;
+  ogg_page og;
+  ogg_uint32_t crc;
+  char * buffer;
+  int i = 0;
+
+  if (in->length != out->length)
+    FAIL("Patched output has a different length");
+
+  ogg_sync_init (&oy);
+  buffer = ogg_sync_buffer (&oy, out->length);
+  memcpy (buffer, out->data, out->length);
+  ogg_sync_wrote (&oy, out->length);
+
+  /* ogg_sync_pageout() rejects pages with a bad checksum */
+  while (ogg_sync_pageout (&oy, &og) == 1) {
+    crc = og.header[22] | (og.header[23] << 8) | (og.header[24] << 16) |
+      ((ogg_uint32_t)og.header[25] << 24);
+
+    ogg_page_checksum_set (&og);
+    if (crc != (og.header[22] | (og.header[23] << 8) | (og.header[24] << 16) |
+                ((ogg_uint32_t)og.header[25] << 24)))
+      FAIL("Bad checksum");
+
+    if (i % 2 == 1) {
+      if (ogg_page_serialno (&og) != 0x12345678)
+        FAIL("serialno not replaced");
+      if (ogg_page_granulepos (&og) != (((ogg_int64_t)i << 40) | 0x0102))
+        FAIL("granulepos not replaced");
+      if (ogg_page_pageno (&og) != 1000 + i)
+        FAIL("pageno not replaced");
+    } else if (ogg_page_serialno (&og) != 7 || ogg_page_pageno (&og) != i) {
+      FAIL("Unpatched page was changed");
+    }
+
+    i++;
+  }
+
+  if (oy.fill != oy.returned)
+    FAIL("Patched output has a bad page");
+
+  ogg_sync_clear (&oy);
+}
+
+int
+main (int argc, char * argv[])
+{
+  static output in, out;
+  int nr_writes;
+
+  write_stream (&in);
+
+  INFO ("Testing page passthrough");
+
+  pass_pages (&in, &out, 0, 0, 0);
+
+  if (in.length != out.length || memcmp (in.data, out.data, in.length) != 0)
+    FAIL("Passthrough output differs");
+
+  nr_writes = out.nr_writes;
+
+  INFO ("Testing batched page passthrough");
+
+  pass_pages (&in, &out, BATCH_BYTES, 0, 0);
+
+  if (in.length != out.length || memcmp (in.data, out.data, in.length) != 0)
+    FAIL("Batched passthrough output differs");
+
+  if (out.nr_writes >= nr_writes / 2)
+    FAIL("Too many batched writes");
+
+  INFO ("Testing batch resizing during page passthrough");
+
+  pass_pages (&in, &out, BATCH_BYTES, 0, 1);
+
+  if (in.length != out.length || memcmp (in.data, out.data, in.length) != 0)
+    FAIL("Resized passthrough output differs");
+
+  INFO ("Testing page header replacement");
+
+  pass_pages (&in, &out, BATCH_BYTES, 1, 0);
+  check_patched (&in, &out);
+
+  exit (0);
+}
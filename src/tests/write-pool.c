@@ -0,0 +1,169 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "oggz/oggz.h"
+
+#include "oggz_tests.h"
+
+/* #define DEBUG */
+
+#define MAX_PACKET 2000
+#define BURST 40
+#define LARGE_PACKET 300000
+#define WRITE_SIZE 4096
+
+static long serialno;
+static int read_iter = 0;
+static unsigned char buf[LARGE_PACKET];
+
+static long
+packet_bytes (int iter)
+{
+  /* One packet larger than the payload ring, to exercise the fallback */
+  if (iter == MAX_PACKET / 2) return LARGE_PACKET;
+  return 1 + (iter * 37) % 3000;
+}
+
+static int
+read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
+{
+  ogg_packet * op = &zp->op;
+  long i;
+
+  if (op->bytes != packet_bytes (read_iter))
+    FAIL ("Packet has incorrect size");
+
+  for (i = 0; i < op->bytes; i++) {
+    if (op->packet[i] != (unsigned char)(read_iter + i))
+      FAIL ("Packet contains incorrect data");
+  }
+
+  read_iter++;
+
+  return 0;
+}
+
+static void
+transfer (OGGZ * writer, OGGZ * reader)
+{
+  unsigned char page[WRITE_SIZE];
+  long n;
+
+  while ((n = oggz_write_output (writer, page, WRITE_SIZE)) > 0) {
+    if (oggz_read_input (reader, page, n) != n)
+      FAIL ("Read failed");
+  }
+}
+
+int
+main (int argc, char * argv[])
+{
+  OGGZ * reader, * writer;
+  oggz_write_pool_stats stats;
+  ogg_packet op;
+  long i;
+  int iter;
+
+  INFO ("Testing the writer packet queue memory pool");
+
+  writer = oggz_new (OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  reader = oggz_new (OGGZ_READ);
+  if (reader == NULL)
+    FAIL("newly created OGGZ reader == NULL");
+
+  if (oggz_write_get_pool_stats (reader, &stats) != OGGZ_ERR_INVALID)
+    FAIL("Pool stats available for a reader");
+
+  oggz_set_read_callback (reader, -1, read_packet, NULL);
+
+  serialno = oggz_serialno_new (writer);
+
+  for (iter = 0; iter < MAX_PACKET; iter++) {
+    for (i = 0; i < packet_bytes (iter); i++)
+      buf[i] = (unsigned char)(iter + i);
+
+    op.packet = buf;
+    op.bytes = packet_bytes (iter);
+    op.b_o_s = (iter == 0);
+    op.e_o_s = (iter == MAX_PACKET - 1);
+    op.granulepos = iter;
+    op.packetno = iter;
+
+    if (oggz_write_feed (writer, &op, serialno, 0, NULL) != 0)
+      FAIL ("Oggz write failed");
+
+    /* Queue packets in bursts so that the ring wraps part way full */
+    if (iter % BURST == BURST - 1) transfer (writer, reader);
+  }
+
+  transfer (writer, reader);
+
+  if (read_iter != MAX_PACKET)
+    FAIL ("Not all packets read");
+
+  if (oggz_write_get_pool_stats (writer, &stats) != 0)
+    FAIL("Could not get pool stats");
+
+#ifdef DEBUG
+  printf ("allocations %ld system %ld queued %ld peak %ld pool %ld peak %ld\n",
+          stats.allocations, stats.system_allocations, stats.bytes_queued,
+          stats.bytes_queued_peak, stats.pool_bytes, stats.pool_bytes_peak);
+#endif
+
+  if (stats.allocations != 2 * MAX_PACKET)
+    FAIL("Incorrect number of allocations counted");
+
+  if (stats.system_allocations * 20 > stats.allocations)
+    FAIL("Too many system allocations");
+
+  if (stats.bytes_queued != 0)
+    FAIL("Written packets still counted as queued");
+
+  if (stats.bytes_queued_peak < LARGE_PACKET ||
+      stats.pool_bytes_peak < stats.bytes_queued_peak)
+    FAIL("Incorrect peak memory counted");
+
+  if (oggz_close (reader) != 0)
+    FAIL("Could not close OGGZ reader");
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+
+  exit (0);
+}
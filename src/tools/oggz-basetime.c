@@ -41,6 +41,8 @@
 
 /* #define DEBUG */
 
+#define WRITE_BATCH_BYTES 65536
+
 typedef struct {
   ogg_int64_t delta;
   int nr_packets;
@@ -49,38 +51,9 @@ typedef struct {
 typedef struct {
   ogg_int64_t base_units;
   OggzTable * tracks;
+  OGGZ * writer;
 } OBData;
 
-static  ogg_int64_t
-_le_64 (ogg_int64_t l)
-{
-  ogg_int64_t ret=l;
-  unsigned char *ucptr = (unsigned char *)&ret;
-#ifdef WORDS_BIGENDIAN
-  unsigned char temp;
-
-  temp = ucptr [0] ;
-  ucptr [0] = ucptr [7] ;
-  ucptr [7] = temp ;
-
-  temp = ucptr [1] ;
-  ucptr [1] = ucptr [6] ;
-  ucptr [6] = temp ;
-
-  temp = ucptr [2] ;
-  ucptr [2] = ucptr [5] ;
-  ucptr [5] = temp ;
-
-  temp = ucptr [3] ;
-  ucptr [3] = ucptr [4] ;
-  ucptr [4] = temp ;
-
-#endif
-  return (*(ogg_int64_t *)ucptr);
-}
-
-#define INT64_LE_AT(x) _le_64((*(ogg_int64_t *)(x)))
-
 /********** OBTrackData **********/
 
 static OBTrackData *
@@ -114,6 +87,7 @@ or_data_new (void)
   if (ord == NULL) return NULL;
 
   ord->base_units = -1;
+  ord->writer = NULL;
   ord->tracks = oggz_table_new ();
   if (ord->tracks == NULL) {
     free (ord);
@@ -137,13 +111,13 @@ or_data_delete (OBData * ord)
   oggz_table_delete (ord->tracks);
 }
 
-/********** checked_fwrite **********/
+/********** checked_write_page **********/
 
 static void
-checked_fwrite (const void *data, size_t size, size_t count, FILE *stream)
+checked_write_page (OGGZ * writer, const ogg_page * og,
+                    const oggz_page_patch * patch)
 {
-  int n = fwrite (data, size, count, stream);
-  if ((size_t)n != count) {
+  if (oggz_write_page (writer, og, patch) != 0) {
     perror ("write failed");
     exit (1);
   }
@@ -152,7 +126,8 @@ checked_fwrite (const void *data, size_t size, size_t count, FILE *stream)
 /********** Filter **********/
 
 static int
-filter_page (OGGZ * oggz, const ogg_page * og, long serialno, OBData * ord)
+filter_page (OGGZ * oggz, const ogg_page * og, long serialno, OBData * ord,
+             oggz_page_patch * patch)
 {
   OBTrackData * ort;
   ogg_int64_t granulepos, new_granulepos;
@@ -172,17 +147,12 @@ filter_page (OGGZ * oggz, const ogg_page * og, long serialno, OBData * ord)
   new_granulepos = (iframe << granuleshift) + pframe;
 
 #ifdef DEBUG
-    fprintf (stderr, "old gp %lld, new gp %lld", granulepos, new_granulepos);
-#endif
-
-  *(ogg_int64_t *)(&og->header[6]) = _le_64(new_granulepos);
-
-#ifdef DEBUG
-  fprintf (stderr, ", totally new gp %lld\n", INT64_LE_AT(&og->header[6]));
+    fprintf (stderr, "old gp %lld, new gp %lld\n", granulepos, new_granulepos);
 #endif
 
-  /* AFTER making any changes to the page, recalculate the page checksum */
-  ogg_page_checksum_set ((ogg_page *)og);
+  /* The page is rewritten with its checksum updated as it is written out */
+  patch->fields = OGGZ_PATCH_GRANULEPOS;
+  patch->granulepos = new_granulepos;
 
   return 0;
 }
@@ -193,6 +163,7 @@ read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
 {
   OBData * ord = (OBData *)user_data;
   OBTrackData * ort;
+  oggz_page_patch patch;
   ogg_int64_t gr_n, gr_d;
   int numheaders;
 
@@ -234,8 +205,9 @@ read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
   }
 
   /* header pages have a granulepos 0 and should not have it changed */
+  patch.fields = 0;
   if (ogg_page_granulepos ((ogg_page *) og) != 0) {
-    filter_page (oggz, og, serialno, ord);
+    filter_page (oggz, og, serialno, ord, &patch);
   }
 
   ort->nr_packets += ogg_page_packets ((ogg_page *)og);
@@ -245,8 +217,7 @@ read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
 	   serialno, ort->nr_packets, ogg_page_granulepos ((ogg_page *)og));
 #endif
 
-  checked_fwrite (og->header, 1, og->header_len, stdout);
-  checked_fwrite (og->body, 1, og->body_len, stdout);
+  checked_write_page (ord->writer, og, &patch);
 
   return 0;
 }
@@ -291,12 +262,22 @@ main (int argc, char ** argv)
     exit (1);
   }
 
+  if ((ord->writer = oggz_open_stdio (stdout, OGGZ_WRITE)) == NULL)
+    goto oom;
+  oggz_write_set_batch (ord->writer, WRITE_BATCH_BYTES, 0);
+
   oggz_set_read_page (oggz, -1, read_page, ord);
 
   ret = oggz_run (oggz);
 
   oggz_close (oggz);
 
+  /* Closing the writer writes out the last batch */
+  if (oggz_close (ord->writer) != 0) {
+    perror ("write failed");
+    exit (1);
+  }
+
   or_data_delete (ord);
 
   if (ret == OGGZ_ERR_STOP_ERR) goto oom;
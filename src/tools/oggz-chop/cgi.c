@@ -150,6 +150,7 @@ cgi_main (OCState * state)
   memset (state, 0, sizeof(*state));
   state->end = -1.0;
   state->do_skeleton = 1;
+  state->do_seek = 1;
 
   if (path_translated == NULL) {
     if (path_info == NULL)
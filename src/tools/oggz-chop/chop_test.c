@@ -0,0 +1,292 @@
+/*
+   Copyright (C) 2008 Annodex Association
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of the Annodex Association nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ASSOCIATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oggz_tests.h"
+
+#include "oggz-chop.h"
+
+#define IN_FILENAME "chop_test.ogg"
+#define SEEK_FILENAME "chop_test_seek.ogg"
+#define LINEAR_FILENAME "chop_test_linear.ogg"
+
+#define DURATION 60 /* seconds */
+
+#define FPS 25
+#define GRANULESHIFT 6
+#define GOP 50 /* frames */
+#define KEYFRAME_BYTES 6000
+#define FRAME_BYTES 400
+
+#define OPUS_GRANULES 960 /* 20 ms */
+#define OPUS_BYTES 80
+
+static unsigned char buf[KEYFRAME_BYTES];
+
+static void
+put_be32 (unsigned char * p, long v)
+{
+  p[0] = (v >> 24) & 0xff;
+  p[1] = (v >> 16) & 0xff;
+  p[2] = (v >> 8) & 0xff;
+  p[3] = v & 0xff;
+}
+
+static void
+put_le32 (unsigned char * p, long v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static void
+feed (OGGZ * writer, long bytes, long serialno, int b_o_s, int e_o_s,
+      ogg_int64_t granulepos, ogg_int64_t packetno, int flush)
+{
+  ogg_packet op;
+
+  op.packet = buf;
+  op.bytes = bytes;
+  op.b_o_s = b_o_s;
+  op.e_o_s = e_o_s;
+  op.granulepos = granulepos;
+  op.packetno = packetno;
+
+  if (oggz_write_feed (writer, &op, serialno, flush, NULL) != 0)
+    FAIL("Oggz write failed");
+}
+
+/* Write a Theora-like track with a keyframe every GOP frames, whose
+ * keyframes span several pages, interleaved with an Opus-like track */
+static void
+write_file (void)
+{
+  FILE * f;
+  OGGZ * writer;
+  long theora_serialno, opus_serialno;
+  ogg_int64_t keyframe;
+  int i, frame = 0, nr_packets = DURATION * 50;
+
+  if ((f = fopen (IN_FILENAME, "wb")) == NULL)
+    FAIL("Could not create test file");
+
+  writer = oggz_open_stdio (f, OGGZ_WRITE);
+  if (writer == NULL)
+    FAIL("newly created OGGZ writer == NULL");
+
+  theora_serialno = oggz_serialno_new (writer);
+  opus_serialno = oggz_serialno_new (writer);
+
+  /* Theora 3.2.1 identification header */
+  memset (buf, 0, 42);
+  memcpy (buf, "\200theora", 7);
+  buf[7] = 3; buf[8] = 2; buf[9] = 1;
+  put_be32 (&buf[22], FPS);
+  put_be32 (&buf[26], 1);
+  buf[40] = (GRANULESHIFT >> 3) & 0x03;
+  buf[41] = (GRANULESHIFT & 0x07) << 5;
+  feed (writer, 42, theora_serialno, 1, 0, 0, 0, OGGZ_FLUSH_AFTER);
+
+  /* Opus identification header */
+  memset (buf, 0, 19);
+  memcpy (buf, "OpusHead", 8);
+  buf[8] = 1; buf[9] = 1;
+  put_le32 (&buf[12], 48000);
+  feed (writer, 19, opus_serialno, 1, 0, 0, 0, OGGZ_FLUSH_AFTER);
+
+  /* Comment headers, and a Theora setup header */
+  memcpy (buf, "\201theora", 7);
+  put_le32 (&buf[7], 0);
+  put_le32 (&buf[11], 0);
+  feed (writer, 15, theora_serialno, 0, 0, 0, 1, 0);
+  memset (buf, 0, 100);
+  memcpy (buf, "\202theora", 7);
+  feed (writer, 100, theora_serialno, 0, 0, 0, 2, OGGZ_FLUSH_AFTER);
+
+  memcpy (buf, "OpusTags", 8);
+  put_le32 (&buf[8], 0);
+  put_le32 (&buf[12], 0);
+  feed (writer, 16, opus_serialno, 0, 0, 0, 1, OGGZ_FLUSH_AFTER);
+
+  /* Every 20 ms of Opus, with a Theora frame every 40 ms */
+  for (i = 0; i < nr_packets; i++) {
+    memset (buf, 'a' + i % 26, sizeof (buf));
+
+    if (i % 2 == 0) {
+      keyframe = frame - frame % GOP;
+      feed (writer, (frame == keyframe) ? KEYFRAME_BYTES : FRAME_BYTES,
+            theora_serialno, 0, (i >= nr_packets - 2),
+            ((keyframe + 1) << GRANULESHIFT) | (frame - keyframe),
+            3 + frame, 0);
+      frame++;
+    }
+
+    feed (writer, OPUS_BYTES, opus_serialno, 0, (i == nr_packets - 1),
+          (ogg_int64_t)(i + 1) * OPUS_GRANULES, 2 + i, 0);
+  }
+
+  while (oggz_write (writer, 4096) > 0);
+
+  if (oggz_close (writer) != 0)
+    FAIL("Could not close OGGZ writer");
+}
+
+static unsigned char *
+load_file (const char * filename, long * length)
+{
+  FILE * f;
+  unsigned char * data;
+
+  if ((f = fopen (filename, "rb")) == NULL)
+    FAIL("Could not open chopped file");
+
+  fseek (f, 0, SEEK_END);
+  *length = ftell (f);
+  fseek (f, 0, SEEK_SET);
+
+  if ((data = malloc (*length + 1)) == NULL)
+    FAIL("Out of memory");
+
+  if (fread (data, 1, *length, f) != (size_t)*length)
+    FAIL("Could not read chopped file");
+
+  fclose (f);
+
+  return data;
+}
+
+/* Compare two chopped files page by page. The Skeleton track is given a
+ * new serialno by each run, so the serialno and checksum of each page are
+ * left out. */
+static void
+compare_files (const char * filename_a, const char * filename_b)
+{
+  unsigned char * a, * b;
+  long length_a, length_b, n = 0, page_len;
+  int i, nr_pages = 0;
+
+  a = load_file (filename_a, &length_a);
+  b = load_file (filename_b, &length_b);
+
+  if (length_a != length_b)
+    FAIL("Seeked and linear output differ in length");
+
+  while (n < length_a) {
+    if (length_a - n < 27 || memcmp (&a[n], "OggS", 4))
+      FAIL("Chopped output is not a sequence of pages");
+
+    page_len = 27 + a[n+26];
+    if (length_a - n < page_len)
+      FAIL("Chopped output ends in a truncated page");
+    for (i = 0; i < a[n+26]; i++)
+      page_len += a[n+27+i];
+    if (length_a - n < page_len)
+      FAIL("Chopped output ends in a truncated page");
+
+    if (memcmp (&a[n], &b[n], 14) ||
+        memcmp (&a[n+18], &b[n+18], 4) ||
+        memcmp (&a[n+26], &b[n+26], page_len - 26))
+      FAIL("Seeked and linear output differ");
+
+    n += page_len;
+    nr_pages++;
+  }
+
+  if (nr_pages < 3)
+    FAIL("Chopped output has too few pages");
+
+  free (a);
+  free (b);
+}
+
+static void
+test_chop (double start, double end, int expect_seek)
+{
+  OCState state;
+  char msg[64];
+
+  snprintf (msg, sizeof (msg), "+ Chopping %g to %g", start, end);
+  INFO (msg);
+
+  memset (&state, 0, sizeof (state));
+  state.infilename = IN_FILENAME;
+  state.outfilename = SEEK_FILENAME;
+  state.do_skeleton = 1;
+  state.do_seek = 1;
+  state.start = start;
+  state.end = end;
+
+  if (chop (&state) != 0)
+    FAIL("Seeking chop failed");
+
+  if (expect_seek && state.seek_units == -1)
+    FAIL("Chop read up to the start instead of seeking");
+
+  memset (&state, 0, sizeof (state));
+  state.infilename = IN_FILENAME;
+  state.outfilename = LINEAR_FILENAME;
+  state.do_skeleton = 1;
+  state.do_seek = 0;
+  state.start = start;
+  state.end = end;
+
+  if (chop (&state) != 0)
+    FAIL("Linear chop failed");
+
+  compare_files (SEEK_FILENAME, LINEAR_FILENAME);
+}
+
+int
+main (int argc, char * argv[])
+{
+  INFO ("Testing that seeking to the chop start matches reading up to it");
+
+  write_file ();
+
+  test_chop (0.5, -1.0, 0);
+  test_chop (7.3, -1.0, 1);
+  test_chop (20.0, -1.0, 1);
+  test_chop (33.33, 41.7, 1);
+  test_chop (58.7, -1.0, 1);
+
+  remove (IN_FILENAME);
+  remove (SEEK_FILENAME);
+  remove (LINEAR_FILENAME);
+
+  exit (0);
+}
@@ -81,6 +81,7 @@ cmd_main (OCState * state, int argc, char * argv[])
   memset (state, 0, sizeof(*state));
   state->end = -1.0;
   state->do_skeleton = 1;
+  state->do_seek = 1;
 
   while (1) {
 #ifdef HAVE_GETOPT_LONG
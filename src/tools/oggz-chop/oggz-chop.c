@@ -69,6 +69,10 @@ typedef struct _OCTrackState {
   /* Greatest previously inferred keyframe value */
   ogg_int64_t prev_keyframe;
 
+  /* Time in units of the latest keyframe (or for tracks without
+   * granuleshift, page with granulepos) read since seeking, or -1 */
+  ogg_int64_t keyframe_units;
+
 } OCTrackState;
 
 static OCTrackState *
@@ -80,6 +84,7 @@ track_state_new (void)
     return NULL;
 
   memset (ts, 0, sizeof(*ts));
+  ts->keyframe_units = -1;
 
   return ts;
 }
@@ -126,6 +131,8 @@ state_init (OCState * state)
   /* Initialize track table and page accumulator */
   state->tracks = oggz_table_new ();
   state->status = OC_INIT;
+
+  state->seek_units = -1;
 }
 
 static void
@@ -549,13 +556,120 @@ write_accum (OCState * state)
   return 0;
 }
 
+/* Upper bound on the granules spanned by each packet of preroll */
+#define OC_PREROLL_GRANULES 8192
+
+/* Slack in units for pages of different tracks being interleaved out of
+ * time order around the point that a seek lands on */
+#define OC_SEEK_MARGIN 1000
+
+/* Convert a number of granules of a track to units (milliseconds) */
+static ogg_int64_t
+track_granule_units (OGGZ * oggz, long serialno, ogg_int64_t granules)
+{
+  ogg_int64_t granule_rate_n, granule_rate_d;
+
+  if (oggz_get_granulerate (oggz, serialno, &granule_rate_n, &granule_rate_d) != 0 ||
+      granule_rate_n <= 0 || granule_rate_d <= 0)
+    return 0;
+
+  return granules * granule_rate_d * 1000 / granule_rate_n;
+}
+
+/*
+ * Find how long before the chop start reading must begin for a track to
+ * have its preroll: each preroll packet spans at most OC_PREROLL_GRANULES.
+ * How far back keyframes are is only known once their pages are read; see
+ * chop_seek_missed() below.
+ */
+static ogg_int64_t
+chop_lead_units (OCState * state, OGGZ * oggz)
+{
+  int i, ntracks, preroll;
+  long serialno;
+  ogg_int64_t lead = 0, units;
+
+  ntracks = oggz_table_size (state->tracks);
+  for (i = 0; i < ntracks; i++) {
+    oggz_table_nth (state->tracks, i, &serialno);
+    preroll = oggz_get_preroll (oggz, serialno);
+    if (preroll <= 0) continue;
+
+    units = track_granule_units (oggz, serialno,
+                                 (ogg_int64_t)preroll * OC_PREROLL_GRANULES);
+    if (units > lead) lead = units;
+  }
+
+  return lead;
+}
+
+/*
+ * Record the time of the keyframe of a page dist frames after it, and check
+ * whether the page begins a new GOP. Just after seeking, the previous
+ * keyframe is not known: the GOP is new only if its keyframe is later than
+ * the point reading resumed from.
+ * Returns: 1 if the page begins a new GOP, 0 otherwise.
+ */
+static int
+track_keyframe_new (OCState * state, OGGZ * oggz, OCTrackState * ts,
+                    long serialno, ogg_int64_t dist)
+{
+  ts->keyframe_units = oggz_tell_units (oggz) -
+    track_granule_units (oggz, serialno, dist);
+
+  if (ts->prev_keyframe != -1) return 1;
+
+  return (ts->keyframe_units - OC_SEEK_MARGIN >= state->seek_units);
+}
+
+/*
+ * Check that reading resumed far enough before the chop start: each track
+ * must have read a page with granulepos since seeking, and tracks with
+ * granuleshift must have read the start of the GOP in progress. Otherwise
+ * set state->reseek_units to seek further back.
+ * Returns: 1 if a track missed what it needs, 0 otherwise.
+ */
+static int
+chop_seek_missed (OCState * state, OGGZ * oggz)
+{
+  OCTrackState * ts;
+  int i, ntracks;
+  long serialno;
+  ogg_int64_t units;
+
+  if (state->seek_units == -1) return 0;
+
+  state->reseek_units = state->seek_units;
+
+  ntracks = oggz_table_size (state->tracks);
+  for (i = 0; i < ntracks; i++) {
+    ts = oggz_table_nth (state->tracks, i, &serialno);
+
+    if (ts->keyframe_units == -1) {
+      /* No telling how far back this track needs; double the distance */
+      units = 2 * state->seek_units - (ogg_int64_t)(state->start * 1000.0) -
+        OC_SEEK_MARGIN;
+    } else if (oggz_get_granuleshift (oggz, serialno) > 0 &&
+               ts->keyframe_units - OC_SEEK_MARGIN < state->seek_units) {
+      units = ts->keyframe_units - OC_SEEK_MARGIN -
+        chop_lead_units (state, oggz);
+    } else {
+      continue;
+    }
+
+    if (units < state->reseek_units) state->reseek_units = units;
+  }
+
+  return (state->reseek_units < state->seek_units);
+}
+
 /* Forward declaration */
 static int
 read_plain (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data);
 
 /* Write out the fisbones and accumulated pages before the chop point.
  * This is called once by read_plain() below as soon as a page beyond the
- * chop start is read. */
+ * chop start is read, unless reading must first seek further back. */
 static int
 chop_glue (OCState * state, OGGZ * oggz)
 {
@@ -564,6 +678,8 @@ chop_glue (OCState * state, OGGZ * oggz)
   OCTrackState * ts;
 
   if (state->status < OC_GLUE_DONE) {
+    if (chop_seek_missed (state, oggz)) return OGGZ_STOP_OK;
+
     /* Write in fisbones */
     fisbones_write (state);
 
@@ -580,7 +696,7 @@ chop_glue (OCState * state, OGGZ * oggz)
 
   state->status = OC_GLUE_DONE;
 
-  return 0;
+  return OGGZ_CONTINUE;
 }
 
 /*
@@ -616,13 +732,15 @@ read_plain (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
       oggz_table_insert (ts->page_accum, accum_size, pa);
     } else {
       ts->fisbone.start_granule = ogg_page_granulepos (OGG_PAGE_CONST(og));
+      ts->keyframe_units = oggz_tell_units (oggz);
       track_state_remove_page_accum (ts);
     }
   } else if (page_time >= state->start &&
       (state->end == -1 || page_time <= state->end)) {
 
-    if (state->status < OC_GLUE_DONE) {
-      chop_glue (state, oggz);
+    if (state->status < OC_GLUE_DONE &&
+        chop_glue (state, oggz) == OGGZ_STOP_OK) {
+      return OGGZ_STOP_OK;
     }
 
     fwrite_ogg_page (state, og);
@@ -660,7 +778,7 @@ read_gs (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
 
   if (page_time >= state->start) {
     /* Glue in fisbones, write out accumulated pages */
-    chop_glue (state, oggz);
+    if (chop_glue (state, oggz) == OGGZ_STOP_OK) return OGGZ_STOP_OK;
 
     /* Switch to the plain page reader */
     oggz_set_read_page (oggz, serialno, read_plain, state);
@@ -673,14 +791,17 @@ read_gs (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
     keyframe = granulepos >> granuleshift;
 
     if (keyframe != ts->prev_keyframe) {
-      if (ogg_page_continued(OGG_PAGE_CONST(og))) {
-        /* If this new-keyframe page is continued, advance the page accumulator,
-         * ie. recover earlier pages from this new GOP */
-        accum_size = track_state_advance_page_accum (ts);
-      } else {
-        /* Otherwise, just clear the page accumulator */
-        track_state_remove_page_accum (ts);
-        accum_size = 0;
+      if (track_keyframe_new (state, oggz, ts, serialno,
+                              granulepos - (keyframe << granuleshift))) {
+        if (ogg_page_continued(OGG_PAGE_CONST(og))) {
+          /* If this new-keyframe page is continued, advance the page
+           * accumulator, ie. recover earlier pages from this new GOP */
+          accum_size = track_state_advance_page_accum (ts);
+        } else {
+          /* Otherwise, just clear the page accumulator */
+          track_state_remove_page_accum (ts);
+          accum_size = 0;
+        }
       }
 
       /* Record this as prev_keyframe */
@@ -712,7 +833,7 @@ read_dirac (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
 
   if (page_time >= state->start) {
     /* Glue in fisbones, write out accumulated pages */
-    chop_glue (state, oggz);
+    if (chop_glue (state, oggz) == OGGZ_STOP_OK) return OGGZ_STOP_OK;
 
     /* Switch to the plain page reader */
     oggz_set_read_page (oggz, serialno, read_plain, state);
@@ -725,6 +846,11 @@ read_dirac (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
     keyframe = granulepos >> granuleshift;
     dist = ((keyframe & 0xff) << 8) | (granulepos & 0xff);
 
+    /* Each picture spans two granules */
+    if (dist == 0 || ts->keyframe_units == -1)
+      ts->keyframe_units = oggz_tell_units (oggz) -
+        track_granule_units (oggz, serialno, dist << 1);
+
     if (dist == 0) {
       if (ogg_page_continued(OGG_PAGE_CONST(og))) {
         /* If this new-keyframe page is continued, advance the page accumulator,
@@ -762,7 +888,7 @@ read_vp8 (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
 
   if (page_time >= state->start) {
     /* Glue in fisbones, write out accumulated pages */
-    chop_glue (state, oggz);
+    if (chop_glue (state, oggz) == OGGZ_STOP_OK) return OGGZ_STOP_OK;
 
     /* Switch to the plain page reader */
     oggz_set_read_page (oggz, serialno, read_plain, state);
@@ -776,14 +902,16 @@ read_vp8 (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
     keyframe = pts - dist;
 
     if (keyframe != ts->prev_keyframe) {
-      if (ogg_page_continued(OGG_PAGE_CONST(og))) {
-        /* If this new-keyframe page is continued, advance the page accumulator,
-         * ie. recover earlier pages from this new GOP */
-        accum_size = track_state_advance_page_accum (ts);
-      } else {
-        /* Otherwise, just clear the page accumulator */
-        track_state_remove_page_accum (ts);
-        accum_size = 0;
+      if (track_keyframe_new (state, oggz, ts, serialno, dist)) {
+        if (ogg_page_continued(OGG_PAGE_CONST(og))) {
+          /* If this new-keyframe page is continued, advance the page
+           * accumulator, ie. recover earlier pages from this new GOP */
+          accum_size = track_state_advance_page_accum (ts);
+        } else {
+          /* Otherwise, just clear the page accumulator */
+          track_state_remove_page_accum (ts);
+          accum_size = 0;
+        }
       }
 
       /* Record this as prev_keyframe */
@@ -798,6 +926,67 @@ read_vp8 (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
   return OGGZ_CONTINUE;
 }
 
+/*
+ * Seek to state->reseek_units, or if that is not past the headers, go back
+ * to the first page after them. The tracks then read on from there as if
+ * the file had been read from the beginning.
+ * Returns: 0 on success, -1 if reading cannot carry on from a known point.
+ */
+static int
+chop_seek (OCState * state, OGGZ * oggz)
+{
+  OCTrackState * ts;
+  int i, ntracks;
+  ogg_int64_t units = -1;
+
+#ifdef DEBUG
+  printf ("chop_seek: start %g, seeking to %lld\n", state->start,
+          (long long)state->reseek_units);
+#endif
+
+  if (state->reseek_units > 0)
+    units = oggz_seek_units (oggz, state->reseek_units, SEEK_SET);
+
+  /* Seeking again must land further back than before */
+  if (state->seek_units != -1 && units >= state->seek_units)
+    units = -1;
+
+  /* If the seek fails before any other, just carry on reading from after
+   * the headers; otherwise go back there */
+  if (units == -1 && state->seek_units != -1 &&
+      oggz_seek (oggz, state->data_offset, SEEK_SET) != state->data_offset)
+    return -1;
+
+  state->seek_units = units;
+
+  ntracks = oggz_table_size (state->tracks);
+  for (i = 0; i < ntracks; i++) {
+    ts = oggz_table_nth (state->tracks, i, NULL);
+    track_state_remove_page_accum (ts);
+    ts->fisbone.start_granule = 0;
+    ts->prev_keyframe = (units == -1) ? 0 : -1;
+    ts->keyframe_units = -1;
+  }
+
+  return 0;
+}
+
+/* Have all header pages been read? */
+static int
+headers_done (OCState * state)
+{
+  OCTrackState * ts;
+  int i, ntracks;
+
+  ntracks = oggz_table_size (state->tracks);
+  for (i = 0; i < ntracks; i++) {
+    ts = oggz_table_nth (state->tracks, i, NULL);
+    if (ts != NULL && ts->headers_remaining > 0) return 0;
+  }
+
+  return 1;
+}
+
 /*
  * OggzReadPageCallback read_headers
  *
@@ -840,6 +1029,14 @@ read_headers (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
       } else {
         oggz_set_read_page (oggz, serialno, read_gs, state);
       }
+
+      /* Once the headers of all tracks are in, stop so that chop() can
+       * seek towards the chop start. All BOS pages precede this one. */
+      if (state->do_seek && state->start > 0.0 &&
+          !ogg_page_bos (OGG_PAGE_CONST(og)) && headers_done (state)) {
+        state->data_offset = oggz_tell (oggz) + og->header_len + og->body_len;
+        return OGGZ_STOP_OK;
+      }
     }
   }
 
@@ -938,7 +1135,20 @@ chop (OCState * state)
   oggz_set_read_page (oggz, -1, read_bos, state);
 
   oggz_run_set_blocksize (oggz, 1024*1024);
-  oggz_run (oggz);
+
+  /* Read the headers, then seek rather than read up to the chop start.
+   * Reading stops again whenever it must seek further back. */
+  if (oggz_run (oggz) == OGGZ_ERR_STOP_OK) {
+    state->reseek_units = (ogg_int64_t) (state->start * 1000.0) -
+      OC_SEEK_MARGIN - chop_lead_units (state, oggz);
+    do {
+      if (chop_seek (state, oggz) == -1) {
+        fprintf (stderr, "oggz-chop: unable to seek in %s\n",
+                 state->infilename);
+        break;
+      }
+    } while (oggz_run (oggz) == OGGZ_ERR_STOP_OK);
+  }
 
   oggz_close (oggz);
 
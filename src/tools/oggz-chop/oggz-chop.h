@@ -63,6 +63,11 @@ typedef struct _OCState {
   double start;
   double end;
 
+  int do_seek; /* Boolean: seek towards start rather than read up to it? */
+  oggz_off_t data_offset; /* Offset of the first page after the headers */
+  ogg_int64_t seek_units; /* Where reading resumed after seeking, or -1 */
+  ogg_int64_t reseek_units; /* Where to seek to when reading stops */
+
   int original_had_skeleton;
 
   /* Commandline options */
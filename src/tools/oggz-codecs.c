@@ -50,8 +50,6 @@
 #  define PRId64 "I64d"
 #endif
 
-#define READ_BLOCKSIZE 16384
-
 static int show_all = 0;
 static int show_as_mime = 0;
 static int show_one_per_line = 0;
@@ -163,12 +161,13 @@ read_page_pass1 (OGGZ * oggz, const ogg_page * og, long serialno, void * user_da
 static int
 oi_pass1 (OGGZ * oggz, OI_Info * info)
 {
-  long n, serialno;
+  long serialno;
 
   oggz_seek (oggz, 0, SEEK_SET);
   oggz_set_read_page (oggz, -1, read_page_pass1, info);
 
-  while ((n = oggz_read (oggz, READ_BLOCKSIZE)) > 0);
+  /* Read page by page, stopping at the first page after the bos pages */
+  oggz_read_headers (oggz);
 
   return 0;
 }
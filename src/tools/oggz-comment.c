@@ -42,28 +42,73 @@
 #endif
 #include <errno.h>
 #include <getopt.h>
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
 
 #include "oggz/oggz.h"
 
 #include "oggz_tools.h"
 
 #define ID_WRITE_DIRECT
-/* define USE_FLUSH_NEXT */
-
-#ifdef USE_FLUSH_NEXT
-static int flush_next = 0;
-#endif
 
 #define S_SERIALNO 0x7
 
+#define READ_BUF_SIZE 4096
+#define PAGE_HEADER_BYTES 27
+#define PAGE_BODY_BYTES 4096 /* As filled by ogg_stream_pageout() */
+#define OUTPUT_BATCH_BYTES 65536
+
+/* A page of the input, stored while reading headers */
+typedef struct {
+  long serialno;
+  ogg_int64_t offset;
+  long header_len;
+  long bytes;
+  unsigned char * data;
+} OCPage;
+
+/* A track whose comments are being edited */
+typedef struct {
+  long serialno;
+  int insert; /* No comment packet to replace (VP8) */
+  int padding; /* Comment packet may be padded with trailing zeros */
+  ogg_packet * comments; /* Replacement comment packet */
+
+  /* Header pages following the bos page, ending with the last header */
+  int bos, first, last;
+  int nr_pages;
+  long old_bytes;
+  long pageno;
+
+  /* Header packets held in those pages, from the comment packet on */
+  int nr_packets;
+  long * lengths;
+  unsigned char * payload;
+  long payload_bytes;
+
+  /* Replacement pages */
+  unsigned char * pages;
+  long pages_bytes;
+  long delta; /* Change in the number of pages */
+} OCStream;
+
 typedef struct {
   int do_delete;
   int do_all;
+  int in_place;
   int got_non_bos;
+  int error;
   OGGZ * reader;
   OGGZ * writer;
   OGGZ * storer; /* Just used for storing comments from commandline */
-  FILE * outfile;
+  FILE * infile;
+  ogg_sync_state oy;
+  ogg_int64_t offset;
+  OCPage * pages;
+  int nr_pages, max_pages;
+  OggzTable * streams;
   OggzTable * seen_tracks;
   OggzTable * serialno_table;
   OggzTable * content_types_table;
@@ -83,6 +128,8 @@ usage (char * progname)
   printf ("\nEditing options\n");
   printf ("  -o filename, --output filename\n");
   printf ("                         Specify output filename\n");
+  printf ("  -i, --in-place         Edit the input file in place. Only the header\n");
+  printf ("                         pages are rewritten if the new comments fit\n");
   printf ("  -d, --delete           Delete comments before editing\n");
   printf ("  -a, --all              Edit comments for all logical bitstreams\n");
   printf ("  -c content-type, --content-type content-type\n");
@@ -124,9 +171,17 @@ ocdata_new ()
   ocdata->content_types_table = oggz_table_new();
   if (ocdata->content_types_table == NULL)
     goto err_content_types_table;
-  
+
+  ocdata->streams = oggz_table_new();
+  if (ocdata->streams == NULL)
+    goto err_streams;
+
+  ogg_sync_init (&ocdata->oy);
+
   return ocdata;
 
+err_streams:
+  free (ocdata->content_types_table);
 err_content_types_table:
   free (ocdata->serialno_table);
 err_serialno_table:
@@ -139,19 +194,36 @@ err_storer:
   return NULL;
 }
 
+static void ocstream_delete (OCStream * ocs);
+
 static void 
 ocdata_delete (OCData *ocdata)
 {
+  int i, n;
+
+  n = oggz_table_size (ocdata->streams);
+  for (i = 0; i < n; i++)
+    ocstream_delete (oggz_table_nth (ocdata->streams, i, NULL));
+
+  for (i = 0; i < ocdata->nr_pages; i++)
+    free (ocdata->pages[i].data);
+  free (ocdata->pages);
+
+  oggz_table_delete (ocdata->streams);
   oggz_table_delete (ocdata->seen_tracks);
   oggz_table_delete (ocdata->serialno_table);
   oggz_table_delete (ocdata->content_types_table);
-  
+
+  ogg_sync_clear (&ocdata->oy);
+
   if (ocdata->reader)
     oggz_close (ocdata->reader);
+  if (ocdata->writer)
+    oggz_close (ocdata->writer);
   if (ocdata->storer)
     oggz_close (ocdata->storer);
-  if (ocdata->outfile)
-    fclose (ocdata->outfile);
+  if (ocdata->infile && ocdata->infile != stdin)
+    fclose (ocdata->infile);
   
   free (ocdata);
 }
@@ -256,58 +328,70 @@ more_headers (OCData * ocdata, ogg_packet * op, long serialno)
   return OGGZ_CONTINUE;
 }
 
-static int
-read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
+static OCStream *
+ocstream_new (long serialno)
 {
-  OCData * ocdata = (OCData *)user_data;
-  size_t n;
+  OCStream * ocs = malloc (sizeof (OCStream));
 
-  n = fwrite (og->header, 1, og->header_len, ocdata->outfile);
-  if (n == (size_t)og->header_len)
-    n = fwrite (og->body, 1, og->body_len, ocdata->outfile);
+  if (ocs == NULL) return NULL;
 
-  return OGGZ_CONTINUE;
+  memset (ocs, 0, sizeof (OCStream));
+  ocs->serialno = serialno;
+
+  return ocs;
+}
+
+static void
+ocstream_delete (OCStream * ocs)
+{
+  oggz_packet_destroy (ocs->comments);
+  free (ocs->lengths);
+  free (ocs->payload);
+  free (ocs->pages);
+  free (ocs);
 }
 
 static int
 read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
 {
   OCData * ocdata = (OCData *)user_data;
-  ogg_packet * op = &zp->op, * copy_op = NULL;
+  ogg_packet * op = &zp->op, bos_op;
+  OggzStreamContent content;
+  OCStream * ocs;
   const char * vendor;
-  int flush, copy_op_flush = 0;
-  int ret;
-
-#ifdef USE_FLUSH_NEXT
-  flush = flush_next;
-  if (op->granulepos == -1) {
-    flush_next = 0;
-  } else {
-    flush_next = OGGZ_FLUSH_BEFORE;
+  int flac_final = 0;
+
+  /* Feed bos packets to the writer so that it knows the content type
+   * when generating comments. Nothing is ever output from the writer. */
+  if (op->b_o_s && oggz_table_lookup (ocdata->seen_tracks, serialno) != NULL) {
+    bos_op = *op;
+    bos_op.packetno = -1;
+    oggz_write_feed (ocdata->writer, &bos_op, serialno, OGGZ_FLUSH_AFTER, NULL);
   }
-#else
-  if (op->granulepos == -1) {
-    flush = 0;
-  } else {
-    flush = OGGZ_FLUSH_AFTER;
-  }
-#endif
 
-  /* Edit the packet data if required */
   if (filter_stream_p (ocdata, serialno) && op->packetno == 1) {
+    if ((ocs = ocstream_new (serialno)) == NULL)
+      goto err_oom;
+
+    content = oggz_stream_get_content (oggz, serialno);
+
     /* For VP8, the comment packet is optional, so we may be in the case
        where we need to write comments, but there is no comments packet
-       in the stream. In that case, packetno 1 will not be a comments
-       packet to replace, so we must insert the comments, and then copy
-       packetno 1 (which will now be packetno 2) to the output */
-    if (oggz_stream_get_content (oggz, serialno) == OGGZ_CONTENT_VP8 &&
+       in the stream. In that case, packetno 1 is not a comments packet
+       to replace, and the comments must be inserted before it. */
+    if (content == OGGZ_CONTENT_VP8 &&
         oggz_stream_get_numheaders (oggz, serialno) == 1) {
-      copy_op = op;
-      copy_op->packetno = -1;
-      copy_op_flush = flush;
-      flush = 1;
+      ocs->insert = 1;
+    } else if (content == OGGZ_CONTENT_FLAC && op->bytes > 0) {
+      flac_final = (op->packet[0] & 0x80) ? 1 : 0;
     }
 
+    /* Decoders ignore anything following the comments in these headers,
+     * so a shorter comment packet can be padded out to fit */
+    ocs->padding = (content == OGGZ_CONTENT_VORBIS ||
+                    content == OGGZ_CONTENT_THEORA ||
+                    content == OGGZ_CONTENT_OPUS);
+
     vendor = oggz_comment_get_vendor (ocdata->reader, serialno);
 
     /* Copy across the comments, unless "delete comments before editing" */
@@ -321,73 +405,678 @@ read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
     oggz_comment_set_vendor (ocdata->writer, serialno, vendor);
 
     /* Generate the replacement comments packet */
-    op = oggz_comments_generate (ocdata->writer, serialno, 0);
+    ocs->comments = oggz_comments_generate (ocdata->writer, serialno, flac_final);
+    if (ocs->comments == NULL) {
+      fprintf (stderr, "oggz-comment: Warning: Unable to generate comments for serialno %010lu\n",
+               serialno);
+      ocstream_delete (ocs);
+    } else if (oggz_table_insert (ocdata->streams, serialno, ocs) == NULL) {
+      ocstream_delete (ocs);
+      goto err_oom;
+    }
   }
 
-  /* Feed the packet into the writer */
-  op->packetno = -1; /* rewrite packetno in case we need to insert a packet */
-  if ((ret = oggz_write_feed (ocdata->writer, op, serialno, flush, NULL)) != 0) 
-    fprintf (stderr, "oggz_write_feed: %d\n", ret);
+  return more_headers (ocdata, op, serialno);
+
+err_oom:
+  fprintf (stderr, "oggz-comment: out of memory\n");
+  ocdata->error = 1;
+  return OGGZ_STOP_ERR;
+}
+
+/*
+ * Read the next page of the input, skipping any junk between pages.
+ * Returns the size of the page, 0 at the end of the input, or -1 on error.
+ */
+static long
+get_page (OCData * ocdata, ogg_page * og)
+{
+  char * buf;
+  size_t nread;
+  long n;
+
+  while ((n = ogg_sync_pageseek (&ocdata->oy, og)) <= 0) {
+    if (n < 0) {
+      ocdata->offset -= n;
+      continue;
+    }
 
-  ret = more_headers (ocdata, op, serialno);
-  if (ret == OGGZ_CONTINUE && copy_op) {
-    if ((ret = oggz_write_feed (ocdata->writer, copy_op, serialno, copy_op_flush, NULL)) != 0) 
-      fprintf (stderr, "oggz_write_feed: %d\n", ret);
+    if ((buf = ogg_sync_buffer (&ocdata->oy, READ_BUF_SIZE)) == NULL)
+      return -1;
+
+    nread = fread (buf, 1, READ_BUF_SIZE, ocdata->infile);
+    if (nread == 0)
+      return ferror (ocdata->infile) ? -1 : 0;
+
+    ogg_sync_wrote (&ocdata->oy, (long)nread);
   }
 
-  return ret;
+  ocdata->offset += n;
+
+  return n;
 }
 
+/*
+ * Read the pages of the input up to the end of the headers of all tracks,
+ * keeping a copy of each page. The pages are fed to the reader to parse the
+ * existing comments; content packets are never decoded.
+ */
 static int
-edit_comments (OCData * ocdata, char * outfilename)
+read_headers (OCData * ocdata)
 {
-  unsigned char buf[1024];
+  ogg_page og;
+  OCPage * page, * pages;
   long n;
 
-  if (outfilename == NULL) {
-    ocdata->outfile = stdout;
-  } else {
-    ocdata->outfile = fopen (outfilename, "wb");
-    if (ocdata->outfile == NULL) {
-      fprintf (stderr, "%s: unable to open output file %s\n",
-	       progname, outfilename);
+  while (!ocdata->got_non_bos || oggz_table_size (ocdata->seen_tracks) > 0) {
+    if (ocdata->nr_pages == ocdata->max_pages) {
+      n = ocdata->max_pages ? ocdata->max_pages * 2 : 16;
+      pages = realloc (ocdata->pages, n * sizeof (OCPage));
+      if (pages == NULL) return -1;
+      ocdata->pages = pages;
+      ocdata->max_pages = n;
+    }
+
+    if ((n = get_page (ocdata, &og)) <= 0)
+      return n;
+
+    page = &ocdata->pages[ocdata->nr_pages];
+    page->offset = ocdata->offset - n;
+
+    if ((page->data = malloc (n)) == NULL)
       return -1;
+
+    memcpy (page->data, og.header, og.header_len);
+    memcpy (page->data + og.header_len, og.body, og.body_len);
+    page->header_len = og.header_len;
+    page->bytes = n;
+    page->serialno = ogg_page_serialno (&og);
+    ocdata->nr_pages++;
+
+    oggz_read_input (ocdata->reader, page->data, n);
+    if (ocdata->error) return -1;
+  }
+
+  return 0;
+}
+
+/* Point og at a page stored in memory */
+static long
+page_at (unsigned char * data, ogg_page * og)
+{
+  int i, nsegs = data[26];
+
+  og->header = data;
+  og->header_len = PAGE_HEADER_BYTES + nsegs;
+  og->body = data + og->header_len;
+  og->body_len = 0;
+  for (i = 0; i < nsegs; i++)
+    og->body_len += data[PAGE_HEADER_BYTES + i];
+
+  return og->header_len + og->body_len;
+}
+
+static int
+layout_error (OCStream * ocs, const char * reason)
+{
+  fprintf (stderr, "oggz-comment: Error: serialno %010lu: %s\n",
+           ocs->serialno, reason);
+  return -1;
+}
+
+/*
+ * Find the header pages of a track to be replaced: those following the
+ * bos page, up to the page ending with the last header packet. The bos
+ * page must hold only the first header, and the last header must end its
+ * page, so that no content packet is touched.
+ */
+static int
+stream_layout (OCData * ocdata, OCStream * ocs)
+{
+  OCPage * page;
+  ogg_page og;
+  unsigned char * lacing, * payload;
+  int numheaders, nsegs, i, s;
+  long len = 0;
+
+  numheaders = oggz_stream_get_numheaders (ocdata->reader, ocs->serialno);
+
+  for (i = 0; i < ocdata->nr_pages; i++) {
+    if (ocdata->pages[i].serialno == ocs->serialno) break;
+  }
+
+  page = &ocdata->pages[i];
+  page_at (page->data, &og);
+  nsegs = og.header[26];
+  lacing = og.header + 27;
+
+  if (!ogg_page_bos (&og) || ogg_page_packets (&og) != 1 ||
+      lacing[nsegs-1] == 255)
+    return layout_error (ocs, "first page does not hold only the first header");
+
+  ocs->bos = i;
+  ocs->first = i + 1;
+  ocs->last = i;
+  ocs->pageno = ogg_page_pageno (&og) + 1;
+
+  if (ocs->insert) return 0;
+
+  if (numheaders < 2)
+    return layout_error (ocs, "no comment header");
+
+  ocs->lengths = malloc ((numheaders - 1) * sizeof (long));
+  if (ocs->lengths == NULL) return -1;
+
+  for (i++; i < ocdata->nr_pages && ocs->nr_packets < numheaders - 1; i++) {
+    page = &ocdata->pages[i];
+    if (page->serialno != ocs->serialno) continue;
+
+    page_at (page->data, &og);
+    nsegs = og.header[26];
+    lacing = og.header + 27;
+
+    if (ocs->nr_pages == 0) {
+      ocs->first = i;
+      ocs->pageno = ogg_page_pageno (&og);
     }
+
+    for (s = 0; s < nsegs; s++) {
+      if (ocs->nr_packets == numheaders - 1)
+        return layout_error (ocs, "last header does not end its page");
+
+      len += lacing[s];
+      if (lacing[s] < 255) {
+        ocs->lengths[ocs->nr_packets++] = len;
+        len = 0;
+      }
+    }
+
+    payload = realloc (ocs->payload, ocs->payload_bytes + og.body_len);
+    if (payload == NULL) return -1;
+    memcpy (payload + ocs->payload_bytes, og.body, og.body_len);
+    ocs->payload = payload;
+    ocs->payload_bytes += og.body_len;
+
+    ocs->last = i;
+    ocs->nr_pages++;
+    ocs->old_bytes += page->bytes;
+  }
+
+  if (ocs->nr_packets < numheaders - 1)
+    return layout_error (ocs, "headers are incomplete");
+
+  return 0;
+}
+
+/* The number of bytes a packet takes up in pages, including lacing */
+static long
+laced_bytes (long len)
+{
+  return len + len/255 + 1;
+}
+
+/*
+ * Lay out the replacement comment packet and the remaining header packets
+ * in pages. If fit is set, the pages must replace the existing header pages
+ * exactly: the same number of pages, taking up the same number of bytes.
+ * Otherwise pages are filled as by ogg_stream_pageout().
+ * Returns -1 if the packets do not fit, or on error.
+ */
+static int
+stream_paginate (OCStream * ocs, int fit)
+{
+  unsigned char * body, * lacing, * h;
+  ogg_page og;
+  long comment_bytes, rest_bytes, body_bytes, target;
+  long nsegs = 0, s = 0, count, bytes, pageno = ocs->pageno;
+  int i, nr_pages = 0, ended, continued = 0;
+
+  free (ocs->pages);
+  ocs->pages = NULL;
+  ocs->pages_bytes = 0;
+
+  comment_bytes = ocs->comments->bytes;
+  rest_bytes = ocs->insert ? 0 : ocs->payload_bytes - ocs->lengths[0];
+
+  if (fit) {
+    if (ocs->insert) return -1;
+
+    target = ocs->old_bytes - PAGE_HEADER_BYTES * ocs->nr_pages;
+    for (i = 1; i < ocs->nr_packets; i++)
+      target -= laced_bytes (ocs->lengths[i]);
+
+    if (ocs->padding) {
+      while (laced_bytes (comment_bytes) < target) comment_bytes++;
+    }
+    if (laced_bytes (comment_bytes) != target) return -1;
+  }
+
+  body_bytes = comment_bytes + rest_bytes;
+  if ((body = malloc (body_bytes)) == NULL) return -1;
+
+  memcpy (body, ocs->comments->packet, ocs->comments->bytes);
+  memset (body + ocs->comments->bytes, 0, comment_bytes - ocs->comments->bytes);
+  if (rest_bytes > 0)
+    memcpy (body + comment_bytes, ocs->payload + ocs->lengths[0], rest_bytes);
+
+  nsegs = comment_bytes/255 + 1;
+  for (i = 1; !ocs->insert && i < ocs->nr_packets; i++)
+    nsegs += ocs->lengths[i]/255 + 1;
+
+  if (fit && (nsegs < ocs->nr_pages || nsegs > 255 * ocs->nr_pages))
+    goto err_body;
+
+  if ((lacing = malloc (nsegs)) == NULL)
+    goto err_body;
+
+  for (i = 0; i < (ocs->insert ? 1 : ocs->nr_packets); i++) {
+    bytes = (i == 0) ? comment_bytes : ocs->lengths[i];
+    for (; bytes >= 255; bytes -= 255) lacing[s++] = 255;
+    lacing[s++] = (unsigned char)bytes;
+  }
+
+  /* At most one page per segment */
+  ocs->pages = malloc ((PAGE_HEADER_BYTES + 1) * nsegs + body_bytes);
+  if (ocs->pages == NULL)
+    goto err_lacing;
+
+  for (s = 0, body_bytes = 0; s < nsegs; s += count) {
+    if (fit) {
+      /* Spread the segments evenly over the pages */
+      count = (nsegs - s + (ocs->nr_pages - nr_pages) - 1) /
+        (ocs->nr_pages - nr_pages);
+      for (i = 0, bytes = 0; i < count; i++) bytes += lacing[s+i];
+    } else {
+      for (count = 0, bytes = 0; s + count < nsegs && count < 255 &&
+             bytes < PAGE_BODY_BYTES; count++)
+        bytes += lacing[s+count];
+    }
+
+    for (i = 0, ended = 0; i < count; i++)
+      if (lacing[s+i] < 255) ended = 1;
+
+    h = ocs->pages + ocs->pages_bytes;
+    memcpy (h, "OggS", 4);
+    h[4] = 0;
+    h[5] = continued ? 0x01 : 0x00;
+    /* Header packets have granulepos 0 */
+    memset (h + 6, ended ? 0x00 : 0xff, 8);
+    for (i = 0; i < 4; i++) {
+      h[14+i] = (ocs->serialno >> (8*i)) & 0xff;
+      h[22+i] = 0;
+    }
+    for (i = 0; i < 4; i++)
+      h[18+i] = (pageno >> (8*i)) & 0xff;
+    h[26] = (unsigned char)count;
+    memcpy (h + PAGE_HEADER_BYTES, lacing + s, count);
+
+    og.header = h;
+    og.header_len = PAGE_HEADER_BYTES + count;
+    og.body = og.header + og.header_len;
+    og.body_len = bytes;
+    memcpy (og.body, body + body_bytes, bytes);
+    ogg_page_checksum_set (&og);
+
+    ocs->pages_bytes += og.header_len + og.body_len;
+    body_bytes += bytes;
+    continued = (lacing[s+count-1] == 255);
+    pageno++;
+    nr_pages++;
+  }
+
+  free (lacing);
+  free (body);
+
+  ocs->delta = nr_pages - ocs->nr_pages;
+
+  if (fit && ocs->pages_bytes != ocs->old_bytes) return -1;
+
+  return 0;
+
+err_lacing:
+  free (lacing);
+err_body:
+  free (body);
+  return -1;
+}
+
+/*
+ * Write out a page, renumbering it if the headers of its track now take up
+ * a different number of pages.
+ */
+static int
+write_page (OGGZ * output, ogg_page * og, OCStream * ocs)
+{
+  oggz_page_patch patch;
+
+  patch.fields = 0;
+  if (ocs != NULL && ocs->delta != 0) {
+    patch.fields = OGGZ_PATCH_PAGENO;
+    patch.pageno = ogg_page_pageno (og) + ocs->delta;
+  }
+
+  if (oggz_write_page (output, og, &patch) != 0) {
+    fprintf (stderr, "%s: error writing output: %s\n", progname, strerror (errno));
+    return -1;
   }
 
-  /* Set up writer, filling in ocdata for callbacks */
+  return 0;
+}
+
+static int
+write_stream_pages (OGGZ * output, OCStream * ocs)
+{
+  ogg_page og;
+  long offset;
+
+  for (offset = 0; offset < ocs->pages_bytes; ) {
+    offset += page_at (ocs->pages + offset, &og);
+    if (write_page (output, &og, NULL) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Write out the stored header pages from..to, substituting the replacement
+ * pages of each edited track and renumbering its later pages.
+ */
+static int
+write_header_pages (OCData * ocdata, OGGZ * output, int from, int to)
+{
+  OCPage * page;
+  OCStream * ocs;
+  ogg_page og;
+  int i;
+
+  for (i = from; i <= to; i++) {
+    page = &ocdata->pages[i];
+    ocs = oggz_table_lookup (ocdata->streams, page->serialno);
+
+    if (ocs != NULL && i >= ocs->first && i <= ocs->last) {
+      if (i == ocs->first && write_stream_pages (output, ocs) == -1)
+        return -1;
+      continue;
+    }
+
+    page_at (page->data, &og);
+    if (write_page (output, &og, (ocs != NULL && i > ocs->bos) ? ocs : NULL) == -1)
+      return -1;
+
+    if (ocs != NULL && ocs->insert && i == ocs->bos &&
+        write_stream_pages (output, ocs) == -1)
+      return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Copy the rest of the input page by page, renumbering the pages of
+ * tracks whose headers now take up a different number of pages.
+ */
+static int
+copy_pages (OCData * ocdata, OGGZ * output)
+{
+  OCStream * ocs;
+  ogg_page og;
+  long n;
+
+  while ((n = get_page (ocdata, &og)) > 0) {
+    ocs = oggz_table_lookup (ocdata->streams, ogg_page_serialno (&og));
+
+    /* A new track in a later chain may reuse the serialno */
+    if (ocs != NULL && ogg_page_bos (&og)) ocs->delta = 0;
+
+    if (write_page (output, &og, ocs) == -1)
+      return -1;
+  }
+
+  return n;
+}
+
+/*
+ * Open an OGGZ for passing pages through to file, taking over the file.
+ */
+static OGGZ *
+open_output (FILE * file)
+{
+  OGGZ * output;
+
+  if ((output = oggz_open_stdio (file, OGGZ_WRITE)) == NULL) {
+    fprintf (stderr, "oggz-comment: out of memory\n");
+    return NULL;
+  }
+
+  oggz_write_set_batch (output, OUTPUT_BATCH_BYTES, 0);
+
+  return output;
+}
+
+static int
+close_output (OGGZ * output)
+{
+  if (oggz_close (output) != 0) {
+    fprintf (stderr, "%s: error writing output: %s\n", progname, strerror (errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Seek the input to a page offset, which may be beyond the range of a long.
+ */
+static int
+seek_input (FILE * file, ogg_int64_t offset)
+{
+  oggz_off_t off = (oggz_off_t)offset;
+
+  if (off != offset) {
+    errno = EINVAL;
+    return -1;
+  }
+
+#ifdef WIN32
+  return _fseeki64 (file, off, SEEK_SET);
+#else
+  return fseeko (file, off, SEEK_SET);
+#endif
+}
+
+/*
+ * Overwrite the header pages of the edited tracks in the input file.
+ * Returns 1 if the new headers do not fit in the space of the old.
+ */
+static int
+rewrite_in_place (OCData * ocdata)
+{
+  OCStream * ocs;
+  OCPage * pages = ocdata->pages;
+  OGGZ * output;
+  int i, n, from = -1, to = -1, ret;
+
+  n = oggz_table_size (ocdata->streams);
+  if (n == 0) return 0;
+
+  for (i = 0; i < n; i++) {
+    ocs = oggz_table_nth (ocdata->streams, i, NULL);
+    if (stream_paginate (ocs, 1) == -1) return 1;
+
+    if (from == -1 || ocs->first < from) from = ocs->first;
+    if (ocs->last > to) to = ocs->last;
+  }
+
+  /* Pages of other tracks in between are rewritten as they are */
+  for (i = from; i < to; i++) {
+    if (pages[i].offset + pages[i].bytes != pages[i+1].offset) return 1;
+  }
+
+  if (seek_input (ocdata->infile, pages[from].offset) == -1) {
+    fprintf (stderr, "%s: error seeking input: %s\n", progname, strerror (errno));
+    return -1;
+  }
+
+  if ((output = open_output (ocdata->infile)) == NULL)
+    return -1;
+  ocdata->infile = NULL;
+
+  ret = write_header_pages (ocdata, output, from, to);
+  if (close_output (output) == -1) ret = -1;
+
+  return ret;
+}
+
+/*
+ * Give a rewritten file the permissions of the file it replaces.
+ */
+static int
+copy_file_mode (FILE * from, FILE * to)
+{
+#ifndef WIN32
+  struct stat statbuf;
+
+  if (fstat (fileno (from), &statbuf) == -1) return -1;
+
+  return fchmod (fileno (to), statbuf.st_mode & 0777);
+#else
+  return 0;
+#endif
+}
+
+static int
+edit_comments (OCData * ocdata, char * infilename, char * outfilename)
+{
+  char * tmpfilename = NULL, * realname = NULL;
+  OCStream * ocs;
+  OGGZ * output;
+  FILE * f;
+  int i, n, ret;
+
+  /* Set up writer, used to generate the replacement comments */
   if ((ocdata->writer = oggz_new (OGGZ_WRITE)) == NULL) {
     fprintf (stderr, "Unable to create new writer: out of memory\n");
+    return -1;
   }
 
   /* Set a page reader to process bos pages */
   oggz_set_read_page (ocdata->reader, -1, read_bos, ocdata);
 
-  /* First, process headers packet-by-packet. */
+  /* Process headers packet-by-packet. */
   oggz_set_read_callback (ocdata->reader, -1, read_packet, ocdata);
-  while ((n = oggz_read (ocdata->reader, 1024)) > 0) {
-    long nn;
-    while ((nn=oggz_write_output (ocdata->writer, buf, n)) > 0) {
-      if (fwrite (buf, 1, nn, ocdata->outfile) < (size_t)nn)
-        break;
+
+  if (read_headers (ocdata) == -1) {
+    if (!ocdata->error)
+      fprintf (stderr, "%s: %s: error reading input\n", progname, infilename);
+    return -1;
+  }
+
+  n = oggz_table_size (ocdata->streams);
+  for (i = 0; i < n; i++) {
+    ocs = oggz_table_nth (ocdata->streams, i, NULL);
+    if (stream_layout (ocdata, ocs) == -1)
+      return -1;
+  }
+
+  if (ocdata->in_place) {
+    if ((ret = rewrite_in_place (ocdata)) != 1)
+      return ret;
+
+#ifndef WIN32
+    /* Replace the file a symlink points to, not the symlink */
+    if ((realname = realpath (infilename, NULL)) == NULL) {
+      fprintf (stderr, "%s: %s: %s\n", progname, infilename,
+               strerror (errno));
+      return -1;
+    }
+    infilename = realname;
+#endif
+
+    /* The new headers are larger: rewrite the whole file */
+    tmpfilename = malloc (strlen (infilename) + 5);
+    if (tmpfilename == NULL) {
+      fprintf (stderr, "oggz-comment: out of memory\n");
+      free (realname);
+      return -1;
+    }
+    sprintf (tmpfilename, "%s.tmp", infilename);
+
+    if ((f = fopen (tmpfilename, "rb")) != NULL) {
+      fclose (f);
+      fprintf (stderr, "%s: temporary file %s already exists\n",
+               progname, tmpfilename);
+      free (tmpfilename);
+      free (realname);
+      return -1;
+    }
+    outfilename = tmpfilename;
+  }
+
+  for (i = 0; i < n; i++) {
+    ocs = oggz_table_nth (ocdata->streams, i, NULL);
+    if (stream_paginate (ocs, 0) == -1) {
+      fprintf (stderr, "oggz-comment: out of memory\n");
+      free (tmpfilename);
+      free (realname);
+      return -1;
     }
   }
 
-  /* We actually don't use the writer any more from here, so close it */
-  oggz_close (ocdata->writer);
+  if (outfilename == NULL) {
+    f = stdout;
+  } else if ((f = fopen (outfilename, "wb")) == NULL) {
+    fprintf (stderr, "%s: unable to open output file %s\n",
+             progname, outfilename);
+    free (tmpfilename);
+    free (realname);
+    return -1;
+  }
 
-  /* Now, the headers are processed. We deregister the packet reading
-   * callback. */
-  oggz_set_read_callback (ocdata->reader, -1, NULL, NULL);
+  if (tmpfilename != NULL && copy_file_mode (ocdata->infile, f) == -1) {
+    fprintf (stderr, "%s: unable to set the mode of %s: %s\n",
+             progname, tmpfilename, strerror (errno));
+    fclose (f);
+    ret = -1;
+    goto done;
+  }
 
-  /* We deal with the rest of the file as pages. */
-  /* Register a callback that copies page data directly across to outfile */
-  oggz_set_read_page (ocdata->reader, -1, read_page, ocdata);
+  if ((output = open_output (f)) == NULL) {
+    fclose (f);
+    ret = -1;
+    goto done;
+  }
 
-  if (oggz_run (ocdata->reader) == OGGZ_ERR_OK)
-    return 0;
-  else
-    return 1;
+  ret = 0;
+  if (write_header_pages (ocdata, output, 0, ocdata->nr_pages - 1) == -1 ||
+      copy_pages (ocdata, output) == -1) {
+    ret = -1;
+  }
+
+  if (close_output (output) == -1) ret = -1;
+
+done:
+  if (tmpfilename != NULL) {
+    if (ret == 0) {
+      fclose (ocdata->infile);
+      ocdata->infile = NULL;
+#ifdef WIN32
+      remove (infilename);
+#endif
+      if (rename (tmpfilename, infilename) == -1) {
+        fprintf (stderr, "%s: unable to rename %s to %s: %s\n",
+                 progname, tmpfilename, infilename, strerror (errno));
+        ret = -1;
+      }
+    } else {
+      remove (tmpfilename);
+    }
+    free (tmpfilename);
+  }
+
+  free (realname);
+
+  return ret;
 }
 
 static int
@@ -414,7 +1103,7 @@ read_comments(OGGZ *oggz, oggz_packet * zp, long serialno, void *user_data)
       printf ("\t%s: %s\n", comment->name, comment->value);
   }
 
-  return more_headers (ocdata, op, serialno);
+  return OGGZ_CONTINUE;
 }
 
 static int
@@ -426,7 +1115,8 @@ list_comments (OCData * ocdata)
   /* First, process headers packet-by-packet. */
   oggz_set_read_callback (ocdata->reader, -1, read_comments, ocdata);
 
-  if (oggz_run (ocdata->reader) == OGGZ_ERR_STOP_OK)
+  /* Only the header pages are read in */
+  if (oggz_read_headers (ocdata->reader) == 0)
     return 0;
   else
     return 1;
@@ -462,17 +1152,19 @@ main (int argc, char ** argv)
   int show_version = 0;
   int show_help = 0;
   int do_list = 0;
+  int use_stdin;
 
   long serialno;
   long n;
   int i = 1;
 
-  char * optstring = "lo:dac:s:hv";
+  char * optstring = "lo:idac:s:hv";
 
 #ifdef HAVE_GETOPT_LONG
   static struct option long_options[] = {
     {"list",     no_argument, 0, 'l'},
     {"output",   required_argument, 0, 'o'},
+    {"in-place", no_argument, 0, 'i'},
     {"delete",   no_argument, 0, 'd'},
     {"all",      no_argument, 0, 'a'},
     {"content-type", required_argument, 0, 'c'},
@@ -523,6 +1215,9 @@ main (int argc, char ** argv)
     case 'l': /* list */
       do_list = 1;
       break;
+    case 'i': /* in-place */
+      ocdata->in_place = 1;
+      break;
     case 'd': /* delete */
       ocdata->do_delete = 1;
       break;
@@ -586,11 +1281,40 @@ main (int argc, char ** argv)
     }
   }
 
+  use_stdin = (infilename == NULL || strcmp (infilename, "-") == 0);
+  if (infilename == NULL)
+    infilename = "-";
+
+  if (ocdata->in_place && !do_list) {
+    if (outfilename != NULL) {
+      fprintf (stderr, "%s: Error: --in-place cannot be used with --output\n",
+               progname);
+      goto exit_err;
+    }
+    if (use_stdin) {
+      fprintf (stderr, "%s: Error: standard input cannot be edited in place\n",
+               progname);
+      goto exit_err;
+    }
+  }
+
   /* Set up reader */
-  if (infilename == NULL || strcmp (infilename, "-") == 0) {
-    ocdata->reader = oggz_open_stdio (stdin, OGGZ_READ|OGGZ_AUTO);
+  if (do_list) {
+    if (use_stdin) {
+      ocdata->reader = oggz_open_stdio (stdin, OGGZ_READ|OGGZ_AUTO);
+    } else {
+      ocdata->reader = oggz_open (infilename, OGGZ_READ|OGGZ_AUTO);
+    }
   } else {
-    ocdata->reader = oggz_open (infilename, OGGZ_READ|OGGZ_AUTO);
+    /* Input is read page by page, and only header pages are given
+     * to the reader */
+    if (use_stdin) {
+      ocdata->infile = stdin;
+    } else {
+      ocdata->infile = fopen (infilename, ocdata->in_place ? "r+b" : "rb");
+    }
+    if (ocdata->infile != NULL)
+      ocdata->reader = oggz_new (OGGZ_READ|OGGZ_AUTO);
   }
 
   if (ocdata->reader == NULL) {
@@ -611,7 +1335,7 @@ main (int argc, char ** argv)
       goto exit_err;
   }
 
-  if (edit_comments (ocdata, outfilename) == 0)
+  if (edit_comments (ocdata, infilename, outfilename) == 0)
     goto exit_ok;
   else
     goto exit_err;
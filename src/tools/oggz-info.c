@@ -41,6 +41,7 @@
 
 #include "oggz/oggz.h"
 #include "oggz_tools.h"
+#include "oggz_tools_jobs.h"
 
 #include "skeleton.h"
 
@@ -52,6 +53,8 @@
 
 #define READ_BLOCKSIZE 1024000
 
+#define INDEX_SUFFIX ".oggzidx"
+
 static char * progname;
 
 static void
@@ -59,6 +62,7 @@ usage (const char * progname)
 {
   printf ("Usage: %s [options] filename ...\n", progname);
   printf ("Display information about one or more Ogg files and their bitstreams\n");
+  printf ("A filename of - reads from standard input\n");
   printf ("\nDisplay options\n");
   printf ("  -l, --length           Display content lengths\n");
   printf ("  -b, --bitrate          Display bitrate information\n");
@@ -66,6 +70,12 @@ usage (const char * progname)
   printf ("  -p, --packet-stats     Display Ogg packet statistics\n");
   printf ("  -k, --skeleton         Display Extra data from OggSkeleton bitstream\n");
   printf ("  -a, --all              Display all information\n");
+  printf ("\nIndexing options\n");
+  printf ("  -i, --save-index       Save a seek index for each file, as FILENAME%s\n",
+          INDEX_SUFFIX);
+  printf ("\nPerformance options\n");
+  printf ("  -j num, --jobs num     Read up to num files at once. Output is still\n");
+  printf ("                         printed in the order files were given\n");
   printf ("\nMiscellaneous options\n");
   printf ("  -h, --help             Display this help and exit\n");
   printf ("  -v, --version          Output version information and exit\n");
@@ -105,6 +115,8 @@ typedef int (*OI_TrackFunc) (OI_Info * info, OI_TrackInfo * oit, long serialno);
 #define OIT_OOM (-1)
 
 struct _OI_Info {
+  FILE * out;
+  FILE * err;
   OGGZ * oggz;
   OggzTable * tracks;
   ogg_int64_t duration;
@@ -113,16 +125,15 @@ struct _OI_Info {
 };
 
 struct _OI_Stats {
-  /* Pass 1 */
   long count;
   long length_total;
   long length_min;
   long length_max;
   long overhead_length_total;
 
-  /* Pass 2 */
-  long length_avg;
-  ogg_int64_t length_deviation_total;
+  /* Running mean and sum of squared deviations, by Welford's method */
+  double length_mean;
+  double length_m2;
   double length_stddev;
 };
 
@@ -142,6 +153,10 @@ static int show_bitrate = 0;
 static int show_page_stats = 0;
 static int show_packet_stats = 0;
 static int show_extra_skeleton_info = 0;
+static int save_index = 0;
+
+/* Number of input files, if more than one */
+static int many_files = 0;
 
 static ogg_int64_t
 gp_to_granule (OGGZ * oggz, long serialno, ogg_int64_t granulepos)
@@ -210,9 +225,26 @@ oi_stats_clear (OI_Stats * stats)
   stats->length_max = 0;
   stats->overhead_length_total = 0;
 
-  stats->length_avg = 0;
-  stats->length_deviation_total = 0;
-  stats->length_stddev = 0;
+  stats->length_mean = 0.0;
+  stats->length_m2 = 0.0;
+  stats->length_stddev = 0.0;
+}
+
+static void
+oi_stats_add (OI_Stats * stats, long bytes)
+{
+  double delta;
+
+  stats->count++;
+  stats->length_total += bytes;
+  if (bytes < stats->length_min)
+    stats->length_min = bytes;
+  if (bytes > stats->length_max)
+    stats->length_max = bytes;
+
+  delta = bytes - stats->length_mean;
+  stats->length_mean += delta / stats->count;
+  stats->length_m2 += delta * (bytes - stats->length_mean);
 }
 
 static OI_TrackInfo *
@@ -245,34 +277,33 @@ oi_bitrate (long bytes, ogg_int64_t ms)
 static void
 oi_stats_print (OI_Info * info, OI_Stats * stats, char * label)
 {
-  printf ("\t%s-Length-Maximum: ", label);
-  ot_fprint_bytes (stdout, stats->length_max);
-  putchar ('\n');
+  fprintf (info->out, "\t%s-Length-Maximum: ", label);
+  ot_fprint_bytes (info->out, stats->length_max);
+  fputc ('\n', info->out);
 
-  printf ("\t%s-Length-StdDev: ", label);
-  ot_fprint_bytes (stdout, stats->length_stddev);
-  putchar ('\n');
+  fprintf (info->out, "\t%s-Length-StdDev: ", label);
+  ot_fprint_bytes (info->out, stats->length_stddev);
+  fputc ('\n', info->out);
 
 #if 0
-  printf ("\t%s-Length-Maximum: %ld bytes\n", label, stats->length_max);
-  /*printf ("\t%s-Length-Average: %ld bytes\n", label, stats->length_avg);*/
-  printf ("\t%s-Length-StdDev: %.0f bytes\n", label, stats->length_stddev);
+  fprintf (info->out, "\t%s-Length-Maximum: %ld bytes\n", label, stats->length_max);
+  fprintf (info->out, "\t%s-Length-StdDev: %.0f bytes\n", label, stats->length_stddev);
   /*
-  printf ("\tRange: [%ld - %ld] bytes, Std.Dev. %.3f bytes\n",
+  fprintf (info->out, "\tRange: [%ld - %ld] bytes, Std.Dev. %.3f bytes\n",
 	  stats->length_min, stats->length_max, stats->length_stddev);
   */
 #endif
 }
 
 static void
-ot_fishead_print(OI_TrackInfo *oit) {
+ot_fishead_print(OI_Info * info, OI_TrackInfo *oit) {
   if (oit->has_fishead) {
     /*
-    printf("\tPresentation Time: %.2f\n", (double)oit->fhInfo.ptime_n/oit->fhInfo.ptime_d);
-    printf("\tBase Time: %.2f\n", (double)oit->fhInfo.btime_n/oit->fhInfo.btime_d);
+    fprintf (info->out, "\tPresentation Time: %.2f\n", (double)oit->fhInfo.ptime_n/oit->fhInfo.ptime_d);
+    fprintf (info->out, "\tBase Time: %.2f\n", (double)oit->fhInfo.btime_n/oit->fhInfo.btime_d);
     */
-    printf("\tSkeleton version: %d.%d\n", oit->fhInfo.version_major, oit->fhInfo.version_minor);
-    /*printf("\tUTC: %s\n", oit->fhInfo.UTC);*/
+    fprintf (info->out, "\tSkeleton version: %d.%d\n", oit->fhInfo.version_major, oit->fhInfo.version_minor);
+    /*fprintf (info->out, "\tUTC: %s\n", oit->fhInfo.UTC);*/
   }
 }
 
@@ -283,17 +314,17 @@ ot_fisbone_print(OI_Info * info, OI_TrackInfo *oit) {
   size_t len;
   
   if (oit->has_fisbone) {
-    printf("\n\tExtra information from Ogg Skeleton track:\n");
-    /*printf("\tserialno: %010u\n", oit->fbInfo.serial_no);*/
-    printf("\tNumber of header packets: %d\n", oit->fbInfo.nr_header_packet);
-    printf("\tGranule rate: %.2f\n", (double)oit->fbInfo.granule_rate_n/oit->fbInfo.granule_rate_d);
-    printf("\tGranule shift: %d\n", (int)oit->fbInfo.granule_shift);
-    printf("\tStart granule: ");
-    ot_fprint_granulepos(stdout, info->oggz, oit->fbInfo.serial_no, oit->fbInfo.start_granule);
-    printf (" ; ");
-    ot_fprint_time (stdout, gp_to_time (info->oggz, oit->fbInfo.serial_no, oit->fbInfo.start_granule));
-    printf ("\n");
-    printf("\tPreroll: %d\n", oit->fbInfo.preroll);
+    fprintf (info->out, "\n\tExtra information from Ogg Skeleton track:\n");
+    /*fprintf (info->out, "\tserialno: %010u\n", oit->fbInfo.serial_no);*/
+    fprintf (info->out, "\tNumber of header packets: %d\n", oit->fbInfo.nr_header_packet);
+    fprintf (info->out, "\tGranule rate: %.2f\n", (double)oit->fbInfo.granule_rate_n/oit->fbInfo.granule_rate_d);
+    fprintf (info->out, "\tGranule shift: %d\n", (int)oit->fbInfo.granule_shift);
+    fprintf (info->out, "\tStart granule: ");
+    ot_fprint_granulepos(info->out, info->oggz, oit->fbInfo.serial_no, oit->fbInfo.start_granule);
+    fprintf (info->out, " ; ");
+    ot_fprint_time (info->out, gp_to_time (info->oggz, oit->fbInfo.serial_no, oit->fbInfo.start_granule));
+    fprintf (info->out, "\n");
+    fprintf (info->out, "\tPreroll: %d\n", oit->fbInfo.preroll);
 
     len = oit->fbInfo.current_header_size+1;
     allocated = messages = _ogg_calloc(len, sizeof(char));
@@ -301,20 +332,20 @@ ot_fisbone_print(OI_Info * info, OI_TrackInfo *oit) {
     strncpy(messages, oit->fbInfo.message_header_fields, len);
     messages[len-1] = '\0';
 
-    printf("\tMessage Header Fields:\n");
+    fprintf (info->out, "\tMessage Header Fields:\n");
     while (1) {
       token = strchr(messages, '\r');
       if (token == NULL)
         break;
       *token = '\0';
-      printf("\t %s\n", messages);
+      fprintf (info->out, "\t %s\n", messages);
 
       token++;
       if (*token == '\n')
         token++;
       messages = token;
     }
-    printf("\n");
+    fprintf (info->out, "\n");
     _ogg_free(allocated);
   }
 
@@ -326,29 +357,29 @@ static int
 oit_print (OI_Info * info, OI_TrackInfo * oit, long serialno)
 {
   if (oit->codec_name) {
-    printf ("\n%s: serialno %010lu\n", oit->codec_name, serialno);
+    fprintf (info->out, "\n%s: serialno %010lu\n", oit->codec_name, serialno);
   } else {
-    printf ("\n???: serialno %010lu\n", serialno);
+    fprintf (info->out, "\n???: serialno %010lu\n", serialno);
   }
-  printf ("\t%ld packets in %ld pages, %.1f packets/page, %.3f%% Ogg overhead\n",
+  fprintf (info->out, "\t%ld packets in %ld pages, %.1f packets/page, %.3f%% Ogg overhead\n",
 	  oit->packets.count, oit->pages.count,
 	  (double)oit->packets.count / (double)oit->pages.count,
           oit->pages.length_stddev == 0 ? 0.0 : 100.0*oit->pages.overhead_length_total/oit->pages.length_total);
 
   if (show_length) {
-    fputs("\tContent-Length: ", stdout);
-    ot_fprint_bytes (stdout, oit->pages.length_total);
-    putchar ('\n');
+    fputs("\tContent-Length: ", info->out);
+    ot_fprint_bytes (info->out, oit->pages.length_total);
+    fputc ('\n', info->out);
   }
 
   if (show_bitrate) {
-    fputs ("\tContent-Bitrate-Average: ", stdout);
-    ot_print_bitrate (oi_bitrate (oit->pages.length_total, info->duration));
-    putchar ('\n');
+    fputs ("\tContent-Bitrate-Average: ", info->out);
+    ot_fprint_bitrate (info->out, oi_bitrate (oit->pages.length_total, info->duration));
+    fputc ('\n', info->out);
   }
 
   if (oit->codec_info != NULL) {
-    fputs (oit->codec_info, stdout);
+    fputs (oit->codec_info, info->out);
   }
 
   if (show_page_stats) {
@@ -360,7 +391,7 @@ oit_print (OI_Info * info, OI_TrackInfo * oit, long serialno)
   }
 
   if (show_extra_skeleton_info && oit->has_fishead) {
-    ot_fishead_print(oit);
+    ot_fishead_print(info, oit);
   }
   if (show_extra_skeleton_info && oit->has_fisbone) {
     if (ot_fisbone_print(info, oit) == OIT_OOM)
@@ -370,24 +401,6 @@ oit_print (OI_Info * info, OI_TrackInfo * oit, long serialno)
   return 0;
  }
 
-static void
-oi_stats_average (OI_Stats * stats)
-{
-  if (stats->count > 0) {
-    stats->length_avg = stats->length_total / stats->count;
-  } else {
-    stats->length_avg = 0;
-  }
-}
-
-static int
-oit_calc_average (OI_Info * info, OI_TrackInfo * oit, long serialno)
-{
-  oi_stats_average (&oit->pages);
-  oi_stats_average (&oit->packets);
-  return 0;
-}
-
 static void
 oi_stats_stddev (OI_Stats * stats)
 {
@@ -397,7 +410,7 @@ oi_stats_stddev (OI_Stats * stats)
     stats->length_stddev = 0.0;
   }
   else {
-    variance = (double)stats->length_deviation_total / (double)(stats->count - 1);
+    variance = stats->length_m2 / (double)(stats->count - 1);
     stats->length_stddev = sqrt (variance);
   }
 }
@@ -411,7 +424,7 @@ oit_calc_stddev (OI_Info * info, OI_TrackInfo * oit, long serialno)
 }
 
 static int
-read_page_pass1 (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
+read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
 {
   OI_Info * info = (OI_Info *)user_data;
   OI_TrackInfo * oit;
@@ -435,36 +448,14 @@ read_page_pass1 (OGGZ * oggz, const ogg_page * og, long serialno, void * user_da
   info->overhead_length_total += og->header_len;
 
   /* Increment the page statistics */
-  oit->pages.count++;
-  oit->pages.length_total += bytes;
-  if (bytes < oit->pages.length_min)
-    oit->pages.length_min = bytes;
-  if (bytes > oit->pages.length_max)
-    oit->pages.length_max = bytes;
+  oi_stats_add (&oit->pages, bytes);
   oit->pages.overhead_length_total += og->header_len;
 
   return 0;
 }
 
 static int
-read_page_pass2 (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
-{
-  OI_Info * info = (OI_Info *)user_data;
-  OI_TrackInfo * oit;
-  long bytes, deviation;
-
-  oit = oggz_table_lookup (info->tracks, serialno);
-
-  /* Increment the page length deviation squared total */
-  bytes = og->header_len + og->body_len;
-  deviation = bytes - oit->pages.length_avg;
-  oit->pages.length_deviation_total += (deviation * deviation);
-
-  return 0;
-}
-
-static int
-read_packet_pass1 (OGGZ * oggz, oggz_packet * zp, long serialno,
+read_packet (OGGZ * oggz, oggz_packet * zp, long serialno,
 		   void * user_data)
 {
   OI_Info * info = (OI_Info *)user_data;
@@ -474,12 +465,7 @@ read_packet_pass1 (OGGZ * oggz, oggz_packet * zp, long serialno,
   oit = oggz_table_lookup (info->tracks, serialno);
 
   /* Increment the packet statistics */
-  oit->packets.count++;
-  oit->packets.length_total += op->bytes;
-  if (op->bytes < oit->packets.length_min)
-    oit->packets.length_min = op->bytes;
-  if (op->bytes > oit->packets.length_max)
-    oit->packets.length_max = op->bytes;
+  oi_stats_add (&oit->packets, op->bytes);
 
   if (!op->e_o_s && !memcmp(op->packet, FISBONE_IDENTIFIER, 8)) {
     fisbone_packet fp;
@@ -491,7 +477,7 @@ read_packet_pass1 (OGGZ * oggz, oggz_packet * zp, long serialno,
       oit->fbInfo = fp;
     }
     else {
-      fprintf(stderr, "Warning: logical stream %08x referenced by skeleton was not found\n",fp.serial_no);
+      fprintf(info->err, "Warning: logical stream %08x referenced by skeleton was not found\n",fp.serial_no);
       fisbone_clear(&fp);
     }
   } else if (!op->e_o_s && !memcmp(op->packet, FISHEAD_IDENTIFIER, 8)) {
@@ -505,34 +491,19 @@ read_packet_pass1 (OGGZ * oggz, oggz_packet * zp, long serialno,
   return 0;
 }
 
+/*
+ * Read the file once, gathering all statistics as it goes. No seeking is
+ * needed, so this also works on non-seekable input.
+ */
 static int
-read_packet_pass2 (OGGZ * oggz, oggz_packet * zp, long serialno,
-		   void * user_data)
-{
-  OI_Info * info = (OI_Info *)user_data;
-  ogg_packet * op = &zp->op;
-  OI_TrackInfo * oit;
-  long deviation;
-  
-  oit = oggz_table_lookup (info->tracks, serialno);
-
-  /* Increment the packet length deviation squared total */
-  deviation = op->bytes - oit->packets.length_avg;
-  oit->packets.length_deviation_total += (deviation * deviation);
-
-  return 0;
-}
-
-static int
-oi_pass1 (OGGZ * oggz, OI_Info * info)
+oi_read (OGGZ * oggz, OI_Info * info)
 {
   long n, serialno;
   int ntracks, i;
   OI_TrackInfo * oit;
 
-  oggz_seek (oggz, 0, SEEK_SET);
-  oggz_set_read_page (oggz, -1, read_page_pass1, info);
-  oggz_set_read_callback (oggz, -1, read_packet_pass1, info);
+  oggz_set_read_page (oggz, -1, read_page, info);
+  oggz_set_read_callback (oggz, -1, read_packet, info);
 
   while ((n = oggz_read (oggz, READ_BLOCKSIZE)) > 0);
 
@@ -540,7 +511,7 @@ oi_pass1 (OGGZ * oggz, OI_Info * info)
   if (n == OGGZ_ERR_STOP_ERR || n == OGGZ_ERR_OUT_OF_MEMORY)
     exit_out_of_memory ();
 
-  oggz_info_apply (oit_calc_average, info);
+  oggz_info_apply (oit_calc_stddev, info);
 
   /* Now we are at the end of the file, calculate the duration */
   info->duration = oggz_tell_units (oggz);
@@ -558,22 +529,21 @@ oi_pass1 (OGGZ * oggz, OI_Info * info)
   return 0;
 }
 
-static int
-oi_pass2 (OGGZ * oggz, OI_Info * info)
+static void
+oi_save_index (OGGZ * oggz, const char * infilename, FILE * err)
 {
-  long n;
+  char * indexname;
 
-  oggz_seek (oggz, 0, SEEK_SET);
-  oggz_set_read_page (oggz, -1, read_page_pass2, info);
-  oggz_set_read_callback (oggz, -1, read_packet_pass2, info);
+  indexname = malloc (strlen (infilename) + strlen (INDEX_SUFFIX) + 1);
+  if (indexname == NULL)
+    exit_out_of_memory ();
 
-  while ((n = oggz_read (oggz, READ_BLOCKSIZE)) > 0);
-  if (n == OGGZ_ERR_OUT_OF_MEMORY)
-    exit_out_of_memory();
+  sprintf (indexname, "%s%s", infilename, INDEX_SUFFIX);
 
-  oggz_info_apply (oit_calc_stddev, info);
+  if (oggz_index_save (oggz, indexname) != 0)
+    fprintf (err, "%s: Could not save index %s\n", progname, indexname);
 
-  return 0;
+  free (indexname);
 }
 
 static int
@@ -589,6 +559,68 @@ oit_delete (OI_Info * info, OI_TrackInfo * oit, long serialno)
   return 0;
 }
 
+static int
+oi_file (int index, FILE * out, FILE * err, void * user_data)
+{
+  char ** filenames = (char **)user_data;
+  char * infilename = filenames[index];
+  OGGZ * oggz;
+  OI_Info info;
+
+  if (strcmp (infilename, "-") == 0) {
+    oggz = oggz_open_stdio (stdin, OGGZ_READ|OGGZ_AUTO);
+  } else {
+    oggz = oggz_open (infilename, OGGZ_READ|OGGZ_AUTO|OGGZ_MMAP|
+                      OGGZ_READAHEAD|(save_index ? OGGZ_INDEX : 0));
+  }
+  if (oggz == NULL) {
+    fprintf (err, "%s: %s\n", infilename, strerror (errno));
+    return -1;
+  }
+
+  info.out = out;
+  info.err = err;
+  info.oggz = oggz;
+  info.tracks = oggz_table_new ();
+  info.length_total = 0;
+  info.overhead_length_total = 0;
+
+  oi_read (oggz, &info);
+
+  if (save_index && strcmp (infilename, "-") != 0)
+    oi_save_index (oggz, infilename, err);
+
+  /* Print summary information */
+  if (many_files)
+    fprintf (out, "Filename: %s\n", infilename);
+  fputs ("Content-Duration: ", out);
+  ot_fprint_time (out, (double)info.duration / 1000.0);
+  fputc ('\n', out);
+
+  if (show_length) {
+    fputs ("Content-Length: ", out);
+    ot_fprint_bytes (out, info.length_total);
+    fputc ('\n', out);
+  }
+
+  if (show_bitrate) {
+    fputs ("Content-Bitrate-Average: ", out);
+    ot_fprint_bitrate (out, oi_bitrate (info.length_total, info.duration));
+    fputc ('\n', out);
+  }
+
+  oggz_info_apply (oit_print, &info);
+
+  oggz_info_apply (oit_delete, &info);
+  oggz_table_delete (info.tracks);
+
+  oggz_close (oggz);
+
+  if (index < many_files - 1) fputs (SEP "\n", out);
+
+  return 0;
+}
+
 int
 main (int argc, char ** argv)
 {
@@ -598,12 +630,9 @@ main (int argc, char ** argv)
   int i;
   int show_all = 0;
 
-  int many_files = 0;
-  char * infilename;
-  OGGZ * oggz;
-  OI_Info info;
+  int nr_workers = 1;
 
-  char * optstring = "hvlbgpka";
+  char * optstring = "hvlbgpkaij:";
 
 #ifdef HAVE_GETOPT_LONG
   static struct option long_options[] = {
@@ -615,6 +644,8 @@ main (int argc, char ** argv)
     {"packet-stats", no_argument, 0, 'p'},
     {"skeleton", no_argument, 0, 'k'},
     {"all", no_argument, 0, 'a'},
+    {"save-index", no_argument, 0, 'i'},
+    {"jobs", required_argument, 0, 'j'},
     {NULL,0,0,0}
   };
 #endif
@@ -672,6 +703,12 @@ main (int argc, char ** argv)
     case 'a':
       show_all = 1;
       break;
+    case 'i': /* save index */
+      save_index = 1;
+      break;
+    case 'j': /* jobs */
+      nr_workers = atoi (optarg);
+      break;
     default:
       break;
     }
@@ -702,56 +739,19 @@ main (int argc, char ** argv)
     show_extra_skeleton_info = 1;
   }
 
-  if (argc > optind+1) {
-    many_files = 1;
+  if (nr_workers < 1) {
+    fprintf (stderr, "%s: Error: [-j num, --jobs num] option must be positive\n",
+             progname);
+    goto exit_err;
   }
 
-  while (optind < argc) {
-    infilename = argv[optind++];
-
-    if ((oggz = oggz_open (infilename, OGGZ_READ|OGGZ_AUTO)) == NULL) {
-      perror (infilename);
-      return (1);
-    }
-
-    info.oggz = oggz;
-    info.tracks = oggz_table_new ();
-    info.length_total = 0;
-    info.overhead_length_total = 0;
-    
-    oi_pass1 (oggz, &info);
-
-    oi_pass2 (oggz, &info);
-    
-    /* Print summary information */
-    if (many_files)
-      printf ("Filename: %s\n", infilename);
-    fputs ("Content-Duration: ", stdout);
-    ot_fprint_time (stdout, (double)info.duration / 1000.0);
-    putchar ('\n');
-    
-    if (show_length) {
-      fputs ("Content-Length: ", stdout);
-      ot_fprint_bytes (stdout, info.length_total);
-      putchar ('\n');
-    }
-    
-    if (show_bitrate) {
-      fputs ("Content-Bitrate-Average: ", stdout);
-      ot_print_bitrate (oi_bitrate (info.length_total, info.duration));
-      putchar ('\n');
-    }
-
-    oggz_info_apply (oit_print, &info);
-    
-    oggz_info_apply (oit_delete, &info);
-    oggz_table_delete (info.tracks);
-
-    oggz_close (oggz);
-    
-    if (optind < argc) puts (SEP);
+  if (argc > optind+1) {
+    many_files = argc - optind;
   }
 
+  if (ot_run_jobs (argc - optind, nr_workers, oi_file, &argv[optind]) > 0)
+    goto exit_err;
+
  exit_ok:
   exit (0);
 
@@ -53,9 +53,11 @@
 
 #define READ_SIZE 4096
 #define WRITE_SIZE 4096
+#define WRITE_BATCH_BYTES 65536
 
 typedef struct {
   OGGZ *reader;
+  OGGZ *writer;
   FILE *outfile;
   int numwrite;
   OggzTable *streams;
@@ -133,7 +135,9 @@ ordata_delete (ORData *ordata)
   
   if (ordata->reader)
     oggz_close (ordata->reader);
-  if (ordata->outfile)
+  if (ordata->writer)
+    oggz_close (ordata->writer);
+  else if (ordata->outfile)
     fclose (ordata->outfile);
   
   free (ordata);
@@ -199,10 +203,9 @@ orstream_delete (ORData *ordata, ORStream *stream)
 }
 
 static void
-checked_fwrite (const void *data, size_t size, size_t count, FILE *stream)
+checked_write_page (OGGZ *writer, const ogg_page *og)
 {
-  int n = fwrite (data, size, count, stream);
-  if ((size_t)n != count) {
+  if (oggz_write_page (writer, og, NULL) != 0) {
     perror ("write failed");
     exit (1);
   }
@@ -214,8 +217,7 @@ rip_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
   ORData *ordata = (ORData *) user_data;
   ORStream *stream = oggz_table_lookup (ordata->streams, serialno);
 
-  checked_fwrite (og->header, 1, og->header_len, ordata->outfile);
-  checked_fwrite (og->body, 1, og->body_len, ordata->outfile);
+  checked_write_page (ordata->writer, og);
 
   if (ogg_page_eos ((ogg_page *)og) && stream != NULL) {
     oggz_table_remove (ordata->streams, serialno);
@@ -263,6 +265,12 @@ oggz_rip (ORData * ordata)
   if (ordata->verbose) 
     fprintf (stderr, "\r Done.                                 \n");
 
+  /* Write out the last batch */
+  if (oggz_flush (ordata->writer) != 0) {
+    perror ("write failed");
+    return -1;
+  }
+
   return 0;
 }
 
@@ -416,7 +424,13 @@ main (int argc, char * argv[])
     }
   }
 
-  oggz_rip (ordata);
+  /* The writer takes over outfile, and closes it */
+  ordata->writer = oggz_open_stdio (ordata->outfile, OGGZ_WRITE);
+  assert (ordata->writer != NULL);
+  oggz_write_set_batch (ordata->writer, WRITE_BATCH_BYTES, 0);
+
+  if (oggz_rip (ordata) != 0)
+    goto exit_err;
 
  exit_ok:
   ordata_delete (ordata);
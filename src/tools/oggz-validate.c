@@ -47,6 +47,7 @@
 #include "oggz/oggz.h"
 
 #include "oggz_tools.h"
+#include "oggz_tools_jobs.h"
 
 #define MAX_ERRORS 10
 
@@ -54,9 +55,22 @@
 
 /* #define DEBUG */
 
+/* Smallest number of bytes worth validating as a separate segment */
+#define SEGMENT_MIN (1024*1024)
+
 typedef ogg_int64_t timestamp_t;
 
+typedef struct _OVSegment OVSegment;
+
 typedef struct _OVData {
+  const char * filename;
+  FILE * err;
+
+  int prefix;
+  int suffix;
+  int nr_errors;
+  timestamp_t current_timestamp;
+
   OGGZ * writer;
   OggzTable * missing_eos;
   OggzTable * packetno;
@@ -65,6 +79,11 @@ typedef struct _OVData {
   int audio_count;
 
   int chain_ended;
+
+  /* Segmented validation only: the segment being validated, and the
+   * granulepos last accepted by the writer for each stream */
+  OVSegment * segment;
+  OggzTable * granulepos;
 } OVData;
 
 typedef struct {
@@ -83,11 +102,13 @@ static error_text errors[] = {
 static char * progname;
 static int max_errors = MAX_ERRORS;
 static int multifile = 0;
-static char * current_filename = NULL;
-static timestamp_t current_timestamp = 0;
-static int exit_status = 0;
-static int nr_errors = 0;
-static int prefix = 0, suffix = 0;
+static int show_results = 0;
+static int nr_segments = 1;
+
+/* Cache the --prefix, --suffix options and reset before validating
+ * each input file */
+static int opt_prefix = 0;
+static int opt_suffix = 0;
 
 static void
 list_errors (void)
@@ -130,6 +151,16 @@ usage (char * progname)
   printf ("                         on the first chain\n");
   printf ("  -P, --partial          Treat input as a the middle portion of a stream;\n");
   printf ("                         equivalent to both --prefix and --suffix\n");
+  printf ("  -r, --results          Print one line per input file to standard output:\n");
+  printf ("                         VALID, INVALID or ERROR, the number of errors\n");
+  printf ("                         and the filename, separated by tabs\n");
+
+  printf ("\nPerformance options\n");
+  printf ("  -j num, --jobs num     Validate up to num files at once. Reports are\n");
+  printf ("                         still printed in the order files were given\n");
+  printf ("  -S num, --segments num Split each large file into up to num segments,\n");
+  printf ("                         and validate these at once. The report is the\n");
+  printf ("                         same as when validating serially\n");
 
   printf ("\nMiscellaneous options\n");
   printf ("  -h, --help             Display this help and exit\n");
@@ -148,16 +179,15 @@ exit_out_of_memory (void)
 }
 
 static int
-log_error (void)
+log_error (OVData * ovdata)
 {
-  if (multifile && nr_errors == 0) {
-    fprintf (stderr, "%s: Error:\n", current_filename);
+  /* Segments are joined up by validate_segmented(), which prints this */
+  if (multifile && ovdata->nr_errors == 0 && ovdata->segment == NULL) {
+    fprintf (ovdata->err, "%s: Error:\n", ovdata->filename);
   }
 
-  exit_status = 1;
-
-  nr_errors++;
-  if (max_errors && nr_errors > max_errors)
+  ovdata->nr_errors++;
+  if (max_errors && ovdata->nr_errors > max_errors)
     return OGGZ_STOP_ERR;
 
   return OGGZ_STOP_OK;
@@ -201,16 +231,18 @@ gp_to_time (OGGZ * oggz, long serialno, ogg_int64_t granulepos)
   return (timestamp_t)((double)(SUBSECONDS * granule * gr_d) / (double)gr_n);
 }
 
+static void granulepos_delete (OggzTable * granulepos);
+
 static void
 ovdata_init (OVData * ovdata)
 {
   int flags;
 
-  current_timestamp = 0;
+  ovdata->current_timestamp = 0;
 
   flags = OGGZ_WRITE|OGGZ_AUTO;
-  if (prefix) flags |= OGGZ_PREFIX;
-  if (suffix) flags |= OGGZ_SUFFIX;
+  if (ovdata->prefix) flags |= OGGZ_PREFIX;
+  if (ovdata->suffix) flags |= OGGZ_SUFFIX;
 
   if ((ovdata->writer = oggz_new (flags)) == NULL) {
     fprintf (stderr, "oggz-validate: unable to create new writer\n");
@@ -236,17 +268,47 @@ ovdata_clear (OVData * ovdata)
 
   oggz_close (ovdata->writer);
 
-  if (!prefix && (max_errors == 0 || nr_errors <= max_errors)) {
+  if (ovdata->segment == NULL && !ovdata->prefix &&
+      (max_errors == 0 || ovdata->nr_errors <= max_errors)) {
     nr_missing_eos = oggz_table_size (ovdata->missing_eos);
     for (i = 0; i < nr_missing_eos; i++) {
-      log_error ();
+      log_error (ovdata);
       oggz_table_nth (ovdata->missing_eos, i, &serialno);
-      fprintf (stderr, "serialno %010lu: missing *** eos\n", serialno);
+      fprintf (ovdata->err, "serialno %010lu: missing *** eos\n", serialno);
     }
   }
 
   oggz_table_delete (ovdata->missing_eos);
   oggz_table_delete (ovdata->packetno);
+  if (ovdata->granulepos) granulepos_delete (ovdata->granulepos);
+}
+
+static void
+granulepos_set (OggzTable * granulepos, long serialno, ogg_int64_t gpos)
+{
+  ogg_int64_t * value;
+
+  if ((value = oggz_table_lookup (granulepos, serialno)) == NULL) {
+    if ((value = malloc (sizeof (ogg_int64_t))) == NULL)
+      exit_out_of_memory();
+    if (oggz_table_insert (granulepos, serialno, value) == NULL)
+      exit_out_of_memory();
+  }
+
+  *value = gpos;
+}
+
+static void
+granulepos_delete (OggzTable * granulepos)
+{
+  long serialno;
+  int i, n;
+
+  n = oggz_table_size (granulepos);
+  for (i = 0; i < n; i++) {
+    free (oggz_table_nth (granulepos, i, &serialno));
+  }
+  oggz_table_delete (granulepos);
 }
 
 static int
@@ -261,7 +323,7 @@ read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
   if (ovdata->chain_ended) {
     ovdata_clear (ovdata);
     ovdata_init (ovdata);
-    suffix = 0;
+    ovdata->suffix = 0;
   }
 
   if (ogg_page_bos ((ogg_page *)og)) {
@@ -276,8 +338,8 @@ read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
       case OGGZ_CONTENT_THEORA:
 	ovdata->theora_count++;
 	if (ovdata->audio_count > 0) {
-	  log_error ();
-	  fprintf (stderr, "serialno %010lu: Theora video bos page after audio bos page\n", serialno);
+	  log_error (ovdata);
+	  fprintf (ovdata->err, "serialno %010lu: Theora video bos page after audio bos page\n", serialno);
 	}
         break;
       case OGGZ_CONTENT_VORBIS:
@@ -296,10 +358,10 @@ read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
   packets = ogg_page_packets ((ogg_page *)og);
 
   /* Check header constraints */
-  if (!suffix) {
+  if (!ovdata->suffix) {
     if (oggz_table_lookup (ovdata->missing_eos, serialno) == NULL) {
-      ret = log_error ();
-      fprintf (stderr, "serialno %010lu: missing *** bos\n", serialno);
+      ret = log_error (ovdata);
+      fprintf (ovdata->err, "serialno %010lu: missing *** bos\n", serialno);
     }
 
     packetno = (ptrdiff_t)oggz_table_lookup (ovdata->packetno, serialno);
@@ -311,17 +373,17 @@ read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
         exit_out_of_memory();
 
       if (packetno == headers && gpos != 0) {
-        ret = log_error ();
-        fprintf (stderr, "serialno %010lu: Terminal header page has non-zero granulepos\n", serialno);
+        ret = log_error (ovdata);
+        fprintf (ovdata->err, "serialno %010lu: Terminal header page has non-zero granulepos\n", serialno);
       } else if (packetno > headers) {
-        ret = log_error ();
-        fprintf (stderr, "serialno %010lu: Terminal header page contains non-header packet\n", serialno);
+        ret = log_error (ovdata);
+        fprintf (ovdata->err, "serialno %010lu: Terminal header page contains non-header packet\n", serialno);
       }
     } else if (packetno == headers-1) {
       /* This is the next page after the page on which the last header finished */
       if (ogg_page_continued (og)) {
-        ret = log_error ();
-        fprintf (stderr, "serialno %010lu: Terminal header page contains non-header segment\n", serialno);
+        ret = log_error (ovdata);
+        fprintf (ovdata->err, "serialno %010lu: Terminal header page contains non-header segment\n", serialno);
       }
 
       /* Mark packetno as greater than headers to avoid these checks for this serialno */
@@ -334,15 +396,15 @@ read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
   /* Check EOS */
   if (ogg_page_eos((ogg_page *)og)) {
     int removed = oggz_table_remove (ovdata->missing_eos, serialno);
-    if (!suffix && removed == -1) {
-      ret = log_error ();
-      fprintf (stderr, "serialno %010lu: *** eos marked but no bos\n",
+    if (!ovdata->suffix && removed == -1) {
+      ret = log_error (ovdata);
+      fprintf (ovdata->err, "serialno %010lu: *** eos marked but no bos\n",
   	       serialno);
     }
 
     if (packets == 0) {
-      ret = log_error ();
-      fprintf (stderr, "serialno %010lu: *** eos marked on page with no completed packets\n",
+      ret = log_error (ovdata);
+      fprintf (ovdata->err, "serialno %010lu: *** eos marked on page with no completed packets\n",
   	       serialno);
     }
 
@@ -353,8 +415,8 @@ read_page (OGGZ * oggz, const ogg_page * og, long serialno, void * user_data)
 
 
   if(gpos != -1 && packets == 0) {
-    ret = log_error ();
-    fprintf (stderr, "serialno %010lu: granulepos %" PRId64 " on page with no completed packets, must be -1\n", serialno, gpos);
+    ret = log_error (ovdata);
+    fprintf (ovdata->err, "serialno %010lu: granulepos %" PRId64 " on page with no completed packets, must be -1\n", serialno, gpos);
   }
 
   return ret;
@@ -371,15 +433,15 @@ read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
 
   timestamp = gp_to_time (oggz, serialno, op->granulepos);
   if (timestamp != -1.0 && oggz_stream_get_content (oggz, serialno) != OGGZ_CONTENT_DIRAC) {
-    if (timestamp < current_timestamp) {
-      ret = log_error();
-      ot_fprint_time (stderr, (double)timestamp/SUBSECONDS);
-      fprintf (stderr, ": serialno %010lu: Packet out of order (previous ",
+    if (timestamp < ovdata->current_timestamp) {
+      ret = log_error (ovdata);
+      ot_fprint_time (ovdata->err, (double)timestamp/SUBSECONDS);
+      fprintf (ovdata->err, ": serialno %010lu: Packet out of order (previous ",
 	       serialno);
-      ot_fprint_time (stderr, (double)current_timestamp/SUBSECONDS);
-      fprintf (stderr, ")\n");
+      ot_fprint_time (ovdata->err, (double)ovdata->current_timestamp/SUBSECONDS);
+      fprintf (ovdata->err, ")\n");
     }
-    current_timestamp = timestamp;
+    ovdata->current_timestamp = timestamp;
   }
 
   if (op->granulepos == -1) {
@@ -388,22 +450,25 @@ read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
     flush = OGGZ_FLUSH_AFTER;
   }
 
-  if ((feed_err = oggz_write_feed (ovdata->writer, op, serialno, flush, NULL)) != 0) {
-    ret = log_error ();
+  if ((feed_err = oggz_write_feed (ovdata->writer, op, serialno, flush, NULL)) == 0) {
+    if (ovdata->granulepos)
+      granulepos_set (ovdata->granulepos, serialno, op->granulepos);
+  } else {
+    ret = log_error (ovdata);
     if (timestamp == -1.0) {
-      fprintf (stderr, "%" PRId64 , oggz_tell (oggz));
+      fprintf (ovdata->err, "%" PRId64 , oggz_tell (oggz));
     } else {
-      ot_fprint_time (stderr, (double)timestamp/SUBSECONDS);
+      ot_fprint_time (ovdata->err, (double)timestamp/SUBSECONDS);
     }
-    fprintf (stderr, ": serialno %010lu: ", serialno);
+    fprintf (ovdata->err, ": serialno %010lu: ", serialno);
     for (i = 0; errors[i].error; i++) {
       if (errors[i].error == feed_err) {
-	fprintf (stderr, "%s\n", errors[i].description);
+	fprintf (ovdata->err, "%s\n", errors[i].description);
 	break;
       }
     }
     if (errors[i].error == 0) {
-      fprintf (stderr,
+      fprintf (ovdata->err,
 	       "Packet violates Ogg framing constraints: %d\n",
 	       feed_err);
     }
@@ -412,8 +477,686 @@ read_packet (OGGZ * oggz, oggz_packet * zp, long serialno, void * user_data)
   return ret;
 }
 
+/*
+ * Segmented validation
+ *
+ * A large file is split at page boundaries into segments which are
+ * validated in parallel, each on its own cursor. The validator and writer
+ * state at the start of each segment after the first is predicted by a
+ * quick scan of the page headers, and checked against the state which the
+ * previous segment actually ended with. The per-segment reports are then
+ * joined up in order, applying --max-errors across the whole file. If any
+ * prediction turns out to be wrong, or the file does not split cleanly
+ * (eg. it is chained), the file is validated serially instead; either way
+ * the report is the same.
+ */
+
+/* Validator and writer state at a segment boundary */
+typedef struct {
+  timestamp_t current_timestamp;
+  OggzTable * missing_eos;
+  OggzTable * packetno;
+  OggzTable * granulepos;
+} OVState;
+
+/* The report position and error count at the end of a callback */
+typedef struct {
+  long report_end;
+  int nr_errors;
+} OVMark;
+
+struct _OVSegment {
+  oggz_off_t begin;
+  oggz_off_t end; /* -1 for the end of the file */
+
+  OVState entry; /* Predicted state at begin, for all but the first segment */
+  OVState exit;  /* State reached at end */
+
+  FILE * report;
+  OVMark * marks;
+  int nr_marks;
+  int max_marks;
+
+  long bytes_written;
+  int ended;
+  int bailed;
+  int failed;
+};
+
+typedef struct {
+  const char * filename;
+  OggzFileInfo * info;
+  OVSegment * segments;
+  int nr_segments;
+} OVSegments;
+
+/* Return value of validate_segmented() for files which must be validated
+ * serially */
+#define SEGMENTED_UNSUITABLE 1
+
+static void
+ovstate_init (OVState * state)
+{
+  state->current_timestamp = 0;
+  if ((state->missing_eos = oggz_table_new ()) == NULL ||
+      (state->packetno = oggz_table_new ()) == NULL ||
+      (state->granulepos = oggz_table_new ()) == NULL)
+    exit_out_of_memory();
+}
+
+static void
+ovstate_clear (OVState * state)
+{
+  if (state->missing_eos) oggz_table_delete (state->missing_eos);
+  if (state->packetno) oggz_table_delete (state->packetno);
+  if (state->granulepos) granulepos_delete (state->granulepos);
+}
+
+static void
+table_copy (OggzTable * dest, OggzTable * src)
+{
+  long serialno;
+  void * data;
+  int i, n;
+
+  n = oggz_table_size (src);
+  for (i = 0; i < n; i++) {
+    data = oggz_table_nth (src, i, &serialno);
+    if (oggz_table_insert (dest, serialno, data) == NULL)
+      exit_out_of_memory();
+  }
+}
+
+static void
+granulepos_copy (OggzTable * dest, OggzTable * src)
+{
+  long serialno;
+  ogg_int64_t * gpos;
+  int i, n;
+
+  n = oggz_table_size (src);
+  for (i = 0; i < n; i++) {
+    gpos = oggz_table_nth (src, i, &serialno);
+    granulepos_set (dest, serialno, *gpos);
+  }
+}
+
+static void
+ovstate_copy (OVState * dest, OVState * src)
+{
+  dest->current_timestamp = src->current_timestamp;
+  table_copy (dest->missing_eos, src->missing_eos);
+  table_copy (dest->packetno, src->packetno);
+  granulepos_copy (dest->granulepos, src->granulepos);
+}
+
+/* Check that every entry of a is in b */
+static int
+table_within (OggzTable * a, OggzTable * b, int granulepos)
+{
+  long serialno;
+  void * data_a, * data_b;
+  int i, n;
+
+  n = oggz_table_size (a);
+  for (i = 0; i < n; i++) {
+    data_a = oggz_table_nth (a, i, &serialno);
+    data_b = oggz_table_lookup (b, serialno);
+    if (granulepos) {
+      if (data_b == NULL ||
+          *(ogg_int64_t *)data_a != *(ogg_int64_t *)data_b)
+        return 0;
+    } else if (data_a != data_b) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static int
+ovstate_equal (OVState * a, OVState * b)
+{
+  return (a->current_timestamp == b->current_timestamp &&
+          table_within (a->missing_eos, b->missing_eos, 0) &&
+          table_within (b->missing_eos, a->missing_eos, 0) &&
+          table_within (a->packetno, b->packetno, 0) &&
+          table_within (b->packetno, a->packetno, 0) &&
+          table_within (a->granulepos, b->granulepos, 1) &&
+          table_within (b->granulepos, a->granulepos, 1));
+}
+
+static void
+segment_mark (OVData * ovdata)
+{
+  OVSegment * segment = ovdata->segment;
+  OVMark * marks;
+
+  if (segment->nr_marks == segment->max_marks) {
+    segment->max_marks = segment->max_marks ? segment->max_marks * 2 : 16;
+    marks = realloc (segment->marks, segment->max_marks * sizeof (OVMark));
+    if (marks == NULL) exit_out_of_memory();
+    segment->marks = marks;
+  }
+
+  marks = &segment->marks[segment->nr_marks++];
+  marks->report_end = ftell (segment->report);
+  marks->nr_errors = ovdata->nr_errors;
+}
+
+static int
+read_page_segment (OGGZ * oggz, const ogg_page * og, long serialno,
+                   void * user_data)
+{
+  OVData * ovdata = (OVData *)user_data;
+  OVSegment * segment = ovdata->segment;
+  int nr_errors = ovdata->nr_errors, ret;
+
+  if (segment->end != -1 && oggz_tell (oggz) >= segment->end) {
+    segment->ended = 1;
+    return OGGZ_STOP_OK;
+  }
+
+  /* Later segments were seeded with the state of a single chain */
+  if (segment->begin > 0 &&
+      (ogg_page_bos ((ogg_page *)og) || ovdata->chain_ended)) {
+    segment->failed = 1;
+    return OGGZ_STOP_ERR;
+  }
+
+  ret = read_page (oggz, og, serialno, user_data);
+  if (ovdata->nr_errors > nr_errors) segment_mark (ovdata);
+
+  return ret;
+}
+
+static int
+read_packet_segment (OGGZ * oggz, oggz_packet * zp, long serialno,
+                     void * user_data)
+{
+  OVData * ovdata = (OVData *)user_data;
+  int nr_errors = ovdata->nr_errors, ret;
+
+  ret = read_packet (oggz, zp, serialno, user_data);
+  if (ovdata->nr_errors > nr_errors) segment_mark (ovdata);
+
+  return ret;
+}
+
+/*
+ * Give the writer of a later segment the streams and granulepos that the
+ * writer of a serial validation would have at its start. The stand-in
+ * bos packets have the lowest packetno, so that any packetno read after
+ * the seek is accepted, as it would be when reading serially.
+ */
+static int
+segment_seed_writer (OVData * ovdata, OggzTable * granulepos)
+{
+  static unsigned char nothing[1];
+  ogg_packet op;
+  ogg_int64_t * gpos;
+  long serialno;
+  int i, n;
+
+  n = oggz_table_size (granulepos);
+  for (i = 0; i < n; i++) {
+    gpos = oggz_table_nth (granulepos, i, &serialno);
+
+    op.packet = nothing;
+    op.bytes = 0;
+    op.b_o_s = 1;
+    op.e_o_s = 0;
+    op.granulepos = *gpos;
+    op.packetno = -2;
+
+    if (oggz_write_feed (ovdata->writer, &op, serialno, 0, NULL) != 0)
+      return -1;
+
+    granulepos_set (ovdata->granulepos, serialno, *gpos);
+  }
+
+  return 0;
+}
+
+static void
+validate_segment (int index, void * user_data)
+{
+  OVSegments * segments = (OVSegments *)user_data;
+  OVSegment * segment = &segments->segments[index];
+  OGGZ * reader;
+  OVData ovdata;
+  unsigned char buf[1024];
+  long n, nout;
+
+  if ((segment->report = tmpfile ()) == NULL) {
+    segment->failed = 1;
+    return;
+  }
+
+  if (index == 0) {
+    reader = oggz_open (segments->filename, OGGZ_READ|OGGZ_AUTO|OGGZ_MMAP|
+                        OGGZ_READAHEAD);
+  } else {
+    reader = oggz_open_file_info (segments->info, segments->filename,
+                                  OGGZ_READ|OGGZ_AUTO|OGGZ_MMAP);
+    if (reader != NULL && oggz_seek (reader, segment->begin, SEEK_SET) == -1) {
+      oggz_close (reader);
+      reader = NULL;
+    }
+  }
+
+  if (reader == NULL) {
+    segment->failed = 1;
+    return;
+  }
+
+  ovdata.filename = segments->filename;
+  ovdata.err = segment->report;
+  ovdata.prefix = 0;
+  ovdata.suffix = 0;
+  ovdata.nr_errors = 0;
+  ovdata.segment = segment;
+  if ((ovdata.granulepos = oggz_table_new ()) == NULL)
+    exit_out_of_memory();
+
+  ovdata_init (&ovdata);
+
+  if (index > 0) {
+    ovdata.current_timestamp = segment->entry.current_timestamp;
+    table_copy (ovdata.missing_eos, segment->entry.missing_eos);
+    table_copy (ovdata.packetno, segment->entry.packetno);
+    if (segment_seed_writer (&ovdata, segment->entry.granulepos) == -1)
+      segment->failed = 1;
+  }
+
+  oggz_set_read_callback (reader, -1, read_packet_segment, &ovdata);
+  oggz_set_read_page (reader, -1, read_page_segment, &ovdata);
+
+  /* As in validate_serial() */
+  while (!segment->failed && (n = oggz_read (reader, 1024)) != 0) {
+    if (max_errors && ovdata.nr_errors > max_errors) {
+      segment->bailed = 1;
+      break;
+    } else while ((nout = oggz_write_output (ovdata.writer, buf, n)) > 0) {
+      segment->bytes_written += nout;
+    }
+
+    if (segment->ended) break;
+  }
+
+  oggz_close (reader);
+
+  ovstate_init (&segment->exit);
+  segment->exit.current_timestamp = ovdata.current_timestamp;
+  table_copy (segment->exit.missing_eos, ovdata.missing_eos);
+  table_copy (segment->exit.packetno, ovdata.packetno);
+  granulepos_copy (segment->exit.granulepos, ovdata.granulepos);
+
+  ovdata_clear (&ovdata);
+}
+
+/* Read the headers of all streams, and note where the data starts */
+static int
+read_page_headers (OGGZ * oggz, const ogg_page * og, long serialno,
+                   void * user_data)
+{
+  OggzTable * packets = (OggzTable *)user_data;
+  long nr_packets;
+  int i, n;
+
+  if (ogg_page_bos ((ogg_page *)og)) {
+    if (oggz_table_insert (packets, serialno, (void *)0x1) == NULL)
+      exit_out_of_memory();
+    return OGGZ_CONTINUE;
+  }
+
+  n = oggz_table_size (packets);
+  for (i = 0; i < n; i++) {
+    /* Counts are stored plus one, as the table cannot hold NULL */
+    nr_packets = (long)oggz_table_nth (packets, i, &serialno) - 1;
+    if (nr_packets < oggz_stream_get_numheaders (oggz, serialno))
+      return OGGZ_CONTINUE;
+  }
+
+  oggz_set_data_start (oggz, oggz_tell (oggz));
+  return OGGZ_STOP_OK;
+}
+
+static int
+read_packet_headers (OGGZ * oggz, oggz_packet * zp, long serialno,
+                     void * user_data)
+{
+  OggzTable * packets = (OggzTable *)user_data;
+  long nr_packets;
+
+  nr_packets = (long)oggz_table_lookup (packets, serialno);
+  if (nr_packets > 0) {
+    if (oggz_table_insert (packets, serialno, (void *)(nr_packets+1)) == NULL)
+      exit_out_of_memory();
+  }
+
+  return OGGZ_CONTINUE;
+}
+
+/*
+ * Find the segment boundaries of a file, and predict the state at each.
+ * This follows read_page() and read_packet() over the page headers alone.
+ * A boundary must fall after all headers and before any eos, at a page
+ * where no stream has a packet continuing across it.
+ * Returns the number of segments, or 1 if the file does not split.
+ */
+static int
+plan_segments (OVSegments * segments, OGGZ * oggz, oggz_off_t length)
+{
+  FILE * file;
+  unsigned char header[27+255];
+  ogg_page og;
+  OVState state;
+  OggzTable * partial;
+  OVSegment * segment;
+  oggz_off_t offset = 0, target;
+  long serialno, other, body_len, packetno, headers;
+  ogg_int64_t gpos;
+  timestamp_t timestamp;
+  int nr_planned = 1, data_started = 0, eos_seen = 0, clean;
+  int nsegs, packets, i, n;
+
+  if ((file = fopen (segments->filename, "rb")) == NULL)
+    return 1;
+
+  ovstate_init (&state);
+  if ((partial = oggz_table_new ()) == NULL)
+    exit_out_of_memory();
+
+  segments->segments[0].begin = 0;
+  target = length / segments->nr_segments;
+
+  og.header = header;
+  og.body = NULL;
+
+  while (fread (header, 1, 27, file) == 27) {
+    if (memcmp (header, "OggS", 4) != 0) goto unsuitable;
+
+    nsegs = header[26];
+    if ((int)fread (header+27, 1, nsegs, file) != nsegs) break;
+
+    for (body_len = 0, i = 0; i < nsegs; i++) body_len += header[27+i];
+    og.header_len = 27 + nsegs;
+    og.body_len = body_len;
+
+    serialno = ogg_page_serialno (&og);
+    gpos = ogg_page_granulepos (&og);
+    packets = ogg_page_packets (&og);
+
+    /* Only a single chain, after its headers, can be split */
+    if (ogg_page_bos (&og)) {
+      if (data_started) goto unsuitable;
+    } else {
+      data_started = 1;
+    }
+    if (eos_seen && oggz_table_size (state.missing_eos) == 0) goto unsuitable;
+
+    /* Packets are delivered when their page completes, as long as the
+     * page has a granulepos */
+    if (packets > 0 && gpos == -1) goto unsuitable;
+
+    /* Can the file be split before this page? */
+    if (nr_planned < segments->nr_segments && offset >= target &&
+        !eos_seen && data_started &&
+        offset - segments->segments[nr_planned-1].begin >= SEGMENT_MIN) {
+      clean = (oggz_table_size (partial) == 0);
+      n = oggz_table_size (state.packetno);
+      for (i = 0; clean && i < n; i++) {
+        packetno = (long)oggz_table_nth (state.packetno, i, &other);
+        if (packetno < oggz_stream_get_numheaders (oggz, other))
+          clean = 0;
+      }
+
+      if (clean) {
+        segments->segments[nr_planned-1].end = offset;
+        segment = &segments->segments[nr_planned++];
+        segment->begin = offset;
+        ovstate_init (&segment->entry);
+        ovstate_copy (&segment->entry, &state);
+
+        target = length / segments->nr_segments * nr_planned;
+      }
+    }
+
+    /* As read_page() */
+    if (ogg_page_bos (&og)) {
+      if (oggz_table_insert (state.missing_eos, serialno, (void *)0x1) == NULL)
+        exit_out_of_memory();
+    }
+
+    packetno = (long)oggz_table_lookup (state.packetno, serialno);
+    headers = oggz_stream_get_numheaders (oggz, serialno);
+    if (packetno < headers-1) {
+      packetno += packets;
+      if (oggz_table_insert (state.packetno, serialno, (void *)packetno) == NULL)
+        goto unsuitable;
+    } else if (packetno == headers-1) {
+      if (oggz_table_insert (state.packetno, serialno, (void *)(headers+1)) == NULL)
+        exit_out_of_memory();
+    }
+
+    if (ogg_page_eos (&og)) {
+      oggz_table_remove (state.missing_eos, serialno);
+      eos_seen = 1;
+    }
+
+    /* As read_packet(), for the last packet on the page */
+    if (packets > 0) {
+      if (ogg_page_bos (&og) ||
+          oggz_table_lookup (state.granulepos, serialno) != NULL) {
+        granulepos_set (state.granulepos, serialno, gpos);
+      }
+
+      timestamp = gp_to_time (oggz, serialno, gpos);
+      if (timestamp != -1.0 &&
+          oggz_stream_get_content (oggz, serialno) != OGGZ_CONTENT_DIRAC) {
+        state.current_timestamp = timestamp;
+      }
+    }
+
+    /* Track packets continuing onto a later page */
+    if (nsegs > 0) {
+      if (header[27+nsegs-1] == 255) {
+        if (oggz_table_insert (partial, serialno, (void *)0x1) == NULL)
+          exit_out_of_memory();
+      } else {
+        oggz_table_remove (partial, serialno);
+      }
+    }
+
+    if (fseek (file, body_len, SEEK_CUR) != 0) break;
+    offset += og.header_len + body_len;
+  }
+
+  segments->segments[nr_planned-1].end = -1;
+
+  ovstate_clear (&state);
+  oggz_table_delete (partial);
+  fclose (file);
+
+  return nr_planned;
+
+ unsuitable:
+  for (i = 1; i < nr_planned; i++) {
+    ovstate_clear (&segments->segments[i].entry);
+  }
+  segments->segments[0].end = -1;
+
+  ovstate_clear (&state);
+  oggz_table_delete (partial);
+  fclose (file);
+
+  return 1;
+}
+
+static void
+report_copy (FILE * report, long from, long to, FILE * err)
+{
+  char buf[1024];
+  size_t n;
+
+  fseek (report, from, SEEK_SET);
+  while (from < to) {
+    n = (size_t)(to - from);
+    if (n > sizeof (buf)) n = sizeof (buf);
+    if ((n = fread (buf, 1, n, report)) == 0) break;
+    fwrite (buf, 1, n, err);
+    from += (long)n;
+  }
+}
+
+/*
+ * Join up the segment reports, printing to err if it is not NULL.
+ * Returns 0 on success or -1 if bailing out, setting nr_errors;
+ * or SEGMENTED_UNSUITABLE if the segments do not join up.
+ */
+static int
+join_segments (OVSegments * segments, FILE * err, int * nr_errors)
+{
+  OVSegment * segment;
+  OVMark * mark;
+  long report_end, serialno;
+  int nr = 0, prev, i, j, n;
+
+  for (i = 0; i < segments->nr_segments; i++) {
+    segment = &segments->segments[i];
+
+    if (segment->failed) return SEGMENTED_UNSUITABLE;
+    if (i > 0 && !ovstate_equal (&segments->segments[i-1].exit, &segment->entry))
+      return SEGMENTED_UNSUITABLE;
+
+    report_end = 0;
+    prev = 0;
+    for (j = 0; j < segment->nr_marks; j++) {
+      mark = &segment->marks[j];
+
+      if (err) {
+        if (multifile && nr == 0)
+          fprintf (err, "%s: Error:\n", segments->filename);
+        report_copy (segment->report, report_end, mark->report_end, err);
+      }
+      report_end = mark->report_end;
+
+      nr += mark->nr_errors - prev;
+      prev = mark->nr_errors;
+
+      /* A serial read stops after a callback which exceeds max_errors;
+       * in the first segment the read itself shows where */
+      if (i > 0 && max_errors && nr > max_errors) {
+        if (err) {
+          fprintf (err,
+                   "oggz-validate --max-errors %d: maximum error count reached, bailing out ...\n",
+                   max_errors);
+        }
+        *nr_errors = nr;
+        return -1;
+      }
+    }
+
+    if (i == 0 && (segment->bailed || segment->bytes_written == 0 ||
+                   (max_errors && nr > max_errors)))
+      return SEGMENTED_UNSUITABLE;
+
+    if (i < segments->nr_segments-1 && !segment->ended)
+      return SEGMENTED_UNSUITABLE;
+  }
+
+  /* As ovdata_clear() */
+  if (max_errors == 0 || nr <= max_errors) {
+    segment = &segments->segments[segments->nr_segments-1];
+    n = oggz_table_size (segment->exit.missing_eos);
+    for (i = 0; i < n; i++) {
+      oggz_table_nth (segment->exit.missing_eos, i, &serialno);
+      if (err) {
+        if (multifile && nr == 0)
+          fprintf (err, "%s: Error:\n", segments->filename);
+        fprintf (err, "serialno %010lu: missing *** eos\n", serialno);
+      }
+      nr++;
+    }
+  }
+
+  *nr_errors = nr;
+  return 0;
+}
+
+static int
+validate_segmented (const char * filename, FILE * err, int * nr_errors)
+{
+  OVSegments segments;
+  OVSegment * segment;
+  OggzTable * packets;
+  OGGZ * oggz;
+  oggz_off_t length;
+  long n;
+  int i, ret = SEGMENTED_UNSUITABLE;
+
+  if (!strncmp (filename, "-", 2) || opt_prefix || opt_suffix)
+    return SEGMENTED_UNSUITABLE;
+
+  if ((oggz = oggz_open (filename, OGGZ_READ|OGGZ_AUTO|OGGZ_MMAP)) == NULL)
+    return SEGMENTED_UNSUITABLE;
+
+  if ((packets = oggz_table_new ()) == NULL)
+    exit_out_of_memory();
+
+  oggz_set_read_page (oggz, -1, read_page_headers, packets);
+  oggz_set_read_callback (oggz, -1, read_packet_headers, packets);
+  while ((n = oggz_read (oggz, 1024)) > 0);
+  oggz_table_delete (packets);
+
+  if (n != OGGZ_ERR_STOP_OK) {
+    oggz_close (oggz);
+    return SEGMENTED_UNSUITABLE;
+  }
+
+  if ((segments.info = oggz_file_info_new (oggz)) == NULL)
+    exit_out_of_memory();
+
+  length = oggz_seek (oggz, 0, SEEK_END);
+  if (length < 2 * SEGMENT_MIN) {
+    oggz_file_info_unref (segments.info);
+    oggz_close (oggz);
+    return SEGMENTED_UNSUITABLE;
+  }
+
+  segments.filename = filename;
+  segments.nr_segments = nr_segments;
+  if ((segments.segments = calloc (nr_segments, sizeof (OVSegment))) == NULL)
+    exit_out_of_memory();
+
+  segments.nr_segments = plan_segments (&segments, oggz, length);
+  oggz_close (oggz);
+
+  if (segments.nr_segments > 1) {
+    ot_run_tasks (segments.nr_segments, segments.nr_segments,
+                  validate_segment, &segments);
+
+    /* Check the segments join up before printing anything */
+    if ((ret = join_segments (&segments, NULL, nr_errors)) != SEGMENTED_UNSUITABLE)
+      join_segments (&segments, err, nr_errors);
+  }
+
+  for (i = 0; i < segments.nr_segments; i++) {
+    segment = &segments.segments[i];
+    if (i > 0) ovstate_clear (&segment->entry);
+    if (segment->exit.missing_eos) ovstate_clear (&segment->exit);
+    if (segment->report) fclose (segment->report);
+    free (segment->marks);
+  }
+  free (segments.segments);
+  oggz_file_info_unref (segments.info);
+
+  return ret;
+}
+
 static int
-validate (char * filename)
+validate_serial (const char * filename, FILE * err, int * nr_errors)
 {
   OGGZ * reader;
   OVData ovdata;
@@ -421,19 +1164,25 @@ validate (char * filename)
   long n, nout = 0, bytes_written = 0;
   int active = 1;
 
-  current_filename = filename;
-  current_timestamp = 0;
-  nr_errors = 0;
+  ovdata.filename = filename;
+  ovdata.err = err;
+  ovdata.prefix = opt_prefix;
+  ovdata.suffix = opt_suffix;
+  ovdata.nr_errors = 0;
+  ovdata.segment = NULL;
+  ovdata.granulepos = NULL;
 
   /*printf ("oggz-validate: %s\n", filename);*/
 
   if (!strncmp (filename, "-", 2)) {
-    if ((reader = oggz_open_stdio (stdin, OGGZ_READ|OGGZ_AUTO)) == NULL) {
-      fprintf (stderr, "oggz-validate: unable to open stdin\n");
+    if ((reader = oggz_open_stdio (stdin, OGGZ_READ|OGGZ_AUTO|OGGZ_MMAP|
+                                   OGGZ_READAHEAD)) == NULL) {
+      fprintf (err, "oggz-validate: unable to open stdin\n");
       return -1;
     }
-  } else if ((reader = oggz_open (filename, OGGZ_READ|OGGZ_AUTO)) == NULL) {
-    fprintf (stderr, "oggz-validate: unable to open file %s\n", filename);
+  } else if ((reader = oggz_open (filename, OGGZ_READ|OGGZ_AUTO|OGGZ_MMAP|
+                                  OGGZ_READAHEAD)) == NULL) {
+    fprintf (err, "oggz-validate: unable to open file %s\n", filename);
     return -1;
   }
 
@@ -444,17 +1193,17 @@ validate (char * filename)
 
   while (active && (n = oggz_read (reader, 1024)) != 0) {
 #ifdef DEBUG
-      fprintf (stderr, "validate: read %ld bytes\n", n);
+      fprintf (err, "validate: read %ld bytes\n", n);
 #endif
     
-    if (max_errors && nr_errors > max_errors) {
-      fprintf (stderr,
+    if (max_errors && ovdata.nr_errors > max_errors) {
+      fprintf (err,
 	       "oggz-validate --max-errors %d: maximum error count reached, bailing out ...\n",
                max_errors);
       active = 0;
     } else while ((nout = oggz_write_output (ovdata.writer, buf, n)) > 0) {
 #ifdef DEBUG
-      fprintf (stderr, "validate: wrote %ld bytes\n", nout);
+      fprintf (err, "validate: wrote %ld bytes\n", nout);
 #endif
       bytes_written += nout;
     }
@@ -463,30 +1212,57 @@ validate (char * filename)
   oggz_close (reader);
 
   if (bytes_written == 0) {
-    log_error ();
-    fprintf (stderr, "File contains no Ogg packets\n");
+    log_error (&ovdata);
+    fprintf (err, "File contains no Ogg packets\n");
   }
 
   ovdata_clear (&ovdata);
 
+  *nr_errors = ovdata.nr_errors;
+
   return active ? 0 : -1;
 }
 
+static int
+validate (const char * filename, FILE * out, FILE * err)
+{
+  int nr_errors = 0, ret = SEGMENTED_UNSUITABLE;
+
+  if (nr_segments > 1)
+    ret = validate_segmented (filename, err, &nr_errors);
+
+  if (ret == SEGMENTED_UNSUITABLE)
+    ret = validate_serial (filename, err, &nr_errors);
+
+  if (show_results) {
+    fprintf (out, "%s\t%d\t%s\n",
+             ret == -1 ? "ERROR" : nr_errors ? "INVALID" : "VALID",
+             nr_errors, filename);
+  }
+
+  if (ret == -1) return -1;
+  return nr_errors ? 1 : 0;
+}
+
+static int
+validate_job (int index, FILE * out, FILE * err, void * user_data)
+{
+  char ** filenames = (char **)user_data;
+
+  return validate (filenames[index], out, err);
+}
+
 int
 main (int argc, char ** argv)
 {
   int show_version = 0;
   int show_help = 0;
+  int exit_status = 0;
+  int nr_workers = 1;
 
-  /* Cache the --prefix, --suffix options and reset before validating
-   * each input file */
-  int opt_prefix = 0;
-  int opt_suffix = 0;
-
-  char * filename;
   int i = 1;
 
-  char * optstring = "M:psPhvE";
+  char * optstring = "M:psPj:S:rhvE";
 
 #ifdef HAVE_GETOPT_LONG
   static struct option long_options[] = {
@@ -494,6 +1270,9 @@ main (int argc, char ** argv)
     {"prefix", no_argument, 0, 'p'},
     {"suffix", no_argument, 0, 's'},
     {"partial", no_argument, 0, 'P'},
+    {"jobs", required_argument, 0, 'j'},
+    {"segments", required_argument, 0, 'S'},
+    {"results", no_argument, 0, 'r'},
     {"help", no_argument, 0, 'h'},
     {"help-errors", no_argument, 0, 'E'},
     {"version", no_argument, 0, 'v'},
@@ -547,6 +1326,15 @@ main (int argc, char ** argv)
       opt_prefix = 1;
       opt_suffix = 1;
       break;
+    case 'j': /* jobs */
+      nr_workers = atoi (optarg);
+      break;
+    case 'S': /* segments */
+      nr_segments = atoi (optarg);
+      break;
+    case 'r': /* results */
+      show_results = 1;
+      break;
     case 'h': /* help */
       show_help = 1;
       break;
@@ -580,6 +1368,16 @@ main (int argc, char ** argv)
     goto exit_err;
   }
 
+  if (nr_segments < 1) {
+    printf ("%s: Error: [-S num, --segments num] option must be positive\n", progname);
+    goto exit_err;
+  }
+
+  if (nr_workers < 1) {
+    printf ("%s: Error: [-j num, --jobs num] option must be positive\n", progname);
+    goto exit_err;
+  }
+
   if (optind >= argc) {
     usage (progname);
     goto exit_err;
@@ -587,13 +1385,9 @@ main (int argc, char ** argv)
 
   if (argc-i > 2) multifile = 1;
 
-  for (i = optind; i < argc; i++) {
-    filename = argv[i];
-    prefix = opt_prefix;
-    suffix = opt_suffix;
-    if (validate (filename) == -1)
-      exit_status = 1;
-  }
+  if (ot_run_jobs (argc - optind, nr_workers, validate_job,
+                   &argv[optind]) > 0)
+    exit_status = 1;
 
  exit_out:
   exit (exit_status);
@@ -456,22 +456,28 @@ ot_fprint_bytes (FILE * stream, long nr_bytes)
  * using quasi-standard abbreviations (Gbps, Mbps, kbps, bps)
  */
 int
-ot_print_bitrate (long bps)
+ot_fprint_bitrate (FILE * stream, long bps)
 {
   if (bps > (1000000000L)) {
-    return printf ("%0.3f Gbps",
-		   (double)bps / (1000.0 * 1000.0 * 1000.0));
+    return fprintf (stream, "%0.3f Gbps",
+		    (double)bps / (1000.0 * 1000.0 * 1000.0));
   } else if (bps > (1000000L)) {
-    return printf ("%0.3f Mbps",
-		   (double)bps / (1000.0 * 1000.0));
+    return fprintf (stream, "%0.3f Mbps",
+		    (double)bps / (1000.0 * 1000.0));
   } else if (bps > (1000L)) {
-    return printf ("%0.3f kbps",
-		   (double)bps / (1000.0));
+    return fprintf (stream, "%0.3f kbps",
+		    (double)bps / (1000.0));
   } else {
-    return printf ("%ld bps", bps);
+    return fprintf (stream, "%ld bps", bps);
   }
 }
 
+int
+ot_print_bitrate (long bps)
+{
+  return ot_fprint_bitrate (stdout, bps);
+}
+
 int
 ot_fprint_time (FILE * stream, double seconds)
 {
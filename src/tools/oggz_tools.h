@@ -50,6 +50,7 @@ int ot_fprint_bytes (FILE * stream, long nr_bytes);
  * using quasi-standard abbreviations (Gbps, Mbps, kbps, bps)
  */
 int ot_print_bitrate (long bps);
+int ot_fprint_bitrate (FILE * stream, long bps);
 
 int ot_fprint_time (FILE * stream, double seconds);
 
@@ -0,0 +1,303 @@
+/*
+  Copyright (C) 2008 Annodex Association
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  - Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  - Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  - Neither the name of the Annodex Association or the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+  PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ASSOCIATION OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "oggz_tools_jobs.h"
+
+/* Number of completed jobs each worker may run ahead of the output */
+#define OT_JOBS_AHEAD 4
+
+static int
+ot_run_jobs_serial (int nr_jobs, OTJobFunc func, void * user_data)
+{
+  int i, nr_failed = 0;
+
+  for (i = 0; i < nr_jobs; i++) {
+    if (func (i, stdout, stderr, user_data) != 0)
+      nr_failed++;
+  }
+
+  return nr_failed;
+}
+
+static void
+ot_run_tasks_serial (int nr_tasks, OTTaskFunc func, void * user_data)
+{
+  int i;
+
+  for (i = 0; i < nr_tasks; i++) {
+    func (i, user_data);
+  }
+}
+
+#ifdef HAVE_PTHREAD_H
+
+typedef struct {
+  pthread_mutex_t mutex;
+  int next;
+  int nr_tasks;
+  OTTaskFunc func;
+  void * user_data;
+} OTTasks;
+
+static void *
+ot_tasks_worker (void * arg)
+{
+  OTTasks * tasks = (OTTasks *)arg;
+  int i;
+
+  while (1) {
+    pthread_mutex_lock (&tasks->mutex);
+    i = tasks->next++;
+    pthread_mutex_unlock (&tasks->mutex);
+
+    if (i >= tasks->nr_tasks) break;
+
+    tasks->func (i, tasks->user_data);
+  }
+
+  return NULL;
+}
+
+void
+ot_run_tasks (int nr_tasks, int nr_workers, OTTaskFunc func, void * user_data)
+{
+  OTTasks tasks;
+  pthread_t * threads;
+  int i, nr_threads = 0;
+
+  if (nr_workers > nr_tasks) nr_workers = nr_tasks;
+  if (nr_workers <= 1 ||
+      (threads = malloc (nr_workers * sizeof (pthread_t))) == NULL) {
+    ot_run_tasks_serial (nr_tasks, func, user_data);
+    return;
+  }
+
+  pthread_mutex_init (&tasks.mutex, NULL);
+  tasks.next = 0;
+  tasks.nr_tasks = nr_tasks;
+  tasks.func = func;
+  tasks.user_data = user_data;
+
+  for (i = 0; i < nr_workers; i++) {
+    if (pthread_create (&threads[i], NULL, ot_tasks_worker, &tasks) != 0)
+      break;
+    nr_threads++;
+  }
+
+  /* Whatever is left over, including everything if no threads could
+   * be started, is done here */
+  ot_tasks_worker (&tasks);
+
+  for (i = 0; i < nr_threads; i++)
+    pthread_join (threads[i], NULL);
+
+  pthread_mutex_destroy (&tasks.mutex);
+  free (threads);
+}
+
+typedef struct {
+  FILE * out;
+  FILE * err;
+  int ret;
+  int done;
+} OTJob;
+
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  OTJob * jobs;
+  int nr_jobs;
+  int next;     /* Next job to hand out */
+  int emitted;  /* Number of jobs whose output has been copied */
+  int window;   /* Maximum number of jobs in flight */
+
+  OTJobFunc func;
+  void * user_data;
+} OTPool;
+
+static void
+ot_copy_stream (FILE * from, FILE * to)
+{
+  char buf[4096];
+  size_t n;
+
+  rewind (from);
+  while ((n = fread (buf, 1, sizeof (buf), from)) > 0) {
+    if (fwrite (buf, 1, n, to) != n) break;
+  }
+}
+
+static void *
+ot_pool_worker (void * arg)
+{
+  OTPool * pool = (OTPool *)arg;
+  OTJob * job;
+  int i;
+
+  while (1) {
+    pthread_mutex_lock (&pool->mutex);
+    while (pool->next < pool->nr_jobs &&
+           pool->next >= pool->emitted + pool->window)
+      pthread_cond_wait (&pool->cond, &pool->mutex);
+    if (pool->next >= pool->nr_jobs) {
+      pthread_mutex_unlock (&pool->mutex);
+      break;
+    }
+    i = pool->next++;
+    pthread_mutex_unlock (&pool->mutex);
+
+    job = &pool->jobs[i];
+    job->out = tmpfile ();
+    job->err = tmpfile ();
+    if (job->out == NULL || job->err == NULL) {
+      perror ("tmpfile");
+      job->ret = -1;
+    } else {
+      job->ret = pool->func (i, job->out, job->err, pool->user_data);
+      fflush (job->out);
+      fflush (job->err);
+    }
+
+    pthread_mutex_lock (&pool->mutex);
+    job->done = 1;
+    pthread_cond_broadcast (&pool->cond);
+    pthread_mutex_unlock (&pool->mutex);
+  }
+
+  return NULL;
+}
+
+int
+ot_run_jobs (int nr_jobs, int nr_workers, OTJobFunc func, void * user_data)
+{
+  OTPool pool;
+  OTJob * job;
+  pthread_t * threads;
+  int i, nr_threads = 0, nr_failed = 0;
+
+  if (nr_workers > nr_jobs) nr_workers = nr_jobs;
+  if (nr_workers <= 1)
+    return ot_run_jobs_serial (nr_jobs, func, user_data);
+
+  pool.jobs = calloc (nr_jobs, sizeof (OTJob));
+  threads = malloc (nr_workers * sizeof (pthread_t));
+  if (pool.jobs == NULL || threads == NULL) {
+    free (pool.jobs);
+    free (threads);
+    return ot_run_jobs_serial (nr_jobs, func, user_data);
+  }
+
+  pthread_mutex_init (&pool.mutex, NULL);
+  pthread_cond_init (&pool.cond, NULL);
+  pool.nr_jobs = nr_jobs;
+  pool.next = 0;
+  pool.emitted = 0;
+  pool.window = nr_workers * OT_JOBS_AHEAD;
+  pool.func = func;
+  pool.user_data = user_data;
+
+  for (i = 0; i < nr_workers; i++) {
+    if (pthread_create (&threads[i], NULL, ot_pool_worker, &pool) != 0)
+      break;
+    nr_threads++;
+  }
+
+  if (nr_threads == 0) {
+    /* No threads could be started; do the work here instead */
+    pthread_cond_destroy (&pool.cond);
+    pthread_mutex_destroy (&pool.mutex);
+    free (threads);
+    free (pool.jobs);
+    return ot_run_jobs_serial (nr_jobs, func, user_data);
+  }
+
+  /* Copy out each job's output in order as it completes */
+  for (i = 0; i < nr_jobs; i++) {
+    job = &pool.jobs[i];
+
+    pthread_mutex_lock (&pool.mutex);
+    while (!job->done)
+      pthread_cond_wait (&pool.cond, &pool.mutex);
+    pthread_mutex_unlock (&pool.mutex);
+
+    if (job->out) {
+      ot_copy_stream (job->out, stdout);
+      fclose (job->out);
+    }
+    if (job->err) {
+      fflush (stdout);
+      ot_copy_stream (job->err, stderr);
+      fclose (job->err);
+    }
+    if (job->ret != 0) nr_failed++;
+
+    pthread_mutex_lock (&pool.mutex);
+    pool.emitted++;
+    pthread_cond_broadcast (&pool.cond);
+    pthread_mutex_unlock (&pool.mutex);
+  }
+
+  for (i = 0; i < nr_threads; i++)
+    pthread_join (threads[i], NULL);
+
+  pthread_cond_destroy (&pool.cond);
+  pthread_mutex_destroy (&pool.mutex);
+  free (threads);
+  free (pool.jobs);
+
+  return nr_failed;
+}
+
+#else /* !HAVE_PTHREAD_H */
+
+void
+ot_run_tasks (int nr_tasks, int nr_workers, OTTaskFunc func, void * user_data)
+{
+  ot_run_tasks_serial (nr_tasks, func, user_data);
+}
+
+int
+ot_run_jobs (int nr_jobs, int nr_workers, OTJobFunc func, void * user_data)
+{
+  return ot_run_jobs_serial (nr_jobs, func, user_data);
+}
+
+#endif /* HAVE_PTHREAD_H */
@@ -0,0 +1,68 @@
+/*
+  Copyright (C) 2008 Annodex Association
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+  - Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  - Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+  - Neither the name of the Annodex Association or the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+  PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ASSOCIATION OR
+  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __OGGZ_TOOLS_JOBS_H__
+#define __OGGZ_TOOLS_JOBS_H__
+
+#include <stdio.h>
+
+/*
+ * A job processes one input, numbered 'index', writing its normal output
+ * to 'out' and its diagnostics to 'err'. Return 0 on success.
+ */
+typedef int (*OTJobFunc) (int index, FILE * out, FILE * err,
+                          void * user_data);
+
+/*
+ * Run nr_jobs jobs on a pool of nr_workers threads. Each job's output is
+ * buffered and copied to stdout and stderr in job order, so the result
+ * is the same as running the jobs one after another. With nr_workers <= 1,
+ * or when built without threads, jobs run serially and write directly to
+ * stdout and stderr.
+ * Returns the number of jobs which did not return 0.
+ */
+int ot_run_jobs (int nr_jobs, int nr_workers, OTJobFunc func,
+                 void * user_data);
+
+/*
+ * A task does one part of a larger piece of work, numbered 'index'.
+ */
+typedef void (*OTTaskFunc) (int index, void * user_data);
+
+/*
+ * Run nr_tasks tasks on a pool of nr_workers threads, and wait for all
+ * of them to complete. Tasks are started in order. With nr_workers <= 1,
+ * or when built without threads, tasks run serially.
+ */
+void ot_run_tasks (int nr_tasks, int nr_workers, OTTaskFunc func,
+                   void * user_data);
+
+#endif /* __OGGZ_TOOLS_JOBS_H__ */